@@ -0,0 +1,42 @@
+#include "AdvRotation.h"
+
+bool AdvRotation::configure(const uint8_t* weights, size_t n)
+{
+    if (n == 0 || n > MAX_IDENTITIES)
+        return false;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (weights[i] == 0 || weights[i] > MAX_WEIGHT)
+            return false;
+    }
+
+    m_count = n;
+    m_total = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        m_weight[i] = weights[i];
+        m_total += weights[i];
+    }
+    reset();
+    return true;
+}
+
+void AdvRotation::reset()
+{
+    for (size_t i = 0; i < m_count; ++i)
+        m_credit[i] = 0;
+}
+
+size_t AdvRotation::next()
+{
+    // every identity earns its weight, the richest is advertised and pays a full cycle
+    size_t pick = 0;
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        m_credit[i] += m_weight[i];
+        if (m_credit[i] > m_credit[pick])
+            pick = i;
+    }
+    m_credit[pick] -= (int16_t)m_total;
+    return pick;
+}
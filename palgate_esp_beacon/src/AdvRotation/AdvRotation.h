@@ -0,0 +1,53 @@
+#ifndef ADV_ROTATION_H
+#define ADV_ROTATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Which identity the beacon advertises in each time slot, for several
+ *        iBeacon identities sharing one advertising set.
+ *
+ * Smooth weighted round-robin: in every run of W consecutive slots (W = sum of
+ * the weights) identity i gets exactly weight[i] slots, spread as evenly as the
+ * weights allow, so each identity's advertising rate is guaranteed rather than
+ * probabilistic. With equal weights this is plain round-robin.
+ *
+ * A slot of slotMs() is at least the longest gap between two advertising events,
+ * so every slot carries at least one event of its identity.
+ *
+ * Single owner: configure() and reset() while rotation is stopped, next() from the
+ * rotation timer only.
+ */
+class AdvRotation
+{
+public:
+    static const size_t MAX_IDENTITIES = 4;
+    static const uint8_t MAX_WEIGHT = 8;
+    static const uint16_t ADV_DELAY_MAX_MS = 10;    // random delay the controller adds to every interval
+
+    // Identities 0..n-1 with their weights (1..MAX_WEIGHT). False (and unchanged) on bad input.
+    bool configure(const uint8_t* weights, size_t n);
+
+    // Back to the start of the cycle: the first slot goes to the heaviest identity (the first on a tie).
+    void reset();
+
+    // Identity for the next slot.
+    size_t next();
+
+    size_t size() const { return m_count; }
+
+    // Slots per cycle (sum of the weights).
+    uint32_t cycleSlots() const { return m_total; }
+
+    // Slot length for a stage advertising at most every `max_interval_ms`.
+    static uint32_t slotMs(uint16_t max_interval_ms) { return (uint32_t)max_interval_ms + ADV_DELAY_MAX_MS; }
+
+private:
+    uint8_t m_weight[MAX_IDENTITIES] = {};
+    int16_t m_credit[MAX_IDENTITIES] = {};
+    size_t m_count = 0;
+    uint32_t m_total = 0;
+};
+
+#endif // #ifndef ADV_ROTATION_H
@@ -0,0 +1,34 @@
+#pragma once
+
+// ============================================================
+// Beacon Configuration File (Template)
+// ------------------------------------------------------------
+// Optional. Rename this file to config.h to enable the settings
+// below; without it the beacon advertises its static iBeacon.
+// config.h is excluded from Git.
+// ============================================================
+
+// Rolling beacon code (replay protection).
+// Must be the same 32-hex-digit secret as PALGATE_ROLLING_KEY_HEX in the
+// scanner's config.h. Each button press then advertises a one-time code
+// that the scanner accepts once.
+// Generate one with e.g.: python3 -c "import os; print(os.urandom(16).hex())"
+// An all-zero key is refused: the beacon then advertises its static iBeacon.
+// #define PALGATE_ROLLING_KEY_HEX "00000000000000000000000000000000"
+
+// Advertising schedule after a press (optional).
+// Stages of {duration_ms, min_interval_ms, max_interval_ms}, 20..10240 ms intervals.
+// Default: 3.1 s burst at 20-30 ms, 3 s at 60-80 ms, 3.9 s at 200-250 ms.
+// Check detection probability and energy per press with tools/adv_schedule_model.py.
+// #define BEACON_ADV_SCHEDULE { {3100, 20, 30}, {3000, 60, 80}, {3900, 200, 250} }
+
+// 1 = a press while advertising ends the session early; 0 (default) = it restarts the burst.
+// #define BEACON_STOP_ON_PRESS 1
+
+// Several iBeacon identities from one device (optional), e.g. two gates or a resident and
+// a visitor UUID. {uuid, major, minor, weight} each, at most 4; identity i is on air in
+// weight[i] of every sum(weights) slots (weights 1..8). With rolling code all identities
+// share the key and the press counter, so their UUIDs must differ in the first 10 bytes.
+// Default: the single PALGATE_BEACON_UUID/_MAJOR/_MINOR identity.
+// Check per-identity detection with tools/adv_schedule_model.py --identities 1,1
+// #define BEACON_IDENTITIES { {"12345678-1234-1234-1234-123456789abc", 1, 1, 1}, {"87654321-4321-4321-4321-cba987654321", 1, 1, 1} }
@@ -1,23 +1,136 @@
 /*******************************************
   Main file for ESP32-based BLE iBeacon transmitter
-  - Press button connected to GPIO0 to start beaconing for 10 seconds
+  - Press button connected to GPIO0 to start beaconing for ~10 seconds:
+    a fast burst first, then progressively longer intervals (ADV_SCHEDULE)
   - Onboard LED (GPIO2) lights up while beaconing
+  - Between presses: light sleep with the BLE controller disabled; the
+    button (GPIO wakeup / edge interrupt) and an esp_timer drive everything
+  - Several iBeacon identities (BEACON_IDENTITIES, e.g. two gates) share the
+    advertising set in weighted time slots (AdvRotation)
 
   Uses the ArduinoBLE library:
 /*******************************************/
 
 #include <Arduino.h>                // Serial, pinMode, digitalWrite, delay, millis
-#include <BLEDevice.h>              // BLEDevice API: BLEDevice::init(), BLEDevice::createServer(), BLEDevice::getAdvertising()
-#include <BLEUtils.h>               // BLE and UUID (BLEUUID used to parse/construct UUIDs)
-#include <BLEBeacon.h>              // BLEBeacon type and helpers: BLEBeacon, setManufacturerId, setProximityUUID, setMajor, setMinor, setSignalPower, getData
+#include <BLEDevice.h>              // BLEDevice API: BLEDevice::init(), BLEDevice::getAdvertising()
+#include <atomic>                   // std::atomic flags shared with the button ISR, esp_timer and GAP callbacks
+#include "esp_bt.h"                 // esp_bt_controller_enable/disable(): BLE controller power between presses
+#include "esp_bt_main.h"            // esp_bluedroid_enable/disable(): host stack on top of the controller
+#include "esp_gap_ble_api.h"        // GAP events: ADV_START_COMPLETE marks the first advertisement
+#include "esp_sleep.h"              // esp_light_sleep_start(), esp_sleep_enable_gpio_wakeup()
+#include "esp_timer.h"              // one-shot stop timer + microsecond timestamps
+#include "driver/gpio.h"            // gpio_wakeup_enable(): wake from light sleep on button level
+#include "PalLog.h"                 // Deferred, compile-time-levelled logging (LOG_E/W/I/D), shared with the scanner
+#include "PhaseAccounting.h"        // Time-in-state and estimated charge per phase, shared with the scanner
+#include <Preferences.h>            // NVS: reserved rolling-code counter block survives reboots
+#include "RollingCode.h"            // Rolling one-time code in UUID tail/major/minor, shared with the scanner
+#include "IBeaconProtocol.h"        // Compile-time iBeacon identity and advertisement bytes, shared with the scanner
+#include "AdvRotation.h"            // Weighted time slots for several identities on one advertising set
+
+#if __has_include("config.h")
+#include "config.h"                 // optional: PALGATE_ROLLING_KEY_HEX, BEACON_ADV_SCHEDULE, BEACON_IDENTITIES (see config_template.h)
+#endif
 
 // Additional BLE classes used in this file (provided by the BLE Arduino library headers above):
-// BLEAdvertisementData (setFlags, setManufacturerData), BLEAdvertising (setAdvertisementData, setMinInterval, setMaxInterval, start, stop)
+// BLEAdvertisementData (addData), BLEAdvertising (setAdvertisementData, setMinInterval, setMaxInterval, start, stop)
 
 #define BUTTON_PIN 0                // GPIO used for the physical button input.
 #define LED_PIN    2                // GPIO used for status LED indication.
-#define BEACON_DURATION_MS 10000    // Duration (in milliseconds) to broadcast BLE beacon after button press.
 #define DEVICE_NAME "ESP32_BEACON"  // BLE device name shown during advertising.
+#define DEBOUNCE_US 30000           // Button edges closer than this (us) to the last accepted one are bounce.
+#define RELEASE_RECHECK_MS 100      // While the button is held, re-read it this often in case a release edge was filtered as bounce.
+#define ROLLING_RESERVE 16          // Counters reserved per NVS write; a reboot skips at most this many (scanner window must be larger).
+
+// Advertising schedule after a press: {duration_ms, min_interval_ms, max_interval_ms} per stage.
+// The first stage should cover one full scanner cycle (loop_awake_ms + sleep_ms, ~3 s) at the
+// fastest interval; later stages only matter if that was missed.
+// Compare schedules with tools/adv_schedule_model.py before changing it.
+#ifndef BEACON_ADV_SCHEDULE
+#define BEACON_ADV_SCHEDULE { {3100, 20, 30}, {3000, 60, 80}, {3900, 200, 250} }
+#endif
+
+// A press while advertising: 1 = stop early (gate already open), 0 = restart the schedule from the burst.
+#ifndef BEACON_STOP_ON_PRESS
+#define BEACON_STOP_ON_PRESS 0
+#endif
+
+// Controller mode BLEDevice::init() enabled (same selection as arduino-esp32's btStart()).
+#if CONFIG_BTDM_CONTROLLER_MODE_BTDM
+#define BT_CONTROLLER_MODE ESP_BT_MODE_BTDM
+#elif CONFIG_BTDM_CONTROLLER_MODE_BR_EDR_ONLY
+#define BT_CONTROLLER_MODE ESP_BT_MODE_CLASSIC_BT
+#else
+#define BT_CONTROLLER_MODE ESP_BT_MODE_BLE
+#endif
+
+struct AdvStage
+{
+  uint32_t duration_ms;
+  uint16_t min_interval_ms;
+  uint16_t max_interval_ms;
+};
+
+static constexpr AdvStage ADV_SCHEDULE[] = BEACON_ADV_SCHEDULE;
+static constexpr size_t ADV_STAGE_COUNT = sizeof(ADV_SCHEDULE) / sizeof(ADV_SCHEDULE[0]);
+
+// Non-connectable advertising allows 20 ms .. 10.24 s (units of 0.625 ms)
+static constexpr bool validAdvSchedule()
+{
+  for (size_t i = 0; i < ADV_STAGE_COUNT; ++i)
+  {
+    const AdvStage& s = ADV_SCHEDULE[i];
+    if (s.duration_ms == 0 || s.min_interval_ms < 20 || s.max_interval_ms > 10240 || s.min_interval_ms > s.max_interval_ms)
+      return false;
+  }
+  return true;
+}
+static_assert(validAdvSchedule(), "BEACON_ADV_SCHEDULE: each stage needs duration > 0 and 20 <= min <= max <= 10240 ms");
+
+// iBeacon identities advertised by this device: {uuid, major, minor, weight} each.
+// With more than one, identity i is on air in weight[i] of every sum(weights) slots.
+// Default: the single PALGATE_BEACON_* identity (no rotation).
+#ifndef BEACON_IDENTITIES
+#define BEACON_IDENTITIES { {PALGATE_BEACON_UUID, PALGATE_BEACON_MAJOR, PALGATE_BEACON_MINOR, 1} }
+#endif
+
+struct BeaconIdentity
+{
+  const char* uuid;
+  uint16_t major;
+  uint16_t minor;
+  uint8_t weight;
+};
+
+static constexpr BeaconIdentity IDENTITIES[] = BEACON_IDENTITIES;
+static constexpr size_t IDENTITY_COUNT = sizeof(IDENTITIES) / sizeof(IDENTITIES[0]);
+static_assert(IDENTITY_COUNT <= AdvRotation::MAX_IDENTITIES, "BEACON_IDENTITIES: at most AdvRotation::MAX_IDENTITIES identities");
+
+static constexpr bool validIdentities()
+{
+  for (size_t i = 0; i < IDENTITY_COUNT; ++i)
+  {
+    if (!IBeacon::parseUuid(IDENTITIES[i].uuid).valid || IDENTITIES[i].weight == 0 || IDENTITIES[i].weight > AdvRotation::MAX_WEIGHT)
+      return false;
+  }
+  return true;
+}
+static_assert(validIdentities(), "BEACON_IDENTITIES: each uuid needs 32 hex digits and 1 <= weight <= AdvRotation::MAX_WEIGHT");
+
+// Static advertisement of every identity, generated at compile time like IBeacon::BEACON_ADV
+struct IdentityAdvertisements
+{
+  IBeacon::Advertisement adv[IDENTITY_COUNT];
+};
+
+static constexpr IdentityAdvertisements makeIdentityAdvertisements()
+{
+  IdentityAdvertisements a{};
+  for (size_t i = 0; i < IDENTITY_COUNT; ++i)
+    a.adv[i] = IBeacon::makeAdvertisement(IBeacon::parseUuid(IDENTITIES[i].uuid), IDENTITIES[i].major,
+                                          IDENTITIES[i].minor, PALGATE_BEACON_TX_POWER);
+  return a;
+}
+static constexpr IdentityAdvertisements IDENTITY_ADV = makeIdentityAdvertisements();
 
 
 
@@ -25,21 +138,64 @@
 // global & static variables 
 //===========================================================
 
-// iBeacon identifiers (UUID, Major, Minor, Tx Power)
-static const char* beacon_uuid = "bc9a7856-3412-3412-3412-341278563412";
-static const uint16_t beacon_major = 1;             // Major identifier for iBeacon grouping
-static const uint16_t beacon_minor = 1;             // Minor identifier for iBeacon grouping
-static const int8_t  beacon_txpower_at_1m = -59;    // Calibrated RSSI measured at 1 meter
+// iBeacon identities (UUID, major, minor): BEACON_IDENTITIES, defaulting to PALGATE_BEACON_* in
+// IBeaconProtocol.h, built into IDENTITY_ADV at compile time
+
+static_assert(RollingCode::PAYLOAD_LEN == IBeacon::MFG_TX_OFFSET - IBeacon::MFG_UUID_OFFSET,
+              "rolling payload replaces UUID, major and minor");
 
 // BLE advertising object + runtime state
 BLEAdvertising* g_pAdvertising = nullptr;           // Handle to BLE advertising instance
 bool g_is_beacon_active = false;                    // Indicates whether the beacon is currently active
-uint32_t g_beacon_start_time = 0;                   // Timestamp (ms) when beacon transmission started
 
-// Button debounce management
-int g_prev_button_state = HIGH;                     // Previous sampled button state
-uint32_t g_last_debounce_ms = 0;                    // Timestamp of last debounce event
-const uint16_t g_debounce_limit_ms = 30;            // Debounce time threshold (ms)
+// One prebuilt payload per identity; switching identity hands the controller another one of these.
+// Written only while advertising is stopped (setup, press), read by the rotation timer.
+static IBeacon::Advertisement g_payloads[IDENTITY_COUNT];
+static AdvRotation g_rotation;                      // slot → identity; rotation timer only while advertising
+static size_t g_identity = 0;                       // identity whose payload is on air
+static esp_timer_handle_t g_rotate_timer = nullptr; // periodic, one slot; only with more than one identity
+
+// Rolling mode (PALGATE_ROLLING_KEY_HEX defined): one counter per press, code computed at press time
+static bool g_rolling = false;
+static uint8_t g_rolling_key[16];
+static uint32_t g_rolling_counter = 0;              // last counter advertised
+static uint32_t g_rolling_reserved = 0;             // counters up to here are covered by the NVS copy
+
+// Events from other contexts (button ISR, esp_timer task, BT task). Each producer
+// sets its flag and notifies the loop task, which is otherwise blocked or asleep.
+static TaskHandle_t g_loop_task = nullptr;
+static std::atomic_bool g_press_pending(false);     // ISR / wakeup: new press to handle
+static std::atomic<uint32_t> g_press_at_us(0);      // low 32 bits of esp_timer time of that press
+static std::atomic_bool g_adv_started(false);       // GAP: controller started advertising
+static std::atomic<uint32_t> g_adv_started_at_us(0);
+static std::atomic_bool g_stage_due(false);         // stage timer fired: next stage or stop
+static volatile uint32_t g_last_edge_us = 0;        // ISR-only: last accepted edge (debounce)
+
+static esp_timer_handle_t g_stage_timer = nullptr;  // one-shot, re-armed with each stage's duration
+static size_t g_adv_stage = 0;                      // index into ADV_SCHEDULE while active
+static bool g_awaiting_first_adv = false;           // latency is measured on the session's first ADV_START only
+
+// Time/charge per phase (light sleep, BLE bring-up, advertising) and press latency stats
+static PhaseAccounting g_phase;
+static uint32_t g_session_press_us = 0;             // press that started the current session
+static uint32_t g_press_count = 0;
+static uint32_t g_latency_min_us = UINT32_MAX;
+static uint32_t g_latency_max_us = 0;
+static uint64_t g_latency_sum_us = 0;
+
+// Beacon-side current estimates (uA): BLE is off in light sleep, so it is far below the scanner's.
+// Calibrate with a shunt on the real board; phases the beacon never enters are 0.
+static const CurrentModel BEACON_CURRENT_MODEL =
+{{
+    40000,      // Active: CPU awake, blocked waiting for an event
+    0,          // Scan
+    40000,      // SerialFlush
+    800,        // LightSleep: RTC + GPIO wakeup, BLE controller off
+    0,          // WiFiConnect
+    0,          // Http
+    50000,      // BleBringUp
+    50000,      // Advertise
+}};
 
 
 
@@ -47,8 +203,22 @@ const uint16_t g_debounce_limit_ms = 30;            // Debounce time threshold (
 // helper function declarations 
 //===========================================================
 static void setupBeacon();
-static void startBeacon();
+static void setupRollingCode();
+static void buildRollingPayloads();
+static void advertiseIdentity(size_t identity);
+static void startBeacon(uint32_t press_at_us);
 static void stopBeacon();
+static void applyAdvStage(size_t stage);
+static void nextAdvStage();
+static void bleUp();
+static void bleDown();
+static void sleepUntilPressed();
+static void onAdvertisingStarted(uint32_t started_at_us);
+static void reportPowerStats();
+static void IRAM_ATTR onButtonEdge();
+static void onStageTimer(void* arg);
+static void onRotateTimer(void* arg);
+static void onGapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
 
 
 
@@ -58,13 +228,35 @@ static void stopBeacon();
 void setup() 
 {
   Serial.begin(115200);
-  Serial.println("ESP32 ready");
+  PalLog::begin();
+  LOG_I("ESP32 ready");
+
+  g_phase.setCurrentModel(BEACON_CURRENT_MODEL);
+  g_loop_task = xTaskGetCurrentTaskHandle();
 
   pinMode(LED_PIN, OUTPUT);
   pinMode(BUTTON_PIN, INPUT_PULLUP);
   digitalWrite(LED_PIN, LOW);
 
+  esp_timer_create_args_t stage_timer_args = {};
+  stage_timer_args.callback = &onStageTimer;
+  stage_timer_args.name = "beacon_stage";
+  esp_timer_create(&stage_timer_args, &g_stage_timer);
+
+  if (IDENTITY_COUNT > 1)
+  {
+    esp_timer_create_args_t rotate_timer_args = {};
+    rotate_timer_args.callback = &onRotateTimer;
+    rotate_timer_args.name = "beacon_rotate";
+    esp_timer_create(&rotate_timer_args, &g_rotate_timer);
+  }
+
+  // Full BLE init once: memory, GATT/GAP registration and the payload survive bleDown()/bleUp(),
+  // so a press only pays for re-enabling the controller and stack.
   setupBeacon();
+  bleDown();
+
+  attachInterrupt(BUTTON_PIN, onButtonEdge, CHANGE);
 }
 
 
@@ -74,41 +266,50 @@ void setup()
 //===========================================================
 void loop() 
 {
-  // Read current button state and current time
-  int current_button_state = digitalRead(BUTTON_PIN);
-  uint32_t now = millis();
-
-  // Debounce: detect state change
-  if (current_button_state != g_prev_button_state) 
-	{
-    g_last_debounce_ms = now;
-    g_prev_button_state = current_button_state;
-  }
-
-  // Stable state check after debounce threshold has passed
-  static bool last_stable_high = true;                      // Tracks last stable button state (HIGH = not pressed)
-  if ((now - g_last_debounce_ms) > g_debounce_limit_ms)     // if we reached the debounce time limit
-	{
-    // Detect a *new* press
-    if (current_button_state == LOW && last_stable_high && !g_is_beacon_active) 
-		{
-      digitalWrite(LED_PIN, HIGH);
-      startBeacon();
-      last_stable_high = false;
-    }
+  // Nothing running and button released → sleep until it is pressed
+  if (!g_is_beacon_active && !g_press_pending.load() && digitalRead(BUTTON_PIN) == HIGH)
+  {
+    sleepUntilPressed();
+  }
+
+  // Block until the ISR, the stage timer or the GAP callback has something for us.
+  // While advertising there is nothing else to do; while the button is still held
+  // (after a session ended) re-check periodically in case the release edge was filtered.
+  if (!g_press_pending.load() && !g_stage_due.load() && !g_adv_started.load())
+  {
+    ulTaskNotifyTake(pdTRUE, g_is_beacon_active ? portMAX_DELAY : pdMS_TO_TICKS(RELEASE_RECHECK_MS));
+  }
 
-    // Button released, update stable state
-    if (current_button_state == HIGH) 
-		{
-      last_stable_high = true;
+  if (g_press_pending.exchange(false))
+  {
+    if (!g_is_beacon_active)
+    {
+      startBeacon(g_press_at_us.load());
+    }
+    else if (BEACON_STOP_ON_PRESS)
+    {
+      stopBeacon();
+      reportPowerStats();
+    }
+    else if (g_adv_stage != 0)
+    {
+      // back to the burst: same payload (and rolling counter), fastest interval again
+      g_pAdvertising->stop();
+      applyAdvStage(0);
+      g_pAdvertising->start();
+      LOG_I("Beacon schedule restarted");
     }
   }
 
-  // stop beacon after beacon duration
-  if (g_is_beacon_active && (now - g_beacon_start_time >= BEACON_DURATION_MS)) 
-	{
-    stopBeacon();
-    digitalWrite(LED_PIN, LOW);
+  if (g_adv_started.exchange(false))
+  {
+    onAdvertisingStarted(g_adv_started_at_us.load());
+  }
+
+  // slow down after each stage, stop after the last one
+  if (g_stage_due.exchange(false) && g_is_beacon_active)
+  {
+    nextAdvStage();
   }
 }
 
@@ -124,41 +325,198 @@ static void setupBeacon()
   BLEDevice::init(DEVICE_NAME);
   if (false == BLEDevice::getInitialized()) 
   {
-    Serial.println("BLE init failed!");
+    LOG_E("BLE init failed!");
   }
 
+  BLEDevice::setCustomGapHandler(onGapEvent);
 
-  BLEServer* pServer = BLEDevice::createServer(); 
-	(void)pServer;
+  // advertising only: nothing connects to the beacon, so no GATT server is registered
+  g_pAdvertising = BLEDevice::getAdvertising();     // intervals are set per stage by applyAdvStage()
+
+  // flags + iBeacon manufacturer data, generated at compile time; rolling mode rewrites
+  // the identity part per press (buildRollingPayloads())
+  for (size_t i = 0; i < IDENTITY_COUNT; ++i)
+    g_payloads[i] = IDENTITY_ADV.adv[i];
+
+  uint8_t weights[IDENTITY_COUNT];
+  for (size_t i = 0; i < IDENTITY_COUNT; ++i)
+    weights[i] = IDENTITIES[i].weight;
+  g_rotation.configure(weights, IDENTITY_COUNT);
+
+  setupRollingCode();
+
+  // once through BLEAdvertising so start() keeps our raw payload; bleUp() and the
+  // rotation timer then load payloads directly
+  BLEAdvertisementData adv_data;
+  adv_data.addData(std::string(reinterpret_cast<const char*>(g_payloads[0].bytes), IBeacon::ADV_LEN));
+  g_pAdvertising->setAdvertisementData(adv_data);
+
+  if (IDENTITY_COUNT > 1)
+  {
+    LOG_I("%u identities, %lu slots per cycle", (unsigned)IDENTITY_COUNT, (unsigned long)g_rotation.cycleSlots());
+  }
+}
+
+/**
+ * @brief Enable rolling mode if config.h provides a key, and resume the press counter
+ *        after the last reserved block (so no counter is ever advertised twice).
+ */
+static void setupRollingCode()
+{
+#ifdef PALGATE_ROLLING_KEY_HEX
+  if (!RollingCode::parseHex(PALGATE_ROLLING_KEY_HEX, g_rolling_key, sizeof(g_rolling_key)))
+  {
+    LOG_E("PALGATE_ROLLING_KEY_HEX must be 32 hex digits; advertising the static beacon");
+    return;
+  }
+  uint8_t any = 0;
+  for (uint8_t b : g_rolling_key)
+    any |= b;
+  if (any == 0)
+  {
+    // the template's placeholder: codes under a key everyone knows protect nothing
+    LOG_E("PALGATE_ROLLING_KEY_HEX is all zeros; advertising the static beacon");
+    return;
+  }
+
+  Preferences prefs;
+  prefs.begin("beacon", false);
+  g_rolling_counter = prefs.getUInt("ctr", 0);
+  g_rolling_reserved = g_rolling_counter + ROLLING_RESERVE;
+  prefs.putUInt("ctr", g_rolling_reserved);
+  prefs.end();
+
+  g_rolling = true;
+  LOG_I("Rolling code on, next counter %lu", (unsigned long)(g_rolling_counter + 1));
+#endif
+}
+
+/**
+ * @brief Next counter → one AES per identity → its advertisement with the code over
+ *        UUID[10..15]/major/minor. All identities advertise the same counter.
+ *        The NVS write only happens once every ROLLING_RESERVE presses.
+ */
+static void buildRollingPayloads()
+{
+  ++g_rolling_counter;
+  if (g_rolling_counter > g_rolling_reserved)
+  {
+    g_rolling_reserved = g_rolling_counter + ROLLING_RESERVE;
+    Preferences prefs;
+    prefs.begin("beacon", false);
+    prefs.putUInt("ctr", g_rolling_reserved);
+    prefs.end();
+  }
+
+  const size_t uuid_at = IBeacon::ADV_MFG_OFFSET + IBeacon::MFG_UUID_OFFSET;
+  for (size_t i = 0; i < IDENTITY_COUNT; ++i)
+  {
+    RollingCode::payload(g_rolling_key, IDENTITY_ADV.adv[i].bytes + uuid_at, g_rolling_counter,
+                         g_payloads[i].bytes + uuid_at);
+  }
+}
 
-  BLEBeacon beacon;
-  beacon.setManufacturerId(0x004C);               // iBeacon packet / format
-  beacon.setProximityUUID(BLEUUID(beacon_uuid));
-  beacon.setMajor(beacon_major);
-  beacon.setMinor(beacon_minor);
-  beacon.setSignalPower(beacon_txpower_at_1m);
+/**
+ * @brief Put one identity's prebuilt payload on air. The controller switches at its next
+ *        advertising event; advertising keeps running.
+ */
+static void advertiseIdentity(size_t identity)
+{
+  g_identity = identity;
+  esp_ble_gap_config_adv_data_raw(g_payloads[identity].bytes, IBeacon::ADV_LEN);
+}
 
-  BLEAdvertisementData advData;
-  advData.setFlags(0x04);                         // BLE-only
-  advData.setManufacturerData(beacon.getData());
+/**
+ * @brief Power the BLE controller and Bluedroid back up (they stay initialised while down)
+ *        and reload the advertising payload, which the controller does not keep.
+ */
+static void bleUp()
+{
+  if (esp_bt_controller_get_status() != ESP_BT_CONTROLLER_STATUS_ENABLED)
+    esp_bt_controller_enable(BT_CONTROLLER_MODE);
+  if (esp_bluedroid_get_status() != ESP_BLUEDROID_STATUS_ENABLED)
+    esp_bluedroid_enable();
 
-  g_pAdvertising = BLEDevice::getAdvertising();
-  g_pAdvertising->setAdvertisementData(advData);
+  advertiseIdentity(g_identity);
+}
 
-  g_pAdvertising->setMinInterval(0x20);             // 0x20 * 0.625ms = 20ms
-  g_pAdvertising->setMaxInterval(0x40);             // 0x40 * 0.625ms = 40ms
+/**
+ * @brief Disable Bluedroid and the BLE controller (radio + modem clock off) without
+ *        de-initialising them, so bleUp() skips allocation and GATT/GAP registration.
+ */
+static void bleDown()
+{
+  if (esp_bluedroid_get_status() == ESP_BLUEDROID_STATUS_ENABLED)
+    esp_bluedroid_disable();
+  if (esp_bt_controller_get_status() == ESP_BT_CONTROLLER_STATUS_ENABLED)
+    esp_bt_controller_disable();
 }
 
-static void startBeacon() 
+static void startBeacon(uint32_t press_at_us) 
 {
   if (!g_pAdvertising) 
 		return;
 
+  digitalWrite(LED_PIN, HIGH);
+
+  // press → ADV_START_COMPLETE is accounted as bring-up; onAdvertisingStarted() switches to Advertise
+  g_phase.enter(Phase::BleBringUp);
+  g_session_press_us = press_at_us;
+  g_awaiting_first_adv = true;
+  if (g_rolling)
+    buildRollingPayloads();
+  g_rotation.reset();
+  g_identity = g_rotation.next();
+  bleUp();
+  applyAdvStage(0);
   g_pAdvertising->start();
   g_is_beacon_active = true;
-  g_beacon_start_time = millis();                     // catch current time
 
-  Serial.println("Beacon started");
+  LOG_I("Beacon started");
+}
+
+/**
+ * @brief Set the stage's advertising interval and arm the stage timer with its duration.
+ *        Takes effect on the next start(); the controller cannot change it while advertising.
+ *        With several identities the rotation slot follows the stage's longest interval.
+ */
+static void applyAdvStage(size_t stage)
+{
+  const AdvStage& s = ADV_SCHEDULE[stage];
+
+  g_adv_stage = stage;
+  g_pAdvertising->setMinInterval((uint16_t)(s.min_interval_ms * 8 / 5));   // 0.625 ms units
+  g_pAdvertising->setMaxInterval((uint16_t)(s.max_interval_ms * 8 / 5));
+
+  esp_timer_stop(g_stage_timer);  // no-op when not running
+  esp_timer_start_once(g_stage_timer, (uint64_t)s.duration_ms * 1000ULL);
+
+  if (g_rotate_timer)
+  {
+    esp_timer_stop(g_rotate_timer);
+    esp_timer_start_periodic(g_rotate_timer, (uint64_t)AdvRotation::slotMs(s.max_interval_ms) * 1000ULL);
+  }
+}
+
+/**
+ * @brief Stage timer expired: restart advertising with the next stage's interval,
+ *        or end the session after the last stage.
+ */
+static void nextAdvStage()
+{
+  if (g_adv_stage + 1 >= ADV_STAGE_COUNT)
+  {
+    stopBeacon();
+    reportPowerStats();
+    return;
+  }
+
+  g_pAdvertising->stop();
+  applyAdvStage(g_adv_stage + 1);
+  g_pAdvertising->start();
+
+  LOG_D("Advertising stage %u: %u-%u ms", (unsigned)g_adv_stage,
+        (unsigned)ADV_SCHEDULE[g_adv_stage].min_interval_ms, (unsigned)ADV_SCHEDULE[g_adv_stage].max_interval_ms);
 }
 
 static void stopBeacon() 
@@ -166,8 +524,145 @@ static void stopBeacon()
   if (!g_pAdvertising) 
 		return;
 
+  esp_timer_stop(g_stage_timer);  // no-op when it already fired
+  if (g_rotate_timer)
+    esp_timer_stop(g_rotate_timer);
   g_pAdvertising->stop();
+  bleDown();
   g_is_beacon_active = false;
+  digitalWrite(LED_PIN, LOW);
+  g_phase.enter(Phase::Active);
+
+  LOG_I("Beacon stopped");
+}
+
+/**
+ * @brief Record button-to-first-advertisement latency (press edge or GPIO wakeup → ADV_START_COMPLETE).
+ */
+static void onAdvertisingStarted(uint32_t started_at_us)
+{
+  // later stages restart advertising too; only the first start is the press latency
+  if (!g_is_beacon_active || !g_awaiting_first_adv)
+    return;
+  g_awaiting_first_adv = false;
+
+  g_phase.enter(Phase::Advertise);
+
+  uint32_t latency_us = started_at_us - g_session_press_us;     // 32-bit wrap-safe
+  ++g_press_count;
+  g_latency_sum_us += latency_us;
+  if (latency_us < g_latency_min_us) g_latency_min_us = latency_us;
+  if (latency_us > g_latency_max_us) g_latency_max_us = latency_us;
+
+  LOG_I("Button -> first advert: %lu us", (unsigned long)latency_us);
+}
 
-  Serial.println("Beacon stopped");
-}
\ No newline at end of file
+/**
+ * @brief Log latency statistics and the estimated average idle current after each session.
+ *        Idle = everything outside BLE bring-up/advertising (light sleep + awake waiting).
+ */
+static void reportPowerStats()
+{
+  g_phase.sync();
+  const PhaseAccounting::Totals& life = g_phase.lifetime();
+
+  // only read by LOG_I (unused when logging is compiled out)
+  [[maybe_unused]] uint32_t idle_mask = PhaseAccounting::phaseBit(Phase::Active) |
+                                        PhaseAccounting::phaseBit(Phase::LightSleep) |
+                                        PhaseAccounting::phaseBit(Phase::SerialFlush);
+  uint64_t idle_us = life.us[(size_t)Phase::Active] + life.us[(size_t)Phase::LightSleep] +
+                     life.us[(size_t)Phase::SerialFlush];
+  [[maybe_unused]] uint32_t sleep_permille = idle_us ? (uint32_t)(life.us[(size_t)Phase::LightSleep] * 1000ULL / idle_us) : 0;
+
+  uint64_t total_pC = 0;
+  for (size_t i = 0; i < PhaseAccounting::PHASE_COUNT; ++i)
+    total_pC += life.charge_pC[i];
+
+  if (g_press_count > 0)
+  {
+    LOG_I("Press latency over %lu presses: min %lu / avg %lu / max %lu us", (unsigned long)g_press_count,
+          (unsigned long)g_latency_min_us, (unsigned long)(g_latency_sum_us / g_press_count), (unsigned long)g_latency_max_us);
+  }
+  LOG_I("Idle: avg %lu uA (est.), %lu.%lu%% of idle time in light sleep, lifetime %.4f mAh",
+        (unsigned long)PhaseAccounting::averageMicroamps(life, idle_mask),
+        (unsigned long)(sleep_permille / 10), (unsigned long)(sleep_permille % 10),
+        PhaseAccounting::toMilliampHours(total_pC));
+}
+
+/**
+ * @brief Light-sleep until the button pulls GPIO0 low. The edge ISR is detached while
+ *        asleep because gpio_wakeup_enable() reprograms the pin's interrupt type.
+ */
+static void sleepUntilPressed()
+{
+  if (PalLog::needsFlush())
+  {
+    g_phase.enter(Phase::SerialFlush);
+    PalLog::flush();    // UART output would be cut by the sleep
+  }
+
+  detachInterrupt(BUTTON_PIN);
+  gpio_wakeup_enable((gpio_num_t)BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+
+  g_phase.enter(Phase::LightSleep);
+  esp_light_sleep_start();
+  uint32_t woke_at_us = (uint32_t)esp_timer_get_time();
+  g_phase.enter(Phase::Active);
+
+  gpio_wakeup_disable((gpio_num_t)BUTTON_PIN);
+  attachInterrupt(BUTTON_PIN, onButtonEdge, CHANGE);
+
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO)
+  {
+    // the wakeup is the press: its falling edge happened while the ISR was detached
+    g_last_edge_us = woke_at_us;
+    g_press_at_us.store(woke_at_us);
+    g_press_pending.store(true);
+  }
+}
+
+/**
+ * @brief Button edge ISR: accept the first edge of a bounce burst, flag presses, wake loop().
+ */
+static void IRAM_ATTR onButtonEdge()
+{
+  uint32_t now_us = (uint32_t)esp_timer_get_time();
+  if ((uint32_t)(now_us - g_last_edge_us) < DEBOUNCE_US)
+    return;
+  g_last_edge_us = now_us;
+
+  if (digitalRead(BUTTON_PIN) == LOW)
+  {
+    g_press_at_us.store(now_us);
+    g_press_pending.store(true);
+  }
+
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(g_loop_task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+// esp_timer task: the current stage's duration elapsed
+static void onStageTimer(void* arg)
+{
+  g_stage_due.store(true);
+  xTaskNotifyGive(g_loop_task);
+}
+
+// esp_timer task: the identity's slot is over, hand the next one's payload to the controller
+static void onRotateTimer(void* arg)
+{
+  advertiseIdentity(g_rotation.next());
+}
+
+// BT task: only timestamps and hands over; all state changes happen in loop()
+static void onGapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param)
+{
+  if (event == ESP_GAP_BLE_ADV_START_COMPLETE_EVT && param->adv_start_cmpl.status == ESP_BT_STATUS_SUCCESS)
+  {
+    g_adv_started_at_us.store((uint32_t)esp_timer_get_time());
+    g_adv_started.store(true);
+    xTaskNotifyGive(g_loop_task);
+  }
+}
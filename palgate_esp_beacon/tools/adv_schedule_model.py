@@ -0,0 +1,267 @@
+#!/usr/bin/env python3
+"""
+Model detection probability and energy per press for beacon advertising schedules.
+
+A schedule is a list of stages "duration_ms:min_ms-max_ms", e.g. the firmware
+default "3100:20-30,3000:60-80,3900:200-250" (see ADV_SCHEDULE in
+main_beacon.cpp). Each advertising event sends one PDU on each of the three
+advertising channels, at interval + a random 0-10 ms advDelay.
+
+The scanner (defaults from its RuntimeConfig) listens for scan_window_ms out of
+every cycle_ms (loop_awake_ms + sleep_ms). Its BLE window covers its whole
+interval, so any event that falls inside a listening window is heard with
+probability p_rx (collisions, fading). The press lands at a uniformly random
+phase of the scanner cycle.
+
+Two estimates are printed for each schedule:
+  * analytic: per listening window, P(miss) = (1 - p_rx)^(window / mean interval),
+    averaged over the press phase (numerically);
+  * Monte Carlo: explicit event times and windows, which also gives latency
+    percentiles.
+
+With --identities W1,W2,... the beacon advertises several iBeacon identities
+(BEACON_IDENTITIES) in turn, like AdvRotation: slots of max_interval + advDelay,
+restarted at each stage, handed out by smooth weighted round-robin so identity i
+owns W_i of every sum(W) slots. Each identity is then reported on its own, as
+seen by a scanner listening for that identity only (at its own random phase);
+the analytic estimate thins the event rate by W_i / sum(W).
+
+Energy per press = baseline current x session length + events x charge per event,
+with the session cut short at detection when --early-stop is given (an oracle
+"stop once the gate opened", as an upper bound on what early stop can save).
+
+usage: adv_schedule_model.py [--schedule S ...] [--trials N] [--scan-window-ms 80]
+                             [--cycle-ms 3000] [--p-rx 0.9] [--baseline-ma 40]
+                             [--event-uc 120] [--early-stop] [--identities 1,1]
+"""
+
+import argparse
+import bisect
+import math
+import random
+import statistics
+
+FLAT = "10000:20-40"
+DEFAULT = "3100:20-30,3000:60-80,3900:200-250"
+CHECKPOINTS_S = (0.5, 1.0, 2.0, 3.0, 5.0, 10.0)
+ADV_DELAY_MS = 10.0
+
+
+def parse_schedule(text):
+    stages = []
+    for part in text.split(","):
+        dur, iv = part.split(":")
+        lo, hi = iv.split("-") if "-" in iv else (iv, iv)
+        stages.append((float(dur), float(lo), float(hi)))
+    return stages
+
+
+def schedule_length(stages):
+    return sum(s[0] for s in stages)
+
+
+def event_times(stages, rng):
+    """Advertising event times (ms since press) for one session."""
+    times = []
+    t0 = 0.0
+    t = 0.0
+    for dur, lo, hi in stages:
+        end = t0 + dur
+        while t < end:
+            times.append(t)
+            # controller picks an interval in [min, max], plus advDelay
+            t += rng.uniform(lo, hi) + rng.uniform(0.0, ADV_DELAY_MS)
+        t0 = end
+    return times
+
+
+def parse_weights(text):
+    weights = [int(w) for w in text.split(",")]
+    if not weights or any(w < 1 for w in weights):
+        raise SystemExit("--identities: weights must be integers >= 1")
+    return weights
+
+
+class Rotation:
+    """Smooth weighted round-robin, as AdvRotation::next()."""
+
+    def __init__(self, weights):
+        self.weights = weights
+        self.total = sum(weights)
+        self.credit = [0] * len(weights)
+
+    def next(self):
+        pick = 0
+        for i, w in enumerate(self.weights):
+            self.credit[i] += w
+            if self.credit[i] > self.credit[pick]:
+                pick = i
+        self.credit[pick] -= self.total
+        return pick
+
+
+def identity_slots(stages, weights):
+    """(slot start ms, identity) for one session; the slot timer restarts with each stage."""
+    rot = Rotation(weights)
+    starts, owners = [0.0], [rot.next()]
+    t0 = 0.0
+    for dur, lo, hi in stages:
+        slot = hi + ADV_DELAY_MS
+        t = t0 + slot
+        while t < t0 + dur:
+            starts.append(t)
+            owners.append(rot.next())
+            t += slot
+        t0 += dur
+    return starts, owners
+
+
+def mean_interval_at(stages, t):
+    start = 0.0
+    for dur, lo, hi in stages:
+        if t < start + dur:
+            return (lo + hi) / 2.0 + ADV_DELAY_MS / 2.0
+        start += dur
+    return None
+
+
+def analytic_cdf(stages, args, checkpoints_ms, share=1.0, phases=400):
+    """P(detected by t) for each checkpoint, averaged over the scanner phase;
+    `share` = fraction of the events that carry the identity listened for."""
+    length = schedule_length(stages)
+    result = [0.0] * len(checkpoints_ms)
+    for k in range(phases):
+        phase = args.cycle_ms * k / phases
+        p_missed = 1.0
+        # the window that started before the press may still be open
+        w_start = phase - args.cycle_ms
+        cdf = []
+        # walk the scanner's listening windows in time order
+        for cp in checkpoints_ms:
+            while w_start < min(cp, length):
+                w_begin = max(w_start, 0.0)
+                w_end = min(w_start + args.scan_window_ms, length, cp)
+                iv = mean_interval_at(stages, w_begin)
+                if iv is not None and w_end > w_begin:
+                    events = (w_end - w_begin) / iv * share
+                    p_missed *= (1.0 - args.p_rx) ** events
+                w_start += args.cycle_ms
+            cdf.append(1.0 - p_missed)
+        for i, v in enumerate(cdf):
+            result[i] += v / phases
+    return result
+
+
+def simulate(stages, args, rng, slots=None, identity=0):
+    """One press: detection time in ms (None = missed) and number of events sent.
+    With `slots` (identity_slots()) only events of `identity` can be detected."""
+    phase = rng.uniform(0.0, args.cycle_ms)
+    times = event_times(stages, rng)
+    for n, t in enumerate(times):
+        if slots is not None and slots[1][bisect.bisect_right(slots[0], t) - 1] != identity:
+            continue
+        # listening windows start at phase + k * cycle
+        k = math.floor((t - phase) / args.cycle_ms)
+        w_start = phase + k * args.cycle_ms
+        if w_start <= t < w_start + args.scan_window_ms and rng.random() < args.p_rx:
+            return t, n + 1
+    return None, len(times)
+
+
+def report(name, stages, args):
+    rng = random.Random(args.seed)
+    length = schedule_length(stages)
+    detected = []
+    charge_uc = []     # mA * ms = uC
+    for _ in range(args.trials):
+        t, n = simulate(stages, args, rng)
+        if t is not None:
+            detected.append(t)
+        if args.early_stop and t is not None:
+            charge_uc.append(args.baseline_ma * t + n * args.event_uc)
+        else:
+            sent = n if t is None else len(event_times(stages, rng))
+            charge_uc.append(args.baseline_ma * length + sent * args.event_uc)
+    mean_uc = statistics.fmean(charge_uc)
+
+    checkpoints_ms = [c * 1000.0 for c in CHECKPOINTS_S if c * 1000.0 <= length]
+    analytic = analytic_cdf(stages, args, checkpoints_ms)
+
+    print("%s  [%s]" % (name, ",".join("%g:%g-%g" % s for s in stages)))
+    print("  %-8s %10s %10s" % ("t", "analytic", "simulated"))
+    for cp, a in zip(checkpoints_ms, analytic):
+        sim = sum(1 for t in detected if t <= cp) / args.trials
+        print("  %6.1fs  %9.4f%% %9.4f%%" % (cp / 1000.0, 100 * a, 100 * sim))
+    if detected:
+        detected.sort()
+        p50 = detected[len(detected) // 2]
+        p95 = detected[min(len(detected) - 1, int(0.95 * len(detected)))]
+        print("  latency  p50 %.0f ms, p95 %.0f ms; missed %.4f%%" %
+              (p50, p95, 100.0 * (args.trials - len(detected)) / args.trials))
+    print("  energy   %.1f mC = %.4f mAh per press%s" %
+          (mean_uc / 1000.0, mean_uc / 3.6e6, " (early stop)" if args.early_stop else ""))
+    print()
+
+
+def report_identities(name, stages, weights, args):
+    """Per-identity detection for a schedule shared by len(weights) identities."""
+    length = schedule_length(stages)
+    slots = identity_slots(stages, weights)
+    checkpoints_ms = [c * 1000.0 for c in CHECKPOINTS_S if c * 1000.0 <= length]
+
+    print("%s  [%s], %d identities, weights %s" %
+          (name, ",".join("%g:%g-%g" % s for s in stages), len(weights), ",".join(map(str, weights))))
+    for ident, w in enumerate(weights):
+        rng = random.Random(args.seed + ident)
+        detected = []
+        for _ in range(args.trials):
+            t, _n = simulate(stages, args, rng, slots, ident)
+            if t is not None:
+                detected.append(t)
+        analytic = analytic_cdf(stages, args, checkpoints_ms, share=w / float(sum(weights)))
+        owned = sum(1 for o in slots[1] if o == ident)
+
+        print("  identity %d (weight %d, %d of %d slots)" % (ident, w, owned, len(slots[1])))
+        print("    %-8s %10s %10s" % ("t", "analytic", "simulated"))
+        for cp, a in zip(checkpoints_ms, analytic):
+            sim = sum(1 for t in detected if t <= cp) / args.trials
+            print("    %6.1fs  %9.4f%% %9.4f%%" % (cp / 1000.0, 100 * a, 100 * sim))
+        if detected:
+            detected.sort()
+            p50 = detected[len(detected) // 2]
+            p95 = detected[min(len(detected) - 1, int(0.95 * len(detected)))]
+            print("    latency  p50 %.0f ms, p95 %.0f ms; missed %.4f%%" %
+                  (p50, p95, 100.0 * (args.trials - len(detected)) / args.trials))
+    print()
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--schedule", action="append",
+                    help="stages 'ms:min-max,...' (repeatable; default: flat 20-40 ms and the firmware default)")
+    ap.add_argument("--trials", type=int, default=20000)
+    ap.add_argument("--scan-window-ms", type=float, default=80.0, help="scanner scan_window_ms")
+    ap.add_argument("--cycle-ms", type=float, default=3000.0, help="scanner loop_awake_ms + sleep_ms")
+    ap.add_argument("--p-rx", type=float, default=0.9, help="P(event in a listening window is received)")
+    ap.add_argument("--baseline-ma", type=float, default=40.0,
+                    help="beacon current between events while advertising (CPU awake)")
+    ap.add_argument("--event-uc", type=float, default=120.0,
+                    help="extra charge per advertising event (3 PDUs)")
+    ap.add_argument("--early-stop", action="store_true", help="end the session at detection")
+    ap.add_argument("--identities", metavar="W1,W2,...",
+                    help="rotate this many identities with these weights (BEACON_IDENTITIES)")
+    ap.add_argument("--seed", type=int, default=1)
+    args = ap.parse_args()
+
+    schedules = args.schedule or [FLAT, DEFAULT]
+    weights = parse_weights(args.identities) if args.identities else None
+    for s in schedules:
+        name = "flat" if s == FLAT else ("default" if s == DEFAULT else "custom")
+        if weights and len(weights) > 1:
+            report_identities(name, parse_schedule(s), weights, args)
+        else:
+            report(name, parse_schedule(s), args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,221 @@
+#include "AdvDecoder.h"
+#include "IBeaconProtocol.h"
+#include <string.h>
+
+static const uint8_t AD_SERVICE_UUID128_INCOMPLETE = 0x06;
+static const uint8_t AD_SERVICE_UUID128_COMPLETE = 0x07;
+static const uint8_t AD_SERVICE_DATA16 = 0x16;
+static const uint8_t AD_MANUFACTURER_DATA = 0xFF;
+
+static const uint16_t COMPANY_APPLE = 0x004C;
+static const uint16_t COMPANY_RADIUS = 0x0118;         // AltBeacon's reference company; phone apps default to it
+static const uint16_t EDDYSTONE_SERVICE = 0xFEAA;
+
+static const size_t ALTBEACON_LEN = 26;                 // company, 0xBEAC, id1(16) id2(2) id3(2), ref RSSI, reserved
+static const size_t EDDYSTONE_UID_LEN = 20;             // service, frame, tx@0m, namespace(10), instance(6) [, RFU(2)]
+static const int8_t EDDYSTONE_0M_TO_1M = 41;            // Eddystone calibrates at 0 m; 1 m is 41 dB lower
+
+static inline uint16_t be16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+static inline uint16_t le16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+bool AdWalker::next(AdStructure& ad)
+{
+    if (m_end - m_p < 2 || m_p[0] == 0)
+        return false;
+    const size_t field = m_p[0];            // type + data
+    if ((size_t)(m_end - m_p - 1) < field)
+        return false;
+
+    ad.type = m_p[1];
+    ad.len = (uint8_t)(field - 1);
+    ad.data = m_p + 2;
+    m_p += 1 + field;
+    return true;
+}
+
+
+// ---- decoders: `ad` already matched their key ----
+
+static bool decodeIBeacon(const AdStructure& ad, AdSighting& out)
+{
+    if (!IBeacon::isIBeacon(ad.data, ad.len))
+        return false;
+    memcpy(out.id, ad.data + IBeacon::MFG_UUID_OFFSET, IBeacon::UUID_LEN);
+    out.major = IBeacon::major(ad.data);
+    out.minor = IBeacon::minor(ad.data);
+    out.tx_power = IBeacon::txPower(ad.data);
+    return true;
+}
+
+static bool decodeAltBeacon(const AdStructure& ad, AdSighting& out)
+{
+    if (ad.len != ALTBEACON_LEN || le16(ad.data) != COMPANY_RADIUS || ad.data[2] != 0xBE || ad.data[3] != 0xAC)
+        return false;
+    memcpy(out.id, ad.data + 4, sizeof(out.id));
+    out.major = be16(ad.data + 20);
+    out.minor = be16(ad.data + 22);
+    out.tx_power = (int8_t)ad.data[24];
+    return true;
+}
+
+static bool decodeEddystoneUid(const AdStructure& ad, AdSighting& out)
+{
+    if (ad.len < EDDYSTONE_UID_LEN || le16(ad.data) != EDDYSTONE_SERVICE || ad.data[2] != 0x00)
+        return false;
+    memcpy(out.id, ad.data + 4, sizeof(out.id));       // namespace, then instance
+    out.major = 0;
+    out.minor = 0;
+    out.tx_power = (int8_t)((int8_t)ad.data[3] - EDDYSTONE_0M_TO_1M);
+    return true;
+}
+
+static bool decodeServiceUuid(const AdStructure& ad, AdSighting& out)
+{
+    if (ad.len < sizeof(out.id))
+        return false;
+    // first UUID of the list; little-endian on air
+    for (size_t i = 0; i < sizeof(out.id); ++i)
+        out.id[i] = ad.data[sizeof(out.id) - 1 - i];
+    out.major = 0;
+    out.minor = 0;
+    out.tx_power = 0;
+    return true;
+}
+
+
+// ---- registry ----
+
+typedef bool (*DecodeFn)(const AdStructure& ad, AdSighting& out);
+
+struct Decoder
+{
+    uint16_t key;
+    AdFormat format;
+    DecodeFn decode;
+};
+
+static constexpr size_t KEY_COUNT = 512;
+static constexpr uint16_t adTypeKey(uint8_t type) { return type; }
+static constexpr uint16_t companyKey(uint16_t company) { return (uint16_t)(0x100 | (company & 0xFF)); }
+
+// The only place a format is added: one line per key it is dispatched on.
+static constexpr Decoder DECODERS[] =
+{
+    { companyKey(COMPANY_APPLE),                AdFormat::IBeacon,      decodeIBeacon },
+    { companyKey(COMPANY_RADIUS),               AdFormat::AltBeacon,    decodeAltBeacon },
+    { adTypeKey(AD_SERVICE_DATA16),             AdFormat::EddystoneUid, decodeEddystoneUid },
+    { adTypeKey(AD_SERVICE_UUID128_COMPLETE),   AdFormat::ServiceUuid,  decodeServiceUuid },
+    { adTypeKey(AD_SERVICE_UUID128_INCOMPLETE), AdFormat::ServiceUuid,  decodeServiceUuid },
+};
+static constexpr size_t DECODER_COUNT = sizeof(DECODERS) / sizeof(DECODERS[0]);
+
+// key → 1 + index into DECODERS, 0 = no decoder
+struct DispatchTable
+{
+    uint8_t slot[KEY_COUNT];
+};
+
+static constexpr DispatchTable makeDispatchTable()
+{
+    DispatchTable t{};
+    for (size_t i = 0; i < DECODER_COUNT; ++i)
+        t.slot[DECODERS[i].key] = (uint8_t)(i + 1);
+    return t;
+}
+
+static constexpr bool uniqueKeys()
+{
+    for (size_t i = 0; i < DECODER_COUNT; ++i)
+        for (size_t j = i + 1; j < DECODER_COUNT; ++j)
+            if (DECODERS[i].key == DECODERS[j].key)
+                return false;
+    return true;
+}
+
+static_assert(DECODER_COUNT < 255, "dispatch slots are uint8_t");
+static_assert(uniqueKeys(), "one decoder per AD type / company ID byte");
+
+static constexpr DispatchTable DISPATCH = makeDispatchTable();
+
+bool AdvDecoder::decode(const uint8_t* payload, size_t len, uint8_t formats, AdSighting& out)
+{
+    out.company = AdSighting::NO_COMPANY;
+
+    AdWalker walker(payload, len);
+    AdStructure ad;
+    while (walker.next(ad))
+    {
+        uint16_t key = ad.type;
+        if (ad.type == AD_MANUFACTURER_DATA)
+        {
+            if (ad.len < 2)
+                continue;
+            out.company = le16(ad.data);
+            key = companyKey(ad.data[0]);
+        }
+
+        const uint8_t slot = DISPATCH.slot[key];
+        if (slot == 0)
+            continue;
+
+        const Decoder& d = DECODERS[slot - 1];
+        if ((formats & formatBit(d.format)) != 0 && d.decode(ad, out))
+        {
+            out.format = d.format;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char* const FORMAT_NAMES[] = { "ibeacon", "altbeacon", "eddystone", "service_uuid" };
+static_assert(sizeof(FORMAT_NAMES) / sizeof(FORMAT_NAMES[0]) == (size_t)AdFormat::COUNT, "one name per format");
+
+const char* AdvDecoder::formatName(AdFormat f)
+{
+    return (size_t)f < (size_t)AdFormat::COUNT ? FORMAT_NAMES[(size_t)f] : "?";
+}
+
+bool AdvDecoder::parseFormats(const char* text, uint8_t& mask)
+{
+    uint8_t m = 0;
+    const char* p = text;
+    while (*p)
+    {
+        const char* end = strchr(p, ',');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+
+        size_t f = 0;
+        while (f < (size_t)AdFormat::COUNT && !(strlen(FORMAT_NAMES[f]) == n && strncmp(p, FORMAT_NAMES[f], n) == 0))
+            ++f;
+        if (f == (size_t)AdFormat::COUNT)
+            return false;
+        m |= formatBit((AdFormat)f);
+
+        p += n;
+        if (*p == ',')
+            ++p;
+    }
+    if (m == 0)
+        return false;
+    mask = m;
+    return true;
+}
+
+void AdvDecoder::formatsToString(uint8_t mask, char* out, size_t cap)
+{
+    size_t used = 0;
+    out[0] = '\0';
+    for (size_t f = 0; f < (size_t)AdFormat::COUNT; ++f)
+    {
+        if ((mask & formatBit((AdFormat)f)) == 0)
+            continue;
+        size_t n = strlen(FORMAT_NAMES[f]) + (used ? 1 : 0);
+        if (used + n + 1 > cap)
+            return;
+        if (used)
+            out[used++] = ',';
+        strcpy(out + used, FORMAT_NAMES[f]);
+        used += strlen(FORMAT_NAMES[f]);
+    }
+}
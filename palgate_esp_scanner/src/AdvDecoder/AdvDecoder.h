@@ -0,0 +1,105 @@
+#ifndef ADV_DECODER_H
+#define ADV_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Advertisement formats the scanner can trigger on. Phones can usually send
+ *        one of the last three (e.g. with a beacon simulator app) but not an iBeacon.
+ */
+enum class AdFormat : uint8_t
+{
+    IBeacon,        // Apple manufacturer data, UUID/major/minor
+    AltBeacon,      // manufacturer data with beacon code 0xBEAC, id1/id2/id3
+    EddystoneUid,   // service data 0xFEAA, frame 0x00: namespace + instance
+    ServiceUuid,    // a 128-bit service UUID in the (in)complete service list
+    COUNT
+};
+
+inline uint8_t formatBit(AdFormat f) { return (uint8_t)(1u << (uint8_t)f); }
+
+
+/**
+ * @brief One AD structure of a raw advertisement: points into the payload, nothing is copied.
+ */
+struct AdStructure
+{
+    uint8_t type;           // AD type (0xFF manufacturer data, 0x16 service data, ...)
+    uint8_t len;            // bytes at data (the length byte minus the type)
+    const uint8_t* data;
+};
+
+/**
+ * @brief Iterates over the AD structures of a raw advertising (+ scan response) payload.
+ *
+ * Zero-copy: every AdStructure points into the caller's buffer. Stops at the end of
+ * the payload, at a zero length byte (padding) and at a structure running past the
+ * end, so a malformed payload never reads out of bounds.
+ */
+class AdWalker
+{
+public:
+    AdWalker(const uint8_t* payload, size_t len) : m_p(payload), m_end(payload + len) {}
+
+    // Next structure; false when there is none.
+    bool next(AdStructure& ad);
+
+private:
+    const uint8_t* m_p;
+    const uint8_t* m_end;
+};
+
+
+/**
+ * @brief What a decoder extracts, the same for every format (POD, 24 bytes).
+ *
+ * `id` is the 16-byte identity the scanner matches against target_uuid, in string
+ * (big-endian) order: iBeacon UUID, AltBeacon id1, Eddystone namespace + instance,
+ * or the service UUID.
+ */
+struct AdSighting
+{
+    static const uint16_t NO_COMPANY = 0xFFFF;
+
+    uint8_t id[16];
+    uint16_t major;         // iBeacon major / AltBeacon id2; 0 for the other formats
+    uint16_t minor;         // iBeacon minor / AltBeacon id3; 0 for the other formats
+    uint16_t company;       // company ID of the last manufacturer data walked, NO_COMPANY if none
+    int8_t tx_power;        // calibrated RSSI at 1 m; 0 if the format has none
+    AdFormat format;
+};
+
+
+/**
+ * @brief Table-driven decoder registry.
+ *
+ * Each decoder is registered under one key: the AD type, or for manufacturer data
+ * the low byte of the company ID (the first data byte). A compile-time table maps
+ * every key to its decoder, so an AD structure no decoder is registered for costs
+ * one table lookup; only a structure whose key matches is parsed further.
+ *
+ * Stateless and reentrant; called on the BT host task.
+ */
+class AdvDecoder
+{
+public:
+    // Formats enabled when nothing is configured: the PalGate beacon only.
+    static const uint8_t DEFAULT_FORMATS = 1u << (uint8_t)AdFormat::IBeacon;
+    static const uint8_t ALL_FORMATS = (1u << (uint8_t)AdFormat::COUNT) - 1;
+
+    // Walk `payload` and decode the first structure whose decoder is enabled in
+    // `formats` (formatBit() mask) and accepts it. `out.company` is set either way.
+    static bool decode(const uint8_t* payload, size_t len, uint8_t formats, AdSighting& out);
+
+    // "ibeacon", "altbeacon", "eddystone", "service_uuid"
+    static const char* formatName(AdFormat f);
+
+    // Comma-separated format names → mask. False on an unknown name or an empty list.
+    static bool parseFormats(const char* text, uint8_t& mask);
+
+    // Mask → comma-separated names (the form parseFormats() reads).
+    static void formatsToString(uint8_t mask, char* out, size_t cap);
+};
+
+#endif // #ifndef ADV_DECODER_H
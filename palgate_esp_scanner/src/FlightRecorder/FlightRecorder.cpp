@@ -0,0 +1,244 @@
+#include "FlightRecorder.h"
+
+#include <Arduino.h>
+#include <cstring>
+#include <time.h>
+#include "esp_partition.h"
+#include "esp_system.h"
+
+FlightRecorder g_flight;
+
+static const char* PARTITION_LABEL = "flightlog";
+
+static inline const esp_partition_t* part(const void* p)
+{
+    return static_cast<const esp_partition_t*>(p);
+}
+
+uint8_t FlightRecorder::crc8(const uint8_t* data, size_t len)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        crc ^= data[i];
+        for (int b = 0; b < 8; ++b)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+bool FlightRecorder::readHeader(size_t sector, FlightSectorHeader& h) const
+{
+    if (esp_partition_read(part(m_part), sector * SECTOR_SIZE, &h, sizeof(h)) != ESP_OK)
+        return false;
+
+    return h.magic == FLIGHT_MAGIC &&
+           h.crc == crc8(reinterpret_cast<const uint8_t*>(&h), offsetof(FlightSectorHeader, crc));
+}
+
+bool FlightRecorder::begin()
+{
+    const esp_partition_t* p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                        ESP_PARTITION_SUBTYPE_ANY, PARTITION_LABEL);
+    if (p == nullptr)
+        return false;
+
+    m_part = p;
+    m_sectors = p->size / SECTOR_SIZE;
+
+    // Newest valid sector is where we resume; oldest is where exports start.
+    bool found = false;
+    uint32_t min_seq = UINT32_MAX;
+    for (size_t s = 0; s < m_sectors; ++s)
+    {
+        FlightSectorHeader h;
+        if (!readHeader(s, h))
+            continue;
+
+        if (!found || h.seq > m_sector_seq)
+        {
+            m_sector = s;
+            m_sector_seq = h.seq;
+        }
+        if (h.seq < min_seq)
+        {
+            min_seq = h.seq;
+            m_oldest = s;
+        }
+        found = true;
+    }
+
+    if (!found)
+    {
+        // blank (or foreign) partition: start at sector 0
+        m_sector = m_sectors - 1;
+        m_sector_seq = 0;
+        m_oldest = 0;
+        m_slot = RECORDS_PER_SECTOR; // forces openNextSector() on first write
+    }
+    else
+    {
+        // records fill a sector front to back: binary search the first erased slot
+        size_t lo = 0, hi = RECORDS_PER_SECTOR;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            uint8_t type = 0xFF;
+            esp_partition_read(p, m_sector * SECTOR_SIZE + sizeof(FlightSectorHeader) +
+                               mid * sizeof(FlightRecord) + offsetof(FlightRecord, type), &type, 1);
+            if (type == 0xFF)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        m_slot = lo;
+    }
+
+    log(FlightEvent::Reboot, (int16_t)esp_reset_reason());
+    return true;
+}
+
+void FlightRecorder::log(FlightEvent type, int16_t code, uint16_t arg, int8_t rssi)
+{
+    uint32_t claim = m_head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = m_queue[claim & (QUEUE_SIZE - 1)];
+
+    // the zero must be visible before any record byte changes (see flush())
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    time_t now = time(nullptr);
+    FlightRecord& r = slot.rec;
+    r.epoch = (now > 1000000000) ? (uint32_t)now : 0;
+    r.uptime_ms = millis();
+    r.type = static_cast<uint8_t>(type);
+    r.rssi = rssi;
+    r.code = code;
+    r.arg = arg;
+    r.reserved = 0;
+    r.crc = crc8(reinterpret_cast<const uint8_t*>(&r), offsetof(FlightRecord, crc));
+
+    slot.seq.store(claim + 1, std::memory_order_release);
+}
+
+void FlightRecorder::flush(bool force)
+{
+    if (m_part == nullptr)
+        return;
+
+    uint32_t head = m_head.load(std::memory_order_acquire);
+
+    // producers lapped us: the overwritten records are gone
+    if (head - m_tail > QUEUE_SIZE)
+    {
+        m_dropped.fetch_add(head - m_tail - QUEUE_SIZE, std::memory_order_relaxed);
+        m_tail = head - QUEUE_SIZE;
+    }
+
+    size_t ready = 0;
+    while (m_tail + ready != head &&
+           m_queue[(m_tail + ready) & (QUEUE_SIZE - 1)].seq.load(std::memory_order_acquire) == m_tail + ready + 1)
+    {
+        ++ready;
+    }
+
+    if (ready == 0)
+        return;
+
+    if (!force && ready < BATCH_RECORDS &&
+        (millis() - m_queue[m_tail & (QUEUE_SIZE - 1)].rec.uptime_ms) < BATCH_MAX_AGE_MS)
+    {
+        return; // batch not due yet
+    }
+
+    FlightRecord batch[QUEUE_SIZE];
+    for (size_t i = 0; i < ready; ++i)
+        batch[i] = m_queue[(m_tail + i) & (QUEUE_SIZE - 1)].rec;
+
+    // seqlock re-check: a producer that lapped us during the copy has changed seq.
+    // Stop at the first torn record; the lap is counted as dropped on the next pass.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    size_t intact = 0;
+    while (intact < ready &&
+           m_queue[(m_tail + intact) & (QUEUE_SIZE - 1)].seq.load(std::memory_order_relaxed) == m_tail + intact + 1)
+    {
+        ++intact;
+    }
+    m_tail += intact;
+
+    if (intact > 0)
+        writeRecords(batch, intact);
+}
+
+void FlightRecorder::openNextSector()
+{
+    m_sector = (m_sector + 1) % m_sectors;
+    m_sector_seq++;
+    m_slot = 0;
+
+    // the ring is full: the sector we are about to erase held the oldest data
+    FlightSectorHeader h;
+    if (m_sector == m_oldest && readHeader(m_sector, h))
+        m_oldest = (m_oldest + 1) % m_sectors;
+
+    esp_partition_erase_range(part(m_part), m_sector * SECTOR_SIZE, SECTOR_SIZE);
+}
+
+void FlightRecorder::writeRecords(const FlightRecord* recs, size_t count)
+{
+    while (count > 0)
+    {
+        if (m_slot >= RECORDS_PER_SECTOR)
+            openNextSector();
+
+        if (m_slot == 0)
+        {
+            FlightSectorHeader h;
+            h.magic = FLIGHT_MAGIC;
+            h.seq = m_sector_seq;
+            h.first_epoch = recs[0].epoch;
+            h.version = FORMAT_VERSION;
+            h.crc = crc8(reinterpret_cast<const uint8_t*>(&h), offsetof(FlightSectorHeader, crc));
+            esp_partition_write(part(m_part), m_sector * SECTOR_SIZE, &h, sizeof(h));
+        }
+
+        size_t room = RECORDS_PER_SECTOR - m_slot;
+        size_t n = (count < room) ? count : room;
+        esp_partition_write(part(m_part),
+                            m_sector * SECTOR_SIZE + sizeof(FlightSectorHeader) + m_slot * sizeof(FlightRecord),
+                            recs, n * sizeof(FlightRecord));
+
+        m_slot += n;
+        recs += n;
+        count -= n;
+    }
+}
+
+bool FlightRecorder::readSector(uint32_t& cursor, uint8_t* buf, uint32_t since_epoch)
+{
+    while (m_part != nullptr && cursor < m_sectors)
+    {
+        size_t s = (m_oldest + cursor) % m_sectors;
+        cursor++;
+
+        FlightSectorHeader h;
+        if (!readHeader(s, h))
+            continue;
+
+        // the next sector's first record bounds this one from above
+        if (since_epoch != 0 && s != m_sector)
+        {
+            FlightSectorHeader next;
+            size_t ns = (s + 1) % m_sectors;
+            if (readHeader(ns, next) && next.seq == h.seq + 1 &&
+                next.first_epoch != 0 && next.first_epoch < since_epoch)
+            {
+                continue;
+            }
+        }
+
+        return esp_partition_read(part(m_part), s * SECTOR_SIZE, buf, SECTOR_SIZE) == ESP_OK;
+    }
+
+    return false;
+}
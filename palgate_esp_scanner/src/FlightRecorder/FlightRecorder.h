@@ -0,0 +1,120 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// On-flash layout (little-endian), shared with tools/flightlog_decode.py:
+//
+//   partition = N sectors of 4096 bytes, used round-robin (erase count is even
+//               across sectors, which is all the wear-levelling a log needs)
+//   sector    = SectorHeader (16 B) + 255 x FlightRecord (16 B)
+//
+// Erased flash reads 0xFF, so an unwritten header/record has magic/type 0xFF...
+// The header is programmed together with the sector's first record, so its
+// first_epoch is a real timestamp and sectors can be binary-searched by time.
+
+enum class FlightEvent : uint8_t
+{
+    Sighting = 1,       // matching beacon heard (code = major, arg = minor, rssi)
+    Trigger = 2,        // TriggerGate() started (arg = detection->trigger ms)
+    HttpResult = 3,     // gate request finished (code = HTTP status / error, arg = GET ms)
+    Reboot = 4,         // boot (code = esp_reset_reason())
+    GattResult = 5,     // local BLE open finished (code = GateLink::Result, arg = connect + write ms)
+    Arbitration = 6,    // multi-scanner arbitration decided (code = TriggerArbiter::Decision, arg = ms)
+};
+
+#pragma pack(push, 1)
+struct FlightRecord
+{
+    uint32_t epoch;         // UNIX seconds, 0 if NTP was not synced yet
+    uint32_t uptime_ms;     // millis() at the event
+    uint8_t type;           // FlightEvent
+    int8_t rssi;
+    int16_t code;
+    uint16_t arg;
+    uint8_t reserved;
+    uint8_t crc;            // CRC-8 over the preceding 15 bytes
+};
+
+struct FlightSectorHeader
+{
+    uint32_t magic;         // FLIGHT_MAGIC
+    uint32_t seq;           // increases by one per sector opened, never reused
+    uint32_t first_epoch;   // epoch of the first record in this sector
+    uint16_t version;
+    uint16_t crc;           // CRC-8 of the preceding 14 bytes (upper byte 0)
+};
+#pragma pack(pop)
+
+static_assert(sizeof(FlightRecord) == 16, "FlightRecord must stay 16 bytes");
+static_assert(sizeof(FlightSectorHeader) == 16, "FlightSectorHeader must stay 16 bytes");
+
+
+/**
+ * @brief Append-only event log in the "flightlog" flash partition.
+ *
+ * log() only touches a RAM ring (atomic slot claim, no flash, no locks), so it
+ * can be called from the BLE callback. flush() runs from loop() and writes
+ * whole batches; flash is never touched on the detection path. flush() reads
+ * slots as a seqlock and never writes a record a producer rewrote mid-copy.
+ */
+class FlightRecorder
+{
+public:
+    static const uint32_t FLIGHT_MAGIC = 0x52464750;    // "PGFR"
+    static const uint16_t FORMAT_VERSION = 1;
+    static const size_t SECTOR_SIZE = 4096;
+    static const size_t RECORDS_PER_SECTOR = (SECTOR_SIZE - sizeof(FlightSectorHeader)) / sizeof(FlightRecord);
+    static const size_t QUEUE_SIZE = 64;                // power of two
+    static const size_t BATCH_RECORDS = 16;             // flush once this many are queued...
+    static const uint32_t BATCH_MAX_AGE_MS = 60000;     // ...or the oldest is this old
+
+    // Locate the partition and resume after the newest record. Returns false if
+    // the partition table has no "flightlog" partition (logging is then a no-op).
+    bool begin();
+
+    // Queue one record. Lock-free; safe from any task.
+    void log(FlightEvent type, int16_t code = 0, uint16_t arg = 0, int8_t rssi = 0);
+
+    // Write queued records to flash if a batch is due (or always when force=true).
+    // Call from loop() only.
+    void flush(bool force = false);
+
+    // Streaming export: sectors oldest-first. `since_epoch` skips sectors that end before it.
+    // Returns false when there are no more sectors. `cursor` starts at 0.
+    bool readSector(uint32_t& cursor, uint8_t* buf, uint32_t since_epoch = 0);
+
+    uint32_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    size_t sectorCount() const { return m_sectors; }
+
+    static uint8_t crc8(const uint8_t* data, size_t len);
+
+private:
+    struct Slot
+    {
+        std::atomic<uint32_t> seq;  // claim index + 1 once written
+        FlightRecord rec;
+    };
+
+    bool readHeader(size_t sector, FlightSectorHeader& h) const;
+    void openNextSector();
+    void writeRecords(const FlightRecord* recs, size_t count);
+
+    const void* m_part = nullptr;   // const esp_partition_t*
+    size_t m_sectors = 0;
+    size_t m_sector = 0;            // sector currently being filled
+    uint32_t m_sector_seq = 0;
+    size_t m_slot = 0;              // next free record index in m_sector
+    size_t m_oldest = 0;            // sector holding the oldest data
+
+    std::atomic<uint32_t> m_head{0};
+    uint32_t m_tail = 0;
+    std::atomic<uint32_t> m_dropped{0};
+    Slot m_queue[QUEUE_SIZE] = {};
+};
+
+extern FlightRecorder g_flight;
+
+#endif // #ifndef FLIGHT_RECORDER_H
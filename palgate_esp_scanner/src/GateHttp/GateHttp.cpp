@@ -0,0 +1,358 @@
+#include "GateHttp.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#include "TaskTopology.h"   // TaskTopology::nowUs()
+
+bool GateHttp::connect(const char* host, uint16_t port, uint32_t timeout_ms)
+{
+    close();
+    m_connected = m_transport.connect(host, port, timeout_ms);
+    return m_connected;
+}
+
+void GateHttp::close()
+{
+    if (m_connected)
+        m_transport.close();
+    m_connected = false;
+}
+
+int GateHttp::get(const char* host, const char* path, const char* header, const char* value, uint32_t timeout_ms)
+{
+    m_body = "";
+    m_body_len = 0;
+    m_truncated = false;
+    if (!m_connected)
+        return ERROR_NOT_CONNECTED;
+
+    int len = snprintf(m_request, sizeof(m_request),
+                       "GET %s HTTP/1.1\r\nHost: %s\r\n%s: %s\r\nUser-Agent: palgate-scanner\r\nConnection: close\r\n\r\n",
+                       path, host, header, value);
+    if (len < 0 || (size_t)len >= sizeof(m_request))
+        return ERROR_SEND_FAILED;
+    if (!m_transport.write(reinterpret_cast<const uint8_t*>(m_request), (size_t)len))
+        return ERROR_SEND_FAILED;
+
+    return readResponse(timeout_ms);
+}
+
+// Case-insensitive prefix match of a header line.
+static bool headerIs(const char* line, const char* name)
+{
+    size_t n = strlen(name);
+    return strncasecmp(line, name, n) == 0 && line[n] == ':';
+}
+
+int GateHttp::readResponse(uint32_t timeout_ms)
+{
+    const uint64_t deadline_us = TaskTopology::nowUs() + (uint64_t)timeout_ms * 1000;
+    size_t have = 0;
+    char* body = nullptr;           // first byte after the header block
+    int status = 0;
+    long content_length = -1;       // -1: until the server closes
+    size_t body_total = 0;          // body bytes received, including those that did not fit
+
+    for (;;)
+    {
+        if (body != nullptr && content_length >= 0 && body_total >= (size_t)content_length)
+            break;
+
+        uint64_t now_us = TaskTopology::nowUs();
+        if (now_us >= deadline_us)
+            return status != 0 ? status : ERROR_READ_TIMEOUT;
+
+        // past the buffer: keep reading (the connection is closed afterwards anyway), keep nothing
+        uint8_t discard[64];
+        const bool full = (have >= RESPONSE_CAP);
+        uint8_t* dst = full ? discard : reinterpret_cast<uint8_t*>(m_response) + have;
+        size_t cap = full ? sizeof(discard) : RESPONSE_CAP - have;
+
+        int n = m_transport.read(dst, cap, (uint32_t)((deadline_us - now_us + 999) / 1000));
+        if (n == TlsTransport::READ_CLOSED)
+        {
+            if (body == nullptr)
+                return ERROR_CONNECTION_LOST;
+            break;
+        }
+        if (n < 0)
+        {
+            if (status != 0)
+                break;      // headers are in: a body cut short still carries the status
+            return n == TlsTransport::READ_TIMEOUT ? ERROR_READ_TIMEOUT : ERROR_CONNECTION_LOST;
+        }
+
+        if (full)
+            m_truncated = true;
+        else
+            have += (size_t)n;
+        if (body != nullptr)
+        {
+            body_total += (size_t)n;
+            continue;
+        }
+
+        m_response[have] = '\0';
+        char* end = strstr(m_response, "\r\n\r\n");
+        if (end == nullptr)
+        {
+            if (have >= RESPONSE_CAP)
+                return ERROR_NO_HTTP_SERVER;    // header block larger than the buffer
+            continue;
+        }
+
+        // status line and the one header that matters
+        if (strncmp(m_response, "HTTP/1.", 7) != 0 || sscanf(m_response + 8, " %3d", &status) != 1 || status < 100)
+            return ERROR_NO_HTTP_SERVER;
+        *end = '\0';
+        for (char* line = strstr(m_response, "\r\n"); line != nullptr; line = strstr(line, "\r\n"))
+        {
+            line += 2;
+            if (headerIs(line, "Content-Length"))
+                content_length = strtol(line + 15, nullptr, 10);
+        }
+        body = end + 4;
+        body_total = have - (size_t)(body - m_response);
+    }
+
+    m_body = body;
+    m_body_len = (size_t)(m_response + have - body);
+    if (content_length >= 0 && m_body_len > (size_t)content_length)
+        m_body_len = (size_t)content_length;
+    m_response[(body - m_response) + m_body_len] = '\0';
+    return status;
+}
+
+const char* GateHttp::errorName(int code)
+{
+    switch (code)
+    {
+        case ERROR_CONNECTION_REFUSED:  return "connection refused";
+        case ERROR_SEND_FAILED:         return "send failed";
+        case ERROR_NOT_CONNECTED:       return "not connected";
+        case ERROR_CONNECTION_LOST:     return "connection lost";
+        case ERROR_NO_HTTP_SERVER:      return "no HTTP server";
+        case ERROR_READ_TIMEOUT:        return "read timeout";
+    }
+    return "?";
+}
+
+
+
+bool SpkiPins::any() const
+{
+    static const uint8_t UNUSED[DIGEST_LEN] = {};
+    for (size_t i = 0; i < COUNT; ++i)
+    {
+        if (memcmp(sha256[i], UNUSED, DIGEST_LEN) != 0)
+            return true;
+    }
+    return false;
+}
+
+bool SpkiPins::matches(const uint8_t digest[DIGEST_LEN]) const
+{
+    static const uint8_t UNUSED[DIGEST_LEN] = {};
+    for (size_t i = 0; i < COUNT; ++i)
+    {
+        // pins and key are public: no need for a constant-time compare
+        if (memcmp(sha256[i], UNUSED, DIGEST_LEN) != 0 && memcmp(sha256[i], digest, DIGEST_LEN) == 0)
+            return true;
+    }
+    return false;
+}
+
+
+
+#if defined(ESP32)
+
+#include "mbedtls/sha256.h"
+#include "mbedtls/x509_crt.h"
+
+bool MbedTlsTransport::begin()
+{
+    if (m_ready)
+        return true;
+
+    mbedtls_entropy_init(&m_entropy);
+    mbedtls_ctr_drbg_init(&m_drbg);
+    mbedtls_ssl_config_init(&m_conf);
+    mbedtls_ssl_init(&m_ssl);
+    mbedtls_net_init(&m_net);
+    mbedtls_ssl_session_init(&m_session);
+
+    static const unsigned char PERSONALIZATION[] = "palgate-scanner";
+    if (mbedtls_ctr_drbg_seed(&m_drbg, mbedtls_entropy_func, &m_entropy, PERSONALIZATION, sizeof(PERSONALIZATION) - 1) != 0 ||
+        mbedtls_ssl_config_defaults(&m_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) != 0)
+    {
+        return false;
+    }
+    mbedtls_ssl_conf_authmode(&m_conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(&m_conf, mbedtls_ctr_drbg_random, &m_drbg);
+
+    // allocates the record buffers: once, for the life of the firmware
+    m_ready = mbedtls_ssl_setup(&m_ssl, &m_conf) == 0;
+    return m_ready;
+}
+
+void MbedTlsTransport::setMaxFragment(uint16_t bytes)
+{
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    unsigned char code = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+    switch (bytes)
+    {
+        case 512:  code = MBEDTLS_SSL_MAX_FRAG_LEN_512; break;
+        case 1024: code = MBEDTLS_SSL_MAX_FRAG_LEN_1024; break;
+        case 2048: code = MBEDTLS_SSL_MAX_FRAG_LEN_2048; break;
+        case 4096: code = MBEDTLS_SSL_MAX_FRAG_LEN_4096; break;
+    }
+    // read by the next handshake's ClientHello
+    mbedtls_ssl_conf_max_frag_len(&m_conf, code);
+#endif
+}
+
+void MbedTlsTransport::setPins(const SpkiPins& pins)
+{
+    if (memcmp(&pins, &m_pins, sizeof(pins)) == 0)
+        return;
+    m_pins = pins;
+    if (m_ready)
+        forgetSession();    // pinned under the old set
+}
+
+bool MbedTlsTransport::connect(const char* host, uint16_t port, uint32_t timeout_ms)
+{
+    m_last = Handshake::Failed;
+    if (!m_ready)
+        return false;
+    close();
+
+    const uint64_t deadline_us = TaskTopology::nowUs() + (uint64_t)timeout_ms * 1000;
+    char port_text[6];
+    snprintf(port_text, sizeof(port_text), "%u", (unsigned)port);
+    if (mbedtls_net_connect(&m_net, host, port_text, MBEDTLS_NET_PROTO_TCP) != 0)
+        return false;
+    m_open = true;
+
+    mbedtls_ssl_conf_read_timeout(&m_conf, timeout_ms);
+    mbedtls_ssl_set_bio(&m_ssl, &m_net, mbedtls_net_send, mbedtls_net_recv, mbedtls_net_recv_timeout);
+    if (mbedtls_ssl_set_hostname(&m_ssl, host) != 0)
+    {
+        close();
+        return false;
+    }
+    if (m_session_host[0] != '\0' && (strcmp(m_session_host, host) != 0 || mbedtls_ssl_set_session(&m_ssl, &m_session) != 0))
+        forgetSession();
+
+    int rc;
+    while ((rc = mbedtls_ssl_handshake(&m_ssl)) != 0)
+    {
+        if ((rc != MBEDTLS_ERR_SSL_WANT_READ && rc != MBEDTLS_ERR_SSL_WANT_WRITE) || TaskTopology::nowUs() >= deadline_us)
+        {
+            close();
+            return false;
+        }
+    }
+
+    if (resumed())
+    {
+        m_last = Handshake::Resumed;
+        return true;
+    }
+    // once per full handshake, before a byte of the request goes out
+    if (!keyPinned())
+    {
+        m_last = Handshake::PinMismatch;
+        forgetSession();
+        close();
+        return false;
+    }
+    m_last = Handshake::Full;
+    saveSession(host);
+    return true;
+}
+
+// The server took the offered session: the negotiated master secret is the cached one.
+// (A full handshake derives a fresh one; this holds for session ids and tickets alike.)
+bool MbedTlsTransport::resumed() const
+{
+    return m_session_host[0] != '\0' && m_ssl.session != nullptr &&
+           memcmp(m_ssl.session->master, m_session.master, sizeof(m_session.master)) == 0;
+}
+
+bool MbedTlsTransport::keyPinned() const
+{
+    if (!m_pins.any())
+        return true;
+
+    // the leaf as parsed by this handshake (MBEDTLS_SSL_KEEP_PEER_CERTIFICATE, on in the IDF)
+    const mbedtls_x509_crt* leaf = mbedtls_ssl_get_peer_cert(&m_ssl);
+    if (leaf == nullptr || leaf->pk_raw.p == nullptr)
+        return false;
+    uint8_t digest[SpkiPins::DIGEST_LEN];
+    if (mbedtls_sha256_ret(leaf->pk_raw.p, leaf->pk_raw.len, digest, 0) != 0)
+        return false;
+    return m_pins.matches(digest);
+}
+
+void MbedTlsTransport::saveSession(const char* host)
+{
+    forgetSession();
+    // a copy incl. the peer certificate: it stays allocated (in the arena) until replaced
+    if (strlen(host) < sizeof(m_session_host) && mbedtls_ssl_get_session(&m_ssl, &m_session) == 0)
+        strcpy(m_session_host, host);
+}
+
+void MbedTlsTransport::forgetSession()
+{
+    mbedtls_ssl_session_free(&m_session);
+    mbedtls_ssl_session_init(&m_session);
+    m_session_host[0] = '\0';
+}
+
+bool MbedTlsTransport::write(const uint8_t* data, size_t len)
+{
+    while (len > 0)
+    {
+        int n = mbedtls_ssl_write(&m_ssl, data, len);
+        if (n == MBEDTLS_ERR_SSL_WANT_READ || n == MBEDTLS_ERR_SSL_WANT_WRITE)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+int MbedTlsTransport::read(uint8_t* buf, size_t cap, uint32_t timeout_ms)
+{
+    mbedtls_ssl_conf_read_timeout(&m_conf, timeout_ms);
+    for (;;)
+    {
+        int n = mbedtls_ssl_read(&m_ssl, buf, cap);
+        if (n > 0)
+            return n;
+        if (n == MBEDTLS_ERR_SSL_WANT_READ || n == MBEDTLS_ERR_SSL_WANT_WRITE)
+            continue;
+        if (n == 0 || n == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)
+            return READ_CLOSED;
+        return n == MBEDTLS_ERR_SSL_TIMEOUT ? READ_TIMEOUT : READ_ERROR;
+    }
+}
+
+void MbedTlsTransport::close()
+{
+    if (!m_open)
+        return;
+    mbedtls_ssl_close_notify(&m_ssl);
+    mbedtls_net_free(&m_net);
+    // frees the session and handshake state; the record buffers stay
+    mbedtls_ssl_session_reset(&m_ssl);
+    m_open = false;
+}
+
+#endif
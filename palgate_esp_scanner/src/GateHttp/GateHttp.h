@@ -0,0 +1,186 @@
+#ifndef GATE_HTTP_H
+#define GATE_HTTP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(ESP32)
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/net_sockets.h"
+#endif
+
+/**
+ * @brief SHA-256 pins of a server's public key: the hash of the leaf certificate's
+ *        DER SubjectPublicKeyInfo, as HPKP's pin-sha256 (in hex here).
+ *
+ * Two slots, the key in use and a backup key, so the host can rotate its key (or
+ * renew its certificate with a new one) without a reflash. An all-zero slot is unused.
+ * Pinning the key rather than checking the chain authenticates the host without a
+ * trust store or a signature check per chain link.
+ */
+struct SpkiPins
+{
+    static const size_t COUNT = 2;
+    static const size_t DIGEST_LEN = 32;
+
+    uint8_t sha256[COUNT][DIGEST_LEN];
+
+    // True if at least one slot is set.
+    bool any() const;
+
+    // True if `digest` equals a set slot.
+    bool matches(const uint8_t digest[DIGEST_LEN]) const;
+};
+
+/**
+ * @brief A TLS byte stream to one server.
+ *
+ * The firmware uses MbedTlsTransport. tools/tls_soak.cpp implements it with
+ * OpenSSL against a local mock of the PalGate API, so GateHttp and the TLS arena
+ * run on Linux for thousands of requests.
+ */
+class TlsTransport
+{
+public:
+    static const int READ_CLOSED = 0;
+    static const int READ_ERROR = -1;
+    static const int READ_TIMEOUT = -2;
+
+    virtual ~TlsTransport() {}
+
+    // TCP connect and TLS handshake; the handshake gives up after `timeout_ms`.
+    virtual bool connect(const char* host, uint16_t port, uint32_t timeout_ms) = 0;
+
+    // Write all of `data`; false if the connection failed.
+    virtual bool write(const uint8_t* data, size_t len) = 0;
+
+    // Bytes read (> 0), READ_CLOSED, READ_ERROR or READ_TIMEOUT.
+    virtual int read(uint8_t* buf, size_t cap, uint32_t timeout_ms) = 0;
+
+    // Close the connection; the transport stays ready for the next connect().
+    virtual void close() = 0;
+};
+
+
+/**
+ * @brief The gate's HTTPS GET, in fixed buffers.
+ *
+ * One request per connection ("Connection: close"). The request is formatted
+ * into, and the response read into, buffers that live as long as the object, so
+ * a trigger allocates nothing; a response longer than the buffer is read to the
+ * end and truncated.
+ *
+ * Single owner: the net task.
+ */
+class GateHttp
+{
+public:
+    // Same numbers as HTTPClient's HTTPC_ERROR_*, so /metrics and flight logs keep their meaning.
+    static const int ERROR_CONNECTION_REFUSED = -1;
+    static const int ERROR_SEND_FAILED = -2;
+    static const int ERROR_NOT_CONNECTED = -4;
+    static const int ERROR_CONNECTION_LOST = -5;
+    static const int ERROR_NO_HTTP_SERVER = -7;
+    static const int ERROR_READ_TIMEOUT = -11;
+
+    static const size_t REQUEST_CAP = 512;
+    static const size_t RESPONSE_CAP = 1024;
+
+    explicit GateHttp(TlsTransport& transport) : m_transport(transport) {}
+
+    bool connect(const char* host, uint16_t port, uint32_t timeout_ms);
+
+    // Send the GET with one extra header; wait for the response. Needs connect().
+    // @return HTTP status, or a negative ERROR_*.
+    int get(const char* host, const char* path, const char* header, const char* value, uint32_t timeout_ms);
+
+    void close();
+
+    // Body of the last response (NUL-terminated, truncated to what the buffer held).
+    const char* body() const { return m_body; }
+    size_t bodyLength() const { return m_body_len; }
+    bool truncated() const { return m_truncated; }
+
+    static const char* errorName(int code);
+
+private:
+    int readResponse(uint32_t timeout_ms);
+
+    TlsTransport& m_transport;
+    bool m_connected = false;
+    char m_request[REQUEST_CAP];
+    char m_response[RESPONSE_CAP + 1];
+    const char* m_body = "";
+    size_t m_body_len = 0;
+    bool m_truncated = false;
+};
+
+
+#if defined(ESP32)
+
+/**
+ * @brief TlsTransport over mbedTLS and lwIP sockets.
+ *
+ * RNG, configuration and SSL context (with its record buffers) are set up once by
+ * begin() and reused: close() only resets the session. Allocations happen on the
+ * calling task, so with hookMbedTls() on the net task they all come from the TLS arena.
+ *
+ * The server is authenticated by its key alone (setPins()): the chain is not
+ * validated. After a full handshake the leaf's SubjectPublicKeyInfo is hashed and
+ * checked against the pins, and the session is kept; the next connect() offers it
+ * and, if the server resumes it, skips both the key exchange and the pin check: a
+ * resumed session proves the server holds the master secret of a pinned one.
+ */
+class MbedTlsTransport : public TlsTransport
+{
+public:
+    // How the last connect() went.
+    enum class Handshake : uint8_t
+    {
+        Failed,         // TCP connect or handshake failed
+        Full,           // full handshake, key pinned (or no pins set)
+        Resumed,        // abbreviated handshake on the session of an earlier full one
+        PinMismatch,    // full handshake, the server's key is not pinned: connection dropped
+    };
+
+    bool begin();
+
+    // Ask the server for records of at most `bytes` (512, 1024, 2048 or 4096;
+    // 0 = no limit) from the next connect() on. Unsupported values are ignored.
+    void setMaxFragment(uint16_t bytes);
+
+    // Server key pins from the next connect() on; no pins set = the server is not
+    // authenticated. A changed set forgets the cached session.
+    void setPins(const SpkiPins& pins);
+
+    Handshake lastHandshake() const { return m_last; }
+
+    bool connect(const char* host, uint16_t port, uint32_t timeout_ms) override;
+    bool write(const uint8_t* data, size_t len) override;
+    int read(uint8_t* buf, size_t cap, uint32_t timeout_ms) override;
+    void close() override;
+
+private:
+    bool resumed() const;
+    bool keyPinned() const;
+    void saveSession(const char* host);
+    void forgetSession();
+
+    mbedtls_entropy_context m_entropy;
+    mbedtls_ctr_drbg_context m_drbg;
+    mbedtls_ssl_config m_conf;
+    mbedtls_ssl_context m_ssl;
+    mbedtls_net_context m_net;
+    mbedtls_ssl_session m_session;      // last pinned session, offered on the next connect()
+    char m_session_host[64] = "";       // host it belongs to; empty = no session
+    SpkiPins m_pins = {};
+    Handshake m_last = Handshake::Failed;
+    bool m_ready = false;
+    bool m_open = false;
+};
+
+#endif
+
+#endif // #ifndef GATE_HTTP_H
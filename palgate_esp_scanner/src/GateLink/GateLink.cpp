@@ -0,0 +1,241 @@
+#include "GateLink.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "TaskTopology.h"   // TaskTopology::nowUs()
+
+#if !defined(ESP32)
+#include <chrono>
+#include <thread>
+#endif
+
+// One scheduler tick (1 ms on the device), while the other path's send resolves.
+static void pauseOneMs()
+{
+#if defined(ESP32)
+    vTaskDelay(1);
+#else
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+}
+
+OpenRace::Grant OpenRace::reserve(uint32_t trace_id, Path path, uint32_t wait_ms)
+{
+    const uint64_t deadline_us = TaskTopology::nowUs() + (uint64_t)wait_ms * 1000;
+    uint32_t s = m_state.load(std::memory_order_acquire);
+    for (;;)
+    {
+        // another trace's state, or released: take it
+        if (traceOf(s) != traceKey(trace_id) || stateOf(s) == FREE)
+        {
+            if (m_state.compare_exchange_weak(s, pack(trace_id, RESERVED, path), std::memory_order_acq_rel))
+                return Grant::Granted;
+            continue;
+        }
+        if (stateOf(s) == OPENED)
+            return Grant::Decided;
+        if (pathOf(s) == path)
+            return Grant::Granted;
+
+        // the other path's send is in flight: wait for its confirm() or release()
+        if (TaskTopology::nowUs() >= deadline_us)
+            return Grant::Busy;
+        pauseOneMs();
+        s = m_state.load(std::memory_order_acquire);
+    }
+}
+
+void OpenRace::release(uint32_t trace_id, Path path)
+{
+    uint32_t held = pack(trace_id, RESERVED, path);
+    m_state.compare_exchange_strong(held, pack(trace_id, FREE, path), std::memory_order_acq_rel);
+}
+
+bool OpenRace::confirm(uint32_t trace_id, Path path)
+{
+    uint32_t s = m_state.load(std::memory_order_acquire);
+    for (;;)
+    {
+        if (traceOf(s) == traceKey(trace_id) && stateOf(s) == OPENED)
+            return pathOf(s) == path;
+        // reserved by us, or (after a Busy) free or held by the other path: the first confirm wins
+        if (m_state.compare_exchange_weak(s, pack(trace_id, OPENED, path), std::memory_order_acq_rel))
+            return true;
+    }
+}
+
+bool GateLink::enabled(const GateLinkTarget& target)
+{
+    if (!AVAILABLE)
+        return false;
+    for (uint8_t b : target.addr)
+    {
+        if (b != 0)
+            return true;
+    }
+    return false;
+}
+
+GateLink::Result GateLink::open(const GateLinkTarget& target, const uint8_t* payload, size_t len,
+                                uint32_t trace_id, OpenRace& race, Timing& timing)
+{
+    if (!enabled(target))
+        return Result::Disabled;
+    if (race.decided(trace_id))
+        return Result::Cancelled;
+
+    uint64_t t0 = TaskTopology::nowUs();
+    if (!m_transport.connect(target.addr, target.timeout_ms))
+    {
+        timing.connect_us = (uint32_t)(TaskTopology::nowUs() - t0);
+        return Result::ConnectFailed;
+    }
+    uint64_t t1 = TaskTopology::nowUs();
+    timing.connect_us = (uint32_t)(t1 - t0);
+
+    // last point where the cloud path can still make this one redundant
+    if (race.reserve(trace_id, OpenRace::Path::Local, target.timeout_ms) == OpenRace::Grant::Decided)
+    {
+        m_transport.disconnect();
+        return Result::Cancelled;
+    }
+
+    uint64_t t2 = TaskTopology::nowUs();
+    bool written = m_transport.write(target.service, target.characteristic, payload, len);
+    timing.write_us = (uint32_t)(TaskTopology::nowUs() - t2);
+    m_transport.disconnect();
+
+    if (!written)
+    {
+        race.release(trace_id, OpenRace::Path::Local);
+        return Result::WriteFailed;
+    }
+    race.confirm(trace_id, OpenRace::Path::Local);
+    return Result::Opened;
+}
+
+const char* GateLink::resultName(Result r)
+{
+    switch (r)
+    {
+        case Result::Opened:        return "opened";
+        case Result::Disabled:      return "disabled";
+        case Result::ConnectFailed: return "connect_failed";
+        case Result::WriteFailed:   return "write_failed";
+        case Result::Cancelled:     return "cancelled";
+    }
+    return "?";
+}
+
+bool GateLink::parseAddress(const char* text, uint8_t out[6])
+{
+    unsigned v[6];
+    char sep[5];
+    int n = sscanf(text, "%2x%c%2x%c%2x%c%2x%c%2x%c%2x", &v[0], &sep[0], &v[1], &sep[1], &v[2], &sep[2],
+                   &v[3], &sep[3], &v[4], &sep[4], &v[5]);
+    if (n != 11 || strlen(text) != 17)
+        return false;
+    for (char c : sep)
+    {
+        if (c != ':' && c != '-')
+            return false;
+    }
+    for (int i = 0; i < 6; ++i)
+        out[i] = (uint8_t)v[i];
+    return true;
+}
+
+
+#if defined(ESP32) && defined(PALGATE_NO_LOCAL_OPEN)
+
+bool BleGattTransport::connect(const uint8_t addr[6], uint32_t timeout_ms) { return false; }
+bool BleGattTransport::write(const uint8_t service[16], const uint8_t characteristic[16], const uint8_t* data, size_t len) { return false; }
+void BleGattTransport::disconnect() {}
+
+#elif defined(ESP32)
+
+#include <BLEDevice.h>
+#include <BLEClient.h>
+#include "esp_gattc_api.h"
+
+static BLEUUID toBleUuid(const uint8_t uuid[16])
+{
+    char text[37];
+    snprintf(text, sizeof(text), "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+             uuid[0], uuid[1], uuid[2], uuid[3], uuid[4], uuid[5], uuid[6], uuid[7],
+             uuid[8], uuid[9], uuid[10], uuid[11], uuid[12], uuid[13], uuid[14], uuid[15]);
+    return BLEUUID(text);
+}
+
+bool BleGattTransport::connect(const uint8_t addr[6], uint32_t timeout_ms)
+{
+    if (m_client == nullptr)
+        m_client = BLEDevice::createClient();
+
+    char text[18];
+    snprintf(text, sizeof(text), "%02x:%02x:%02x:%02x:%02x:%02x", addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
+    return m_client->connect(BLEAddress(std::string(text)), BLE_ADDR_TYPE_PUBLIC, timeout_ms);
+}
+
+// Status of the one write in flight (the local task issues one at a time), set by the
+// GATTC event handler on the BT task.
+static const int WRITE_PENDING = -1;
+static std::atomic<int> s_write_status{WRITE_PENDING};
+static std::atomic<uint32_t> s_write_key{0};    // conn_id << 16 | attribute handle being written
+
+static void onGattcEvent(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t* param)
+{
+    if (event != ESP_GATTC_WRITE_CHAR_EVT)
+        return;
+    uint32_t key = ((uint32_t)param->write.conn_id << 16) | param->write.handle;
+    if (key == s_write_key.load(std::memory_order_acquire))
+        s_write_status.store((int)param->write.status, std::memory_order_release);
+}
+
+bool BleGattTransport::write(const uint8_t service[16], const uint8_t characteristic[16], const uint8_t* data, size_t len)
+{
+    BLERemoteService* svc = m_client->getService(toBleUuid(service));      // discovery on first use per link
+    if (svc == nullptr)
+        return false;
+    BLERemoteCharacteristic* chr = svc->getCharacteristic(toBleUuid(characteristic));
+    if (chr == nullptr || !chr->canWrite())
+        return false;
+
+    static bool s_handler_set = false;
+    if (!s_handler_set)
+    {
+        BLEDevice::setCustomGattcHandler(onGattcEvent);
+        s_handler_set = true;
+    }
+
+    // not writeValue(): it waits for the response but discards its status
+    s_write_status.store(WRITE_PENDING, std::memory_order_relaxed);
+    s_write_key.store(((uint32_t)m_client->getConnId() << 16) | chr->getHandle(), std::memory_order_release);
+    if (esp_ble_gattc_write_char(m_client->getGattcIf(), m_client->getConnId(), chr->getHandle(), (uint16_t)len,
+                                 const_cast<uint8_t*>(data), ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE) != ESP_OK)
+    {
+        s_write_key.store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint64_t deadline_us = TaskTopology::nowUs() + (uint64_t)WRITE_TIMEOUT_MS * 1000;
+    int status = WRITE_PENDING;
+    while ((status = s_write_status.load(std::memory_order_acquire)) == WRITE_PENDING &&
+           m_client->isConnected() && TaskTopology::nowUs() < deadline_us)
+    {
+        vTaskDelay(1);
+    }
+    s_write_key.store(0, std::memory_order_relaxed);
+
+    // no response (link lost, timeout) counts as not written: the cloud request goes ahead
+    return status == ESP_GATT_OK;
+}
+
+void BleGattTransport::disconnect()
+{
+    if (m_client != nullptr && m_client->isConnected())
+        m_client->disconnect();
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef GATE_LINK_H
+#define GATE_LINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * @brief The GATT client operations a local gate open needs.
+ *
+ * The firmware uses BleGattTransport (Bluedroid BLEClient). tools/gate_link_sim.cpp
+ * implements a simulated PalGate unit, so the open path and the race against the
+ * cloud request run on Linux without BlueZ or a radio.
+ */
+class GattTransport
+{
+public:
+    virtual ~GattTransport() {}
+
+    // Connect to the peripheral at `addr` (public address, most significant byte first).
+    virtual bool connect(const uint8_t addr[6], uint32_t timeout_ms) = 0;
+
+    // Write `len` bytes to `characteristic` of `service` (128-bit UUIDs, text order),
+    // with response: true only once the peer acknowledged the write with success.
+    virtual bool write(const uint8_t service[16], const uint8_t characteristic[16], const uint8_t* data, size_t len) = 0;
+
+    virtual void disconnect() = 0;
+};
+
+
+/**
+ * @brief First-success-wins arbitration between the open paths of one trigger.
+ *
+ * A path reserves the trigger right before its irrevocable step (GATT write, HTTP GET),
+ * then confirms once the peer acknowledged it or releases it on failure. While one
+ * path's send is in flight the other waits for its outcome instead of assuming it: a
+ * confirmed open cancels the other path, a released one lets it go ahead. Only a
+ * confirmed open ever cancels anything. If the wait runs out, the waiting path sends
+ * anyway (Busy): opening twice is better than not opening.
+ * Lock-free (one 32-bit CAS word: the ESP32 has no 64-bit atomics and libatomic would
+ * take a lock); shared by the net and local tasks.
+ */
+class OpenRace
+{
+public:
+    enum class Path : uint8_t { Cloud = 1, Local = 2 };
+
+    enum class Grant : uint8_t
+    {
+        Granted,        // reserved for this path: send, then confirm() or release()
+        Decided,        // the other path confirmed an open: do not send
+        Busy,           // the other path's send was still unresolved after wait_ms
+    };
+
+    // Reserve `trace_id`'s send for `path`, waiting up to `wait_ms` while the other path holds it.
+    Grant reserve(uint32_t trace_id, Path path, uint32_t wait_ms);
+
+    // The send failed (or was never made): let the other path go ahead.
+    void release(uint32_t trace_id, Path path);
+
+    // The peer acknowledged the send. True if this path opened the gate first.
+    bool confirm(uint32_t trace_id, Path path);
+
+    // True once some path confirmed an open for `trace_id`.
+    bool decided(uint32_t trace_id) const
+    {
+        uint32_t s = m_state.load(std::memory_order_acquire);
+        return traceOf(s) == traceKey(trace_id) && stateOf(s) == OPENED;
+    }
+
+    // True if `path` confirmed the open for `trace_id` (it won the race).
+    bool wonBy(uint32_t trace_id, Path path) const
+    {
+        return m_state.load(std::memory_order_acquire) == pack(trace_id, OPENED, path);
+    }
+
+private:
+    static const uint8_t FREE = 0, RESERVED = 1, OPENED = 2;
+
+    // low 28 bits of the trace id, then path (2 bits), then state (2 bits). Only the
+    // latest trigger is ever compared, so ids 2^28 apart never meet.
+    static uint32_t traceKey(uint32_t trace_id) { return trace_id & 0x0FFFFFFFu; }
+    static uint32_t pack(uint32_t trace_id, uint8_t state, Path path)
+    {
+        return (traceKey(trace_id) << 4) | ((uint32_t)path << 2) | state;
+    }
+    static uint32_t traceOf(uint32_t s) { return s >> 4; }
+    static uint8_t stateOf(uint32_t s) { return (uint8_t)(s & 3); }
+    static Path pathOf(uint32_t s) { return (Path)(uint8_t)((s >> 2) & 3); }
+
+    std::atomic<uint32_t> m_state{0};
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "OpenRace must not take a lock");
+};
+
+
+/** @brief Where the gate's own BLE interface lives (RuntimeConfig gate_ble_*). */
+struct GateLinkTarget
+{
+    uint8_t addr[6];                // all zero = local path disabled
+    uint8_t service[16];
+    uint8_t characteristic[16];
+    uint32_t timeout_ms;            // connection attempt budget
+};
+
+
+/**
+ * @brief Local open path: connect to the PalGate unit as a GATT client and write the
+ *        same x-bt-token the cloud request carries.
+ *
+ * open() blocks for up to the connect timeout plus one write round trip, so it
+ * runs on its own task ("local"), next to the net task's HTTPS request.
+ */
+class GateLink
+{
+public:
+    enum class Result : int8_t
+    {
+        Opened = 0,         // token written and acknowledged (the race is confirmed)
+        Disabled,           // no gate address configured
+        ConnectFailed,
+        WriteFailed,        // service/characteristic missing, write rejected or not acknowledged
+        Cancelled,          // the other path confirmed an open first; nothing written
+    };
+
+    struct Timing
+    {
+        uint32_t connect_us = 0;
+        uint32_t write_us = 0;
+    };
+
+    // Builds with PALGATE_NO_LOCAL_OPEN (the lean profile) link no BLEClient code; the
+    // local path is then never enabled and the cloud request opens the gate alone.
+#ifdef PALGATE_NO_LOCAL_OPEN
+    static const bool AVAILABLE = false;
+#else
+    static const bool AVAILABLE = true;
+#endif
+
+    explicit GateLink(GattTransport& transport) : m_transport(transport) {}
+
+    static bool enabled(const GateLinkTarget& target);
+
+    // Reserves `race` for the write and confirms or releases it with the outcome.
+    // Waits at most target.timeout_ms for a cloud request in flight to resolve.
+    Result open(const GateLinkTarget& target, const uint8_t* payload, size_t len,
+                uint32_t trace_id, OpenRace& race, Timing& timing);
+
+    static const char* resultName(Result r);
+
+    // Parse "aa:bb:cc:dd:ee:ff" (also accepts '-' separators). False on malformed input.
+    static bool parseAddress(const char* text, uint8_t out[6]);
+
+private:
+    GattTransport& m_transport;
+};
+
+
+#if defined(ESP32)
+
+class BLEClient;
+
+/**
+ * @brief GattTransport over the Arduino BLE library (shares the scanner's BLEDevice).
+ *
+ * The library's writeValue() drops the ATT status of the write response, so write()
+ * issues the request itself and takes the status from ESP_GATTC_WRITE_CHAR_EVT
+ * (a custom GATTC handler); no response within WRITE_TIMEOUT_MS is a failure.
+ */
+class BleGattTransport : public GattTransport
+{
+public:
+    static const uint32_t WRITE_TIMEOUT_MS = 2000;
+
+    bool connect(const uint8_t addr[6], uint32_t timeout_ms) override;
+    bool write(const uint8_t service[16], const uint8_t characteristic[16], const uint8_t* data, size_t len) override;
+    void disconnect() override;
+
+private:
+    BLEClient* m_client = nullptr;      // created once, reused across opens
+};
+
+#endif
+
+#endif // #ifndef GATE_LINK_H
@@ -0,0 +1,225 @@
+#include "Metrics.h"
+
+#include <cstdio>
+
+ScannerMetrics g_metrics;
+
+
+//===========================================================
+// LogHistogram
+//===========================================================
+
+size_t LogHistogram::bucketIndex(uint32_t value)
+{
+    if (value < SUB_COUNT)
+        return value;
+
+    uint32_t exp = 31u - static_cast<uint32_t>(__builtin_clz(value));    // position of the top set bit
+    if (exp >= MAX_EXP)
+        return BUCKETS - 1;
+
+    uint32_t shift = exp - SUB_BITS;
+    uint32_t sub = (value >> shift) & (SUB_COUNT - 1);
+    return SUB_COUNT + (exp - SUB_BITS) * SUB_COUNT + sub;
+}
+
+uint32_t LogHistogram::bucketLowerBound(size_t index)
+{
+    if (index < SUB_COUNT)
+        return static_cast<uint32_t>(index);
+
+    uint32_t rel = static_cast<uint32_t>(index - SUB_COUNT);
+    uint32_t shift = rel / SUB_COUNT;
+    uint32_t sub = rel % SUB_COUNT;
+    return (SUB_COUNT + sub) << shift;
+}
+
+uint32_t LogHistogram::bucketUpperBound(size_t index)
+{
+    if (index + 1 >= BUCKETS)
+        return UINT32_MAX;
+    return bucketLowerBound(index + 1) - 1;
+}
+
+
+//===========================================================
+// StatusCodeCounter
+//===========================================================
+
+void StatusCodeCounter::inc(int code)
+{
+    // linear probe from a cheap hash; at most SLOTS steps
+    size_t start = static_cast<uint32_t>(code) % SLOTS;
+    for (size_t n = 0; n < SLOTS; ++n)
+    {
+        size_t i = (start + n) % SLOTS;
+        int32_t cur = m_codes[i].load(std::memory_order_relaxed);
+
+        if (cur == EMPTY)
+        {
+            int32_t expected = EMPTY;
+            if (m_codes[i].compare_exchange_strong(expected, code, std::memory_order_relaxed))
+                cur = code;
+            else
+                cur = expected; // another task claimed it first
+        }
+
+        if (cur == code)
+        {
+            m_counts[i].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    m_overflow.inc();
+}
+
+bool StatusCodeCounter::slot(size_t i, int& code, uint32_t& count) const
+{
+    int32_t c = m_codes[i].load(std::memory_order_relaxed);
+    if (c == EMPTY)
+        return false;
+
+    code = c;
+    count = m_counts[i].load(std::memory_order_relaxed);
+    return true;
+}
+
+
+//===========================================================
+// Prometheus text format
+//===========================================================
+
+void promHeader(std::string& out, const char* name, const char* type, const char* help)
+{
+    char line[160];
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    out += line;
+}
+
+void promSample(std::string& out, const char* name, const char* labels, double value)
+{
+    char line[160];
+    if (labels && labels[0])
+        snprintf(line, sizeof(line), "%s{%s} %.9g\n", name, labels, value);
+    else
+        snprintf(line, sizeof(line), "%s %.9g\n", name, value);
+    out += line;
+}
+
+// Buckets are exported cumulatively; empty buckets are skipped to keep the page
+// small (cumulative counts stay valid since "le" only has to be monotonic).
+// _sum is estimated from bucket midpoints — the record path keeps no 64-bit sum.
+void promHistogram(std::string& out, const char* name, const char* help, const LogHistogram& h, double scale)
+{
+    promHeader(out, name, "histogram", help);
+
+    char metric[96];
+    char labels[48];
+    uint64_t cumulative = 0;
+    double sum = 0.0;
+
+    snprintf(metric, sizeof(metric), "%s_bucket", name);
+    for (size_t i = 0; i < LogHistogram::BUCKETS; ++i)
+    {
+        uint32_t c = h.bucketCount(i);
+        if (c == 0)
+            continue;
+
+        cumulative += c;
+        double lo = LogHistogram::bucketLowerBound(i);
+        double hi = LogHistogram::bucketUpperBound(i);
+        sum += c * (lo + (hi - lo) / 2.0);
+
+        if (i + 1 < LogHistogram::BUCKETS)
+        {
+            snprintf(labels, sizeof(labels), "le=\"%.9g\"", hi * scale);
+            promSample(out, metric, labels, (double)cumulative);
+        }
+    }
+    promSample(out, metric, "le=\"+Inf\"", (double)cumulative);
+
+    snprintf(metric, sizeof(metric), "%s_sum", name);
+    promSample(out, metric, nullptr, sum * scale);
+    snprintf(metric, sizeof(metric), "%s_count", name);
+    promSample(out, metric, nullptr, (double)cumulative);
+}
+
+static void promCounter(std::string& out, const char* name, const char* help, const Counter& c)
+{
+    promHeader(out, name, "counter", help);
+    promSample(out, name, nullptr, c.get());
+}
+
+void renderPrometheus(const ScannerMetrics& m, std::string& out)
+{
+    promCounter(out, "palgate_adv_seen_total", "BLE advertisements delivered to the scan callback.", m.adv_seen);
+    promCounter(out, "palgate_adv_matched_total", "Advertisements matching the target beacon.", m.adv_matched);
+    promCounter(out, "palgate_adv_rejected_total", "Advertisements in an enabled format that did not match.", m.adv_rejected);
+    promCounter(out, "palgate_triggers_total", "TriggerGate() invocations.", m.triggers);
+    promCounter(out, "palgate_wifi_reconnects_total", "WiFi STA disconnects that started a reconnect.", m.wifi_reconnects);
+    promCounter(out, "palgate_rolling_rejected_total", "Rolling-code adverts with a code outside the accept window.", m.rolling_rejected);
+    promCounter(out, "palgate_rolling_resyncs_total", "Rolling-code windows re-anchored by a two-press resync.", m.rolling_resyncs);
+
+    promHistogram(out, "palgate_detect_to_trigger_seconds", "First matching advertisement to TriggerGate() entry.",
+                  m.detect_to_trigger_us, 1e-6);
+    promHistogram(out, "palgate_http_begin_seconds", "TCP connect and TLS handshake of the cloud request.", m.http_begin_us, 1e-6);
+    promHistogram(out, "palgate_http_get_seconds", "Cloud request sent to response read.", m.http_get_us, 1e-6);
+    promHistogram(out, "palgate_wifi_reconnect_seconds", "WiFi link lost to IP reacquired.", m.wifi_reconnect_ms, 1e-3);
+    promHistogram(out, "palgate_open_cloud_seconds", "First matching advertisement to a 2xx from the cloud.", m.open_cloud_us, 1e-6);
+    promHistogram(out, "palgate_open_local_seconds", "First matching advertisement to the acknowledged GATT write.", m.open_local_us, 1e-6);
+    promHistogram(out, "palgate_gatt_connect_seconds", "GATT connection to the PalGate unit.", m.gatt_connect_us, 1e-6);
+    promHistogram(out, "palgate_gatt_write_seconds", "GATT service lookup and token write.", m.gatt_write_us, 1e-6);
+    promHistogram(out, "palgate_arbitration_seconds", "Detection to the multi-scanner arbitration decision.", m.arbitration_ms, 1e-3);
+    promHistogram(out, "palgate_mqtt_publish_seconds", "MQTT batch write to send (QoS 0) or PUBACK (QoS 1).", m.mqtt_publish_us, 1e-6);
+    promHistogram(out, "palgate_mqtt_event_age_seconds", "MQTT export event queued to its batch published.", m.mqtt_event_age_ms, 1e-3);
+
+    promHeader(out, "palgate_open_wins_total", "counter", "Triggers by the path that opened the gate first.");
+    promSample(out, "palgate_open_wins_total", "path=\"cloud\"", m.open_wins_cloud.get());
+    promSample(out, "palgate_open_wins_total", "path=\"local\"", m.open_wins_local.get());
+
+    promHeader(out, "palgate_local_open_total", "counter", "Local (GATT) open attempts by outcome.");
+    promSample(out, "palgate_local_open_total", "result=\"opened\"", m.local_opened.get());
+    promSample(out, "palgate_local_open_total", "result=\"connect_failed\"", m.local_connect_failed.get());
+    promSample(out, "palgate_local_open_total", "result=\"write_failed\"", m.local_write_failed.get());
+    promSample(out, "palgate_local_open_total", "result=\"cancelled\"", m.local_cancelled.get());
+
+    promHeader(out, "palgate_arbitration_total", "counter", "Multi-scanner arbitrations by outcome.");
+    promSample(out, "palgate_arbitration_total", "result=\"won\"", m.arbitration_won.get());
+    promSample(out, "palgate_arbitration_total", "result=\"outscored\"", m.arbitration_outscored.get());
+    promSample(out, "palgate_arbitration_total", "result=\"claimed\"", m.arbitration_claimed.get());
+    promHeader(out, "palgate_triggers_coalesced_total", "counter", "Beacons that arrived while another beacon's open was under way and joined it.");
+    promSample(out, "palgate_triggers_coalesced_total", nullptr, m.triggers_coalesced.get());
+    promHeader(out, "palgate_tls_handshakes_total", "counter", "Cloud request TLS handshakes by kind (pin_mismatch: request not sent).");
+    promSample(out, "palgate_tls_handshakes_total", "kind=\"full\"", m.tls_full.get());
+    promSample(out, "palgate_tls_handshakes_total", "kind=\"resumed\"", m.tls_resumed.get());
+    promSample(out, "palgate_tls_handshakes_total", "kind=\"pin_mismatch\"", m.tls_pin_mismatch.get());
+    promCounter(out, "palgate_mqtt_batches_total", "MQTT batches published.", m.mqtt_batches);
+    promCounter(out, "palgate_mqtt_events_total", "Events in published MQTT batches.", m.mqtt_events);
+    promCounter(out, "palgate_mqtt_bytes_total", "Payload bytes of published MQTT batches.", m.mqtt_bytes);
+    promHeader(out, "palgate_mqtt_events_lost_total", "counter", "MQTT export events not queued (shed: sightings under backpressure).");
+    promSample(out, "palgate_mqtt_events_lost_total", "reason=\"shed\"", m.mqtt_sightings_shed.get());
+    promSample(out, "palgate_mqtt_events_lost_total", "reason=\"dropped\"", m.mqtt_events_dropped.get());
+    promHeader(out, "palgate_mqtt_connects_total", "counter", "MQTT broker connection attempts by outcome.");
+    promSample(out, "palgate_mqtt_connects_total", "result=\"ok\"", m.mqtt_connects.get());
+    promSample(out, "palgate_mqtt_connects_total", "result=\"failed\"", m.mqtt_connect_failed.get());
+    promCounter(out, "palgate_mqtt_publish_failed_total", "MQTT batches not sent or not acknowledged (resent).", m.mqtt_publish_failed);
+    promHeader(out, "palgate_duplicates_suppressed_total", "counter", "Detections not triggered because another scanner opened its gate.");
+    promSample(out, "palgate_duplicates_suppressed_total", nullptr,
+               (double)m.arbitration_outscored.get() + m.arbitration_claimed.get());
+
+    promHeader(out, "palgate_http_status_total", "counter", "Gate requests by HTTP status (negative = HTTPClient error).");
+    char labels[32];
+    for (size_t i = 0; i < m.http_status.size(); ++i)
+    {
+        int code;
+        uint32_t count;
+        if (m.http_status.slot(i, code, count))
+        {
+            snprintf(labels, sizeof(labels), "code=\"%d\"", code);
+            promSample(out, "palgate_http_status_total", labels, count);
+        }
+    }
+    if (m.http_status.overflow())
+        promSample(out, "palgate_http_status_total", "code=\"other\"", m.http_status.overflow());
+}
@@ -0,0 +1,151 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+
+// Fixed-memory telemetry primitives. Every record operation is a bounded number
+// of relaxed 32-bit atomic RMWs (lock-free on the ESP32), so they are safe to
+// call from the BLE callback task, the WiFi event task and loop() alike.
+
+
+/**
+ * @brief Monotonic event counter.
+ */
+class Counter
+{
+public:
+    void inc(uint32_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t get() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> m_value{0};
+};
+
+
+/**
+ * @brief HDR-style log-bucketed histogram.
+ *
+ * Values below 2^SUB_BITS get one bucket each; above that every power of two
+ * is split into 2^SUB_BITS linear sub-buckets, giving ~25% worst-case
+ * relative error over 1 .. 2^MAX_EXP with a fixed bucket array.
+ * Values beyond the top bucket saturate into it.
+ */
+class LogHistogram
+{
+public:
+    static const uint32_t SUB_BITS = 2;
+    static const uint32_t SUB_COUNT = 1u << SUB_BITS;
+    static const uint32_t MAX_EXP = 26;                  // ~67 s when recording microseconds
+    static const size_t BUCKETS = SUB_COUNT + (MAX_EXP - SUB_BITS) * SUB_COUNT;
+
+    void record(uint32_t value)
+    {
+        m_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint32_t bucketCount(size_t i) const { return m_buckets[i].load(std::memory_order_relaxed); }
+
+    static size_t bucketIndex(uint32_t value);
+    static uint32_t bucketUpperBound(size_t index);     // inclusive
+    static uint32_t bucketLowerBound(size_t index);
+
+private:
+    std::atomic<uint32_t> m_buckets[BUCKETS] = {};
+};
+
+
+/**
+ * @brief Per-status-code counters in a fixed open-addressed table.
+ *
+ * First use of a code claims a slot with one CAS; later hits are a plain
+ * fetch_add. Codes that arrive after the table is full land in the overflow count.
+ */
+class StatusCodeCounter
+{
+public:
+    static const size_t SLOTS = 8;
+
+    void inc(int code);
+
+    size_t size() const { return SLOTS; }
+    bool slot(size_t i, int& code, uint32_t& count) const;
+    uint32_t overflow() const { return m_overflow.get(); }
+
+private:
+    static const int32_t EMPTY = INT32_MIN;
+
+    std::atomic<int32_t> m_codes[SLOTS] = {
+        {EMPTY}, {EMPTY}, {EMPTY}, {EMPTY}, {EMPTY}, {EMPTY}, {EMPTY}, {EMPTY}
+    };
+    std::atomic<uint32_t> m_counts[SLOTS] = {};
+    Counter m_overflow;
+};
+
+
+/**
+ * @brief Scanner-wide metrics. One global instance (g_metrics).
+ */
+struct ScannerMetrics
+{
+    Counter adv_seen;               // every advertisement delivered to onResult()
+    Counter adv_matched;            // advertisements that matched the target
+    Counter adv_rejected;           // advertisements in an enabled format (AdvDecoder) that did not match
+    Counter triggers;               // TriggerGate() invocations
+    Counter wifi_reconnects;        // STA disconnect events that started a reconnect
+    Counter rolling_rejected;       // rolling mode: identity prefix matched, code not in the window
+    Counter rolling_resyncs;        // rolling mode: window re-anchored after two consecutive presses
+    Counter open_wins_cloud;        // triggers whose first successful open was the HTTPS request
+    Counter open_wins_local;        // triggers whose first successful open was the GATT write
+    Counter local_opened;           // GATT write acknowledged
+    Counter local_connect_failed;   // GATT connection attempt failed or timed out
+    Counter local_write_failed;     // service/characteristic missing or link lost during the write
+    Counter local_cancelled;        // skipped because the cloud path had already opened the gate
+    Counter arbitration_won;        // multi-scanner: this scanner had the strongest sighting and opened
+    Counter arbitration_outscored;  // multi-scanner: stood down, a peer heard the beacon stronger
+    Counter arbitration_claimed;    // multi-scanner: stood down, a peer had already claimed the beacon
+    Counter triggers_coalesced;     // beacons that arrived during another beacon's open and joined it
+    Counter tls_full;               // cloud request: full handshake, API key pinned (or pinning off)
+    Counter tls_resumed;            // cloud request: abbreviated handshake on a pinned session
+    Counter tls_pin_mismatch;       // cloud request: API host's key not pinned, request not sent
+    Counter mqtt_batches;           // MQTT export: batches published (QoS 1: acknowledged)
+    Counter mqtt_events;            // MQTT export: events in those batches
+    Counter mqtt_bytes;             // MQTT export: payload bytes of those batches
+    Counter mqtt_sightings_shed;    // MQTT export: sightings not queued, the rest is kept for gate events
+    Counter mqtt_events_dropped;    // MQTT export: events not queued (queue full) or discarded (export off)
+    Counter mqtt_connects;          // MQTT export: broker sessions established
+    Counter mqtt_connect_failed;    // MQTT export: connect, CONNECT or CONNACK failed
+    Counter mqtt_publish_failed;    // MQTT export: batch write or PUBACK failed (the batch is resent)
+
+    LogHistogram detect_to_trigger_us;  // first matching packet -> TriggerGate() entry
+    LogHistogram http_begin_us;         // cloud request: TCP connect + TLS handshake
+    LogHistogram http_get_us;           // cloud request: request sent -> response read
+    LogHistogram wifi_reconnect_ms;     // link lost -> got IP again
+    LogHistogram open_cloud_us;         // first matching packet -> 2xx from the cloud
+    LogHistogram open_local_us;         // first matching packet -> GATT write acknowledged
+    LogHistogram gatt_connect_us;       // GATT connection to the PalGate unit established
+    LogHistogram gatt_write_us;         // service lookup + token write with response
+    LogHistogram arbitration_ms;        // detection -> arbitration decided (won at the window end, lost earlier)
+    LogHistogram mqtt_publish_us;       // MQTT export: batch written -> sent (QoS 0) or acknowledged (QoS 1)
+    LogHistogram mqtt_event_age_ms;     // MQTT export: post() -> batch published, per event
+
+    StatusCodeCounter http_status;      // HTTP status / negative GateHttp::ERROR_* (HTTPClient's numbers)
+};
+
+extern ScannerMetrics g_metrics;
+
+
+/**
+ * @brief Append the Prometheus text exposition of `m` to `out`.
+ *        Gauges that need platform calls (heap, phase totals) are appended by the caller.
+ */
+void renderPrometheus(const ScannerMetrics& m, std::string& out);
+
+// Exposition helpers, shared with callers that append their own series.
+void promHeader(std::string& out, const char* name, const char* type, const char* help);
+void promSample(std::string& out, const char* name, const char* labels, double value);
+void promHistogram(std::string& out, const char* name, const char* help, const LogHistogram& h, double scale);
+
+#endif // #ifndef METRICS_H
@@ -0,0 +1,576 @@
+#include "MqttExport.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(ESP32)
+#include <lwip/netdb.h>
+#include <lwip/sockets.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#endif
+
+#include "AdvDecoder.h"
+#include "Metrics.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0      // lwIP raises no SIGPIPE
+#endif
+
+static const uint32_t WRITE_TIMEOUT_MS = 3000;     // send buffer full this long: the broker is gone
+
+static uint32_t nowMs()
+{
+    return (uint32_t)(TaskTopology::nowUs() / 1000);
+}
+
+static uint32_t minU32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+
+// ---- TcpTransport ----
+
+// select() for one fd: > 0 ready, 0 timed out, < 0 error
+static int waitReady(int fd, bool for_write, uint32_t timeout_ms)
+{
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    return select(fd + 1, for_write ? nullptr : &set, for_write ? &set : nullptr, nullptr, &tv);
+}
+
+bool TcpTransport::connect(const char* host, uint16_t port, uint32_t timeout_ms)
+{
+    close();
+
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &res) != 0 || res == nullptr)
+        return false;
+
+    // non-blocking connect, so an unreachable broker costs timeout_ms and not the TCP default
+    m_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    bool ok = m_fd >= 0 && fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL, 0) | O_NONBLOCK) == 0;
+    if (ok && ::connect(m_fd, res->ai_addr, res->ai_addrlen) != 0)
+    {
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        ok = errno == EINPROGRESS && waitReady(m_fd, true, timeout_ms) > 0 &&
+             getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &err_len) == 0 && err == 0;
+    }
+    freeaddrinfo(res);
+
+    if (!ok)
+    {
+        close();
+        return false;
+    }
+    int one = 1;    // a batch is one write; don't hold it back for the previous PUBACK
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return true;
+}
+
+bool TcpTransport::write(const uint8_t* data, size_t len)
+{
+    while (m_fd >= 0 && len > 0)
+    {
+        ssize_t n = send(m_fd, data, len, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            data += n;
+            len -= (size_t)n;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if (waitReady(m_fd, true, WRITE_TIMEOUT_MS) <= 0)
+                return false;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return len == 0;
+}
+
+int TcpTransport::read(uint8_t* buf, size_t cap, uint32_t timeout_ms)
+{
+    if (m_fd < 0)
+        return READ_ERROR;
+    int ready = waitReady(m_fd, false, timeout_ms);
+    if (ready == 0)
+        return READ_TIMEOUT;
+    if (ready < 0)
+        return READ_ERROR;
+
+    ssize_t n = recv(m_fd, buf, cap, 0);
+    if (n > 0)
+        return (int)n;
+    if (n == 0)
+        return READ_CLOSED;
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? READ_TIMEOUT : READ_ERROR;
+}
+
+void TcpTransport::close()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+}
+
+
+// ---- MqttCodec ----
+
+static uint8_t* putString(uint8_t* p, const char* s, size_t len)
+{
+    *p++ = (uint8_t)(len >> 8);
+    *p++ = (uint8_t)len;
+    memcpy(p, s, len);
+    return p + len;
+}
+
+size_t MqttCodec::fixedHeader(uint8_t* out, uint8_t first_byte, uint32_t remaining)
+{
+    if (remaining > 268435455u)     // four 7-bit length bytes
+        return 0;
+
+    size_t n = 0;
+    out[n++] = first_byte;
+    do
+    {
+        uint8_t b = remaining & 0x7F;
+        remaining >>= 7;
+        out[n++] = remaining ? (uint8_t)(b | 0x80) : b;
+    } while (remaining);
+    return n;
+}
+
+size_t MqttCodec::connect(uint8_t* out, size_t cap, const MqttSettings& s)
+{
+    const size_t id_len = strnlen(s.client_id, sizeof(s.client_id));
+    const size_t user_len = strnlen(s.user, sizeof(s.user));
+    const size_t pass_len = user_len ? strnlen(s.pass, sizeof(s.pass)) : 0;   // 3.1.1: no password without a user
+
+    uint8_t flags = 0x02;   // clean session: nothing is queued for us while we are away
+    uint32_t remaining = 10 + 2 + (uint32_t)id_len;
+    if (user_len)
+    {
+        flags |= 0x80;
+        remaining += 2 + (uint32_t)user_len;
+    }
+    if (pass_len)
+    {
+        flags |= 0x40;
+        remaining += 2 + (uint32_t)pass_len;
+    }
+
+    uint8_t header[MAX_HEADER];
+    size_t n = fixedHeader(header, CONNECT << 4, remaining);
+    if (n == 0 || n + remaining > cap)
+        return 0;
+
+    memcpy(out, header, n);
+    uint8_t* p = putString(out + n, "MQTT", 4);
+    *p++ = 4;               // protocol level 3.1.1
+    *p++ = flags;
+    *p++ = (uint8_t)(s.keepalive_s >> 8);
+    *p++ = (uint8_t)s.keepalive_s;
+    p = putString(p, s.client_id, id_len);
+    if (user_len)
+        p = putString(p, s.user, user_len);
+    if (pass_len)
+        p = putString(p, s.pass, pass_len);
+    return (size_t)(p - out);
+}
+
+size_t MqttCodec::publishHeader(uint8_t* out, size_t cap, const char* topic, size_t payload_len,
+                                uint8_t qos, uint16_t packet_id, bool dup)
+{
+    const size_t topic_len = strlen(topic);
+    const size_t variable = 2 + topic_len + (qos ? 2 : 0);
+    if (topic_len > 0xFFFF || variable + payload_len > 0xFFFFFFFFu)
+        return 0;
+
+    uint8_t first = (uint8_t)(PUBLISH << 4);
+    if (qos)
+        first |= (uint8_t)(dup ? 0x0A : 0x02);  // QoS 1 (+ DUP); QoS 0 must not set DUP
+    uint8_t header[MAX_HEADER];
+    size_t n = fixedHeader(header, first, (uint32_t)(variable + payload_len));
+    if (n == 0 || n + variable > cap)
+        return 0;
+
+    memcpy(out, header, n);
+    uint8_t* p = putString(out + n, topic, topic_len);
+    if (qos)
+    {
+        *p++ = (uint8_t)(packet_id >> 8);
+        *p++ = (uint8_t)packet_id;
+    }
+    return (size_t)(p - out);
+}
+
+
+// ---- MqttExporter: producer ----
+
+bool MqttExporter::post(const ExportEvent& ev)
+{
+    ExportEvent queued = ev;
+    queued.posted_ms = nowMs();
+
+    if (queued.kind == ExportEvent::Kind::Sighting && m_queue.depth() >= QUEUE_CAP - GATE_RESERVE)
+    {
+        m_lost.fetch_add(1, std::memory_order_relaxed);
+        g_metrics.mqtt_sightings_shed.inc();
+        return false;
+    }
+    if (!m_queue.push(queued))
+    {
+        m_lost.fetch_add(1, std::memory_order_relaxed);
+        g_metrics.mqtt_events_dropped.inc();
+        return false;
+    }
+    m_signal.notify();
+    return true;
+}
+
+
+// ---- MqttExporter: consumer ----
+
+// Whatever the session was opened with (qos and batch_ms apply per batch)
+static bool sameSession(const MqttSettings& a, const MqttSettings& b)
+{
+    return a.port == b.port && a.keepalive_s == b.keepalive_s &&
+           strncmp(a.host, b.host, sizeof(a.host)) == 0 && strncmp(a.topic, b.topic, sizeof(a.topic)) == 0 &&
+           strncmp(a.user, b.user, sizeof(a.user)) == 0 && strncmp(a.pass, b.pass, sizeof(a.pass)) == 0 &&
+           strncmp(a.client_id, b.client_id, sizeof(a.client_id)) == 0;
+}
+
+uint32_t MqttExporter::service(const MqttSettings& s, bool network_up)
+{
+    const bool enabled = s.host[0] != '\0';
+    if (connected() && (!enabled || !network_up || !sameSession(s, m_active)))
+        drop(network_up);   // DISCONNECT only if the link is still there
+
+    if (!enabled)
+    {
+        // export off: nothing is kept for a broker that may never be configured
+        uint32_t discarded = (uint32_t)m_staged_count.load(std::memory_order_relaxed);
+        ExportEvent ev;
+        while (m_queue.pop(ev))
+            ++discarded;
+        g_metrics.mqtt_events_dropped.inc(discarded);
+        m_staged_count.store(0, std::memory_order_relaxed);
+        m_resend = false;
+        m_lost_in_flight = 0;
+        m_lost.store(0, std::memory_order_relaxed);
+        return IDLE_WAIT_MS;
+    }
+
+    // Stage while disconnected too: the queue behind a full batch is what sheds.
+    size_t count = m_staged_count.load(std::memory_order_relaxed);
+    while (count < MAX_BATCH && m_queue.pop(m_staged[count]))
+        m_staged_count.store(++count, std::memory_order_relaxed);
+
+    if (!connected())
+    {
+        if (!network_up)
+            return IDLE_WAIT_MS;
+        uint32_t now = nowMs();
+        if ((int32_t)(m_retry_at_ms - now) > 0)
+            return minU32(m_retry_at_ms - now, IDLE_WAIT_MS);
+        if (!open(s))
+        {
+            g_metrics.mqtt_connect_failed.inc();
+            backOff(now);
+            return IDLE_WAIT_MS;
+        }
+        g_metrics.mqtt_connects.inc();
+    }
+
+    // Publish full batches at once and a partial one batch_ms after its first event;
+    // a batch that was not acknowledged goes again right after the reconnect.
+    // Bounded, so a flood cannot keep the settings and keepalive checks from running.
+    for (size_t published = 0; count > 0; )
+    {
+        if (published >= QUEUE_CAP)
+            return 0;
+        uint32_t age = nowMs() - m_staged[0].posted_ms;
+        if (!m_resend && count < MAX_BATCH && age < s.batch_ms)
+            return minU32(s.batch_ms - age, IDLE_WAIT_MS);
+
+        size_t before = count;
+        if (!publishBatch(s))
+        {
+            g_metrics.mqtt_publish_failed.inc();
+            drop(false);
+            backOff(nowMs());
+            return IDLE_WAIT_MS;
+        }
+        m_retry_ms = RETRY_MIN_MS;
+
+        count = m_staged_count.load(std::memory_order_relaxed);
+        published += before - count;
+        while (count < MAX_BATCH && m_queue.pop(m_staged[count]))
+            m_staged_count.store(++count, std::memory_order_relaxed);
+    }
+
+    // keepalive: the broker drops a client that is silent for 1.5 x keepalive_s
+    const uint32_t ping_ms = s.keepalive_s * 1000u / 2;
+    if (ping_ms == 0)
+        return IDLE_WAIT_MS;
+    uint32_t idle = nowMs() - m_last_tx_ms;
+    if (idle >= ping_ms)
+    {
+        if (!ping())
+        {
+            drop(false);
+            backOff(nowMs());
+            return IDLE_WAIT_MS;
+        }
+        idle = 0;
+    }
+    return minU32(ping_ms - idle, IDLE_WAIT_MS);
+}
+
+bool MqttExporter::open(const MqttSettings& s)
+{
+    if (!m_transport.connect(s.host, s.port, CONNECT_TIMEOUT_MS))
+        return false;
+
+    size_t len = MqttCodec::connect(m_packet, PACKET_CAP, s);
+    if (len == 0 || !writeAll(m_packet, len) || !awaitPacket(MqttCodec::CONNACK, 0, CONNECT_TIMEOUT_MS))
+    {
+        m_transport.close();
+        return false;
+    }
+    m_active = s;
+    m_connected.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void MqttExporter::drop(bool graceful)
+{
+    if (graceful)
+    {
+        static const uint8_t PACKET[2] = { MqttCodec::DISCONNECT << 4, 0 };
+        m_transport.write(PACKET, sizeof(PACKET));
+    }
+    m_transport.close();
+    m_connected.store(false, std::memory_order_relaxed);
+}
+
+void MqttExporter::backOff(uint32_t now_ms)
+{
+    m_retry_at_ms = now_ms + m_retry_ms;
+    m_retry_ms = minU32(m_retry_ms * 2, RETRY_MAX_MS);
+}
+
+bool MqttExporter::publishBatch(const MqttSettings& s)
+{
+    // A resend is the same message: same events, seq, lost count and packet id.
+    size_t count = m_resend ? m_inflight : m_staged_count.load(std::memory_order_relaxed);
+    if (!m_resend)
+        m_lost_in_flight += m_lost.exchange(0, std::memory_order_relaxed);
+    const size_t len = encodeBatch(count);
+
+    char topic[sizeof(s.topic) + 8];
+    snprintf(topic, sizeof(topic), "%s/events", s.topic);
+    const uint8_t qos = s.qos ? 1 : 0;
+    const bool dup = m_resend;
+    if (!m_resend)
+        m_packet_id = (uint16_t)(m_packet_id % 0xFFFF + 1);    // 1..65535
+    const size_t header = MqttCodec::publishHeader(m_packet, PACKET_CAP, topic, len, qos, m_packet_id, dup);
+    if (header == 0)
+        return false;
+
+    m_resend = true;        // until it is known to be out
+    m_inflight = count;
+    const uint64_t start = TaskTopology::nowUs();
+    if (!writeAll(m_packet, header) || !writeAll(reinterpret_cast<const uint8_t*>(m_payload), len))
+        return false;
+    if (qos && !awaitPacket(MqttCodec::PUBACK, m_packet_id, ACK_TIMEOUT_MS))
+        return false;
+    g_metrics.mqtt_publish_us.record((uint32_t)(TaskTopology::nowUs() - start));
+
+    const uint32_t now = nowMs();
+    for (size_t i = 0; i < count; ++i)
+        g_metrics.mqtt_event_age_ms.record(now - m_staged[i].posted_ms);
+    g_metrics.mqtt_batches.inc();
+    g_metrics.mqtt_events.inc((uint32_t)count);
+    g_metrics.mqtt_bytes.inc((uint32_t)len);
+
+    const size_t left = m_staged_count.load(std::memory_order_relaxed) - count;
+    memmove(m_staged, m_staged + count, left * sizeof(ExportEvent));
+    m_staged_count.store(left, std::memory_order_relaxed);
+    m_resend = false;
+    m_lost_in_flight = 0;
+    ++m_seq;
+    return true;
+}
+
+// "b" (and "n" for the rolling beacon) of a Sighting, Trigger or Coalesced event
+static void formatBeacon(char* out, size_t cap, const ExportEvent& e)
+{
+    const AdFormat format = (AdFormat)e.detail;
+    if (e.beacon == ExportEvent::ROLLING_BEACON)
+        snprintf(out, cap, "\"b\":\"rolling\",\"n\":%u", (unsigned)e.counter);
+    else if (format == AdFormat::IBeacon || format == AdFormat::AltBeacon)
+        snprintf(out, cap, "\"b\":\"%s/%u/%u\"", AdvDecoder::formatName(format),
+                 (unsigned)(e.beacon >> 16), (unsigned)(e.beacon & 0xFFFF));
+    else
+        snprintf(out, cap, "\"b\":\"%s\"", AdvDecoder::formatName(format));
+}
+
+static int formatEvent(char* out, size_t cap, const char* sep, const ExportEvent& e)
+{
+    const unsigned long long t = e.unix_ms;
+    char beacon[48];
+    if (e.kind != ExportEvent::Kind::Result)
+        formatBeacon(beacon, sizeof(beacon), e);
+    switch (e.kind)
+    {
+        case ExportEvent::Kind::Sighting:
+            return snprintf(out, cap, "%s{\"k\":\"s\",%s,\"r\":%d,\"t\":%llu}", sep, beacon, e.rssi, t);
+        case ExportEvent::Kind::Trigger:
+            return snprintf(out, cap, "%s{\"k\":\"t\",%s,\"id\":%u,\"t\":%llu}", sep, beacon, (unsigned)e.trace_id, t);
+        case ExportEvent::Kind::Coalesced:
+            return snprintf(out, cap, "%s{\"k\":\"j\",%s,\"t\":%llu}", sep, beacon, t);
+        case ExportEvent::Kind::Result:
+            return snprintf(out, cap, "%s{\"k\":\"o\",\"id\":%u,\"p\":\"%s\",\"ok\":%u,\"first\":%u,\"c\":%d,\"ms\":%u,\"t\":%llu}",
+                            sep, (unsigned)e.trace_id, (e.detail & ExportEvent::PATH_LOCAL) ? "local" : "cloud",
+                            (e.detail & ExportEvent::OPENED) ? 1u : 0u, (e.detail & ExportEvent::FIRST) ? 1u : 0u,
+                            (int)e.code, (unsigned)e.elapsed_ms, t);
+    }
+    return -1;
+}
+
+size_t MqttExporter::encodeBatch(size_t& count)
+{
+    static const char TAIL[] = "]}";
+
+    size_t len = (size_t)snprintf(m_payload, PAYLOAD_CAP, "{\"seq\":%u,\"lost\":%u,\"ev\":[",
+                                  (unsigned)m_seq, (unsigned)m_lost_in_flight);
+    size_t encoded = 0;
+    for (; encoded < count; ++encoded)
+    {
+        // the rest waits for the next batch
+        size_t room = PAYLOAD_CAP - len - (sizeof(TAIL) - 1);
+        int n = formatEvent(m_payload + len, room, encoded ? "," : "", m_staged[encoded]);
+        if (n < 0 || (size_t)n >= room)
+            break;
+        len += (size_t)n;
+    }
+    memcpy(m_payload + len, TAIL, sizeof(TAIL) - 1);
+    count = encoded;
+    return len + sizeof(TAIL) - 1;
+}
+
+bool MqttExporter::ping()
+{
+    static const uint8_t PACKET[2] = { MqttCodec::PINGREQ << 4, 0 };
+    return writeAll(PACKET, sizeof(PACKET)) && awaitPacket(MqttCodec::PINGRESP, 0, ACK_TIMEOUT_MS);
+}
+
+bool MqttExporter::writeAll(const uint8_t* data, size_t len)
+{
+    if (!m_transport.write(data, len))
+        return false;
+    m_last_tx_ms = nowMs();
+    return true;
+}
+
+// Exactly `len` bytes before `deadline_ms`; the broker's packets are read one at a
+// time, so nothing of the next one is consumed.
+static bool readExact(MqttTransport& t, uint8_t* buf, size_t len, uint32_t deadline_ms)
+{
+    while (len > 0)
+    {
+        int32_t left = (int32_t)(deadline_ms - nowMs());
+        if (left <= 0)
+            return false;
+        int n = t.read(buf, len, (uint32_t)left);
+        if (n == MqttTransport::READ_TIMEOUT)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+bool MqttExporter::readPacket(uint8_t& first_byte, uint8_t* body, size_t cap, size_t& len, uint32_t timeout_ms)
+{
+    const uint32_t deadline = nowMs() + timeout_ms;
+    if (!readExact(m_transport, &first_byte, 1, deadline))
+        return false;
+
+    uint32_t remaining = 0;
+    for (int shift = 0; ; shift += 7)
+    {
+        uint8_t b;
+        if (shift > 21 || !readExact(m_transport, &b, 1, deadline))
+            return false;
+        remaining |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            break;
+    }
+
+    // keep the first `cap` bytes, skip the rest (we subscribe to nothing, so this is rare)
+    len = remaining < cap ? remaining : cap;
+    if (!readExact(m_transport, body, len, deadline))
+        return false;
+    for (uint32_t skip = remaining - (uint32_t)len; skip > 0; )
+    {
+        uint8_t scratch[32];
+        size_t n = minU32(skip, sizeof(scratch));
+        if (!readExact(m_transport, scratch, n, deadline))
+            return false;
+        skip -= (uint32_t)n;
+    }
+    return true;
+}
+
+bool MqttExporter::awaitPacket(uint8_t type, uint16_t packet_id, uint32_t timeout_ms)
+{
+    const uint32_t deadline = nowMs() + timeout_ms;
+    for (;;)
+    {
+        int32_t left = (int32_t)(deadline - nowMs());
+        uint8_t first_byte;
+        uint8_t body[4];
+        size_t len;
+        if (left <= 0 || !readPacket(first_byte, body, sizeof(body), len, (uint32_t)left))
+            return false;
+        if ((first_byte >> 4) != type)
+            continue;   // e.g. a late PINGRESP while waiting for a PUBACK
+
+        switch (type)
+        {
+            case MqttCodec::CONNACK:
+                return len >= 2 && body[1] == 0;    // return code 0: accepted
+            case MqttCodec::PUBACK:
+                if (len >= 2 && ((body[0] << 8) | body[1]) == packet_id)
+                    return true;
+                break;      // an older batch's PUBACK
+            default:
+                return true;
+        }
+    }
+}
@@ -0,0 +1,233 @@
+#ifndef MQTT_EXPORT_H
+#define MQTT_EXPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#include "TaskTopology.h"
+
+/**
+ * @brief One event for the home-automation side (POD, 40 bytes).
+ *
+ * Sighting:  the target beacon was heard (after ingest's per-beacon rate limit).
+ * Trigger:   this beacon made the scanner open the gate; the Result events carry the same trace id.
+ * Coalesced: this beacon arrived while another one's open was in progress and joined it.
+ * Result:    one path's outcome of a trigger.
+ */
+struct ExportEvent
+{
+    enum class Kind : uint8_t
+    {
+        Sighting,
+        Trigger,
+        Coalesced,
+        Result,
+    };
+
+    // Result: `detail` bits
+    static const uint8_t PATH_LOCAL = 0x01;    // GATT write (else the cloud request)
+    static const uint8_t OPENED = 0x02;        // this path opened the gate
+    static const uint8_t FIRST = 0x04;         // ... before the other path
+
+    // `beacon` of the rolling-code beacon: its major/minor change with every press
+    static const uint32_t ROLLING_BEACON = 0xFFFFFFFF;
+
+    Kind kind;
+    uint8_t detail;         // Sighting, Trigger, Coalesced: AdFormat; Result: PATH_LOCAL | OPENED | FIRST
+    int8_t rssi;            // Sighting
+    uint8_t reserved;
+    uint32_t beacon;        // Sighting, Trigger, Coalesced: (major << 16) | minor, or ROLLING_BEACON
+    uint32_t counter;       // ... and the rolling code's press counter (0 for a static beacon)
+    int32_t code;           // Result: HTTP status / GateHttp::ERROR_* (cloud), GateLink::Result (local)
+    uint32_t trace_id;      // Trigger, Result
+    uint32_t elapsed_ms;    // Result: first matching packet -> outcome
+    uint32_t posted_ms;     // set by MqttExporter::post()
+    uint64_t unix_ms;       // wall clock; 0 before NTP sync
+};
+
+
+/**
+ * @brief A byte stream to the broker. TcpTransport is the firmware's (and the host
+ *        test's); tools/mqtt_soak.cpp can put a fault-injecting one in between.
+ */
+class MqttTransport
+{
+public:
+    static const int READ_CLOSED = 0;
+    static const int READ_ERROR = -1;
+    static const int READ_TIMEOUT = -2;
+
+    virtual ~MqttTransport() {}
+
+    virtual bool connect(const char* host, uint16_t port, uint32_t timeout_ms) = 0;
+    virtual bool write(const uint8_t* data, size_t len) = 0;
+    // Bytes read (> 0), READ_CLOSED, READ_ERROR or READ_TIMEOUT.
+    virtual int read(uint8_t* buf, size_t cap, uint32_t timeout_ms) = 0;
+    virtual void close() = 0;
+};
+
+/**
+ * @brief MqttTransport over a BSD socket (lwIP on the ESP32, the kernel on Linux).
+ */
+class TcpTransport : public MqttTransport
+{
+public:
+    ~TcpTransport() override { close(); }
+
+    bool connect(const char* host, uint16_t port, uint32_t timeout_ms) override;
+    bool write(const uint8_t* data, size_t len) override;
+    int read(uint8_t* buf, size_t cap, uint32_t timeout_ms) override;
+    void close() override;
+
+private:
+    int m_fd = -1;
+};
+
+
+/**
+ * @brief Broker and batching settings, copied from the RuntimeConfig by the caller.
+ */
+struct MqttSettings
+{
+    char host[48];          // empty = export off
+    uint16_t port;
+    uint8_t qos;            // 0 or 1
+    uint16_t batch_ms;      // how long the first event of a batch waits for more
+    uint16_t keepalive_s;
+    char topic[48];         // batches go to <topic>/events
+    char user[32];          // empty = no credentials
+    char pass[32];
+    char client_id[24];
+};
+
+
+/**
+ * @brief MQTT 3.1.1 packets the exporter sends and parses, into caller buffers.
+ */
+namespace MqttCodec
+{
+    // Packet types (upper nibble of the first byte)
+    static const uint8_t CONNECT = 1;
+    static const uint8_t CONNACK = 2;
+    static const uint8_t PUBLISH = 3;
+    static const uint8_t PUBACK = 4;
+    static const uint8_t PINGREQ = 12;
+    static const uint8_t PINGRESP = 13;
+    static const uint8_t DISCONNECT = 14;
+
+    static const size_t MAX_HEADER = 5;     // type byte + at most 4 length bytes
+
+    // Fixed header for a packet with `remaining` bytes after it; 0 if `remaining` is too large.
+    size_t fixedHeader(uint8_t* out, uint8_t first_byte, uint32_t remaining);
+
+    // CONNECT with clean session; 0 if it does not fit `cap`.
+    size_t connect(uint8_t* out, size_t cap, const MqttSettings& s);
+
+    // PUBLISH up to (not including) the payload; 0 if it does not fit `cap`.
+    size_t publishHeader(uint8_t* out, size_t cap, const char* topic, size_t payload_len,
+                         uint8_t qos, uint16_t packet_id, bool dup);
+}
+
+
+/**
+ * @brief Batched, non-blocking MQTT export of sightings and gate events.
+ *
+ * Producer side (the control task only): post() copies the event into a bounded
+ * SPSC queue and wakes the exporter task; it never blocks and never touches the
+ * network. Under backpressure sightings are shed first: they may not take the last
+ * GATE_RESERVE slots, which stay free for gate events. Whatever is shed is counted
+ * and reported as "lost" in the next batch, so the subscriber knows it missed events.
+ *
+ * Consumer side (its own task): service() moves events into a batch of at most
+ * MAX_BATCH, waits up to batch_ms after the first one for more, and publishes the
+ * batch as one compact JSON message on <topic>/events:
+ *
+ *   {"seq":7,"lost":0,"ev":[{"k":"s","b":"ibeacon/1/1","r":-67,"t":1718000000123},
+ *     {"k":"t","b":"ibeacon/1/1","id":42,"t":...},{"k":"o","id":42,"p":"cloud","ok":1,"first":1,"c":200,"ms":412,"t":...}]}
+ *
+ * k: s = sighting, t = trigger, j = joined another beacon's open (coalesced), o = outcome;
+ * b = the beacon, stable across presses: "<format>/<major>/<minor>" (iBeacon, AltBeacon),
+ * "<format>" (the formats without ids) or "rolling", which also carries n = its press
+ * counter; t = Unix ms (0 before NTP sync).
+ *
+ * QoS 1 waits for the PUBACK before the next batch; a batch that is not acknowledged
+ * stays and is resent (DUP, same seq, so the subscriber can drop a duplicate) after
+ * the reconnect. While the broker is away the queue fills and sheds instead of the
+ * producers stalling. Reconnects back off exponentially up to RETRY_MAX_MS.
+ *
+ * Counters and histograms go to g_metrics (mqtt_*); depth() and highWater() are
+ * the queue gauges.
+ */
+class MqttExporter
+{
+public:
+    static const size_t QUEUE_CAP = 64;
+    static const size_t GATE_RESERVE = 8;       // slots only trigger / outcome events may use
+    static const size_t MAX_BATCH = 16;
+    static const size_t PAYLOAD_CAP = 1536;
+    static const size_t PACKET_CAP = 256;       // CONNECT and PUBLISH headers
+    static const uint32_t CONNECT_TIMEOUT_MS = 3000;
+    static const uint32_t ACK_TIMEOUT_MS = 3000;
+    static const uint32_t RETRY_MIN_MS = 1000;
+    static const uint32_t RETRY_MAX_MS = 60000;
+    static const uint32_t IDLE_WAIT_MS = 1000;
+
+    explicit MqttExporter(MqttTransport& transport) : m_transport(transport) {}
+
+    // ---- producer: the control task ----
+
+    // Queue `ev` (posted_ms is set here). False if it was shed.
+    bool post(const ExportEvent& ev);
+
+    // ---- consumer: the exporter task ----
+
+    // Connect, batch and publish as far as possible without waiting for new events.
+    // `s` is the current configuration; a change reconnects. Returns the ms until the
+    // next call is due (earlier if post() signals).
+    uint32_t service(const MqttSettings& s, bool network_up);
+
+    // Block until post() signals or `timeout_ms` elapsed.
+    void wait(uint32_t timeout_ms) { m_signal.wait(timeout_ms); }
+
+    // ---- any task (metrics) ----
+
+    bool connected() const { return m_connected.load(std::memory_order_relaxed); }
+    uint32_t depth() const { return m_queue.depth(); }
+    uint32_t highWater() const { return m_queue.highWater(); }
+    uint32_t staged() const { return m_staged_count.load(std::memory_order_relaxed); }
+
+private:
+    bool open(const MqttSettings& s);
+    void drop(bool graceful);
+    void backOff(uint32_t now_ms);
+    bool publishBatch(const MqttSettings& s);
+    size_t encodeBatch(size_t& count);
+    bool ping();
+    bool writeAll(const uint8_t* data, size_t len);
+    bool readPacket(uint8_t& first_byte, uint8_t* body, size_t cap, size_t& len, uint32_t timeout_ms);
+    bool awaitPacket(uint8_t type, uint16_t packet_id, uint32_t timeout_ms);
+
+    MqttTransport& m_transport;
+    SpscQueue<ExportEvent, QUEUE_CAP> m_queue;
+    TaskSignal m_signal;
+    std::atomic<uint32_t> m_lost{0};            // shed since the last published batch
+
+    // exporter task only
+    ExportEvent m_staged[MAX_BATCH];
+    std::atomic<uint32_t> m_staged_count{0};
+    MqttSettings m_active = {};                 // settings of the open connection
+    std::atomic<bool> m_connected{false};
+    bool m_resend = false;                      // the staged head was sent but not acknowledged
+    size_t m_inflight = 0;                      // ... and this many events of it
+    uint32_t m_lost_in_flight = 0;              // "lost" count of the batch being sent
+    uint32_t m_seq = 0;
+    uint16_t m_packet_id = 0;
+    uint32_t m_last_tx_ms = 0;
+    uint32_t m_retry_at_ms = 0;
+    uint32_t m_retry_ms = RETRY_MIN_MS;
+    uint8_t m_packet[PACKET_CAP];
+    char m_payload[PAYLOAD_CAP];
+};
+
+#endif // #ifndef MQTT_EXPORT_H
@@ -0,0 +1,60 @@
+#include "PortalAssets.h"
+
+#include <Arduino.h>
+#include <WebServer.h>
+#include <cstring>
+
+#include "PalLog.h"
+#include "PortalAssetsData.h"
+
+static const size_t PORTAL_ASSET_COUNT = sizeof(PORTAL_ASSETS) / sizeof(PORTAL_ASSETS[0]);
+
+const PortalAsset* findPortalAsset(const char* uri)
+{
+    if (strcmp(uri, "/") == 0)
+        uri = "/index.html";
+
+    for (size_t i = 0; i < PORTAL_ASSET_COUNT; ++i)
+    {
+        if (strcmp(PORTAL_ASSETS[i].path, uri) == 0)
+            return &PORTAL_ASSETS[i];
+    }
+    return nullptr;
+}
+
+void servePortalAsset(WebServer& server, const PortalAsset& asset)
+{
+    [[maybe_unused]] uint32_t t0 = micros();    // only read by LOG_D
+
+    // no-cache = "revalidate every time": the browser keeps the body and we answer 304
+    server.sendHeader("ETag", asset.etag);
+    server.sendHeader("Cache-Control", "no-cache");
+
+    if (server.header("If-None-Match") == asset.etag)
+    {
+        server.send(304, asset.mime, "");
+        LOG_D("portal %s: 304 in %lu us", asset.path, (unsigned long)(micros() - t0));
+        return;
+    }
+
+    server.sendHeader("Content-Encoding", "gzip");
+    server.send_P(200, asset.mime, reinterpret_cast<PGM_P>(asset.gz), asset.gz_len);
+    LOG_D("portal %s: %u gzip bytes in %lu us, free heap %u", asset.path, (unsigned)asset.gz_len,
+          (unsigned long)(micros() - t0), (unsigned)ESP.getFreeHeap());
+}
+
+void registerPortalAssets(WebServer& server)
+{
+    static const char* HEADERS[] = { "If-None-Match" };
+    server.collectHeaders(HEADERS, 1);
+
+    for (size_t i = 0; i < PORTAL_ASSET_COUNT; ++i)
+    {
+        const PortalAsset* asset = &PORTAL_ASSETS[i];
+        server.on(asset->path, HTTP_GET, [&server, asset]() { servePortalAsset(server, *asset); });
+    }
+
+    const PortalAsset* index = findPortalAsset("/");
+    if (index != nullptr)
+        server.on("/", HTTP_GET, [&server, index]() { servePortalAsset(server, *index); });
+}
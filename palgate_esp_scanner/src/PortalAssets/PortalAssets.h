@@ -0,0 +1,32 @@
+#ifndef PORTAL_ASSETS_H
+#define PORTAL_ASSETS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+class WebServer;
+
+/**
+ * @brief One pre-gzipped portal file in flash (generated from portal/ by
+ *        tools/build_portal_assets.py into PortalAssetsData.h).
+ */
+struct PortalAsset
+{
+    const char* path;       // URI, e.g. "/index.html"
+    const char* mime;       // Content-Type
+    const uint8_t* gz;      // gzip bytes in flash (PROGMEM)
+    size_t gz_len;
+    const char* etag;       // quoted strong ETag of the gzip bytes
+};
+
+// Lookup by URI; "/" maps to "/index.html". nullptr if unknown.
+const PortalAsset* findPortalAsset(const char* uri);
+
+// Serve one asset: 304 when If-None-Match matches its ETag, otherwise the gzip
+// bytes streamed straight from flash (no heap copy of the body).
+void servePortalAsset(WebServer& server, const PortalAsset& asset);
+
+// Register a GET route for every asset (plus "/") and collect If-None-Match.
+void registerPortalAssets(WebServer& server);
+
+#endif // #ifndef PORTAL_ASSETS_H
@@ -0,0 +1,44 @@
+// GENERATED by tools/build_portal_assets.py from portal/ — do not edit.
+#ifndef PORTAL_ASSETS_DATA_H
+#define PORTAL_ASSETS_DATA_H
+
+#include <pgmspace.h>
+#include "PortalAssets.h"
+
+static const uint8_t ASSET__index_html[461] PROGMEM = {
+    0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x6d,0x92,0x6f,0x6b,0xdb,0x30,
+    0x10,0xc6,0xbf,0x8a,0xa6,0xb1,0xb1,0x41,0x8d,0x9d,0xa4,0x2b,0x9d,0x2d,0x1b,0x4a,
+    0xba,0x8e,0xbd,0x6a,0x58,0x0a,0x63,0x2f,0x65,0xeb,0x9c,0x1c,0x95,0x25,0x4d,0x3a,
+    0xe7,0xcf,0x42,0xbe,0xfb,0xe4,0x38,0x1d,0x2d,0xe4,0x8d,0x85,0xef,0xb9,0x7b,0xee,
+    0xee,0x27,0x89,0x77,0xf7,0x8f,0xf3,0xa7,0xdf,0x8b,0x6f,0x6c,0x4d,0x9d,0xae,0xc4,
+    0xf9,0x0b,0x52,0x55,0xa2,0x03,0x92,0xac,0x59,0x4b,0x1f,0x80,0x4a,0xde,0x53,0x9b,
+    0xdc,0xf2,0x73,0xd4,0xc8,0x0e,0x4a,0xbe,0x41,0xd8,0x3a,0xeb,0x89,0xb3,0xc6,0x1a,
+    0x02,0x13,0xb3,0xb6,0xa8,0x68,0x5d,0x2a,0xd8,0x60,0x03,0xc9,0xe9,0xe7,0x8a,0xa1,
+    0x41,0x42,0xa9,0x93,0xd0,0x48,0x0d,0xe5,0x84,0xb3,0xb4,0x12,0x84,0xa4,0xa1,0x5a,
+    0x48,0xfd,0x5d,0x12,0xb0,0xa8,0x18,0x03,0x5e,0xa4,0x63,0x58,0x04,0xda,0xc7,0xa3,
+    0xb6,0x6a,0x7f,0x68,0xa3,0x73,0xd2,0xca,0x0e,0xf5,0x3e,0xbf,0xf3,0xd1,0xa6,0x70,
+    0x52,0x29,0x34,0xab,0x7c,0x9a,0xb9,0xdd,0x11,0x8d,0xeb,0xe9,0x70,0x6a,0x94,0x4f,
+    0xb2,0xec,0xc3,0x7f,0x75,0x32,0x75,0xbb,0xa2,0x93,0x7e,0x85,0x26,0xbf,0x75,0x3b,
+    0x96,0x15,0xb5,0xdd,0x25,0x01,0xff,0x0e,0x62,0x6d,0xbd,0x02,0x9f,0xc4,0xc8,0xb1,
+    0xee,0x89,0xac,0x39,0xbc,0x29,0x7b,0x65,0x57,0xcb,0xe6,0x79,0xe5,0x6d,0x6f,0x54,
+    0xfe,0xfe,0x7a,0x7e,0xf7,0xf0,0x25,0x2b,0x1a,0xab,0xad,0xcf,0xb7,0x6b,0x24,0x28,
+    0x46,0xa3,0xdc,0x58,0x03,0x47,0x91,0x8e,0x63,0x8b,0x74,0xc4,0x37,0x8c,0x1f,0x51,
+    0xce,0xaa,0xb9,0x35,0x2d,0xae,0x7a,0x0f,0xec,0x17,0x3e,0x60,0x94,0x67,0x95,0x68,
+    0xad,0xef,0x98,0x6c,0x08,0xad,0x29,0x79,0x1a,0xe4,0x06,0x38,0x8b,0x64,0xd7,0x56,
+    0x95,0x7c,0xf1,0xb8,0x7c,0x8a,0xa0,0xb5,0xac,0x41,0x57,0x43,0x09,0x5b,0x2e,0x7f,
+    0xdc,0xe7,0x22,0x1d,0x23,0xe2,0xb4,0xf3,0xf9,0x0a,0x42,0x40,0x15,0x2b,0xe5,0x4e,
+    0x83,0x59,0x45,0xf2,0x7c,0x36,0xe5,0xcc,0xc3,0x9f,0x1e,0x3d,0xa8,0x17,0x8f,0x85,
+    0x0c,0x61,0x1b,0x27,0xbd,0x6c,0xe1,0xa2,0xfa,0xc6,0xe2,0xe6,0x9a,0x33,0xda,0xbb,
+    0xb3,0x34,0x14,0x5e,0xb0,0xf4,0x68,0x3d,0xd2,0x9e,0x7d,0xca,0x58,0xc9,0x9c,0x87,
+    0x16,0x7c,0x94,0xaf,0x98,0x75,0xc3,0x4e,0x52,0x7f,0xbe,0xdc,0xcc,0x4b,0xf3,0xfc,
+    0xe2,0x6e,0xfa,0xae,0x06,0x1f,0x5b,0x63,0x64,0x90,0x9d,0x46,0x28,0xf9,0xd7,0xb8,
+    0xf9,0x78,0x27,0xe7,0xac,0xd0,0xd7,0x1d,0x12,0xaf,0x96,0x91,0x11,0xfb,0x28,0x3b,
+    0x57,0xb0,0x9f,0x10,0x48,0x7a,0x12,0xe9,0x98,0x18,0x89,0x0f,0x38,0xe3,0x31,0x22,
+    0x4f,0x4f,0x8f,0xf8,0x1f,0xab,0x93,0x2d,0x42,0xda,0x02,0x00,0x00,
+};
+
+static const PortalAsset PORTAL_ASSETS[] = {
+    { "/index.html", "text/html", ASSET__index_html, sizeof(ASSET__index_html), "\"ae147505dd6abdc0\"" },
+};
+
+#endif // #ifndef PORTAL_ASSETS_DATA_H
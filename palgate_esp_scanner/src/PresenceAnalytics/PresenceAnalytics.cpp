@@ -0,0 +1,330 @@
+#include "PresenceAnalytics.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// distinct seeds so the sketches and the HyperLogLogs do not share hash bits
+static const uint64_t SEED_COMPANY = 0x9E3779B97F4A7C15ULL;
+static const uint64_t SEED_MAC = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t SEED_DEVICE = 0x165667B19E3779F9ULL;
+
+uint64_t PresenceAnalytics::hashKey(uint64_t key, uint64_t seed)
+{
+    // splitmix64 finalizer
+    uint64_t z = key + seed;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static_assert(sizeof(PresenceAnalytics) <= PresenceAnalytics::RAM_BUDGET, "analytics must fit its fixed RAM budget");
+
+static uint64_t packMac(const uint8_t mac[6])
+{
+    uint64_t k = 0;
+    for (int i = 0; i < 6; ++i)
+        k = (k << 8) | mac[i];
+    return k;
+}
+
+
+// ---- CountMinSketch ----
+
+uint32_t CountMinSketch::add(uint64_t hash)
+{
+    // row i uses h1 + i*h2 (Kirsch-Mitzenmacher): one 64-bit hash for all rows
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1u;
+    uint16_t* cells[DEPTH];
+    uint16_t lowest = UINT16_MAX;
+    for (uint32_t i = 0; i < DEPTH; ++i)
+    {
+        cells[i] = &m_rows[i][(h1 + i * h2) & (WIDTH - 1)];
+        if (*cells[i] < lowest)
+            lowest = *cells[i];
+    }
+
+    if (lowest == UINT16_MAX)
+    {
+        for (auto& row : m_rows)
+        {
+            for (uint16_t& c : row)
+                c >>= 1;
+        }
+        ++m_halvings;
+        lowest >>= 1;
+    }
+
+    // conservative update: only the counters at the minimum grow
+    for (uint16_t* c : cells)
+    {
+        if (*c == lowest)
+            *c = lowest + 1;
+    }
+    return (uint32_t)lowest + 1;
+}
+
+uint32_t CountMinSketch::estimate(uint64_t hash) const
+{
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1u;
+    uint16_t lowest = UINT16_MAX;
+    for (uint32_t i = 0; i < DEPTH; ++i)
+    {
+        uint16_t c = m_rows[i][(h1 + i * h2) & (WIDTH - 1)];
+        if (c < lowest)
+            lowest = c;
+    }
+    return lowest;
+}
+
+void CountMinSketch::clear()
+{
+    memset(m_rows, 0, sizeof(m_rows));
+    m_halvings = 0;
+}
+
+
+// ---- HyperLogLog ----
+
+void HyperLogLog::add(uint64_t hash)
+{
+    uint32_t index = (uint32_t)(hash >> (64 - P));
+    uint64_t rest = hash << P;
+    // rank = leading zeros of the remaining bits + 1 (capped when they are all zero)
+    uint8_t rank = rest ? (uint8_t)(__builtin_clzll(rest) + 1) : (uint8_t)(64 - P + 1);
+    if (rank > m_reg[index])
+        m_reg[index] = rank;
+}
+
+double HyperLogLog::estimate() const
+{
+    const double m = (double)REGISTERS;
+    double sum = 0.0;
+    uint32_t zeros = 0;
+    for (uint8_t r : m_reg)
+    {
+        sum += std::ldexp(1.0, -(int)r);
+        zeros += (r == 0);
+    }
+
+    const double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double e = alpha * m * m / sum;
+
+    // small range: linear counting is more accurate while registers are still empty
+    if (e <= 2.5 * m && zeros != 0)
+        e = m * std::log(m / (double)zeros);
+    return e;
+}
+
+void HyperLogLog::clear()
+{
+    memset(m_reg, 0, sizeof(m_reg));
+}
+
+
+// ---- PresenceAnalytics ----
+
+PresenceAnalytics::Beacon* PresenceAnalytics::findBeacon(uint32_t identity)
+{
+    for (Beacon& b : m_beacons)
+    {
+        if (b.used && b.identity == identity)
+            return &b;
+    }
+    for (Beacon& b : m_beacons)
+    {
+        if (!b.used)
+        {
+            b.used = true;
+            b.identity = identity;
+            return &b;
+        }
+    }
+    return nullptr;
+}
+
+void PresenceAnalytics::closeVisit(Beacon& b)
+{
+    uint32_t dwell_s = (b.last_seen_ms - b.visit_start_ms) / 1000;
+    b.present = false;
+    b.last_dwell_s = dwell_s;
+    b.dwell_total_s += dwell_s;
+    if (dwell_s > b.dwell_max_s)
+        b.dwell_max_s = dwell_s;
+}
+
+void PresenceAnalytics::addHeavy(CountMinSketch& sketch, HeavyHitter* top, uint64_t key, uint64_t seed)
+{
+    uint32_t halvings = sketch.halvings();
+    uint32_t count = sketch.add(hashKey(key, seed));
+    if (sketch.halvings() != halvings)
+    {
+        // keep the tracked counts on the sketch's scale
+        for (size_t i = 0; i < TOP_K; ++i)
+            top[i].count >>= 1;
+    }
+    offerHeavy(top, key, count);
+}
+
+void PresenceAnalytics::offerHeavy(HeavyHitter* top, uint64_t key, uint32_t count)
+{
+    size_t smallest = 0;
+    for (size_t i = 0; i < TOP_K; ++i)
+    {
+        if (top[i].count != 0 && top[i].key == key)
+        {
+            top[i].count = count;
+            return;
+        }
+        if (top[i].count < top[smallest].count)
+            smallest = i;
+    }
+    if (count > top[smallest].count)
+    {
+        top[smallest].key = key;
+        top[smallest].count = count;
+    }
+}
+
+void PresenceAnalytics::observe(const AdvObservation& obs, uint32_t hour)
+{
+    const uint64_t mac = packMac(obs.mac);
+
+    HourCounter& slot = m_hours[hour % HOURS];
+    if (!slot.used || slot.hour != hour)
+    {
+        slot.used = true;
+        slot.hour = hour;
+        slot.devices.clear();
+    }
+    slot.devices.add(hashKey(mac, SEED_DEVICE));
+
+    if (obs.flags & AdvObservation::TARGET)
+    {
+        ++m_target_adverts;
+        Beacon* b = findBeacon(obs.identity);
+        if (b == nullptr)
+        {
+            ++m_beacon_overflow;
+            return;
+        }
+        if (!b->present)
+        {
+            b->present = true;
+            b->visit_start_ms = obs.at_ms;
+            ++b->arrivals;
+            uint16_t& per_hour = b->arrivals_by_hour[hour % 24];
+            if (per_hour != UINT16_MAX)
+                ++per_hour;
+        }
+        b->last_seen_ms = obs.at_ms;
+        b->last_rssi = obs.rssi;
+        return;
+    }
+
+    ++m_foreign_adverts;
+    if (obs.company != AdvObservation::NO_COMPANY)
+        addHeavy(m_companies, m_top_companies, obs.company, SEED_COMPANY);
+    addHeavy(m_macs, m_top_macs, mac, SEED_MAC);
+}
+
+void PresenceAnalytics::tick(uint32_t now_ms)
+{
+    for (Beacon& b : m_beacons)
+    {
+        if (b.used && b.present && (int32_t)(now_ms - b.last_seen_ms) > (int32_t)ABSENCE_MS)
+            closeVisit(b);
+    }
+}
+
+void PresenceAnalytics::heavyJson(std::string& out, const char* name, const HeavyHitter* e, bool mac)
+{
+    char buf[64];
+
+    out += "\"";
+    out += name;
+    out += "\":[";
+    bool comma = false;
+    for (size_t i = 0; i < TOP_K; ++i)
+    {
+        if (e[i].count == 0)
+            continue;
+        if (mac)
+        {
+            uint64_t k = e[i].key;
+            snprintf(buf, sizeof(buf), "%s{\"mac\":\"%02x:%02x:%02x:%02x:%02x:%02x\",\"count\":%u}", comma ? "," : "",
+                     (unsigned)(k >> 40) & 0xFF, (unsigned)(k >> 32) & 0xFF, (unsigned)(k >> 24) & 0xFF,
+                     (unsigned)(k >> 16) & 0xFF, (unsigned)(k >> 8) & 0xFF, (unsigned)k & 0xFF, (unsigned)e[i].count);
+        }
+        else
+        {
+            snprintf(buf, sizeof(buf), "%s{\"company\":\"0x%04x\",\"count\":%u}", comma ? "," : "",
+                     (unsigned)e[i].key, (unsigned)e[i].count);
+        }
+        out += buf;
+        comma = true;
+    }
+    out += "]";
+}
+
+void PresenceAnalytics::toJson(std::string& out, uint32_t now_ms, uint32_t hour, uint32_t dropped) const
+{
+    char buf[160];
+    snprintf(buf, sizeof(buf),
+             "{\"target_adverts\":%u,\"foreign_adverts\":%u,\"dropped_observations\":%u,\"beacon_overflow\":%u,\"beacons\":[",
+             (unsigned)m_target_adverts, (unsigned)m_foreign_adverts, (unsigned)dropped, (unsigned)m_beacon_overflow);
+    out += buf;
+
+    bool comma = false;
+    for (const Beacon& b : m_beacons)
+    {
+        if (!b.used)
+            continue;
+        // the rolling-code beacon has no fixed major/minor
+        out += comma ? "," : "";
+        if (b.identity == AdvObservation::ROLLING_BEACON)
+            snprintf(buf, sizeof(buf), "{\"rolling\":true,");
+        else
+            snprintf(buf, sizeof(buf), "{\"major\":%u,\"minor\":%u,", (unsigned)(b.identity >> 16), (unsigned)(b.identity & 0xFFFF));
+        out += buf;
+        snprintf(buf, sizeof(buf), "\"present\":%s,\"arrivals\":%u,\"last_seen_s_ago\":%u,\"last_rssi\":%d,",
+                 b.present ? "true" : "false", (unsigned)b.arrivals, (unsigned)((now_ms - b.last_seen_ms) / 1000), (int)b.last_rssi);
+        out += buf;
+        snprintf(buf, sizeof(buf), "\"dwell_total_s\":%u,\"dwell_max_s\":%u,\"last_dwell_s\":%u,\"arrivals_by_utc_hour\":[",
+                 (unsigned)b.dwell_total_s, (unsigned)b.dwell_max_s, (unsigned)b.last_dwell_s);
+        out += buf;
+        for (size_t h = 0; h < 24; ++h)
+        {
+            snprintf(buf, sizeof(buf), "%s%u", h ? "," : "", (unsigned)b.arrivals_by_hour[h]);
+            out += buf;
+        }
+        out += "]}";
+        comma = true;
+    }
+    out += "],";
+
+    // counts are relative: each halving divided them by two
+    snprintf(buf, sizeof(buf), "\"company_halvings\":%u,\"mac_halvings\":%u,",
+             (unsigned)m_companies.halvings(), (unsigned)m_macs.halvings());
+    out += buf;
+    heavyJson(out, "top_companies", m_top_companies, false);
+    out += ",";
+    heavyJson(out, "top_macs", m_top_macs, true);
+
+    // newest hour first
+    out += ",\"distinct_devices_per_hour\":[";
+    comma = false;
+    for (size_t back = 0; back < HOURS && back <= hour; ++back)
+    {
+        const HourCounter& slot = m_hours[(hour - back) % HOURS];
+        if (!slot.used || slot.hour != hour - back)
+            continue;
+        snprintf(buf, sizeof(buf), "%s{\"hour\":%u,\"devices\":%.0f}", comma ? "," : "",
+                 (unsigned)slot.hour, slot.devices.estimate());
+        out += buf;
+        comma = true;
+    }
+    out += "]}\n";
+}
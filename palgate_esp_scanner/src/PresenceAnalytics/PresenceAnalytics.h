@@ -0,0 +1,153 @@
+#ifndef PRESENCE_ANALYTICS_H
+#define PRESENCE_ANALYTICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/**
+ * @brief One advertisement as the BLE callback hands it to the analytics (POD, 20 bytes).
+ */
+struct AdvObservation
+{
+    static const uint16_t NO_COMPANY = 0xFFFF;  // no manufacturer data
+    static const uint8_t TARGET = 0x01;         // matched the target iBeacon
+    static const uint32_t ROLLING_BEACON = 0xFFFFFFFF;     // every press of the rolling-code beacon
+
+    uint8_t mac[6];
+    uint16_t company;       // Bluetooth SIG company ID of the manufacturer data
+    uint32_t identity;      // target only: major << 16 | minor, or ROLLING_BEACON
+    uint32_t at_ms;         // millis() when the callback saw it
+    int8_t rssi;
+    uint8_t flags;
+};
+
+
+/**
+ * @brief Count-min sketch with conservative update and 16-bit counters.
+ *        Estimates never undercount; overcount is bounded by ~e/WIDTH of the total.
+ *        When a counter would overflow, every counter is halved (halvings() counts
+ *        this), so the sketch keeps ranking keys with old traffic weighted down.
+ */
+class CountMinSketch
+{
+public:
+    static const uint32_t DEPTH = 4;
+    static const uint32_t WIDTH = 256;      // power of two
+
+    // Add one occurrence of `hash`; returns the new estimate.
+    uint32_t add(uint64_t hash);
+    uint32_t estimate(uint64_t hash) const;
+    uint32_t halvings() const { return m_halvings; }
+    void clear();
+
+private:
+    uint16_t m_rows[DEPTH][WIDTH] = {};
+    uint32_t m_halvings = 0;
+};
+
+
+/**
+ * @brief HyperLogLog distinct counter, 2^P one-byte registers (~1.04/sqrt(2^P) error).
+ */
+class HyperLogLog
+{
+public:
+    static const uint32_t P = 8;
+    static const uint32_t REGISTERS = 1u << P;
+
+    void add(uint64_t hash);
+    double estimate() const;
+    void clear();
+
+private:
+    uint8_t m_reg[REGISTERS] = {};
+};
+
+
+/**
+ * @brief Fixed-memory presence statistics fed by the advertisement stream.
+ *
+ * - per beacon (its identity: major/minor of the target UUID, or the one rolling-code
+ *   beacon, whose major/minor change every press): arrivals, visits' dwell time,
+ *   arrivals by UTC hour of day
+ * - foreign traffic: count-min sketch of manufacturer IDs and of MACs, each with
+ *   the TOP_K heaviest keys seen so far
+ * - distinct devices per hour: one HyperLogLog per hour for the last HOURS hours
+ *
+ * No allocation after construction; sizeof(PresenceAnalytics) is the whole budget.
+ * Single owner: observe(), tick() and toJson() must run on the same task (loop()).
+ */
+class PresenceAnalytics
+{
+public:
+    static const size_t RAM_BUDGET = 12 * 1024; // checked against sizeof(PresenceAnalytics)
+    static const size_t MAX_BEACONS = 16;       // further identities are only counted (beacon_overflow)
+    static const size_t TOP_K = 8;
+    static const size_t HOURS = 24;
+    static const uint32_t ABSENCE_MS = 120000;  // a beacon unheard this long has left
+
+    // Feed one advertisement. `hour` is the current hour index (UNIX time / 3600, or
+    // uptime hours before NTP sync); it selects the distinct-device counter.
+    void observe(const AdvObservation& obs, uint32_t hour);
+
+    // Close visits of beacons not heard for ABSENCE_MS. Call periodically.
+    void tick(uint32_t now_ms);
+
+    // Append the statistics as one JSON object. `dropped` is reported as-is
+    // (observations the hand-over queue had to drop).
+    void toJson(std::string& out, uint32_t now_ms, uint32_t hour, uint32_t dropped) const;
+
+    // 64-bit mix of a packed key (MAC or company ID) with a per-structure seed.
+    static uint64_t hashKey(uint64_t key, uint64_t seed);
+
+private:
+    struct Beacon
+    {
+        uint32_t identity;
+        bool used;
+        bool present;
+        int8_t last_rssi;
+        uint32_t arrivals;
+        uint32_t visit_start_ms;
+        uint32_t last_seen_ms;
+        uint32_t dwell_total_s;
+        uint32_t dwell_max_s;
+        uint32_t last_dwell_s;
+        uint16_t arrivals_by_hour[24];  // UTC hour of day
+    };
+
+    struct HeavyHitter
+    {
+        uint64_t key;       // company ID or MAC (48 bits)
+        uint32_t count;     // count-min estimate when last seen
+    };
+
+    struct HourCounter
+    {
+        uint32_t hour;      // hour index this slot holds; slots are reused round-robin
+        bool used;
+        HyperLogLog devices;
+    };
+
+    Beacon* findBeacon(uint32_t identity);
+    void closeVisit(Beacon& b);
+    static void addHeavy(CountMinSketch& sketch, HeavyHitter* top, uint64_t key, uint64_t seed);
+    static void offerHeavy(HeavyHitter* top, uint64_t key, uint32_t count);
+    static void heavyJson(std::string& out, const char* name, const HeavyHitter* top, bool mac);
+
+    Beacon m_beacons[MAX_BEACONS] = {};
+    uint32_t m_beacon_overflow = 0;
+
+    CountMinSketch m_companies;
+    CountMinSketch m_macs;
+    HeavyHitter m_top_companies[TOP_K] = {};
+    HeavyHitter m_top_macs[TOP_K] = {};
+
+    HourCounter m_hours[HOURS] = {};
+
+    uint32_t m_target_adverts = 0;
+    uint32_t m_foreign_adverts = 0;
+};
+
+#endif // #ifndef PRESENCE_ANALYTICS_H
@@ -0,0 +1,183 @@
+#include "RollingAuth.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <cstring>
+
+#include "Metrics.h"
+#include "PalLog.h"
+
+RollingAuth g_rolling;
+
+static const char* NVS_NAMESPACE = "rolling";
+static const char* NVS_KEY_LAST = "last";
+
+bool RollingAuth::graceElapsed() const
+{
+    return (millis() - m_last_swap_ms) >= GRACE_MS;
+}
+
+void RollingAuth::configure(const RuntimeConfig& c)
+{
+    if (!c.rolling_enabled)
+    {
+        m_enabled.store(false, std::memory_order_release);
+        m_pending_rebuild = false;
+        m_pending_publish = false;  // m_last is in NVS; re-enabling rebuilds from it
+        return;
+    }
+
+    if (!m_loaded)
+    {
+        Preferences prefs;
+        prefs.begin(NVS_NAMESPACE, true);
+        m_last = prefs.getUInt(NVS_KEY_LAST, 0);
+        prefs.end();
+        m_accepted.store(m_last, std::memory_order_release);
+        m_loaded = true;
+    }
+
+    memcpy(m_key, c.rolling_key, sizeof(m_key));
+    m_window = c.rolling_window;
+    m_have_candidate = false;
+
+    // key or window may have changed: full rebuild, now or on a later service() pass
+    if (m_active.load(std::memory_order_relaxed) == nullptr || graceElapsed())
+        rebuild();
+    else
+        m_pending_rebuild = true;
+
+    LOG_I("Rolling code on: last counter %lu, window %u", (unsigned long)m_last, (unsigned)m_window);
+}
+
+void RollingAuth::rebuild()
+{
+    // m_window AES calls
+    const RollingWindow* active = m_active.load(std::memory_order_relaxed);
+    RollingWindow* spare = (active == &m_windows[0]) ? &m_windows[1] : &m_windows[0];
+    spare->reset(m_key, m_last, m_window);
+    m_active.store(spare, std::memory_order_release);
+    m_last_swap_ms = millis();
+    m_spare_current = false;
+    m_pending_rebuild = false;
+    m_pending_publish = false;      // the rebuilt window already starts at m_last
+
+    m_enabled.store(true, std::memory_order_release);
+}
+
+bool RollingAuth::match(const uint8_t tag[RollingCode::TAG_LEN], uint32_t& counter)
+{
+    const RollingWindow* w = m_active.load(std::memory_order_acquire);
+    if (w != nullptr && w->lookup(tag, counter))
+    {
+        // accepted, but the window has not slid past it yet: a repeat advert
+        return counter > m_accepted.load(std::memory_order_acquire);
+    }
+
+    // the beacon repeats its code for the whole press: not an attack, nothing to resync
+    if (w != nullptr && w->isLast(tag))
+        return false;
+
+    g_metrics.rolling_rejected.inc();
+
+    uint8_t empty = 0;
+    if (m_parked_state.compare_exchange_strong(empty, 1, std::memory_order_acquire))
+    {
+        memcpy(m_parked, tag, RollingCode::TAG_LEN);
+        m_parked_state.store(2, std::memory_order_release);
+    }
+    return false;
+}
+
+void RollingAuth::publish(uint32_t last)
+{
+    const RollingWindow* active = m_active.load(std::memory_order_relaxed);
+    RollingWindow* spare = (active == &m_windows[0]) ? &m_windows[1] : &m_windows[0];
+
+    // the spare is one accept (or more) behind: slide it (AES for the new tail only)
+    // unless it still holds the key/window from before the last configure()
+    if (m_spare_current)
+        spare->advance(last);
+    else
+        spare->reset(m_key, last, m_window);
+
+    m_active.store(spare, std::memory_order_release);
+    m_last_swap_ms = millis();
+    m_spare_current = true;     // the previous active window has the same key and window size
+    m_pending_publish = false;
+}
+
+void RollingAuth::accept(uint32_t counter)
+{
+    if (!enabled() || counter <= m_last)
+        return;
+
+    m_last = counter;
+    m_accepted.store(m_last, std::memory_order_release);
+    m_have_candidate = false;
+
+    Preferences prefs;
+    prefs.begin(NVS_NAMESPACE, false);
+    prefs.putUInt(NVS_KEY_LAST, m_last);
+    prefs.end();
+
+    // the spare may still be read by a callback that loaded it before the last swap
+    if (m_pending_rebuild)
+        return;                 // the rebuild starts at m_last anyway
+    if (graceElapsed())
+        publish(m_last);
+    else
+        m_pending_publish = true;
+}
+
+void RollingAuth::service()
+{
+    if (!(m_pending_rebuild || m_pending_publish) || !graceElapsed())
+        return;
+
+    if (m_pending_rebuild)
+        rebuild();
+    else
+        publish(m_last);
+}
+
+bool RollingAuth::resync(uint32_t& counter, uint16_t& major, uint16_t& minor)
+{
+    if (m_parked_state.load(std::memory_order_acquire) != 2)
+        return false;
+
+    uint8_t tag[RollingCode::TAG_LEN];
+    memcpy(tag, m_parked, sizeof(tag));
+    m_parked_state.store(0, std::memory_order_release);
+
+    // the beacon repeats one tag for its whole session: search each tag once
+    if (!enabled() || memcmp(tag, m_last_searched, sizeof(tag)) == 0)
+        return false;
+    memcpy(m_last_searched, tag, sizeof(tag));
+
+    uint8_t expected[RollingCode::TAG_LEN];
+    for (uint32_t c = m_last + m_window + 1; c <= m_last + RESYNC_RANGE; ++c)
+    {
+        RollingCode::tag(m_key, c, expected);
+        if (memcmp(expected, tag, sizeof(tag)) != 0)
+            continue;
+
+        if (m_have_candidate && c == m_candidate + 1)
+        {
+            LOG_W("Rolling code resynchronised at counter %lu", (unsigned long)c);
+            g_metrics.rolling_resyncs.inc();
+            counter = c;
+            // the tag ends with major and minor as sent (big-endian)
+            const size_t at = RollingCode::TAG_LEN - 4;
+            major = (uint16_t)((tag[at] << 8) | tag[at + 1]);
+            minor = (uint16_t)((tag[at + 2] << 8) | tag[at + 3]);
+            return true;
+        }
+
+        LOG_W("Rolling code %lu ahead of window; press again to resync", (unsigned long)(c - m_last));
+        m_have_candidate = true;
+        m_candidate = c;
+        return false;
+    }
+    return false;
+}
@@ -0,0 +1,83 @@
+#ifndef ROLLING_AUTH_H
+#define ROLLING_AUTH_H
+
+#include <stdint.h>
+#include <atomic>
+
+#include "RollingCode.h"
+#include "RuntimeConfig.h"
+
+/**
+ * @brief Scanner side of the rolling beacon code.
+ *
+ * The BLE callback checks each advert's tag with one RollingWindow lookup (no AES).
+ * loop() accepts the counter it acted on: the window slides past it (AES only for the
+ * new tail) in the inactive buffer, which is then published with one pointer store.
+ * A buffer published less than GRACE_MS ago may still be read, so the slide then waits
+ * for a later service() pass instead of stalling loop(); until it lands, counters at or
+ * below the accepted one are filtered by value. Repeat adverts of the accepted press
+ * are recognised by tag and ignored quietly (neither rejected nor searched).
+ * The last accepted counter is kept in NVS, so replays stay rejected across reboots.
+ *
+ * A beacon pressed many times out of range falls outside the window. Its unknown tags are
+ * parked for loop(), which searches further ahead (RESYNC_RANGE AES calls, once per new tag)
+ * and re-anchors only after two consecutive counters were seen, like a car key fob.
+ */
+class RollingAuth
+{
+public:
+    static const uint32_t RESYNC_RANGE = 1024;
+    static const uint32_t GRACE_MS = 500;
+
+    // setup() and whenever the config generation changes (loop()).
+    void configure(const RuntimeConfig& c);
+
+    bool enabled() const { return m_enabled.load(std::memory_order_acquire); }
+
+    // BLE callback: true and the counter when `tag` is inside the window.
+    // A miss is parked for resync() and counted in g_metrics.rolling_rejected.
+    bool match(const uint8_t tag[RollingCode::TAG_LEN], uint32_t& counter);
+
+    // loop(): the counter was acted upon; it and everything before it are now rejected.
+    void accept(uint32_t counter);
+
+    // loop(), every pass: publish a window update deferred by the grace period.
+    void service();
+
+    // loop(): examine a parked unknown tag. True (with the counter to act on and the
+    // major/minor the beacon sent it with) once a desynchronised beacon has sent two
+    // consecutive counters.
+    bool resync(uint32_t& counter, uint16_t& major, uint16_t& minor);
+
+    uint32_t lastAccepted() const { return m_last; }
+
+private:
+    bool graceElapsed() const;
+    void publish(uint32_t last);
+    void rebuild();
+
+    RollingWindow m_windows[2];
+    std::atomic<const RollingWindow*> m_active{nullptr};
+    std::atomic_bool m_enabled{false};
+    uint8_t m_key[16] = {};
+    uint16_t m_window = 0;
+    uint32_t m_last = 0;
+    std::atomic<uint32_t> m_accepted{0};    // m_last for the callback, ahead of the published window
+    bool m_loaded = false;
+    bool m_pending_publish = false;     // accept() ran inside the grace period
+    bool m_pending_rebuild = false;     // configure() ran inside the grace period
+    bool m_spare_current = false;   // inactive window built with the current key/window size
+    uint32_t m_last_swap_ms = 0;
+
+    // callback -> loop hand-over of one unknown tag (0 empty, 1 being written, 2 ready)
+    std::atomic<uint8_t> m_parked_state{0};
+    uint8_t m_parked[RollingCode::TAG_LEN];
+    uint8_t m_last_searched[RollingCode::TAG_LEN] = {};
+
+    bool m_have_candidate = false;
+    uint32_t m_candidate = 0;
+};
+
+extern RollingAuth g_rolling;
+
+#endif // #ifndef ROLLING_AUTH_H
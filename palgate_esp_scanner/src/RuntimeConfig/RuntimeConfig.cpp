@@ -0,0 +1,581 @@
+#include "RuntimeConfig.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#include "token_generator.h"    // hexStringToBytes()
+#include "IBeaconProtocol.h"    // IBeacon::BEACON_UUID, parseUuid()
+#include "GateLink.h"           // GateLink::parseAddress()
+#include "AdvDecoder.h"         // AdvDecoder::parseFormats()
+#include "config.h"             // PALGATE_* credentials (compile-time defaults)
+
+RuntimeConfigStore g_config;
+
+static const char* NVS_NAMESPACE = "cfg";
+static const char* NVS_KEY = "blob";
+
+// An all-zero key is what an unset one looks like, and everyone knows it.
+static bool isZeroKey(const uint8_t* key, size_t len)
+{
+    uint8_t any = 0;
+    for (size_t i = 0; i < len; ++i)
+        any |= key[i];
+    return any == 0;
+}
+
+RuntimeConfig RuntimeConfigStore::defaults()
+{
+    RuntimeConfig c;
+    memset(&c, 0, sizeof(c));
+
+    // the beacon's compile-time identity, in over-the-air order
+    static_assert(sizeof(c.target_uuid) == IBeacon::UUID_LEN, "target_uuid holds one iBeacon UUID");
+    memcpy(c.target_uuid, IBeacon::BEACON_UUID.bytes, sizeof(c.target_uuid));
+
+    c.debounce_ms = 10000;
+    c.coalesce_ms = 4000;
+    c.scan_window_ms = 80;
+    c.loop_awake_ms = 200;
+    c.sleep_ms = 2800;
+    c.led_on_ms = 3000;
+    c.scan_hw_interval_ms = 200;
+    c.scan_hw_window_ms = 200;
+
+#ifdef PALGATE_ROLLING_KEY_HEX
+    c.rolling_enabled = hexStringToBytes(PALGATE_ROLLING_KEY_HEX, c.rolling_key, sizeof(c.rolling_key)) &&
+                        !isZeroKey(c.rolling_key, sizeof(c.rolling_key)) ? 1 : 0;
+#endif
+    c.rolling_window = 32;
+    c.adv_formats = AdvDecoder::DEFAULT_FORMATS;
+#ifdef PALGATE_ADV_FORMATS
+    AdvDecoder::parseFormats(PALGATE_ADV_FORMATS, c.adv_formats);     // unchanged if malformed
+#endif
+    if (c.rolling_enabled)
+        c.adv_formats = formatBit(AdFormat::IBeacon);  // the static formats would bypass the code
+
+    c.phone_number = PALGATE_PHONE_NUMBER;
+    hexStringToBytes(PALGATE_SESSION_TOKEN, c.session, sizeof(c.session));
+    c.token_type = (uint8_t)PALGATE_TOKEN_TYPE;
+    strncpy(c.gate_host, "api1.pal-es.com", sizeof(c.gate_host) - 1);
+    strncpy(c.gate_path, "/v1/bt/device/4G600106591/open-gate?outputNum=1", sizeof(c.gate_path) - 1);
+
+    c.gate_ble_timeout_ms = 3000;
+#ifdef PALGATE_GATE_BLE_ADDR
+    if (!GateLink::parseAddress(PALGATE_GATE_BLE_ADDR, c.gate_ble_addr) ||
+        !parseUuid(PALGATE_GATE_BLE_SERVICE_UUID, c.gate_ble_service) ||
+        !parseUuid(PALGATE_GATE_BLE_CHAR_UUID, c.gate_ble_char))
+    {
+        memset(c.gate_ble_addr, 0, sizeof(c.gate_ble_addr));
+    }
+#endif
+
+#if defined(PALGATE_MESH_WINDOW_MS) && defined(PALGATE_MESH_KEY_HEX)
+    if (hexStringToBytes(PALGATE_MESH_KEY_HEX, c.mesh_key, sizeof(c.mesh_key)) && !isZeroKey(c.mesh_key, sizeof(c.mesh_key)))
+        c.mesh_window_ms = PALGATE_MESH_WINDOW_MS;
+#endif
+    c.mesh_port = 47474;
+    c.mesh_min_rssi = -80;
+
+    c.tls_arena_kb = 48;
+#ifdef PALGATE_API_PIN_SHA256
+    hexStringToBytes(PALGATE_API_PIN_SHA256, c.api_pins[0], sizeof(c.api_pins[0]));
+#endif
+#ifdef PALGATE_API_PIN_BACKUP_SHA256
+    hexStringToBytes(PALGATE_API_PIN_BACKUP_SHA256, c.api_pins[1], sizeof(c.api_pins[1]));
+#endif
+
+#ifdef PALGATE_MQTT_HOST
+    strncpy(c.mqtt_host, PALGATE_MQTT_HOST, sizeof(c.mqtt_host) - 1);
+#endif
+#ifdef PALGATE_MQTT_TOPIC
+    strncpy(c.mqtt_topic, PALGATE_MQTT_TOPIC, sizeof(c.mqtt_topic) - 1);
+#else
+    strncpy(c.mqtt_topic, "palgate", sizeof(c.mqtt_topic) - 1);
+#endif
+#ifdef PALGATE_MQTT_USER
+    strncpy(c.mqtt_user, PALGATE_MQTT_USER, sizeof(c.mqtt_user) - 1);
+#endif
+#ifdef PALGATE_MQTT_PASS
+    strncpy(c.mqtt_pass, PALGATE_MQTT_PASS, sizeof(c.mqtt_pass) - 1);
+#endif
+#ifdef PALGATE_MQTT_PORT
+    c.mqtt_port = PALGATE_MQTT_PORT;
+#else
+    c.mqtt_port = 1883;
+#endif
+#ifdef PALGATE_MQTT_QOS
+    c.mqtt_qos = PALGATE_MQTT_QOS;
+#else
+    c.mqtt_qos = 1;
+#endif
+    c.mqtt_batch_ms = 250;
+    c.mqtt_keepalive_s = 60;
+
+    return c;
+}
+
+uint32_t RuntimeConfigStore::checksum(const RuntimeConfig& c)
+{
+    // FNV-1a: enough to reject a blob from another firmware layout
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&c);
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof(RuntimeConfig, crc); ++i)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+bool RuntimeConfigStore::validate(const RuntimeConfig& c, const char*& error)
+{
+    if (c.scan_window_ms < 10 || c.scan_window_ms > 2000)           { error = "scan_window_ms must be 10..2000"; return false; }
+    if (c.loop_awake_ms < c.scan_window_ms || c.loop_awake_ms > 10000) { error = "loop_awake_ms must be scan_window_ms..10000"; return false; }
+    if (c.sleep_ms > 60000)                                         { error = "sleep_ms must be <= 60000"; return false; }
+    if (c.debounce_ms > 600000)                                     { error = "debounce_ms must be <= 600000"; return false; }
+    if (c.coalesce_ms > 30000)                                      { error = "coalesce_ms must be <= 30000"; return false; }
+    if (c.led_on_ms > 60000)                                        { error = "led_on_ms must be <= 60000"; return false; }
+    if (c.scan_hw_interval_ms < 3 || c.scan_hw_interval_ms > 10240) { error = "scan_hw_interval_ms must be 3..10240"; return false; }
+    if (c.scan_hw_window_ms < 3 || c.scan_hw_window_ms > c.scan_hw_interval_ms) { error = "scan_hw_window_ms must be 3..scan_hw_interval_ms"; return false; }
+    if (c.rolling_enabled > 1)                                      { error = "rolling_enabled must be 0 or 1"; return false; }
+    if (c.rolling_window < 1 || c.rolling_window > 64)              { error = "rolling_window must be 1..64"; return false; }
+    if (c.rolling_enabled && isZeroKey(c.rolling_key, sizeof(c.rolling_key))) { error = "rolling_enabled needs a non-zero rolling_key"; return false; }
+    if (c.adv_formats == 0 || (c.adv_formats & ~AdvDecoder::ALL_FORMATS) != 0) { error = "adv_formats must name at least one known format"; return false; }
+    if (c.rolling_enabled && c.adv_formats != formatBit(AdFormat::IBeacon)) { error = "rolling_enabled needs adv_formats=ibeacon (the others are static)"; return false; }
+    if (c.token_type > 2)                                           { error = "token_type must be 0..2"; return false; }
+    if (c.gate_host[0] == '\0' || memchr(c.gate_host, '\0', sizeof(c.gate_host)) == nullptr) { error = "gate_host invalid"; return false; }
+    if (c.gate_path[0] != '/' || memchr(c.gate_path, '\0', sizeof(c.gate_path)) == nullptr)  { error = "gate_path must start with /"; return false; }
+    if (c.gate_ble_timeout_ms < 500 || c.gate_ble_timeout_ms > 10000) { error = "gate_ble_timeout_ms must be 500..10000"; return false; }
+    if (c.mesh_window_ms > 2000)                                    { error = "mesh_window_ms must be <= 2000"; return false; }
+    if (c.mesh_port < 1024)                                         { error = "mesh_port must be 1024..65535"; return false; }
+    if (c.mesh_min_rssi > 0)                                        { error = "mesh_min_rssi must be <= 0"; return false; }
+    if (c.mesh_window_ms != 0 && isZeroKey(c.mesh_key, sizeof(c.mesh_key))) { error = "mesh_window_ms needs a mesh_key"; return false; }
+    if (c.tls_max_frag != 0 && c.tls_max_frag != 512 && c.tls_max_frag != 1024 && c.tls_max_frag != 2048 && c.tls_max_frag != 4096)
+                                                                    { error = "tls_max_frag must be 0, 512, 1024, 2048 or 4096"; return false; }
+    if (c.tls_arena_kb != 0 && (c.tls_arena_kb < 24 || c.tls_arena_kb > 96)) { error = "tls_arena_kb must be 0 or 24..96"; return false; }
+    if (strpbrk(c.gate_host, "\"\\/ ") != nullptr || strpbrk(c.gate_path, "\"\\ ") != nullptr) { error = "gate_host/gate_path contain invalid characters"; return false; }
+    if (memchr(c.mqtt_host, '\0', sizeof(c.mqtt_host)) == nullptr || memchr(c.mqtt_topic, '\0', sizeof(c.mqtt_topic)) == nullptr ||
+        memchr(c.mqtt_user, '\0', sizeof(c.mqtt_user)) == nullptr || memchr(c.mqtt_pass, '\0', sizeof(c.mqtt_pass)) == nullptr)
+                                                                    { error = "mqtt_* string not terminated"; return false; }
+    if (strpbrk(c.mqtt_host, "\"\\/ ") != nullptr || strpbrk(c.mqtt_user, "\"\\") != nullptr) { error = "mqtt_host/mqtt_user contain invalid characters"; return false; }
+    if (c.mqtt_topic[0] == '\0' || strpbrk(c.mqtt_topic, "+#\"\\ ") != nullptr) { error = "mqtt_topic must be a topic name without wildcards"; return false; }
+    if (c.mqtt_port == 0)                                           { error = "mqtt_port must be 1..65535"; return false; }
+    if (c.mqtt_qos > 1)                                             { error = "mqtt_qos must be 0 or 1"; return false; }
+    if (c.mqtt_batch_ms > 10000)                                    { error = "mqtt_batch_ms must be <= 10000"; return false; }
+    if (c.mqtt_keepalive_s != 0 && (c.mqtt_keepalive_s < 10 || c.mqtt_keepalive_s > 3600)) { error = "mqtt_keepalive_s must be 0 or 10..3600"; return false; }
+    return true;
+}
+
+// Exactly 2*len hex digits and nothing else (sscanf-based parsing also takes
+// signs, spaces and trailing characters).
+static bool parseHex(const char* text, uint8_t* out, size_t len)
+{
+    if (text == nullptr || strlen(text) != 2 * len)
+        return false;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        int hi = IBeacon::hexValue(text[2 * i]);
+        int lo = IBeacon::hexValue(text[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+}
+
+bool RuntimeConfigStore::parseUuid(const char* text, uint8_t out[16])
+{
+    // plain 32 digits, or the canonical dashed form (dashes only at 8, 13, 18, 23)
+    char digits[33];
+    size_t n = 0;
+    size_t len = (text != nullptr) ? strlen(text) : 0;
+    bool dashed = (len == 36);
+    if (len != 32 && !dashed)
+        return false;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        bool dash_here = dashed && (i == 8 || i == 13 || i == 18 || i == 23);
+        if (dash_here != (text[i] == '-'))
+            return false;
+        if (!dash_here)
+            digits[n++] = text[i];
+    }
+    digits[n] = '\0';
+
+    return parseHex(digits, out, 16);
+}
+
+void RuntimeConfigStore::begin()
+{
+    RuntimeConfig c = defaults();
+
+    Preferences prefs;
+    prefs.begin(NVS_NAMESPACE, true);   // read-only
+    RuntimeConfig stored;
+    const char* error = nullptr;
+    if (prefs.getBytes(NVS_KEY, &stored, sizeof(stored)) == sizeof(stored) &&
+        stored.crc == checksum(stored) && validate(stored, error))
+    {
+        c = stored;
+    }
+    prefs.end();
+
+    m_buffers[0] = c;
+    m_active.store(&m_buffers[0], std::memory_order_release);
+    m_last_swap_ms = millis();
+}
+
+bool RuntimeConfigStore::graceElapsed() const
+{
+    return (millis() - m_last_swap_ms) >= GRACE_MS;
+}
+
+bool RuntimeConfigStore::apply(const RuntimeConfig& next, const char*& error)
+{
+    if (!validate(next, error))
+        return false;
+
+    RuntimeConfig staged = next;
+    staged.generation = latest().generation + 1;
+    staged.crc = checksum(staged);
+
+    Preferences prefs;
+    prefs.begin(NVS_NAMESPACE, false);
+    bool ok = prefs.putBytes(NVS_KEY, &staged, sizeof(staged)) == sizeof(staged);
+    prefs.end();
+    if (!ok)
+    {
+        error = "NVS write failed";
+        return false;
+    }
+
+    // the inactive buffer may still be referenced by a reader of the previous
+    // swap: a second update that soon waits in m_next instead of the loop spinning
+    m_next = staged;
+    m_pending = true;
+    service();
+    return true;
+}
+
+void RuntimeConfigStore::service()
+{
+    if (m_pending && graceElapsed())
+        publish();
+}
+
+void RuntimeConfigStore::publish()
+{
+    const RuntimeConfig* active = m_active.load(std::memory_order_relaxed);
+    RuntimeConfig* spare = (active == &m_buffers[0]) ? &m_buffers[1] : &m_buffers[0];
+
+    *spare = m_next;
+    m_pending = false;
+    m_active.store(spare, std::memory_order_release);
+    m_last_swap_ms = millis();
+}
+
+void RuntimeConfigStore::reset()
+{
+    Preferences prefs;
+    prefs.begin(NVS_NAMESPACE, false);
+    prefs.clear();
+    prefs.end();
+}
+
+
+
+// Parses an unsigned decimal into [0, max]; rejects empty strings and trailing junk.
+static bool parseUnsigned(const char* text, uint64_t max, uint64_t& out)
+{
+    if (text == nullptr || *text == '\0')
+        return false;
+
+    char* end = nullptr;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (*end != '\0' || v > max)
+        return false;
+
+    out = v;
+    return true;
+}
+
+static bool copyString(char* dst, size_t size, const char* src)
+{
+    size_t len = strlen(src);
+    if (len >= size)
+        return false;
+    memcpy(dst, src, len + 1);
+    memset(dst + len, 0, size - len - 1);  // keep the NVS blob / checksum deterministic
+    return true;
+}
+
+bool RuntimeConfigStore::setField(RuntimeConfig& c, const char* key, const char* value, const char*& error)
+{
+    uint64_t v = 0;
+
+    struct U32Field { const char* name; uint32_t RuntimeConfig::* field; };
+    static const U32Field U32_FIELDS[] =
+    {
+        { "debounce_ms",    &RuntimeConfig::debounce_ms },
+        { "scan_window_ms", &RuntimeConfig::scan_window_ms },
+        { "loop_awake_ms",  &RuntimeConfig::loop_awake_ms },
+        { "sleep_ms",       &RuntimeConfig::sleep_ms },
+        { "led_on_ms",      &RuntimeConfig::led_on_ms },
+    };
+
+    for (const U32Field& f : U32_FIELDS)
+    {
+        if (strcmp(key, f.name) != 0)
+            continue;
+        if (!parseUnsigned(value, UINT32_MAX, v)) { error = "expected unsigned integer"; return false; }
+        c.*f.field = (uint32_t)v;
+        return true;
+    }
+
+    if (strcmp(key, "coalesce_ms") == 0)
+    {
+        if (!parseUnsigned(value, UINT16_MAX, v)) { error = "expected unsigned 16-bit integer"; return false; }
+        c.coalesce_ms = (uint16_t)v;
+        return true;
+    }
+    if (strcmp(key, "scan_hw_interval_ms") == 0)
+    {
+        if (!parseUnsigned(value, UINT16_MAX, v)) { error = "expected unsigned 16-bit integer"; return false; }
+        c.scan_hw_interval_ms = (uint16_t)v;
+        return true;
+    }
+    if (strcmp(key, "scan_hw_window_ms") == 0)
+    {
+        if (!parseUnsigned(value, UINT16_MAX, v)) { error = "expected unsigned 16-bit integer"; return false; }
+        c.scan_hw_window_ms = (uint16_t)v;
+        return true;
+    }
+    if (strcmp(key, "rolling_enabled") == 0)
+    {
+        if (!parseUnsigned(value, UINT8_MAX, v)) { error = "expected unsigned integer"; return false; }
+        c.rolling_enabled = (uint8_t)v;
+        return true;
+    }
+    if (strcmp(key, "rolling_window") == 0)
+    {
+        if (!parseUnsigned(value, UINT8_MAX, v)) { error = "expected unsigned integer"; return false; }
+        c.rolling_window = (uint8_t)v;
+        return true;
+    }
+    if (strcmp(key, "rolling_key") == 0)
+    {
+        if (!parseHex(value, c.rolling_key, sizeof(c.rolling_key))) { error = "rolling_key must be 32 hex digits"; return false; }
+        return true;
+    }
+    if (strcmp(key, "adv_formats") == 0)
+    {
+        if (!AdvDecoder::parseFormats(value, c.adv_formats)) { error = "adv_formats must list ibeacon, altbeacon, eddystone, service_uuid"; return false; }
+        return true;
+    }
+    if (strcmp(key, "target_uuid") == 0)
+    {
+        if (!parseUuid(value, c.target_uuid)) { error = "target_uuid must be 32 hex digits"; return false; }
+        return true;
+    }
+    if (strcmp(key, "phone_number") == 0)
+    {
+        if (!parseUnsigned(value, UINT64_MAX, v)) { error = "expected unsigned integer"; return false; }
+        c.phone_number = v;
+        return true;
+    }
+    if (strcmp(key, "token_type") == 0)
+    {
+        if (!parseUnsigned(value, UINT8_MAX, v)) { error = "expected unsigned integer"; return false; }
+        c.token_type = (uint8_t)v;
+        return true;
+    }
+    if (strcmp(key, "session") == 0)
+    {
+        if (!parseHex(value, c.session, sizeof(c.session))) { error = "session must be 32 hex digits"; return false; }
+        return true;
+    }
+    if (strcmp(key, "gate_host") == 0)
+    {
+        if (!copyString(c.gate_host, sizeof(c.gate_host), value)) { error = "gate_host too long"; return false; }
+        return true;
+    }
+    if (strcmp(key, "gate_path") == 0)
+    {
+        if (!copyString(c.gate_path, sizeof(c.gate_path), value)) { error = "gate_path too long"; return false; }
+        return true;
+    }
+    if (strcmp(key, "gate_ble_addr") == 0)
+    {
+        // empty disables the local path
+        if (value[0] == '\0') { memset(c.gate_ble_addr, 0, sizeof(c.gate_ble_addr)); return true; }
+        if (!GateLink::parseAddress(value, c.gate_ble_addr)) { error = "gate_ble_addr must be aa:bb:cc:dd:ee:ff"; return false; }
+        return true;
+    }
+    if (strcmp(key, "gate_ble_timeout_ms") == 0)
+    {
+        if (!parseUnsigned(value, UINT16_MAX, v)) { error = "expected unsigned 16-bit integer"; return false; }
+        c.gate_ble_timeout_ms = (uint16_t)v;
+        return true;
+    }
+    if (strcmp(key, "gate_ble_service") == 0)
+    {
+        if (!parseUuid(value, c.gate_ble_service)) { error = "gate_ble_service must be 32 hex digits"; return false; }
+        return true;
+    }
+    if (strcmp(key, "gate_ble_char") == 0)
+    {
+        if (!parseUuid(value, c.gate_ble_char)) { error = "gate_ble_char must be 32 hex digits"; return false; }
+        return true;
+    }
+    if (strcmp(key, "mesh_window_ms") == 0)
+    {
+        if (!parseUnsigned(value, UINT16_MAX, v)) { error = "expected unsigned 16-bit integer"; return false; }
+        c.mesh_window_ms = (uint16_t)v;
+        return true;
+    }
+    if (strcmp(key, "mesh_port") == 0)
+    {
+        if (!parseUnsigned(value, UINT16_MAX, v)) { error = "expected unsigned 16-bit integer"; return false; }
+        c.mesh_port = (uint16_t)v;
+        return true;
+    }
+    if (strcmp(key, "mesh_id") == 0)
+    {
+        if (!parseUnsigned(value, UINT32_MAX, v)) { error = "expected unsigned integer"; return false; }
+        c.mesh_id = (uint32_t)v;
+        return true;
+    }
+    if (strcmp(key, "mesh_min_rssi") == 0)
+    {
+        char* end = nullptr;
+        long dbm = strtol(value, &end, 10);
+        if (value[0] == '\0' || *end != '\0' || dbm < INT8_MIN || dbm > INT8_MAX) { error = "expected dBm (-128..0)"; return false; }
+        c.mesh_min_rssi = (int8_t)dbm;
+        return true;
+    }
+    if (strcmp(key, "mesh_key") == 0)
+    {
+        if (!parseHex(value, c.mesh_key, sizeof(c.mesh_key))) { error = "mesh_key must be 32 hex digits"; return false; }
+        return true;
+    }
+    if (strcmp(key, "tls_max_frag") == 0)
+    {
+        if (!parseUnsigned(value, UINT16_MAX, v)) { error = "expected unsigned 16-bit integer"; return false; }
+        c.tls_max_frag = (uint16_t)v;
+        return true;
+    }
+    if (strcmp(key, "tls_arena_kb") == 0)
+    {
+        if (!parseUnsigned(value, UINT8_MAX, v)) { error = "expected unsigned integer"; return false; }
+        c.tls_arena_kb = (uint8_t)v;
+        return true;
+    }
+    if (strcmp(key, "api_pin") == 0 || strcmp(key, "api_pin_backup") == 0)
+    {
+        uint8_t* pin = c.api_pins[strcmp(key, "api_pin") == 0 ? 0 : 1];
+        // empty clears the slot
+        if (value[0] == '\0') { memset(pin, 0, sizeof(c.api_pins[0])); return true; }
+        if (!parseHex(value, pin, sizeof(c.api_pins[0]))) { error = "api_pin must be 64 hex digits (SHA-256)"; return false; }
+        return true;
+    }
+    if (strcmp(key, "mqtt_host") == 0)
+    {
+        // empty turns the export off
+        if (!copyString(c.mqtt_host, sizeof(c.mqtt_host), value)) { error = "mqtt_host too long"; return false; }
+        return true;
+    }
+    if (strcmp(key, "mqtt_topic") == 0)
+    {
+        if (!copyString(c.mqtt_topic, sizeof(c.mqtt_topic), value)) { error = "mqtt_topic too long"; return false; }
+        return true;
+    }
+    if (strcmp(key, "mqtt_user") == 0)
+    {
+        if (!copyString(c.mqtt_user, sizeof(c.mqtt_user), value)) { error = "mqtt_user too long"; return false; }
+        return true;
+    }
+    if (strcmp(key, "mqtt_pass") == 0)
+    {
+        if (!copyString(c.mqtt_pass, sizeof(c.mqtt_pass), value)) { error = "mqtt_pass too long"; return false; }
+        return true;
+    }
+    if (strcmp(key, "mqtt_port") == 0)
+    {
+        if (!parseUnsigned(value, UINT16_MAX, v)) { error = "expected unsigned 16-bit integer"; return false; }
+        c.mqtt_port = (uint16_t)v;
+        return true;
+    }
+    if (strcmp(key, "mqtt_qos") == 0)
+    {
+        if (!parseUnsigned(value, UINT8_MAX, v)) { error = "expected unsigned integer"; return false; }
+        c.mqtt_qos = (uint8_t)v;
+        return true;
+    }
+    if (strcmp(key, "mqtt_batch_ms") == 0)
+    {
+        if (!parseUnsigned(value, UINT16_MAX, v)) { error = "expected unsigned 16-bit integer"; return false; }
+        c.mqtt_batch_ms = (uint16_t)v;
+        return true;
+    }
+    if (strcmp(key, "mqtt_keepalive_s") == 0)
+    {
+        if (!parseUnsigned(value, UINT16_MAX, v)) { error = "expected unsigned 16-bit integer"; return false; }
+        c.mqtt_keepalive_s = (uint16_t)v;
+        return true;
+    }
+
+    error = "unknown key";
+    return false;
+}
+
+void RuntimeConfigStore::toJson(const RuntimeConfig& c, std::string& out)
+{
+    char uuid[33], service[33], characteristic[33];
+    for (size_t i = 0; i < sizeof(c.target_uuid); ++i)
+    {
+        snprintf(uuid + 2 * i, 3, "%02x", c.target_uuid[i]);
+        snprintf(service + 2 * i, 3, "%02x", c.gate_ble_service[i]);
+        snprintf(characteristic + 2 * i, 3, "%02x", c.gate_ble_char[i]);
+    }
+    static const uint8_t UNUSED_PIN[sizeof(c.api_pins[0])] = {};
+    char pins[2][65];
+    for (size_t p = 0; p < 2; ++p)
+    {
+        pins[p][0] = '\0';
+        for (size_t i = 0; memcmp(c.api_pins[p], UNUSED_PIN, sizeof(UNUSED_PIN)) != 0 && i < sizeof(UNUSED_PIN); ++i)
+            snprintf(pins[p] + 2 * i, 3, "%02x", c.api_pins[p][i]);
+    }
+    char formats[48];
+    AdvDecoder::formatsToString(c.adv_formats, formats, sizeof(formats));
+    char addr[18];
+    snprintf(addr, sizeof(addr), "%02x:%02x:%02x:%02x:%02x:%02x", c.gate_ble_addr[0], c.gate_ble_addr[1],
+             c.gate_ble_addr[2], c.gate_ble_addr[3], c.gate_ble_addr[4], c.gate_ble_addr[5]);
+
+    // validate() rejects quotes and backslashes in host/path and the MQTT strings, so they print without escaping
+    char buf[1600];
+    snprintf(buf, sizeof(buf),
+        "{\"generation\":%u,\"target_uuid\":\"%s\",\"debounce_ms\":%u,\"coalesce_ms\":%u,"
+        "\"scan_window_ms\":%u,\"loop_awake_ms\":%u,\"sleep_ms\":%u,\"led_on_ms\":%u,"
+        "\"scan_hw_interval_ms\":%u,\"scan_hw_window_ms\":%u,"
+        "\"rolling_enabled\":%u,\"rolling_window\":%u,\"rolling_key\":\"***\",\"adv_formats\":\"%s\","
+        "\"phone_number\":\"***\",\"session\":\"***\",\"token_type\":%u,"
+        "\"gate_host\":\"%s\",\"gate_path\":\"%s\","
+        "\"gate_ble_addr\":\"%s\",\"gate_ble_timeout_ms\":%u,\"gate_ble_service\":\"%s\",\"gate_ble_char\":\"%s\","
+        "\"mesh_window_ms\":%u,\"mesh_port\":%u,\"mesh_id\":%u,\"mesh_min_rssi\":%d,\"mesh_key\":\"***\","
+        "\"tls_max_frag\":%u,\"tls_arena_kb\":%u,\"api_pin\":\"%s\",\"api_pin_backup\":\"%s\","
+        "\"mqtt_host\":\"%s\",\"mqtt_port\":%u,\"mqtt_qos\":%u,\"mqtt_topic\":\"%s\",\"mqtt_user\":\"%s\",\"mqtt_pass\":\"***\","
+        "\"mqtt_batch_ms\":%u,\"mqtt_keepalive_s\":%u}\n",
+        (unsigned)c.generation, uuid, (unsigned)c.debounce_ms, (unsigned)c.coalesce_ms,
+        (unsigned)c.scan_window_ms, (unsigned)c.loop_awake_ms, (unsigned)c.sleep_ms, (unsigned)c.led_on_ms,
+        (unsigned)c.scan_hw_interval_ms, (unsigned)c.scan_hw_window_ms,
+        (unsigned)c.rolling_enabled, (unsigned)c.rolling_window, formats,
+        (unsigned)c.token_type, c.gate_host, c.gate_path,
+        addr, (unsigned)c.gate_ble_timeout_ms, service, characteristic,
+        (unsigned)c.mesh_window_ms, (unsigned)c.mesh_port, (unsigned)c.mesh_id, (int)c.mesh_min_rssi,
+        (unsigned)c.tls_max_frag, (unsigned)c.tls_arena_kb, pins[0], pins[1],
+        c.mqtt_host, (unsigned)c.mqtt_port, (unsigned)c.mqtt_qos, c.mqtt_topic, c.mqtt_user,
+        (unsigned)c.mqtt_batch_ms, (unsigned)c.mqtt_keepalive_s);
+    out += buf;
+}
@@ -0,0 +1,146 @@
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <type_traits>
+
+/**
+ * @brief Every site-tunable setting, loaded from NVS once at boot.
+ *
+ * Fields read on the detection path come first so they share the first cache
+ * line; the trigger path's cold fields (URL, credentials) follow.
+ */
+struct RuntimeConfig
+{
+    // ---- hot: BLE callback / loop() ----
+    uint8_t target_uuid[16];        // beacon id the scanner triggers on (iBeacon UUID, or another format's, see adv_formats)
+    uint32_t debounce_ms;           // per beacon: ignore its detections this soon after it triggered
+    uint32_t scan_window_ms;        // how long each scan runs before stop() (was 80)
+    uint32_t loop_awake_ms;         // awake time per cycle before light sleep (was 200)
+    uint32_t sleep_ms;              // light-sleep per cycle (was SLEEP_MS)
+    uint32_t led_on_ms;             // LED on time after a successful open
+    uint16_t scan_hw_interval_ms;   // BLEScan::setInterval()
+    uint16_t scan_hw_window_ms;     // BLEScan::setWindow()
+    uint8_t rolling_enabled;        // 1 = iBeacons must carry a rolling code (RollingCode.h)
+    uint8_t rolling_window;         // accepted counters ahead of the last one (1..64)
+    uint16_t coalesce_ms;           // other beacons arriving this soon after an open join it (TriggerPolicy.h)
+    uint8_t adv_formats;            // advertisement formats that can match target_uuid (AdvDecoder.h formatBit() mask)
+    uint8_t reserved_hot[3];
+    uint32_t generation;            // bumped on every applied update
+    uint32_t reserved_gen;          // explicit: phone_number is 8-byte aligned
+
+    // ---- cold: TriggerGate() ----
+    uint64_t phone_number;          // PALGATE_PHONE_NUMBER
+    uint8_t session[16];            // PALGATE_SESSION_TOKEN, already parsed from hex
+    uint8_t token_type;             // PALGATE_TOKEN_TYPE
+    uint8_t reserved[3];
+    char gate_host[48];             // API host (HTTPS, port 443)
+    char gate_path[112];            // request path incl. query
+    uint8_t rolling_key[16];        // PALGATE_ROLLING_KEY_HEX, shared with the beacon
+
+    // ---- cold: local BLE open (GateLink.h) ----
+    uint8_t gate_ble_addr[6];       // PalGate unit's public address; all zero = cloud path only
+    uint16_t gate_ble_timeout_ms;   // connection attempt budget
+    uint8_t gate_ble_service[16];   // GATT service holding the open characteristic
+    uint8_t gate_ble_char[16];      // characteristic the x-bt-token is written to
+
+    // ---- cold: multi-scanner arbitration (ScannerMesh.h) ----
+    uint16_t mesh_window_ms;        // wait this long for other scanners' sightings; 0 = standalone
+    uint16_t mesh_port;             // UDP port of the site's multicast group
+    uint32_t mesh_id;               // this scanner's id in arbitration; 0 = derived from the MAC
+    int8_t mesh_min_rssi;           // dBm the filtered RSSI must reach before a detection is arbitrated
+    uint8_t reserved_mesh[3];
+    uint8_t mesh_key[16];           // signs the site's mesh messages; the same on every scanner
+
+    // ---- cold: cloud request (GateHttp.h, TlsArena.h) ----
+    uint16_t tls_max_frag;          // record size asked of the API host: 512/1024/2048/4096, 0 = no limit
+    uint8_t tls_arena_kb;           // KiB reserved at boot for the TLS session, 0 = heap (applies after a reboot)
+    uint8_t reserved_tls;
+    uint8_t api_pins[2][32];        // SHA-256 of the API host's key (SpkiPins): in use, backup; all zero = not verified
+
+    // ---- cold: MQTT export (MqttExport.h) ----
+    char mqtt_host[48];             // broker host name or address; empty = export off
+    char mqtt_topic[48];            // batches go to <mqtt_topic>/events
+    char mqtt_user[32];             // empty = no credentials
+    char mqtt_pass[32];
+    uint16_t mqtt_port;
+    uint16_t mqtt_batch_ms;         // how long a batch's first event waits for more
+    uint16_t mqtt_keepalive_s;      // 0 = no keepalive
+    uint8_t mqtt_qos;               // 0 or 1
+    uint8_t reserved_mqtt;
+
+    uint32_t crc;                   // over all preceding bytes, for the NVS copy
+};
+
+// The checksum and the NVS blob cover raw bytes: no compiler padding allowed,
+// only reserved_* fields, which defaults() zeroes and copies carry along.
+static_assert(std::has_unique_object_representations<RuntimeConfig>::value, "RuntimeConfig must have no padding");
+
+
+/**
+ * @brief Double-buffered config with atomic publish.
+ *
+ * Readers call cfg(): one acquire load of the active pointer, then plain field
+ * loads. An update is applied to the inactive buffer, validated, persisted and
+ * published with a single pointer store. The buffer a reader may still hold is
+ * reused at the earliest one grace period later (readers never keep the
+ * pointer beyond one callback / loop pass); an update that comes sooner is
+ * persisted at once and published by service() when the grace period ends.
+ */
+class RuntimeConfigStore
+{
+public:
+    static const uint32_t GRACE_MS = 500;
+
+    // Defaults from config.h / compile-time constants, overridden by NVS if valid.
+    void begin();
+
+    const RuntimeConfig& get() const { return *m_active.load(std::memory_order_acquire); }
+
+    // Validate `next`, persist it and make it active, or pending if the last swap
+    // was less than GRACE_MS ago. On failure nothing changes and `error` says why.
+    // Call from loop() only (single writer), like service() and latest().
+    bool apply(const RuntimeConfig& next, const char*& error);
+
+    // Publish a pending update once the grace period has passed (every loop() pass).
+    void service();
+
+    // The config the next reboot starts with: the pending update, else the active one.
+    const RuntimeConfig& latest() const { return m_pending ? m_next : get(); }
+
+    // Forget the NVS copy; defaults apply after the next reboot.
+    void reset();
+
+    static RuntimeConfig defaults();
+    static bool validate(const RuntimeConfig& c, const char*& error);
+    // Exactly 32 hex digits, optionally in the 8-4-4-4-12 form; anything else (trailing digits included) fails.
+    static bool parseUuid(const char* text, uint8_t out[16]);
+
+    // Set one field by name from its text form (the /config form arguments).
+    // Returns false for an unknown key or malformed value. Ranges are checked by validate().
+    static bool setField(RuntimeConfig& c, const char* key, const char* value, const char*& error);
+
+    // JSON object of all fields; phone number, session token, rolling key and MQTT password are masked.
+    static void toJson(const RuntimeConfig& c, std::string& out);
+
+private:
+    static uint32_t checksum(const RuntimeConfig& c);
+    bool graceElapsed() const;
+    void publish();
+
+    RuntimeConfig m_buffers[2];
+    RuntimeConfig m_next;               // persisted, waiting for the grace period
+    bool m_pending = false;
+    std::atomic<const RuntimeConfig*> m_active{&m_buffers[0]};
+    uint32_t m_last_swap_ms = 0;
+};
+
+extern RuntimeConfigStore g_config;
+
+// Shorthand for hot-path reads.
+inline const RuntimeConfig& cfg() { return g_config.get(); }
+
+#endif // #ifndef RUNTIME_CONFIG_H
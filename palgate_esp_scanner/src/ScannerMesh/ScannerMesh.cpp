@@ -0,0 +1,521 @@
+#include "ScannerMesh.h"
+
+#include <cstring>
+
+#include "Aes128.h"
+
+static const uint8_t MAGIC[2] = { 'P', 'M' };
+
+static int32_t clampI32(int32_t v, int32_t lo, int32_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static void put16(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    put16(p, (uint16_t)v);
+    put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return (uint32_t)get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+// RFC 4493 subkey: the block shifted left by one bit, 0x87 folded in on carry.
+static void cmacDouble(const uint8_t in[16], uint8_t out[16])
+{
+    uint8_t carry = in[0] >> 7;
+    for (size_t i = 0; i < 15; ++i)
+        out[i] = (uint8_t)((in[i] << 1) | (in[i + 1] >> 7));
+    out[15] = (uint8_t)((in[15] << 1) ^ (carry ? 0x87 : 0));
+}
+
+// AES-CMAC of the message body (RFC 4493). The body is 1.5 blocks, so the
+// last block is always the padded one and takes the second subkey.
+static void cmac(const uint8_t key[16], const uint8_t body[MeshMessage::BODY_SIZE], uint8_t mac[16])
+{
+    static_assert(MeshMessage::BODY_SIZE > 16 && MeshMessage::BODY_SIZE < 32, "one full block, one partial");
+
+    uint8_t k1[16] = {};
+    uint8_t k2[16];
+    Aes128::encrypt(key, k1, k1);
+    cmacDouble(k1, k1);
+    cmacDouble(k1, k2);
+
+    uint8_t x[16];
+    Aes128::encrypt(key, body, x);
+
+    uint8_t last[16] = {};
+    memcpy(last, body + 16, MeshMessage::BODY_SIZE - 16);
+    last[MeshMessage::BODY_SIZE - 16] = 0x80;
+    for (size_t i = 0; i < 16; ++i)
+        x[i] ^= last[i] ^ k2[i];
+    Aes128::encrypt(key, x, mac);
+}
+
+
+// ---- MeshMessage ----
+
+int32_t MeshMessage::score() const
+{
+    // 2 quarter-dB per dB/s of trend, capped at +/-8 dB/s
+    return (int32_t)rssi_q4 + 2 * clampI32(trend, -8, 8);
+}
+
+bool MeshMessage::beats(const MeshMessage& other) const
+{
+    if (score() != other.score())
+        return score() > other.score();
+    if (samples != other.samples)
+        return samples > other.samples;
+    return scanner_id < other.scanner_id;
+}
+
+void MeshMessage::encode(const uint8_t key[KEY_LEN], uint8_t out[WIRE_SIZE]) const
+{
+    out[0] = MAGIC[0];
+    out[1] = MAGIC[1];
+    out[2] = VERSION;
+    out[3] = (uint8_t)kind;
+    put32(out + 4, scanner_id);
+    put16(out + 8, major);
+    put16(out + 10, minor);
+    put16(out + 12, (uint16_t)rssi_q4);
+    out[14] = (uint8_t)trend;
+    out[15] = samples;
+    put32(out + 16, (uint32_t)unix_ms);
+    put32(out + 20, (uint32_t)(unix_ms >> 32));
+
+    uint8_t mac[16];
+    cmac(key, out, mac);
+    memcpy(out + BODY_SIZE, mac, TAG_SIZE);
+}
+
+bool MeshMessage::authentic(const uint8_t key[KEY_LEN], const uint8_t* in, size_t len)
+{
+    if (len != WIRE_SIZE)
+        return false;
+    uint8_t mac[16];
+    cmac(key, in, mac);
+
+    // constant time, so the tag cannot be found byte by byte
+    uint8_t diff = 0;
+    for (size_t i = 0; i < TAG_SIZE; ++i)
+        diff |= (uint8_t)(mac[i] ^ in[BODY_SIZE + i]);
+    return diff == 0;
+}
+
+bool MeshMessage::decode(const uint8_t* in, size_t len, MeshMessage& out)
+{
+    if (len < BODY_SIZE || in[0] != MAGIC[0] || in[1] != MAGIC[1] || in[2] != VERSION)
+        return false;
+    if (in[3] != (uint8_t)Kind::Sighting && in[3] != (uint8_t)Kind::Claim)
+        return false;
+
+    out.kind = (Kind)in[3];
+    out.scanner_id = get32(in + 4);
+    out.major = get16(in + 8);
+    out.minor = get16(in + 10);
+    out.rssi_q4 = (int16_t)get16(in + 12);
+    out.trend = (int8_t)in[14];
+    out.samples = in[15];
+    out.unix_ms = (uint64_t)get32(in + 16) | ((uint64_t)get32(in + 20) << 32);
+    return out.scanner_id != 0;
+}
+
+
+// ---- TriggerArbiter ----
+
+void TriggerArbiter::setKey(const uint8_t key[MeshMessage::KEY_LEN])
+{
+    memcpy(m_key, key, sizeof(m_key));
+}
+
+TriggerArbiter::Filter* TriggerArbiter::findFilter(uint16_t major, uint16_t minor, uint32_t now_ms)
+{
+    Filter* victim = &m_filters[0];
+    for (Filter& f : m_filters)
+    {
+        if (f.used && f.major == major && f.minor == minor)
+        {
+            if (now_ms - f.last_ms > FILTER_IDLE_MS)
+                f.samples = 0;      // a new approach: forget the last one
+            return &f;
+        }
+        if (!f.used)
+            victim = &f;
+        else if (victim->used && now_ms - f.last_ms > now_ms - victim->last_ms)
+            victim = &f;
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    victim->used = true;
+    victim->major = major;
+    victim->minor = minor;
+    return victim;
+}
+
+void TriggerArbiter::sample(uint16_t major, uint16_t minor, int rssi, uint32_t now_ms)
+{
+    Filter* f = findFilter(major, minor, now_ms);
+    int32_t q4 = rssi * 4;
+
+    if (f->samples == 0)
+    {
+        f->rssi_q4 = q4;
+        f->trend_q4 = 0;
+    }
+    else
+    {
+        // EWMA (alpha 1/4) smooths fading; the trend is the EWMA (1/2) of its slope
+        int32_t prev = f->rssi_q4;
+        f->rssi_q4 += (q4 - f->rssi_q4) / 4;
+        uint32_t dt = now_ms - f->last_ms;
+        if (dt > 0)
+        {
+            int32_t slope = (f->rssi_q4 - prev) * 1000 / (int32_t)dt;
+            f->trend_q4 += (slope - f->trend_q4) / 2;
+        }
+    }
+    f->last_ms = now_ms;
+    if (f->samples < UINT8_MAX)
+        ++f->samples;
+}
+
+int TriggerArbiter::filteredRssi(uint16_t major, uint16_t minor, uint32_t now_ms) const
+{
+    for (const Filter& f : m_filters)
+    {
+        if (f.used && f.major == major && f.minor == minor && f.samples != 0 && now_ms - f.last_ms <= FILTER_IDLE_MS)
+            return f.rssi_q4 / 4;
+    }
+    return -127;
+}
+
+const TriggerArbiter::Claim* TriggerArbiter::findClaim(uint16_t major, uint16_t minor, uint32_t now_ms, uint32_t hold_ms) const
+{
+    for (const Claim& c : m_claims)
+    {
+        if (c.used && c.major == major && c.minor == minor && now_ms - c.at_ms <= hold_ms)
+            return &c;
+    }
+    return nullptr;
+}
+
+void TriggerArbiter::remember(const MeshMessage& msg, uint32_t now_ms)
+{
+    if (msg.kind == MeshMessage::Kind::Claim)
+    {
+        Claim& c = m_claims[m_claims_next];
+        m_claims_next = (m_claims_next + 1) % MAX_CLAIMS;
+        c.used = true;
+        c.major = msg.major;
+        c.minor = msg.minor;
+        c.scanner_id = msg.scanner_id;
+        c.at_ms = now_ms;
+        return;
+    }
+
+    Heard& h = m_heard[m_heard_next];
+    m_heard_next = (m_heard_next + 1) % MAX_HEARD;
+    h.used = true;
+    h.msg = msg;
+    h.at_ms = now_ms;
+}
+
+void TriggerArbiter::settle(Decision d, uint32_t winner_id, uint32_t now_ms, Outcome& out)
+{
+    m_pending = false;
+    out.decision = d;
+    out.major = m_own.major;
+    out.minor = m_own.minor;
+    out.latency_ms = now_ms - m_started_ms;
+    out.winner_id = winner_id;
+}
+
+void TriggerArbiter::broadcast(const MeshMessage& msg)
+{
+    uint8_t buf[MeshMessage::WIRE_SIZE];
+    msg.encode(m_key, buf);
+    if (m_transport.send(buf, sizeof(buf)))
+        ++m_stats.tx;
+}
+
+bool TriggerArbiter::propose(uint16_t major, uint16_t minor, uint32_t window_ms, uint32_t claim_hold_ms,
+                             uint32_t now_ms, uint64_t unix_ms, Outcome& out)
+{
+    if (m_pending)
+        return true;    // still arbitrating the previous detection
+
+    m_own.kind = MeshMessage::Kind::Sighting;
+    m_own.scanner_id = m_id;
+    m_own.major = major;
+    m_own.minor = minor;
+    m_own.rssi_q4 = -127 * 4;
+    m_own.trend = 0;
+    m_own.samples = 0;
+    m_own.unix_ms = unix_ms;
+    for (const Filter& f : m_filters)
+    {
+        if (f.used && f.major == major && f.minor == minor && f.samples != 0)
+        {
+            m_own.rssi_q4 = (int16_t)clampI32(f.rssi_q4, INT16_MIN, INT16_MAX);
+            m_own.trend = (int8_t)clampI32(f.trend_q4 / 4, INT8_MIN, INT8_MAX);
+            m_own.samples = f.samples;
+        }
+    }
+
+    m_started_ms = now_ms;
+    m_window_ms = window_ms;
+    m_repeated = false;
+    m_claim_hold_ms = claim_hold_ms;
+
+    const Claim* claim = findClaim(major, minor, now_ms, claim_hold_ms);
+    if (claim != nullptr)
+    {
+        settle(Decision::Claimed, claim->scanner_id, now_ms, out);
+        return false;
+    }
+
+    // announce even when already outscored: a third scanner that missed the stronger
+    // sighting still stands down on ours
+    broadcast(m_own);
+
+    for (const Heard& h : m_heard)
+    {
+        if (h.used && h.msg.major == major && h.msg.minor == minor &&
+            now_ms - h.at_ms <= 2 * window_ms && h.msg.beats(m_own))
+        {
+            settle(Decision::Outscored, h.msg.scanner_id, now_ms, out);
+            return false;
+        }
+    }
+
+    m_pending = true;
+    return true;
+}
+
+bool TriggerArbiter::poll(uint32_t now_ms, uint64_t unix_ms, Outcome& out)
+{
+    bool settled = false;
+    uint8_t buf[64];
+    size_t len;
+
+    while ((len = m_transport.receive(buf, sizeof(buf))) > 0)
+    {
+        MeshMessage msg;
+        if (len != MeshMessage::WIRE_SIZE)
+        {
+            ++m_stats.rejected;
+            continue;
+        }
+        if (!MeshMessage::authentic(m_key, buf, len))
+        {
+            ++m_stats.forged;
+            continue;
+        }
+        if (!MeshMessage::decode(buf, len, msg))
+        {
+            ++m_stats.rejected;
+            continue;
+        }
+        if (msg.scanner_id == m_id)
+            continue;       // our own datagram, looped back by the group
+
+        // with both clocks synced, drop what was delayed or replayed
+        if (unix_ms != 0 && msg.unix_ms != 0)
+        {
+            uint64_t skew = unix_ms > msg.unix_ms ? unix_ms - msg.unix_ms : msg.unix_ms - unix_ms;
+            if (skew > MAX_SKEW_MS)
+            {
+                ++m_stats.rejected;
+                continue;
+            }
+        }
+
+        ++m_stats.rx;
+        remember(msg, now_ms);
+
+        if (!m_pending || msg.major != m_own.major || msg.minor != m_own.minor)
+            continue;
+        if (msg.kind == MeshMessage::Kind::Claim)
+        {
+            settle(Decision::Claimed, msg.scanner_id, now_ms, out);
+            settled = true;
+        }
+        else if (msg.beats(m_own))
+        {
+            settle(Decision::Outscored, msg.scanner_id, now_ms, out);
+            settled = true;
+        }
+    }
+
+    // one loss would otherwise let a weaker scanner open too
+    if (m_pending && !m_repeated && now_ms - m_started_ms >= m_window_ms / 2)
+    {
+        m_repeated = true;
+        broadcast(m_own);
+    }
+    return settled;
+}
+
+bool TriggerArbiter::decide(uint32_t now_ms, uint64_t unix_ms, Outcome& out)
+{
+    if (!m_pending)
+        return false;
+
+    settle(Decision::Won, m_id, now_ms, out);
+
+    m_held = m_own;
+    m_held.kind = MeshMessage::Kind::Claim;
+    m_held.unix_ms = unix_ms;
+    m_holding = true;
+    m_won_ms = now_ms;
+    m_claim_sent_ms = now_ms;
+    broadcast(m_held);
+    return true;
+}
+
+void TriggerArbiter::repeatClaim(uint16_t major, uint16_t minor, uint32_t now_ms, uint64_t unix_ms)
+{
+    if (!m_holding || m_held.major != major || m_held.minor != minor)
+        return;
+    if (now_ms - m_won_ms > m_claim_hold_ms)
+    {
+        m_holding = false;
+        return;
+    }
+    if (now_ms - m_claim_sent_ms < CLAIM_REPEAT_MS)
+        return;
+
+    m_claim_sent_ms = now_ms;
+    m_held.unix_ms = unix_ms;
+    broadcast(m_held);
+}
+
+const char* TriggerArbiter::decisionName(Decision d)
+{
+    switch (d)
+    {
+        case Decision::Won:         return "won";
+        case Decision::Outscored:   return "outscored";
+        case Decision::Claimed:     return "claimed";
+    }
+    return "?";
+}
+
+
+// ---- UdpMulticastTransport ----
+
+#if defined(ESP32)
+
+bool UdpMulticastTransport::begin(const uint8_t group[4], uint16_t port)
+{
+    // (re)join after every reconnect: the membership belongs to the old netif
+    m_udp.stop();
+    m_joined = m_udp.beginMulticast(IPAddress(group[0], group[1], group[2], group[3]), port) == 1;
+    return m_joined;
+}
+
+bool UdpMulticastTransport::send(const uint8_t* data, size_t len)
+{
+    if (!m_joined || !m_udp.beginMulticastPacket())
+        return false;
+    m_udp.write(data, len);
+    return m_udp.endPacket() == 1;
+}
+
+size_t UdpMulticastTransport::receive(uint8_t* buf, size_t cap)
+{
+    if (!m_joined || m_udp.parsePacket() <= 0)
+        return 0;
+    int n = m_udp.read(buf, cap);   // anything beyond cap is discarded with the packet
+    return n > 0 ? (size_t)n : 0;
+}
+
+#else   // host (Linux): BSD sockets
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+UdpMulticastTransport::~UdpMulticastTransport()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool UdpMulticastTransport::begin(const uint8_t group[4], uint16_t port)
+{
+    if (m_fd >= 0)
+        close(m_fd);
+    m_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_fd < 0)
+        return false;
+
+    memcpy(&m_group, group, 4);
+    m_port = htons(port);
+    in_addr iface;
+    iface.s_addr = inet_addr(m_interface);
+
+    // several scanners in one process (tools/mesh_sim.cpp) share the port
+    int one = 1;
+    sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_port = m_port;
+    local.sin_addr.s_addr = m_group;
+
+    ip_mreq membership = {};
+    membership.imr_multiaddr.s_addr = m_group;
+    membership.imr_interface = iface;
+
+    uint8_t ttl = 1;    // site-local: never routed
+    bool ok = setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0 &&
+              bind(m_fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) == 0 &&
+              setsockopt(m_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) == 0 &&
+              setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) == 0 &&
+              setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &one, sizeof(one)) == 0 &&
+              setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == 0 &&
+              fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK) == 0;
+    if (!ok)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+    return ok;
+}
+
+bool UdpMulticastTransport::send(const uint8_t* data, size_t len)
+{
+    if (m_fd < 0)
+        return false;
+    sockaddr_in to = {};
+    to.sin_family = AF_INET;
+    to.sin_port = m_port;
+    to.sin_addr.s_addr = m_group;
+    return sendto(m_fd, data, len, 0, reinterpret_cast<sockaddr*>(&to), sizeof(to)) == (ssize_t)len;
+}
+
+size_t UdpMulticastTransport::receive(uint8_t* buf, size_t cap)
+{
+    if (m_fd < 0)
+        return 0;
+    ssize_t n = recv(m_fd, buf, cap, 0);
+    return n > 0 ? (size_t)n : 0;
+}
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef SCANNER_MESH_H
+#define SCANNER_MESH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(ESP32)
+#include <WiFiUdp.h>
+#endif
+
+/**
+ * @brief One message between scanners (24 bytes, little-endian, then an 8-byte tag).
+ *
+ * Sighting: "I detected this beacon and would trigger, with this evidence".
+ * Claim:    "I won the arbitration for this beacon and am opening my gate".
+ *
+ * The tag is AES-CMAC (RFC 4493) over the 24 bytes under the site's mesh_key,
+ * truncated to 64 bits: without the key nobody on the LAN can make a scanner
+ * stand down.
+ */
+struct MeshMessage
+{
+    enum class Kind : uint8_t
+    {
+        Sighting = 1,
+        Claim = 2,
+    };
+
+    static const size_t BODY_SIZE = 24;
+    static const size_t TAG_SIZE = 8;
+    static const size_t WIRE_SIZE = BODY_SIZE + TAG_SIZE;
+    static const uint8_t VERSION = 2;
+    static const size_t KEY_LEN = 16;
+
+    Kind kind;
+    uint32_t scanner_id;    // sender; never 0
+    uint16_t major;         // beacon identity
+    uint16_t minor;
+    int16_t rssi_q4;        // filtered RSSI, 1/4 dBm
+    int8_t trend;           // filtered RSSI slope, dB/s (positive = approaching)
+    uint8_t samples;        // sightings behind the estimate (saturates at 255)
+    uint64_t unix_ms;       // sender's clock at detection; 0 before NTP sync
+
+    // Approach evidence: higher wins. A rising signal counts up to +/-4 dB.
+    int32_t score() const;
+
+    // True if this sighting beats `other` (score, then samples, then lower scanner_id),
+    // so every scanner ranks the same set of sightings the same way.
+    bool beats(const MeshMessage& other) const;
+
+    // Body and tag. decode() only parses the body: check authentic() first.
+    void encode(const uint8_t key[KEY_LEN], uint8_t out[WIRE_SIZE]) const;
+    static bool decode(const uint8_t* in, size_t len, MeshMessage& out);
+
+    // True if `in` is a whole datagram whose tag matches its body under `key`.
+    static bool authentic(const uint8_t key[KEY_LEN], const uint8_t* in, size_t len);
+};
+
+
+/**
+ * @brief Datagram transport between the scanners of one site.
+ *
+ * UdpMulticastTransport is the only implementation: on the ESP32 it joins the
+ * group on the STA interface, on Linux it binds to a local interface address
+ * (127.0.0.1 by default), so several arbiters can talk over loopback in
+ * tools/mesh_sim.cpp.
+ */
+class MeshTransport
+{
+public:
+    virtual ~MeshTransport() {}
+
+    virtual bool begin(const uint8_t group[4], uint16_t port) = 0;
+    virtual bool send(const uint8_t* data, size_t len) = 0;
+
+    // Non-blocking: length of the next datagram copied into `buf`, 0 if none is waiting.
+    virtual size_t receive(uint8_t* buf, size_t cap) = 0;
+};
+
+
+/**
+ * @brief Decides which of several scanners that heard the same beacon opens its gate.
+ *
+ * A scanner with a detection calls propose(): it multicasts its Sighting (again
+ * half-way through, against datagram loss) and waits window_ms for the others.
+ * It stands down early when it hears a stronger Sighting or a Claim for the
+ * beacon; at the deadline decide() makes it the winner, and it multicasts a
+ * Claim so scanners that detect the car later stand down too; the Claim is
+ * repeated while the winner keeps hearing the car. Sightings heard up to
+ * 2 * window_ms before propose() still count, so scanners whose scan windows
+ * are out of step compare the same evidence.
+ *
+ * A scanner only stands down on an authentic message it actually received, so
+ * a lost or forged datagram can cause a duplicate open but never a missed one.
+ *
+ * Single owner: every method runs on the loop() task.
+ */
+class TriggerArbiter
+{
+public:
+    enum class Decision : uint8_t
+    {
+        Won = 0,        // no stronger sighting and no claim: open the gate
+        Outscored,      // a peer had stronger evidence for the same beacon
+        Claimed,        // a peer already claimed the beacon
+    };
+
+    struct Outcome
+    {
+        Decision decision;
+        uint16_t major;
+        uint16_t minor;
+        uint32_t latency_ms;    // propose() to the decision
+        uint32_t winner_id;     // scanner that opens (ours when Won, 0 if unknown)
+    };
+
+    struct Stats
+    {
+        uint32_t tx = 0;
+        uint32_t rx = 0;
+        uint32_t rejected = 0;  // malformed or too old
+        uint32_t forged = 0;    // tag does not match: another key, or not a scanner
+    };
+
+    static const size_t MAX_FILTERS = 8;        // beacons with an RSSI estimate
+    static const size_t MAX_HEARD = 16;         // peer sightings remembered for look-back
+    static const size_t MAX_CLAIMS = 8;
+    static const uint32_t FILTER_IDLE_MS = 10000;
+    static const uint32_t MAX_SKEW_MS = 2000;   // reject messages this far from our clock (both synced)
+    static const uint32_t CLAIM_REPEAT_MS = 1000;
+
+    explicit TriggerArbiter(MeshTransport& transport) : m_transport(transport) {}
+
+    void setScannerId(uint32_t id) { m_id = id ? id : 1; }
+    uint32_t scannerId() const { return m_id; }
+
+    // The site's mesh_key: every scanner of the site signs and verifies with it.
+    void setKey(const uint8_t key[MeshMessage::KEY_LEN]);
+
+    // Feed every matching advertisement: keeps the filtered RSSI and its trend per beacon.
+    void sample(uint16_t major, uint16_t minor, int rssi, uint32_t now_ms);
+
+    // Filtered RSSI of a beacon in dBm, -127 if it has no recent samples.
+    int filteredRssi(uint16_t major, uint16_t minor, uint32_t now_ms) const;
+
+    // Start arbitrating a detection. Returns true if it is pending (the caller runs
+    // decide() at now_ms + window_ms); false if it was settled on the spot -- a peer
+    // claimed the beacon within claim_hold_ms, or a stronger sighting was heard
+    // within the last 2 * window_ms -- in which case `out` holds the outcome.
+    bool propose(uint16_t major, uint16_t minor, uint32_t window_ms, uint32_t claim_hold_ms,
+                 uint32_t now_ms, uint64_t unix_ms, Outcome& out);
+
+    // Drain the transport and repeat the pending Sighting once half the window has passed.
+    // Returns true if a message settled the pending arbitration early.
+    bool poll(uint32_t now_ms, uint64_t unix_ms, Outcome& out);
+
+    // Window elapsed: settle the pending arbitration (multicasts a Claim when Won).
+    bool decide(uint32_t now_ms, uint64_t unix_ms, Outcome& out);
+
+    // Call on every further detection of a beacon (e.g. while debounced). If this scanner
+    // won it within the last claim_hold_ms, the Claim goes out again, at most every
+    // CLAIM_REPEAT_MS: scanners that detect the car later, or lost the Claim, stand down.
+    void repeatClaim(uint16_t major, uint16_t minor, uint32_t now_ms, uint64_t unix_ms);
+
+    bool pending() const { return m_pending; }
+    const Stats& stats() const { return m_stats; }
+
+    static const char* decisionName(Decision d);
+
+private:
+    struct Filter
+    {
+        uint16_t major;
+        uint16_t minor;
+        bool used;
+        uint8_t samples;
+        int32_t rssi_q4;
+        int32_t trend_q4;       // 1/4 dB per second
+        uint32_t last_ms;
+    };
+
+    struct Heard
+    {
+        MeshMessage msg;
+        uint32_t at_ms;         // our millis() when it arrived
+        bool used;
+    };
+
+    struct Claim
+    {
+        uint16_t major;
+        uint16_t minor;
+        uint32_t scanner_id;
+        uint32_t at_ms;
+        bool used;
+    };
+
+    Filter* findFilter(uint16_t major, uint16_t minor, uint32_t now_ms);
+    const Claim* findClaim(uint16_t major, uint16_t minor, uint32_t now_ms, uint32_t hold_ms) const;
+    void remember(const MeshMessage& msg, uint32_t now_ms);
+    void settle(Decision d, uint32_t winner_id, uint32_t now_ms, Outcome& out);
+    void broadcast(const MeshMessage& msg);
+
+    MeshTransport& m_transport;
+    uint32_t m_id = 1;
+    uint8_t m_key[MeshMessage::KEY_LEN] = {};
+
+    Filter m_filters[MAX_FILTERS] = {};
+    Heard m_heard[MAX_HEARD] = {};
+    size_t m_heard_next = 0;
+    Claim m_claims[MAX_CLAIMS] = {};
+    size_t m_claims_next = 0;
+
+    bool m_pending = false;
+    MeshMessage m_own = {};     // our Sighting for the pending arbitration
+    uint32_t m_started_ms = 0;
+    uint32_t m_window_ms = 0;
+    bool m_repeated = false;    // the Sighting went out a second time
+    uint32_t m_claim_hold_ms = 0;
+
+    bool m_holding = false;     // we won m_held and our Claim still holds
+    MeshMessage m_held = {};    // the Claim we sent
+    uint32_t m_won_ms = 0;
+    uint32_t m_claim_sent_ms = 0;
+
+    Stats m_stats;
+};
+
+
+/**
+ * @brief MeshTransport over UDP multicast (WiFiUDP on the ESP32, BSD sockets on Linux).
+ */
+class UdpMulticastTransport : public MeshTransport
+{
+public:
+#if !defined(ESP32)
+    // Local interface address to join and send on (the ESP32 always uses the STA interface).
+    explicit UdpMulticastTransport(const char* interface_addr = "127.0.0.1") : m_interface(interface_addr) {}
+    ~UdpMulticastTransport() override;
+#endif
+
+    bool begin(const uint8_t group[4], uint16_t port) override;
+    bool send(const uint8_t* data, size_t len) override;
+    size_t receive(uint8_t* buf, size_t cap) override;
+
+private:
+#if defined(ESP32)
+    WiFiUDP m_udp;
+    bool m_joined = false;
+#else
+    const char* m_interface;
+    int m_fd = -1;
+    uint32_t m_group = 0;   // network order
+    uint16_t m_port = 0;
+#endif
+};
+
+#endif // #ifndef SCANNER_MESH_H
@@ -0,0 +1,106 @@
+#include "SpanTrace.h"
+
+#include <cstdio>
+
+SpanTrace g_trace;
+
+static const char* const STAGE_NAMES[static_cast<size_t>(TraceStage::Count)] =
+{
+    "adv_received", "loop_pickup", "token_generated", "http_begin",
+    "tls_handshake", "request_sent", "first_response_byte", "led_on"
+};
+
+const char* SpanTrace::stageName(TraceStage s)
+{
+    size_t i = static_cast<size_t>(s);
+    return (i < static_cast<size_t>(TraceStage::Count)) ? STAGE_NAMES[i] : "?";
+}
+
+uint32_t SpanTrace::begin()
+{
+    uint32_t id = m_next_id.fetch_add(1, std::memory_order_relaxed) + 1;
+    return id ? id : begin(); // skip 0 on wrap
+}
+
+void SpanTrace::mark(uint32_t id, TraceStage stage, uint64_t ts_us)
+{
+    if (id == 0)
+        return;
+
+    uint32_t claim = m_head.fetch_add(1, std::memory_order_relaxed);
+    Record& r = m_ring[claim & (CAPACITY - 1)];
+
+    // the zero must be visible before any payload byte changes
+    r.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    r.sample.trace_id = id;
+    r.sample.ts_us = ts_us;
+    r.sample.stage = static_cast<uint8_t>(stage);
+    r.seq.store(claim + 1, std::memory_order_release);
+}
+
+bool SpanTrace::read(uint32_t index, Sample& out) const
+{
+    const Record& r = m_ring[index & (CAPACITY - 1)];
+    if (r.seq.load(std::memory_order_acquire) != index + 1)
+        return false;
+
+    out = r.sample;
+
+    // a writer that started during the copy has zeroed or advanced seq by now
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return r.seq.load(std::memory_order_relaxed) == index + 1;
+}
+
+void SpanTrace::dumpChromeJson(WriteFn write, void* ctx, const char* device) const
+{
+    char buf[192];
+    int n = snprintf(buf, sizeof(buf),
+                     "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"device\":\"%s\"},\"traceEvents\":[", device ? device : "");
+    write(buf, (size_t)n, ctx);
+
+    uint32_t head = m_head.load(std::memory_order_acquire);
+    uint32_t first = (head > CAPACITY) ? head - CAPACITY : 0;
+    bool comma = false;
+
+    // Ring order is claim order, so a stage's successor for the same trace is the
+    // next valid record with that id. CAPACITY is small, the scan is O(n^2) only at dump time.
+    for (uint32_t i = first; i < head; ++i)
+    {
+        Sample r;
+        if (!read(i, r))
+            continue;
+
+        uint64_t end_us = r.ts_us;
+        for (uint32_t j = i + 1; j < head; ++j)
+        {
+            Sample next;
+            if (read(j, next) && next.trace_id == r.trace_id)
+            {
+                end_us = next.ts_us;
+                break;
+            }
+        }
+
+        const char* name = stageName(static_cast<TraceStage>(r.stage));
+        if (end_us > r.ts_us)
+        {
+            n = snprintf(buf, sizeof(buf),
+                         "%s{\"name\":\"%s\",\"cat\":\"gate\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":%u}",
+                         comma ? "," : "", name, (unsigned long long)r.ts_us,
+                         (unsigned long long)(end_us - r.ts_us), (unsigned)r.trace_id);
+        }
+        else
+        {
+            // last stage of a trace (or still in flight): instant event
+            n = snprintf(buf, sizeof(buf),
+                         "%s{\"name\":\"%s\",\"cat\":\"gate\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":1,\"tid\":%u}",
+                         comma ? "," : "", name, (unsigned long long)r.ts_us, (unsigned)r.trace_id);
+        }
+
+        write(buf, (size_t)n, ctx);
+        comma = true;
+    }
+
+    write("]}\n", 3, ctx);
+}
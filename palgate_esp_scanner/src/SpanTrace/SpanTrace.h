@@ -0,0 +1,77 @@
+#ifndef SPAN_TRACE_H
+#define SPAN_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Stages of one advertisement -> gate-open event, in pipeline order.
+enum class TraceStage : uint8_t
+{
+    AdvReceived = 0,    // first matching packet in ScanCallbacks::onResult
+    LoopPickup,         // loop() drains the sighting queue, woken by ingest
+    TokenGenerated,     // generateToken() returned
+    HttpBegin,          // connecting to the API host (name kept from http.begin())
+    TlsHandshake,       // TLS connection to the API host established
+    RequestSent,        // GateHttp::get() issued
+    FirstResponseByte,  // GateHttp::get() returned, i.e. the response was read
+    LedOn,              // LED switched on after a 2xx response
+    Count
+};
+
+
+/**
+ * @brief Fixed-size ring of per-event stage timestamps.
+ *
+ * mark() claims a slot with one atomic fetch_add and publishes it with a
+ * release store of its sequence number, so it is safe from the BLE callback
+ * and from loop(). The oldest records are overwritten once the ring wraps.
+ * Dumps read each slot as a seqlock (sequence, copy, sequence again) and skip
+ * slots that were rewritten while being copied.
+ */
+class SpanTrace
+{
+public:
+    static const size_t CAPACITY = 256;     // must be a power of two
+
+    // Sink used by the dump functions (HTTP chunk, Serial, file...).
+    typedef void (*WriteFn)(const char* data, size_t len, void* ctx);
+
+    // Start a new trace; returns its id (never 0).
+    uint32_t begin();
+
+    // Record `stage` for trace `id` at time `ts_us` (esp_timer clock).
+    void mark(uint32_t id, TraceStage stage, uint64_t ts_us);
+
+    // Emit the ring as Chrome / Perfetto trace-event JSON.
+    // Each stage becomes a complete ("X") event lasting until the next recorded stage
+    // of the same trace; one trace id per thread lane.
+    void dumpChromeJson(WriteFn write, void* ctx, const char* device) const;
+
+    static const char* stageName(TraceStage s);
+
+private:
+    struct Sample
+    {
+        uint32_t trace_id;
+        uint64_t ts_us;
+        uint8_t stage;
+    };
+
+    struct Record
+    {
+        std::atomic<uint32_t> seq;      // claim index + 1 once fully written, 0 while writing
+        Sample sample;
+    };
+
+    // Copy the record of claim `index`; false if the slot holds another claim or was rewritten meanwhile.
+    bool read(uint32_t index, Sample& out) const;
+
+    std::atomic<uint32_t> m_next_id{0};
+    std::atomic<uint32_t> m_head{0};
+    Record m_ring[CAPACITY] = {};
+};
+
+extern SpanTrace g_trace;
+
+#endif // #ifndef SPAN_TRACE_H
@@ -0,0 +1,106 @@
+#include "TaskTopology.h"
+
+#if defined(ESP32)
+
+#include "esp_timer.h"
+
+uint64_t TaskTopology::nowUs()
+{
+    return (uint64_t)esp_timer_get_time();
+}
+
+bool TaskTopology::startPinned(const char* name, void (*fn)(void*), void* arg, int core, unsigned priority, uint32_t stack_bytes)
+{
+    // FreeRTOS on the ESP32 takes the stack depth in bytes
+    return xTaskCreatePinnedToCore(fn, name, stack_bytes, arg, priority, nullptr, core) == pdPASS;
+}
+
+#else   // host (Linux): pthreads
+
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
+
+uint64_t TaskTopology::nowUs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+bool TaskTopology::startPinned(const char* name, void (*fn)(void*), void* arg, int core, unsigned priority, uint32_t stack_bytes)
+{
+    struct Start
+    {
+        void (*fn)(void*);
+        void* arg;
+        char name[16];      // Linux thread names: 15 characters
+        static void* run(void* p)
+        {
+            Start s = *static_cast<Start*>(p);
+            delete static_cast<Start*>(p);
+            // named from inside: the creator's handle to a detached thread may already be stale
+            pthread_setname_np(pthread_self(), s.name);
+            s.fn(s.arg);
+            return nullptr;
+        }
+    };
+
+    const size_t stack = stack_bytes < PTHREAD_STACK_MIN ? PTHREAD_STACK_MIN : stack_bytes;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, stack);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    // pin like xTaskCreatePinnedToCore(); a missing core just leaves the thread unpinned
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+
+    pthread_t thread;
+    Start* start = new Start{fn, arg, {}};
+    snprintf(start->name, sizeof(start->name), "%s", name);
+    int rc = pthread_create(&thread, &attr, &Start::run, start);
+    if (rc == EINVAL)
+    {
+        // affinity rejected (core not present): retry unpinned
+        pthread_attr_t plain;
+        pthread_attr_init(&plain);
+        pthread_attr_setstacksize(&plain, stack);
+        pthread_attr_setdetachstate(&plain, PTHREAD_CREATE_DETACHED);
+        rc = pthread_create(&thread, &plain, &Start::run, start);
+        pthread_attr_destroy(&plain);
+    }
+    pthread_attr_destroy(&attr);
+
+    if (rc != 0)
+    {
+        delete start;
+        return false;
+    }
+    (void)priority;
+    return true;
+}
+
+bool TaskSignal::wait(uint32_t timeout_ms)
+{
+    if (timeout_ms == FOREVER)
+        return sem_wait(&m_sem) == 0;
+
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return sem_timedwait(&m_sem, &ts) == 0;
+}
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef TASK_TOPOLOGY_H
+#define TASK_TOPOLOGY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#if defined(ESP32)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#else
+#include <semaphore.h>
+#endif
+
+/*
+ * Scanner task topology. Tasks share no mutable state except through the
+ * bounded SPSC queues below (and the atomic OpenRace between "net" and "local");
+ * every queue has exactly one producer and one consumer.
+ *
+ *   core 0  BT controller + Bluedroid host task
+ *           "ingest"  ScanCallbacks::onResult(): parse, filter, rate-limit
+ *                       |  g_sightings (SightingEvent), g_observations (AdvObservation);
+ *                       |  a sighting signals control at once (g_control_signal)
+ *   core 1              v
+ *           "control" loop(): timer wheel, scan windows, trigger policy, LED, sleep,
+ *                     presence analytics, scanner mesh, /metrics, /config and /analytics
+ *                       |  g_trigger_requests           ^  g_trigger_results
+ *                       v                               |
+ *           "net"     NetTask(): token, TLS, HTTP ------+
+ *           "local"   LocalTask(): token, GATT write; fed by control through
+ *                     g_local_requests / g_local_results, racing "net" (OpenRace)
+ *           "mqtt"    MqttTask(): batches and publishes the events control posts to
+ *                     the MqttExporter's queue (sightings, triggers, outcomes)
+ *
+ * On Linux the same primitives run on pthreads pinned with pthread_setaffinity_np,
+ * so tools/topology_bench.cpp can load the topology with synthetic advertisement floods.
+ */
+namespace TaskTopology
+{
+    static const int RADIO_CORE = 0;    // where the BT host task runs (Bluedroid is pinned to core 0)
+    static const int APP_CORE = 1;      // loop() (ARDUINO_RUNNING_CORE) and the network task
+
+    // Monotonic microseconds (esp_timer on the device, CLOCK_MONOTONIC on the host).
+    uint64_t nowUs();
+
+    // Start `fn(arg)` as a task pinned to `core`. Priority is FreeRTOS-only.
+    bool startPinned(const char* name, void (*fn)(void*), void* arg, int core, unsigned priority, uint32_t stack_bytes);
+}
+
+
+/**
+ * @brief Bounded single-producer / single-consumer ring.
+ *
+ * push() and pop() are wait-free: one acquire load of the other side's index,
+ * a copy, one release store. A full queue rejects the item and counts it as dropped.
+ * depth() and highWater() may be read from any task (for metrics).
+ */
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // producer only
+    bool push(const T& item)
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) >= N)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_items[tail & (N - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        uint32_t depth = tail + 1 - m_head.load(std::memory_order_relaxed);
+        if (depth > m_high_water.load(std::memory_order_relaxed))
+            m_high_water.store(depth, std::memory_order_relaxed);
+        return true;
+    }
+
+    // consumer only
+    bool pop(T& out)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+
+        out = m_items[head & (N - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t depth() const
+    {
+        return m_tail.load(std::memory_order_relaxed) - m_head.load(std::memory_order_relaxed);
+    }
+    uint32_t highWater() const { return m_high_water.load(std::memory_order_relaxed); }
+    uint32_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    // indices on separate cache lines (host) so producer and consumer do not false-share
+    alignas(64) std::atomic<uint32_t> m_head{0};
+    alignas(64) std::atomic<uint32_t> m_tail{0};
+    std::atomic<uint32_t> m_high_water{0};
+    std::atomic<uint32_t> m_dropped{0};
+    T m_items[N];
+};
+
+
+/**
+ * @brief Wakes one consumer task after a push. Carries no data: the consumer
+ *        drains its queue on every wakeup, so extra or merged wakeups are harmless.
+ */
+class TaskSignal
+{
+public:
+    static const uint32_t FOREVER = UINT32_MAX;
+
+#if defined(ESP32)
+    // The waiting task binds itself on its first wait(); a notify() before that is lost,
+    // which is why consumers wait with a timeout.
+    void notify()
+    {
+        TaskHandle_t t = m_task.load(std::memory_order_acquire);
+        if (t)
+            xTaskNotifyGive(t);
+    }
+
+    bool wait(uint32_t timeout_ms)
+    {
+        m_task.store(xTaskGetCurrentTaskHandle(), std::memory_order_release);
+        TickType_t ticks = (timeout_ms == FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+        return ulTaskNotifyTake(pdTRUE, ticks) > 0;
+    }
+
+private:
+    std::atomic<TaskHandle_t> m_task{nullptr};
+#else
+    TaskSignal() { sem_init(&m_sem, 0, 0); }
+    ~TaskSignal() { sem_destroy(&m_sem); }
+
+    void notify() { sem_post(&m_sem); }
+    bool wait(uint32_t timeout_ms);
+
+private:
+    sem_t m_sem;
+#endif
+};
+
+
+/**
+ * @brief Busy time and work items of one task. Single writer (the task itself);
+ *        readable from any task. Milliseconds in 32 bits: 49 days of busy time.
+ */
+class TaskStats
+{
+public:
+    void addBusy(uint32_t us)
+    {
+        m_pending_us += us;
+        if (m_pending_us >= 1000)
+        {
+            m_busy_ms.fetch_add(m_pending_us / 1000, std::memory_order_relaxed);
+            m_pending_us %= 1000;
+        }
+        m_runs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint32_t busyMs() const { return m_busy_ms.load(std::memory_order_relaxed); }
+    uint32_t runs() const { return m_runs.load(std::memory_order_relaxed); }
+
+private:
+    uint32_t m_pending_us = 0;          // writer-local remainder below 1 ms
+    std::atomic<uint32_t> m_busy_ms{0};
+    std::atomic<uint32_t> m_runs{0};
+};
+
+
+/**
+ * @brief Accounts the enclosing scope as busy time of `stats`.
+ */
+class BusyScope
+{
+public:
+    explicit BusyScope(TaskStats& stats) : m_stats(stats), m_start(TaskTopology::nowUs()) {}
+    ~BusyScope() { m_stats.addBusy((uint32_t)(TaskTopology::nowUs() - m_start)); }
+
+private:
+    TaskStats& m_stats;
+    uint64_t m_start;
+};
+
+#endif // #ifndef TASK_TOPOLOGY_H
@@ -0,0 +1,172 @@
+#include "TimerWheel.h"
+
+// Layout: a timer whose expiry is `delta` ticks ahead of m_now lives in the lowest
+// level whose span (64^(level+1) ticks) covers delta, in the slot selected by the
+// expiry's digit for that level. Level-0 slots therefore hold timers of exactly one
+// tick; a higher slot is re-inserted one level down (cascaded) when m_now reaches
+// the start of its block, which is always before any timer in it is due.
+
+void TimerWheel::link(WheelTimer& t)
+{
+    uint32_t delta = t.expires - m_now;
+    uint32_t level = 0;
+    while (level + 1 < LEVELS && delta >= (1u << ((level + 1) * SLOT_BITS)))
+        ++level;
+
+    uint32_t i = slotIndex(t.expires, level);
+    WheelTimer*& head = m_slots[level][i];
+
+    t.level = (uint8_t)level;
+    t.slot = (uint8_t)i;
+    t.prev = nullptr;
+    t.next = head;
+    if (head)
+        head->prev = &t;
+    head = &t;
+    m_occupied[level] |= (1ULL << i);
+}
+
+void TimerWheel::unlink(WheelTimer& t)
+{
+    if (t.prev)
+    {
+        t.prev->next = t.next;
+    }
+    else
+    {
+        m_slots[t.level][t.slot] = t.next;
+        if (t.next == nullptr)
+            m_occupied[t.level] &= ~(1ULL << t.slot);
+    }
+
+    if (t.next)
+        t.next->prev = t.prev;
+
+    t.next = t.prev = nullptr;
+}
+
+void TimerWheel::scheduleAt(WheelTimer& t, uint32_t at_ms)
+{
+    if (t.pending)
+    {
+        unlink(t);
+        --m_count;
+    }
+
+    int32_t delay_ms = (int32_t)(at_ms - m_now);
+    if (delay_ms <= 0)
+        delay_ms = 1;
+    if ((uint32_t)delay_ms > MAX_DELAY_MS)
+        delay_ms = MAX_DELAY_MS;
+
+    t.expires = m_now + (uint32_t)delay_ms;
+    t.pending = true;
+    ++m_count;
+    link(t);
+}
+
+void TimerWheel::cancel(WheelTimer& t)
+{
+    if (!t.pending)
+        return;
+
+    unlink(t);
+    t.pending = false;
+    --m_count;
+}
+
+// Move every timer of the current block of `level` one level (or more) down.
+void TimerWheel::cascade(uint32_t level)
+{
+    uint32_t i = slotIndex(m_now, level);
+    WheelTimer* t = m_slots[level][i];
+    m_slots[level][i] = nullptr;
+    m_occupied[level] &= ~(1ULL << i);
+
+    while (t)
+    {
+        WheelTimer* next = t->next;
+        link(*t);
+        t = next;
+    }
+}
+
+// Next tick after m_now (capped at `limit`) that has a due level-0 slot or starts a new level-1 block.
+uint32_t TimerWheel::nextStep(uint32_t limit) const
+{
+    uint32_t i = m_now & (SLOTS - 1);
+    uint64_t later = (i == SLOTS - 1) ? 0 : (m_occupied[0] & (~0ULL << (i + 1)));
+
+    uint32_t step = later ? (uint32_t)__builtin_ctzll(later) - i : SLOTS - i;
+    return (step <= limit - m_now) ? m_now + step : limit;
+}
+
+size_t TimerWheel::advance(uint32_t now_ms)
+{
+    size_t ran = 0;
+
+    while (m_now != now_ms && (int32_t)(now_ms - m_now) > 0)
+    {
+        m_now = nextStep(now_ms);
+
+        // a new block on level L is also a new block on every level below: cascade top-down
+        for (uint32_t level = LEVELS - 1; level > 0; --level)
+        {
+            uint32_t block_mask = (1u << (level * SLOT_BITS)) - 1;
+            if ((m_now & block_mask) == 0)
+                cascade(level);
+        }
+
+        uint32_t i = m_now & (SLOTS - 1);
+        while (m_slots[0][i])
+        {
+            // pop one at a time: the callback may cancel or re-arm other timers in this slot
+            WheelTimer* t = m_slots[0][i];
+            unlink(*t);
+            t->pending = false;
+            --m_count;
+            ++ran;
+            if (t->callback)
+                t->callback(t->arg);
+        }
+    }
+
+    return ran;
+}
+
+bool TimerWheel::nextDeadline(uint32_t& at_ms) const
+{
+    if (m_count == 0)
+        return false;
+
+    bool found = false;
+    uint32_t best = 0;
+
+    for (uint32_t level = 0; level < LEVELS; ++level)
+    {
+        uint64_t occ = m_occupied[level];
+        if (occ == 0)
+            continue;
+
+        // first non-empty slot in circular order after the current one; the current
+        // slot itself holds only timers a full revolution ahead, so it comes last
+        uint32_t cur = slotIndex(m_now, level);
+        uint32_t rot = (cur + 1) & (SLOTS - 1);
+        uint64_t rotated = (rot == 0) ? occ : ((occ >> rot) | (occ << (SLOTS - rot)));
+        uint32_t i = (rot + (uint32_t)__builtin_ctzll(rotated)) & (SLOTS - 1);
+
+        // slots only order timers between blocks, not within one: take the minimum
+        for (const WheelTimer* t = m_slots[level][i]; t; t = t->next)
+        {
+            uint32_t delta = t->expires - m_now;
+            if (!found || delta < best - m_now)
+            {
+                best = t->expires;
+                found = true;
+            }
+        }
+    }
+
+    at_ms = best;
+    return found;
+}
@@ -0,0 +1,93 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief One-shot timer owned by the caller (typically a static) and linked into a TimerWheel.
+ *
+ * The wheel never allocates: scheduling links the node into a slot list, so a timer
+ * must outlive its pending period. Periodic jobs re-schedule themselves from the callback.
+ */
+struct WheelTimer
+{
+    typedef void (*Callback)(void* arg);
+
+    WheelTimer(Callback cb = nullptr, void* a = nullptr) : callback(cb), arg(a) {}
+
+    Callback callback;
+    void* arg;
+
+    // owned by TimerWheel
+    uint32_t expires = 0;
+    WheelTimer* next = nullptr;
+    WheelTimer* prev = nullptr;
+    uint8_t level = 0;
+    uint8_t slot = 0;
+    bool pending = false;
+};
+
+
+/**
+ * @brief Hierarchical timer wheel with a millisecond tick (4 levels x 64 slots, ~4.6 h range).
+ *
+ * schedule() and cancel() are O(1) list operations. advance() walks only the
+ * ticks that have a due level-0 slot or a cascade boundary, so catching up after
+ * a long light sleep costs about one step per 64 ms. The clock is whatever the
+ * caller passes in (millis() on the device, a virtual clock on the host), and
+ * all arithmetic wraps like millis().
+ *
+ * Single-owner: schedule/cancel/advance must all run on the loop() task.
+ */
+class TimerWheel
+{
+public:
+    static const uint32_t LEVELS = 4;
+    static const uint32_t SLOT_BITS = 6;
+    static const uint32_t SLOTS = 1u << SLOT_BITS;
+    static const uint32_t MAX_DELAY_MS = (1u << (LEVELS * SLOT_BITS)) - 1;   // longer delays are clamped
+
+    // Start the clock; timers scheduled before this run relative to 0.
+    void begin(uint32_t now_ms) { m_now = now_ms; }
+
+    // (Re)arm `t` to fire `delay_ms` after the wheel's current time (at least one tick later).
+    void schedule(WheelTimer& t, uint32_t delay_ms) { scheduleAt(t, m_now + delay_ms); }
+
+    // (Re)arm `t` for the absolute time `at_ms`, e.g. millis() + delay from inside a callback
+    // that ran long. Times at or before the wheel's current time fire on the next tick.
+    void scheduleAt(WheelTimer& t, uint32_t at_ms);
+
+    // Disarm `t`; no-op if it is not pending.
+    void cancel(WheelTimer& t);
+
+    // Run, in expiry order, every timer due at or before `now_ms`. Returns how many ran.
+    // Callbacks may schedule or cancel any timer, including their own.
+    size_t advance(uint32_t now_ms);
+
+    // Earliest pending expiry; false if nothing is scheduled.
+    bool nextDeadline(uint32_t& at_ms) const;
+
+    // Time up to which all timers have run.
+    uint32_t now() const { return m_now; }
+
+    size_t pendingCount() const { return m_count; }
+
+private:
+    void link(WheelTimer& t);
+    void unlink(WheelTimer& t);
+    void cascade(uint32_t level);
+    uint32_t nextStep(uint32_t limit) const;
+
+    static uint32_t slotIndex(uint32_t expires, uint32_t level)
+    {
+        return (expires >> (level * SLOT_BITS)) & (SLOTS - 1);
+    }
+
+    WheelTimer* m_slots[LEVELS][SLOTS] = {};
+    uint64_t m_occupied[LEVELS] = {};       // bit i set = slot i non-empty
+    uint32_t m_now = 0;
+    size_t m_count = 0;
+};
+
+#endif // #ifndef TIMER_WHEEL_H
@@ -0,0 +1,259 @@
+#include "TlsArena.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(ESP32)
+#include "esp_heap_caps.h"
+#endif
+
+// Internal RAM only: the TLS buffers are touched on every record.
+static void* reserve(size_t bytes)
+{
+#if defined(ESP32)
+    return heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+    return malloc(bytes);
+#endif
+}
+
+bool TlsArena::begin(size_t bytes)
+{
+    if (m_base != nullptr)
+        return false;
+    // the block is never returned: align inside it rather than keep the raw pointer
+    void* raw = reserve(bytes + ALIGN);
+    if (raw == nullptr)
+        return false;
+    uintptr_t aligned = ((uintptr_t)raw + ALIGN - 1) & ~(uintptr_t)(ALIGN - 1);
+    return begin(reinterpret_cast<void*>(aligned), bytes);
+}
+
+bool TlsArena::begin(void* mem, size_t bytes)
+{
+    bytes &= ~(size_t)(ALIGN - 1);
+    if (m_base != nullptr || mem == nullptr || ((uintptr_t)mem & (ALIGN - 1)) != 0 ||
+        bytes < MIN_BLOCK || bytes > (UINT32_MAX & ~USED))
+    {
+        return false;
+    }
+
+    m_base = static_cast<uint8_t*>(mem);
+    m_size = bytes;
+    m_first_free = 0;
+    Header* h = at(0);
+    h->size = (uint32_t)bytes;
+    h->prev_size = 0;
+    return true;
+}
+
+TlsArena::Header* TlsArena::next(const Header* h) const
+{
+    size_t off = offsetOf(h) + sizeOf(h);
+    return off < m_size ? at(off) : nullptr;
+}
+
+// Cut a free block down to `need` bytes if the rest can stand as a block of its own.
+void TlsArena::split(Header* h, size_t need)
+{
+    size_t have = sizeOf(h);
+    if (have - need < MIN_BLOCK)
+        return;
+
+    Header* rest = at(offsetOf(h) + need);
+    rest->size = (uint32_t)(have - need);
+    rest->prev_size = (uint32_t)need;
+    h->size = (uint32_t)need | (h->size & USED);
+    Header* after = next(rest);
+    if (after != nullptr)
+        after->prev_size = rest->size;
+}
+
+void TlsArena::accountUsed(int32_t delta)
+{
+    uint32_t used = m_used.load(std::memory_order_relaxed) + (uint32_t)delta;
+    m_used.store(used, std::memory_order_relaxed);
+    if (used > m_peak.load(std::memory_order_relaxed))
+        m_peak.store(used, std::memory_order_relaxed);
+}
+
+// Block size for `bytes` of payload, 0 if it can never fit.
+size_t TlsArena::blockFor(size_t bytes) const
+{
+    if (bytes > m_size)
+        return 0;
+    size_t need = (bytes + sizeof(Header) + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    return need < MIN_BLOCK ? MIN_BLOCK : need;
+}
+
+void* TlsArena::calloc(size_t n, size_t size)
+{
+    if (m_base == nullptr || (size != 0 && n > SIZE_MAX / size))
+        return nullptr;
+    const size_t need = blockFor(n * size);
+    if (need == 0)
+        return nullptr;
+
+    for (size_t off = m_first_free; off < m_size; off += sizeOf(at(off)))
+    {
+        Header* h = at(off);
+        if (isUsed(h) || sizeOf(h) < need)
+            continue;
+
+        split(h, need);
+        h->size |= USED;
+        if (off == m_first_free)
+            m_first_free = off + sizeOf(h);
+        accountUsed((int32_t)sizeOf(h));
+        m_allocations.fetch_add(1, std::memory_order_relaxed);
+
+        void* p = h + 1;
+        memset(p, 0, sizeOf(h) - sizeof(Header));
+        return p;
+    }
+    return nullptr;
+}
+
+void TlsArena::free(void* p)
+{
+    if (p == nullptr)
+        return;
+
+    Header* h = static_cast<Header*>(p) - 1;
+    accountUsed(-(int32_t)sizeOf(h));
+    h->size &= ~USED;
+
+    Header* n = next(h);
+    if (n != nullptr && !isUsed(n))
+        h->size += n->size;
+    if (h->prev_size != 0)
+    {
+        Header* prev = at(offsetOf(h) - h->prev_size);
+        if (!isUsed(prev))
+        {
+            prev->size += h->size;
+            h = prev;
+        }
+    }
+    n = next(h);
+    if (n != nullptr)
+        n->prev_size = h->size;
+    if (offsetOf(h) < m_first_free)
+        m_first_free = offsetOf(h);
+}
+
+void* TlsArena::realloc(void* p, size_t size)
+{
+    if (p == nullptr)
+        return calloc(1, size);
+    const size_t need = blockFor(size);
+    if (need == 0)
+        return nullptr;
+
+    Header* h = static_cast<Header*>(p) - 1;
+    const size_t have = sizeOf(h);
+    if (need <= have)
+        return p;   // shrinking keeps the block: not worth a split
+
+    // grow into a free neighbour
+    Header* n = next(h);
+    if (n != nullptr && !isUsed(n) && have + n->size >= need)
+    {
+        const bool was_first_free = (offsetOf(n) == m_first_free);
+        h->size = (uint32_t)(have + n->size);       // free for split()
+        Header* after = next(h);
+        if (after != nullptr)
+            after->prev_size = h->size;
+        split(h, need);
+        h->size |= USED;
+        if (was_first_free)
+            m_first_free = offsetOf(h) + sizeOf(h);
+        accountUsed((int32_t)(sizeOf(h) - have));
+        return p;
+    }
+
+    void* q = calloc(1, size);
+    if (q == nullptr)
+        return nullptr;
+    memcpy(q, p, have - sizeof(Header));
+    free(p);
+    return q;
+}
+
+size_t TlsArena::usable(const void* p) const
+{
+    return sizeOf(static_cast<const Header*>(p) - 1) - sizeof(Header);
+}
+
+size_t TlsArena::largestFree() const
+{
+    size_t largest = 0;
+    for (size_t off = m_first_free; off < m_size; off += sizeOf(at(off)))
+    {
+        const Header* h = at(off);
+        if (!isUsed(h) && sizeOf(h) - sizeof(Header) > largest)
+            largest = sizeOf(h) - sizeof(Header);
+    }
+    return largest;
+}
+
+size_t TlsArena::blocks() const
+{
+    size_t n = 0;
+    for (size_t off = 0; off < m_size; off += sizeOf(at(off)))
+        ++n;
+    return n;
+}
+
+
+
+#if defined(ESP32)
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mbedtls/platform.h"
+
+static TlsArena* s_arena = nullptr;
+static TaskHandle_t s_owner = nullptr;
+
+// The IDF's own mbedTLS allocator on boards without PSRAM.
+static void* heapCalloc(size_t n, size_t size)
+{
+    return heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+static void* arenaCalloc(size_t n, size_t size)
+{
+    if (xTaskGetCurrentTaskHandle() == s_owner)
+    {
+        void* p = s_arena->calloc(n, size);
+        if (p != nullptr)
+            return p;
+        s_arena->countFallback();
+    }
+    return heapCalloc(n, size);
+}
+
+static void arenaFree(void* p)
+{
+    // blocks allocated before the hook, or by other tasks, are heap blocks
+    if (s_arena->owns(p))
+        s_arena->free(p);
+    else
+        heap_caps_free(p);
+}
+
+bool hookMbedTls(TlsArena& arena)
+{
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO) && !defined(MBEDTLS_PLATFORM_FREE_MACRO)
+    if (!arena.active() || s_arena != nullptr)
+        return false;
+    s_arena = &arena;
+    s_owner = xTaskGetCurrentTaskHandle();
+    return mbedtls_platform_set_calloc_free(arenaCalloc, arenaFree) == 0;
+#else
+    return false;
+#endif
+}
+
+#endif
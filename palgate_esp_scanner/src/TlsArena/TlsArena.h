@@ -0,0 +1,110 @@
+#ifndef TLS_ARENA_H
+#define TLS_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * @brief Fixed block, reserved once at boot, that the TLS stack allocates from.
+ *
+ * A TLS session allocates tens of KB (record buffers, the peer's certificate chain,
+ * key exchange numbers) and frees them again when it closes. From the system heap,
+ * that churn slowly fragments it, until the session's large buffers no longer fit.
+ * Here the session gets the same bytes every time: everything it allocates is freed
+ * when it closes, so the arena returns to the same layout after every request and
+ * the heap never sees it.
+ *
+ * First fit over an implicit block list with boundary tags; neighbouring free
+ * blocks merge on free(). calloc() returns nullptr when nothing fits: the caller
+ * falls back to the heap and counts it (fallbacks()).
+ *
+ * Single owner: allocation and free run on one task (the net task, see
+ * hookMbedTls()). The statistics may be read from any task.
+ */
+class TlsArena
+{
+public:
+    static const size_t ALIGN = 8;
+
+    // Carve `bytes` out of the heap (once; call early, while the heap is still whole).
+    bool begin(size_t bytes);
+
+    // Use caller-provided memory instead (host tools). `mem` must be ALIGN-aligned.
+    bool begin(void* mem, size_t bytes);
+
+    bool active() const { return m_base != nullptr; }
+
+    // Zeroed block of n * size bytes, nullptr if it does not fit.
+    void* calloc(size_t n, size_t size);
+
+    // p must satisfy owns(p).
+    void free(void* p);
+
+    // Grow or shrink in place if the block allows it, else move within the arena.
+    // nullptr (p untouched) if it does not fit.
+    void* realloc(void* p, size_t size);
+
+    bool owns(const void* p) const
+    {
+        const uint8_t* b = static_cast<const uint8_t*>(p);
+        return b >= m_base && b < m_base + m_size;
+    }
+
+    // Usable bytes of an allocated block.
+    size_t usable(const void* p) const;
+
+    // Walks the block list: owner task only.
+    size_t largestFree() const;
+    size_t blocks() const;
+
+    size_t size() const { return m_size; }
+    uint32_t used() const { return m_used.load(std::memory_order_relaxed); }
+    uint32_t peak() const { return m_peak.load(std::memory_order_relaxed); }
+    uint32_t allocations() const { return m_allocations.load(std::memory_order_relaxed); }
+
+    // Requests the arena could not hold (served by the heap instead).
+    uint32_t fallbacks() const { return m_fallbacks.load(std::memory_order_relaxed); }
+    void countFallback() { m_fallbacks.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+    // Boundary tag in front of every block. Sizes include the header.
+    struct Header
+    {
+        uint32_t size;          // bit 0: in use
+        uint32_t prev_size;     // size of the block before (0 for the first)
+    };
+    static_assert(sizeof(Header) == ALIGN, "payloads must stay aligned");
+    static const uint32_t USED = 1;
+    static const size_t MIN_BLOCK = 2 * ALIGN;
+
+    Header* at(size_t offset) const { return reinterpret_cast<Header*>(m_base + offset); }
+    size_t offsetOf(const Header* h) const { return reinterpret_cast<const uint8_t*>(h) - m_base; }
+    static size_t sizeOf(const Header* h) { return h->size & ~USED; }
+    static bool isUsed(const Header* h) { return (h->size & USED) != 0; }
+    Header* next(const Header* h) const;
+    size_t blockFor(size_t bytes) const;
+    void split(Header* h, size_t need);
+    void accountUsed(int32_t delta);
+
+    uint8_t* m_base = nullptr;
+    size_t m_size = 0;
+    size_t m_first_free = 0;        // no free block below this offset
+
+    std::atomic<uint32_t> m_used{0};
+    std::atomic<uint32_t> m_peak{0};
+    std::atomic<uint32_t> m_allocations{0};
+    std::atomic<uint32_t> m_fallbacks{0};
+};
+
+
+#if defined(ESP32)
+
+// Route every mbedTLS allocation made by the calling task to `arena`; other tasks
+// (the WiFi supplicant uses mbedTLS too) keep the heap. Returns false if this
+// mbedTLS build has no replaceable allocator or the arena is not active.
+bool hookMbedTls(TlsArena& arena);
+
+#endif
+
+#endif // #ifndef TLS_ARENA_H
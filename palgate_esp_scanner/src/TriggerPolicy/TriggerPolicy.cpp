@@ -0,0 +1,155 @@
+#include "TriggerPolicy.h"
+
+static_assert(TriggerPolicy::SLOTS < TriggerPolicy::NO_SLOT, "slot indices must fit a uint8_t");
+
+uint32_t TriggerPolicy::home(uint32_t identity)
+{
+    // Fibonacci hashing: major/minor pairs differ mostly in the low bits
+    return (identity * 2654435769u) >> (32 - SLOT_BITS);
+}
+
+bool TriggerPolicy::isLive(const Entry& e, uint32_t now_ms) const
+{
+    return e.used && (e.in_flight || (e.cooling && now_ms - e.last_ms < e.cooldown_ms));
+}
+
+TriggerPolicy::Entry* TriggerPolicy::lookup(uint32_t identity, uint32_t now_ms)
+{
+    // Entries are never emptied, only taken over, so an identity always sits before
+    // the first unused entry of its probe sequence.
+    const uint32_t start = home(identity);
+    Entry* reusable = nullptr;      // first unused or expired entry on the way
+    Entry* oldest = nullptr;        // live, nothing in flight, triggered longest ago
+    for (size_t i = 0; i < SLOTS; ++i)
+    {
+        Entry& e = m_entries[(start + i) & (SLOTS - 1)];
+        if (!e.used)
+        {
+            if (reusable == nullptr)
+                reusable = &e;
+            break;
+        }
+        if (e.identity == identity)
+            return &e;
+        if (!isLive(e, now_ms))
+        {
+            if (reusable == nullptr)
+                reusable = &e;
+        }
+        else if (!e.in_flight && (oldest == nullptr || (int32_t)(e.last_ms - oldest->last_ms) < 0))
+        {
+            oldest = &e;
+        }
+    }
+
+    Entry* e = reusable;
+    if (e == nullptr)
+    {
+        e = oldest;
+        if (e == nullptr)
+            return nullptr;     // every entry has an open in flight
+        ++m_recycled;
+    }
+    if (m_open_slot != NO_SLOT && e == &m_entries[m_open_slot])
+        m_open_slot = NO_SLOT;
+    *e = Entry();
+    e->used = true;
+    e->identity = identity;
+    return e;
+}
+
+TriggerPolicy::Decision TriggerPolicy::admit(uint32_t identity, uint32_t now_ms, const Rules& rules)
+{
+    Entry* e = lookup(identity, now_ms);
+    if (e == nullptr)
+    {
+        // no state to keep: open, but this beacon gets no cooldown and nobody can join it
+        m_open_slot = NO_SLOT;
+        return { Verdict::Open, NO_SLOT };
+    }
+    const uint8_t slot = (uint8_t)(e - m_entries);
+
+    if (e->in_flight)
+        return { Verdict::InFlight, slot };
+    if (e->cooling && now_ms - e->last_ms < e->cooldown_ms)
+        return { Verdict::Cooldown, slot };
+
+    e->last_ms = now_ms;
+    e->cooldown_ms = rules.cooldown_ms;
+    e->coalesce_ms = rules.coalesce_ms;
+    e->cooling = true;
+
+    if (m_open_slot != NO_SLOT)
+    {
+        const Entry& opener = m_entries[m_open_slot];
+        bool in_flight = opener.in_flight && opener.open_seq == m_open_seq;
+        if (in_flight || now_ms - m_open_ms < opener.coalesce_ms)
+        {
+            e->open_seq = m_open_seq;
+            return { Verdict::Coalesced, slot };
+        }
+    }
+
+    e->open_seq = ++m_open_seq;
+    e->in_flight = true;
+    e->pending = 0;
+    e->trace_id = 0;
+    m_open_slot = slot;
+    m_open_ms = now_ms;
+    return { Verdict::Open, slot };
+}
+
+void TriggerPolicy::launched(uint8_t slot, uint32_t trace_id, uint8_t paths)
+{
+    if (slot >= SLOTS || !m_entries[slot].in_flight)
+        return;
+
+    Entry& e = m_entries[slot];
+    e.trace_id = trace_id;
+    e.pending = paths;
+    if (paths != 0)
+        return;
+
+    // nothing went out: the opener keeps its cooldown, the beacons that joined are released
+    e.in_flight = false;
+    for (Entry& other : m_entries)
+    {
+        if (&other != &e && other.used && other.cooling && !other.in_flight && other.open_seq == e.open_seq)
+            other.cooling = false;
+    }
+    if (m_open_slot == slot)
+        m_open_slot = NO_SLOT;
+}
+
+void TriggerPolicy::finished(uint32_t trace_id)
+{
+    for (Entry& e : m_entries)
+    {
+        if (e.used && e.in_flight && e.pending != 0 && e.trace_id == trace_id)
+        {
+            if (--e.pending == 0)
+                e.in_flight = false;
+            return;
+        }
+    }
+}
+
+size_t TriggerPolicy::live(uint32_t now_ms) const
+{
+    size_t n = 0;
+    for (const Entry& e : m_entries)
+        n += isLive(e, now_ms);
+    return n;
+}
+
+const char* TriggerPolicy::verdictName(Verdict v)
+{
+    switch (v)
+    {
+        case Verdict::Open:      return "open";
+        case Verdict::Coalesced: return "coalesced";
+        case Verdict::Cooldown:  return "cooldown";
+        case Verdict::InFlight:  return "in_flight";
+    }
+    return "?";
+}
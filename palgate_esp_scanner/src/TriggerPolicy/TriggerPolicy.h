@@ -0,0 +1,96 @@
+#ifndef TRIGGER_POLICY_H
+#define TRIGGER_POLICY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Per-beacon trigger state: cooldown, open in flight and coalescing.
+ *
+ * One entry per beacon identity in a fixed open-addressing table (linear probing,
+ * never resized), so admit() costs at most SLOTS probes and the footprint is
+ * fixed. An entry whose cooldown has run out and that has nothing in flight can be
+ * taken by another identity; if every probed entry is live, the one that triggered
+ * longest ago is recycled (its cooldown ends early).
+ *
+ * Cooldowns are per beacon, so one car never holds another back. A beacon that
+ * arrives while another beacon's open is in flight, or within that open's
+ * coalescing window, joins it: no second request, but its own cooldown starts.
+ * If the open never goes out (no time sync, another scanner won), the beacons
+ * that joined it are released again.
+ *
+ * Single owner: every method runs on the loop() task.
+ */
+class TriggerPolicy
+{
+public:
+    enum class Verdict : uint8_t
+    {
+        Open = 0,       // send an open request, then report it with launched()
+        Coalesced,      // another beacon's open is under way: joins it, cooldown started
+        Cooldown,       // this beacon triggered (or joined an open) less than cooldown_ms ago
+        InFlight,       // this beacon's own open has no result yet
+    };
+
+    // Copied into the entry on every trigger, so a config change applies from the next one.
+    struct Rules
+    {
+        uint32_t cooldown_ms;   // per beacon
+        uint32_t coalesce_ms;   // others arriving this soon after an open join it
+    };
+
+    struct Decision
+    {
+        Verdict verdict;
+        uint8_t slot;           // Open: pass to launched() (NO_SLOT if no entry could be kept)
+    };
+
+    static const uint32_t SLOT_BITS = 4;
+    static const size_t SLOTS = 1u << SLOT_BITS;
+    static const uint8_t NO_SLOT = 0xFF;
+
+    // Call for every sighting that would trigger.
+    Decision admit(uint32_t identity, uint32_t now_ms, const Rules& rules);
+
+    // The open admit() allowed went out on `paths` paths (0: it did not go out at all).
+    void launched(uint8_t slot, uint32_t trace_id, uint8_t paths);
+
+    // One path of an open reported its result.
+    void finished(uint32_t trace_id);
+
+    // Entries still in cooldown or in flight.
+    size_t live(uint32_t now_ms) const;
+
+    uint32_t recycled() const { return m_recycled; }
+
+    static const char* verdictName(Verdict v);
+
+private:
+    struct Entry
+    {
+        uint32_t identity;
+        uint32_t last_ms;       // last trigger, or the open it joined
+        uint32_t cooldown_ms;
+        uint32_t coalesce_ms;
+        uint32_t trace_id;      // own open, once launched
+        uint16_t open_seq;      // own open, or the one it joined
+        uint8_t pending;        // paths of the own open without a result
+        bool used;
+        bool cooling;           // cooldown runs from last_ms
+        bool in_flight;         // own open admitted and not finished
+    };
+
+    static uint32_t home(uint32_t identity);
+    bool isLive(const Entry& e, uint32_t now_ms) const;
+    Entry* lookup(uint32_t identity, uint32_t now_ms);
+
+    Entry m_entries[SLOTS] = {};
+    uint32_t m_recycled = 0;
+
+    // the latest open anchors the coalescing window (its entry holds the window length)
+    uint8_t m_open_slot = NO_SLOT;
+    uint16_t m_open_seq = 0;
+    uint32_t m_open_ms = 0;
+};
+
+#endif // #ifndef TRIGGER_POLICY_H
@@ -1,24 +1,329 @@
 #include "WiFiCredsManager.h"
 
-bool WiFiCredsManager::load(String& ssid, String& pass)
+// NVS layout in the "wifi" namespace:
+//   e<i>         one Record per slot, written whole with a single putBytes(), so a
+//                power loss leaves either the old entry or the new one. A network
+//                keeps its slot while it is stored; the order is the rank inside.
+// Older firmware stored s<i>/p<i>/r<i>/c<i>/b<i>/q<i> keys counted by "n", or before
+// that a single "ssid"/"pass" pair; both are read and migrated by the next write.
+
+struct Record
+{
+    char ssid[33];              // 802.11: at most 32 bytes
+    char pass[65];              // WPA2: 8..63 characters, or 64 hex digits
+    uint8_t rank;
+    uint8_t channel;
+    uint8_t bssid[6];
+    int8_t rssi;
+};
+
+static const char OLD_PREFIXES[] = { 's', 'p', 'r', 'c', 'q', 'b' };
+
+static void key(char* out, char prefix, size_t i)
+{
+    out[0] = prefix;
+    out[1] = static_cast<char>('0' + i);
+    out[2] = '\0';
+}
+
+bool WiFiCredsManager::loadEntry(Preferences& prefs, size_t i, WiFiNetwork& n)
+{
+    char k[3];
+    Record r;
+
+    key(k, 'e', i);
+    if (prefs.getBytes(k, &r, sizeof(r)) != sizeof(r))
+        return false;
+    r.ssid[sizeof(r.ssid) - 1] = '\0';
+    r.pass[sizeof(r.pass) - 1] = '\0';
+
+    n.ssid = r.ssid;
+    n.pass = r.pass;
+    n.rank = r.rank;
+    n.channel = r.channel;
+    memcpy(n.bssid, r.bssid, sizeof(n.bssid));
+    n.rssi = r.rssi;
+    return n.ssid.length() > 0;
+}
+
+// The multi-key layout: read only, for the migration.
+static bool loadOldEntry(Preferences& prefs, size_t i, WiFiNetwork& n)
+{
+    char k[3];
+
+    key(k, 's', i); n.ssid = prefs.getString(k, "");
+    key(k, 'p', i); n.pass = prefs.getString(k, "");
+    key(k, 'r', i); n.rank = prefs.getUChar(k, static_cast<uint8_t>(i));
+    key(k, 'c', i); n.channel = prefs.getUChar(k, 0);
+    key(k, 'q', i); n.rssi = prefs.getChar(k, 0);
+    key(k, 'b', i);
+    if (prefs.getBytes(k, n.bssid, sizeof(n.bssid)) != sizeof(n.bssid))
+        n.channel = 0; // no usable BSSID: force a scanning connect
+
+    return n.ssid.length() > 0;
+}
+
+bool WiFiCredsManager::fits(const WiFiNetwork& n)
+{
+    return n.ssid.length() > 0 && n.ssid.length() < sizeof(Record::ssid) && n.pass.length() < sizeof(Record::pass);
+}
+
+void WiFiCredsManager::storeEntry(Preferences& prefs, size_t i, const WiFiNetwork& n)
+{
+    char k[3];
+    Record r;
+
+    memset(&r, 0, sizeof(r));
+    strncpy(r.ssid, n.ssid.c_str(), sizeof(r.ssid) - 1);
+    strncpy(r.pass, n.pass.c_str(), sizeof(r.pass) - 1);
+    r.rank = n.rank;
+    r.channel = n.channel;
+    memcpy(r.bssid, n.bssid, sizeof(r.bssid));
+    r.rssi = n.rssi;
+
+    key(k, 'e', i);
+    prefs.putBytes(k, &r, sizeof(r));
+}
+
+size_t WiFiCredsManager::loadAll(WiFiNetwork out[], size_t max)
 {
     Preferences prefs;
-    
+    size_t count = 0;
+
     prefs.begin("wifi", true);  // read-only
-    ssid = prefs.getString("ssid", "");
-    pass = prefs.getString("pass", "");
+
+    if (prefs.isKey("n"))
+    {
+        // multi-key layout; "n" goes only once every entry has its record
+        size_t n = prefs.getUChar("n", 0);
+        for (size_t i = 0; i < n && i < MAX_NETWORKS && count < max; ++i)
+        {
+            out[count] = WiFiNetwork();
+            if (loadOldEntry(prefs, i, out[count]))
+                ++count;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < MAX_NETWORKS && count < max; ++i)
+        {
+            out[count] = WiFiNetwork();
+            if (loadEntry(prefs, i, out[count]))
+                ++count;
+        }
+
+        // legacy single-network layout
+        if (count == 0 && max > 0)
+        {
+            out[0] = WiFiNetwork();
+            out[0].ssid = prefs.getString("ssid", "");
+            out[0].pass = prefs.getString("pass", "");
+            count = out[0].ssid.length() > 0 ? 1 : 0;
+        }
+    }
+
     prefs.end();
 
+    // insertion sort by rank (at most MAX_NETWORKS entries)
+    for (size_t i = 1; i < count; ++i)
+    {
+        for (size_t j = i; j > 0 && out[j].rank < out[j - 1].rank; --j)
+        {
+            WiFiNetwork tmp = out[j];
+            out[j] = out[j - 1];
+            out[j - 1] = tmp;
+        }
+    }
+
+    return count;
+}
+
+size_t WiFiCredsManager::count()
+{
+    WiFiNetwork nets[MAX_NETWORKS];
+    return loadAll(nets, MAX_NETWORKS);
+}
+
+bool WiFiCredsManager::load(String& ssid, String& pass)
+{
+    WiFiNetwork nets[MAX_NETWORKS];
+    size_t n = loadAll(nets, MAX_NETWORKS);
+
+    ssid = n ? nets[0].ssid : String("");
+    pass = n ? nets[0].pass : String("");
+
     return (ssid.length() > 0 && pass.length() > 0);
 }
 
 void WiFiCredsManager::save(const String& ssid, const String& pass)
+{
+    add(ssid, pass, 0);
+}
+
+bool WiFiCredsManager::add(const String& ssid, const String& pass, uint8_t rank)
+{
+    WiFiNetwork nets[MAX_NETWORKS];
+    size_t n = loadAll(nets, MAX_NETWORKS);
+
+    size_t i = 0;
+    while (i < n && nets[i].ssid != ssid)
+        ++i;
+
+    if (i == n)
+    {
+        if (n == MAX_NETWORKS)
+        {
+            // full: replace the least preferred entry
+            i = n - 1;
+        }
+        else
+        {
+            ++n;
+        }
+        nets[i] = WiFiNetwork();
+        nets[i].ssid = ssid;
+    }
+
+    nets[i].pass = pass;
+    nets[i].rank = rank;
+    if (!fits(nets[i]))
+        return false;
+
+    storeAll(nets, n);
+    return true;
+}
+
+// Called on every association: rewrites the matching entry's record only when
+// the channel or BSSID changed; the credentials in it go along unchanged.
+void WiFiCredsManager::updateCache(const String& ssid, uint8_t channel, const uint8_t bssid[6], int8_t rssi)
+{
+    Preferences prefs;
+
+    prefs.begin("wifi", false); // read-write
+
+    size_t slot = MAX_NETWORKS;
+    WiFiNetwork net;
+    for (size_t i = 0; i < MAX_NETWORKS && !prefs.isKey("n"); ++i)
+    {
+        if (loadEntry(prefs, i, net) && net.ssid == ssid)
+        {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot == MAX_NETWORKS)
+    {
+        // an older layout: migrate once, with the cache filled in
+        prefs.end();
+
+        WiFiNetwork nets[MAX_NETWORKS];
+        size_t n = loadAll(nets, MAX_NETWORKS);
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (nets[i].ssid != ssid)
+                continue;
+            nets[i].channel = channel;
+            memcpy(nets[i].bssid, bssid, 6);
+            nets[i].rssi = rssi;
+            storeAll(nets, n);
+            break;
+        }
+        return;
+    }
+
+    // skip the flash write if nothing that matters for a targeted connect changed
+    if (net.channel != channel || memcmp(net.bssid, bssid, 6) != 0)
+    {
+        net.channel = channel;
+        memcpy(net.bssid, bssid, 6);
+        net.rssi = rssi;
+        storeEntry(prefs, slot, net);
+    }
+
+    prefs.end();
+}
+
+// Each network goes to the slot it already has (a new one to a free slot, or the
+// slot of the network it replaces), as one record, then slots no longer in the
+// list are removed. A power loss at any point leaves every slot either old or new:
+// no network is lost, doubled or paired with another's password. NVS skips
+// records that did not change. Also migrates the older layouts.
+void WiFiCredsManager::storeAll(const WiFiNetwork nets[], size_t n)
 {
     Preferences prefs;
+    char k[3];
 
     prefs.begin("wifi", false); // read-write
-    prefs.putString("ssid", ssid);
-    prefs.putString("pass", pass);
+
+    String owner[MAX_NETWORKS];
+    if (!prefs.isKey("n"))
+    {
+        for (size_t i = 0; i < MAX_NETWORKS; ++i)
+        {
+            WiFiNetwork e;
+            if (loadEntry(prefs, i, e))
+                owner[i] = e.ssid;
+        }
+    }
+
+    size_t slot_of[MAX_NETWORKS];
+    bool taken[MAX_NETWORKS] = {};
+    for (size_t j = 0; j < n; ++j)
+    {
+        slot_of[j] = MAX_NETWORKS;
+        for (size_t i = 0; i < MAX_NETWORKS && slot_of[j] == MAX_NETWORKS; ++i)
+        {
+            if (!taken[i] && owner[i].length() > 0 && owner[i] == nets[j].ssid)
+            {
+                slot_of[j] = i;
+                taken[i] = true;
+            }
+        }
+    }
+    for (size_t j = 0; j < n; ++j)
+    {
+        for (size_t i = 0; i < MAX_NETWORKS && slot_of[j] == MAX_NETWORKS; ++i)
+        {
+            bool listed = false;
+            for (size_t l = 0; l < n; ++l)
+                listed = listed || (owner[i].length() > 0 && owner[i] == nets[l].ssid);
+            if (!taken[i] && !listed)
+            {
+                slot_of[j] = i;
+                taken[i] = true;
+            }
+        }
+    }
+
+    for (size_t j = 0; j < n; ++j)
+        storeEntry(prefs, slot_of[j], nets[j]);
+
+    for (size_t i = 0; i < MAX_NETWORKS; ++i)
+    {
+        key(k, 'e', i);
+        if (!taken[i] && prefs.isKey(k))
+            prefs.remove(k);
+    }
+
+    // older layouts: "n" first, so the records are read from now on
+    if (prefs.isKey("n"))
+        prefs.remove("n");
+    for (size_t i = 0; i < MAX_NETWORKS; ++i)
+    {
+        for (char prefix : OLD_PREFIXES)
+        {
+            key(k, prefix, i);
+            if (prefs.isKey(k))
+                prefs.remove(k);
+        }
+    }
+    if (prefs.isKey("ssid"))
+    {
+        prefs.remove("ssid");
+        prefs.remove("pass");
+    }
+
     prefs.end();
 }
 
@@ -4,12 +4,41 @@
 #include <Arduino.h>
 #include <Preferences.h>
 
+// One known network plus what we learned the last time we were associated to it.
+// The cached channel/BSSID allow a targeted connect that skips the full channel scan.
+struct WiFiNetwork
+{
+    String ssid;
+    String pass;
+    uint8_t rank = 0;           // user priority, 0 = most preferred
+    uint8_t channel = 0;        // last associated channel, 0 = unknown
+    uint8_t bssid[6] = {0};     // last associated AP
+    int8_t rssi = 0;            // last seen RSSI, 0 = unknown
+
+    bool hasBssid() const { return channel != 0; }
+};
+
 class WiFiCredsManager
 {
 public:
+    static const size_t MAX_NETWORKS = 4;
+
+    // Single-network API (first/most preferred entry) kept for existing callers.
     bool load(String& ssid, String& pass);
     void save(const String& ssid, const String& pass);
     void clear();
+
+    // Ranked list API.
+    size_t loadAll(WiFiNetwork out[], size_t max);      // returns count, sorted by rank
+    bool add(const String& ssid, const String& pass, uint8_t rank);  // insert or update by SSID; false if too long
+    void updateCache(const String& ssid, uint8_t channel, const uint8_t bssid[6], int8_t rssi);
+    size_t count();
+
+private:
+    static bool fits(const WiFiNetwork& n);     // SSID 1..32 bytes, password at most 64
+    void storeEntry(Preferences& prefs, size_t i, const WiFiNetwork& n);
+    void storeAll(const WiFiNetwork nets[], size_t n);
+    bool loadEntry(Preferences& prefs, size_t i, WiFiNetwork& n);
 };
 
 #endif
@@ -1,4 +1,8 @@
 #include "WiFiProvisioning.h"
+#include <DNSServer.h>
+#include "PortalAssets.h"
+#include "PalLog.h"
+#include "WiFiRoaming.h"
 
 // HTTP server instance
 WebServer g_webServer(80);
@@ -9,55 +13,45 @@ bool g_should_reboot = false;
 // External reference to WiFiCredsManager instance
 extern WiFiCredsManager wifi_creds;
 
-// HTML page for WiFi configuration
-String htmlWiFiConfigPage()
-{
-    return R"rawliteral(
-        <html>
-        <head>
-            <meta name="viewport" content="width=device-width, initial-scale=1" />
-            <style>
-                body { font-family: Arial; padding: 20px; }
-                input { width: 100%; padding: 12px; margin: 8px 0; }
-                button { padding: 12px; width: 100%; background: #4CAF50; color: white; border: none; }
-            </style>
-        </head>
-        <body>
-            <h3>Configure WiFi</h3>
-            <form action="/save" method="POST">
-                <label>WiFi SSID:</label>
-                <input name="ssid" length="32" required>
-                <label>Password:</label>
-                <input name="pass" length="64" type="password" required>
-                <button type="submit">Save & Restart</button>
-            </form>
-        </body>
-        </html>
-    )rawliteral";
-}
+// Captive-portal DNS: every name resolves to the AP, so phones open the portal by themselves
+static DNSServer s_dns;
+static const uint16_t DNS_PORT = 53;
 
 // Start AP mode + define the routes
 void startAPMode()
 {
-    Serial.println("Starting AP Mode for WiFi configuration...");
+    LOG_I("Starting AP Mode for WiFi configuration...");
 
     WiFi.mode(WIFI_AP);
     WiFi.softAP("ESP_Wifi", "12345678");  
 
-    Serial.print("AP IP: ");
-    Serial.println(WiFi.softAPIP());
+    LOG_I("AP IP: %s", WiFi.softAPIP().toString().c_str());
+
+    s_dns.start(DNS_PORT, "*", WiFi.softAPIP());
 
-    // Route for main page
-    g_webServer.on("/", HTTP_GET, []() {
-        g_webServer.send(200, "text/html", htmlWiFiConfigPage());
+    // Pages from portal/, pre-gzipped into flash at build time (tools/build_portal_assets.py)
+    registerPortalAssets(g_webServer);
+
+    // OS connectivity checks (generate_204, hotspot-detect.html, ...) and any other
+    // URL land here: redirect to the portal so the captive-portal sheet opens it
+    g_webServer.onNotFound([]() {
+        g_webServer.sendHeader("Location", String("http://") + WiFi.softAPIP().toString() + "/");
+        g_webServer.send(302, "text/plain", "");
     });
 
     // Route for saving WiFi credentials
     g_webServer.on("/save", HTTP_POST, []() {
         String ssid = g_webServer.arg("ssid");
         String pass = g_webServer.arg("pass");
-
-        wifi_creds.save(ssid, pass);
+        String rank = g_webServer.arg("rank");
+
+        // add to (or update in) the ranked list; new networks default to lowest priority
+        uint8_t r = rank.length() ? (uint8_t)rank.toInt() : (uint8_t)wifi_creds.count();
+        if (!wifi_creds.add(ssid, pass, r))
+        {
+            g_webServer.send(400, "text/plain", "SSID must be 1-32 bytes, password at most 64.");
+            return;
+        }
         g_webServer.send(200, "text/plain", "Saved. Rebooting...");
         g_should_reboot = true;
     });
@@ -71,7 +65,15 @@ void startAPMode()
 	});
 
     g_webServer.begin();
-    Serial.println("AP WebServer started.");
+    LOG_I("AP WebServer started.");
+}
+
+
+
+void handlePortal()
+{
+    s_dns.processNextRequest();
+    g_webServer.handleClient();
 }
 
 
@@ -87,19 +89,21 @@ void WiFiEventHandler(WiFiEvent_t event)
     {
         // Connected to the access point (no IP yet)
         case SYSTEM_EVENT_STA_CONNECTED:
-    		Serial.println("Connected to WiFi. Waiting for IP...");
+    		LOG_I("Connected to WiFi. Waiting for IP...");
             break;
 
         // Received IP address from the router (DHCP)
         case SYSTEM_EVENT_STA_GOT_IP:
-            Serial.print("Got IP: ");
-            Serial.println(WiFi.localIP());
+            LOG_I("Got IP: %s", WiFi.localIP().toString().c_str());
+            LOG_I("Metrics at http://%s/metrics", WiFi.localIP().toString().c_str());
+            g_wifi_roaming.onGotIp();
             break;
 
-        // Lost connection to the access point
+        // Lost connection to the access point (or a connect attempt failed).
+        // Reconnecting is left to g_wifi_roaming.service() in loop(): no work in the event task.
         case SYSTEM_EVENT_STA_DISCONNECTED:
-            Serial.println("WiFi disconnected, reconnecting...");
-            WiFi.reconnect();
+            LOG_W("WiFi disconnected");
+            g_wifi_roaming.onDisconnected();
             break;
 
 		case SYSTEM_EVENT_WIFI_READY:
@@ -110,8 +114,7 @@ void WiFiEventHandler(WiFiEvent_t event)
 
         // Any other unhandled WiFi event
         default:
-            Serial.print("Unhandled WiFi event: ");
-            Serial.println(event);
+            LOG_D("Unhandled WiFi event: %d", (int)event);
             break;
     }
 }
\ No newline at end of file
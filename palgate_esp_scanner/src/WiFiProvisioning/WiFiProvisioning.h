@@ -16,8 +16,8 @@ extern bool g_should_reboot;
 // Expose the AP starter so main.cpp can call it
 void startAPMode();
 
-// HTML page provider (used internally but OK to expose)
-String htmlWiFiConfigPage();
+// AP-mode service: answers captive-portal DNS queries and serves the portal (call from loop())
+void handlePortal();
 
 // WiFi event callback (exposed to main.cpp)
 void WiFiEventHandler(WiFiEvent_t event);
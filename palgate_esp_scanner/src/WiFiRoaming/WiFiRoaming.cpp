@@ -0,0 +1,173 @@
+#include "WiFiRoaming.h"
+#include "Metrics.h"
+#include "PalLog.h"
+#include "esp_timer.h"
+
+WiFiRoaming g_wifi_roaming;
+
+bool WiFiRoaming::begin(WiFiCredsManager& store)
+{
+    m_store = &store;
+    m_count = store.loadAll(m_nets, WiFiCredsManager::MAX_NETWORKS);
+    if (m_count == 0)
+        return false;
+
+    WiFi.setAutoReconnect(false);   // we decide when and where to reconnect
+
+    m_state = State::Backoff;
+    m_deadline_ms = millis();       // first attempt on the next service()
+    return true;
+}
+
+void WiFiRoaming::onDisconnected()
+{
+    uint64_t none = 0;
+    m_evt_disconnected_us.compare_exchange_strong(none, (uint64_t)esp_timer_get_time());
+    m_evt_disconnected.store(true);
+}
+
+void WiFiRoaming::onGotIp()
+{
+    m_evt_got_ip.store(true);
+}
+
+// Higher is better: user rank dominates, then last RSSI, minus recent failures.
+int WiFiRoaming::pickCandidate() const
+{
+    int best = -1;
+    int best_score = INT32_MIN;
+
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        int rssi = m_nets[i].rssi ? m_nets[i].rssi : -85;
+        int score = rssi - 20 * (int)m_nets[i].rank - 25 * (int)m_failures[i];
+        if (score > best_score)
+        {
+            best_score = score;
+            best = (int)i;
+        }
+    }
+
+    return best;
+}
+
+void WiFiRoaming::startAttempt(uint32_t now_ms)
+{
+    m_current = pickCandidate();
+    if (m_current < 0)
+    {
+        m_state = State::Idle;
+        return;
+    }
+
+    const WiFiNetwork& n = m_nets[m_current];
+    m_current_targeted = n.hasBssid() && !m_force_scan[m_current];
+
+    if (m_current_targeted)
+    {
+        LOG_I("WiFi: connecting to %s (ch %u, targeted)", n.ssid.c_str(), (unsigned)n.channel);
+        WiFi.begin(n.ssid.c_str(), n.pass.c_str(), n.channel, n.bssid);
+    }
+    else
+    {
+        LOG_I("WiFi: connecting to %s (scan)", n.ssid.c_str());
+        WiFi.begin(n.ssid.c_str(), n.pass.c_str());
+    }
+
+    m_state = State::Connecting;
+    m_deadline_ms = now_ms + CONNECT_TIMEOUT_MS;
+}
+
+void WiFiRoaming::attemptFailed(uint32_t now_ms)
+{
+    if (m_current >= 0)
+    {
+        if (m_failures[m_current] < 8)
+            m_failures[m_current]++;
+        if (m_current_targeted)
+            m_force_scan[m_current] = true;
+    }
+
+    WiFi.disconnect();
+
+    LOG_W("WiFi: attempt failed, retry in %lu ms", (unsigned long)m_backoff_ms);
+    m_state = State::Backoff;
+    m_deadline_ms = now_ms + m_backoff_ms;
+    m_backoff_ms = (m_backoff_ms * 2 > BACKOFF_MAX_MS) ? BACKOFF_MAX_MS : m_backoff_ms * 2;
+}
+
+void WiFiRoaming::connected(uint32_t now_ms)
+{
+    m_state = State::Connected;
+    m_backoff_ms = BACKOFF_MIN_MS;
+
+    if (m_outage_start_us != 0)
+    {
+        uint64_t outage_ms = ((uint64_t)esp_timer_get_time() - m_outage_start_us) / 1000ULL;
+        g_metrics.wifi_reconnect_ms.record((uint32_t)outage_ms);
+        LOG_I("WiFi: reconnected after %lu ms", (unsigned long)outage_ms);
+        m_outage_start_us = 0;
+    }
+
+    if (m_current < 0)
+        return;
+
+    // refresh the fast-connect cache for next time
+    WiFiNetwork& n = m_nets[m_current];
+    m_failures[m_current] = 0;
+    m_force_scan[m_current] = false;
+
+    const uint8_t* bssid = WiFi.BSSID();
+    n.rssi = WiFi.RSSI();
+    if (bssid != nullptr && (n.channel != (uint8_t)WiFi.channel() || memcmp(n.bssid, bssid, 6) != 0))
+    {
+        n.channel = (uint8_t)WiFi.channel();
+        memcpy(n.bssid, bssid, 6);
+        m_store->updateCache(n.ssid, n.channel, n.bssid, n.rssi);
+    }
+}
+
+void WiFiRoaming::service()
+{
+    uint32_t now = millis();
+
+    if (m_evt_got_ip.exchange(false))
+    {
+        connected(now);
+    }
+
+    if (m_evt_disconnected.exchange(false))
+    {
+        uint64_t at_us = m_evt_disconnected_us.exchange(0);
+
+        if (m_state == State::Connected)
+        {
+            // link lost: retry immediately, backoff only applies to repeated failures
+            g_metrics.wifi_reconnects.inc();
+            m_outage_start_us = at_us;
+            m_state = State::Backoff;
+            m_deadline_ms = now;
+        }
+        else if (m_state == State::Connecting)
+        {
+            attemptFailed(now); // auth failure / AP not found: don't wait for the timeout
+        }
+    }
+
+    switch (m_state)
+    {
+        case State::Backoff:
+            if ((int32_t)(now - m_deadline_ms) >= 0)
+                startAttempt(now);
+            break;
+
+        case State::Connecting:
+            if ((int32_t)(now - m_deadline_ms) >= 0)
+                attemptFailed(now);
+            break;
+
+        case State::Idle:
+        case State::Connected:
+            break;
+    }
+}
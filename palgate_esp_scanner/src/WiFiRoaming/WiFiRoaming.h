@@ -0,0 +1,67 @@
+#ifndef WIFI_ROAMING_H
+#define WIFI_ROAMING_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <atomic>
+#include "WiFiCredsManager.h"
+
+/**
+ * @brief Reconnect state machine over the ranked network list.
+ *
+ * WiFi events only set flags (they run on the WiFi event task); all decisions
+ * and WiFi.begin() calls happen in service(), called from loop(). A lost link
+ * is retried at once, then with exponential backoff. Each attempt picks the best
+ * known network, and the connect targets its cached channel + BSSID so the
+ * driver skips the full channel scan. If a targeted attempt fails, the next
+ * attempt on that network falls back to a scanning connect, since the AP may
+ * have changed channel.
+ */
+class WiFiRoaming
+{
+public:
+    static const uint32_t CONNECT_TIMEOUT_MS = 8000;
+    static const uint32_t BACKOFF_MIN_MS = 500;
+    static const uint32_t BACKOFF_MAX_MS = 60000;
+
+    // Load the known networks and arm the first connect. Returns false if none are stored.
+    bool begin(WiFiCredsManager& store);
+
+    // Drive the state machine. Call from loop(); never blocks.
+    void service();
+
+    // WiFi event hooks (event task context).
+    void onDisconnected();
+    void onGotIp();
+
+    bool isConnected() const { return m_state == State::Connected; }
+
+private:
+    enum class State : uint8_t { Idle, Backoff, Connecting, Connected };
+
+    int pickCandidate() const;
+    void startAttempt(uint32_t now_ms);
+    void attemptFailed(uint32_t now_ms);
+    void connected(uint32_t now_ms);
+
+    WiFiCredsManager* m_store = nullptr;
+    WiFiNetwork m_nets[WiFiCredsManager::MAX_NETWORKS];
+    uint8_t m_failures[WiFiCredsManager::MAX_NETWORKS] = {0};
+    bool m_force_scan[WiFiCredsManager::MAX_NETWORKS] = {false};
+    size_t m_count = 0;
+
+    State m_state = State::Idle;
+    int m_current = -1;
+    bool m_current_targeted = false;
+    uint32_t m_deadline_ms = 0;         // Backoff: next attempt; Connecting: give up
+    uint32_t m_backoff_ms = BACKOFF_MIN_MS;
+    uint64_t m_outage_start_us = 0;     // link lost at (0 = initial connect, not measured)
+
+    std::atomic<bool> m_evt_disconnected{false};
+    std::atomic<bool> m_evt_got_ip{false};
+    std::atomic<uint64_t> m_evt_disconnected_us{0};
+};
+
+extern WiFiRoaming g_wifi_roaming;
+
+#endif // #ifndef WIFI_ROAMING_H
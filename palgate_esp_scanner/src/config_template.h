@@ -31,3 +31,57 @@ static const char* PALGATE_SESSION_TOKEN = "REPLACE_ME";
 static const int PALGATE_TOKEN_TYPE = 1; // <-- REPLACE ME (1 or 2)
 
 
+// Password for POST /config (HTTP basic auth, user "admin").
+// Runtime configuration updates stay disabled until you uncomment this and pick a password.
+// #define PALGATE_CONFIG_PASSWORD "REPLACE_ME"
+
+// Optional rolling beacon code (replay protection). Uncomment and set the same
+// 32-hex-digit secret in the beacon's config.h; the scanner then only accepts
+// one-time codes from the beacon instead of its static iBeacon.
+// Generate one with e.g.: python3 -c "import os; print(os.urandom(16).hex())"
+// #define PALGATE_ROLLING_KEY_HEX "00000000000000000000000000000000"
+
+// Optional: advertisement formats that can open the gate, e.g. for residents who use a
+// phone instead of the beacon. Comma-separated: ibeacon, altbeacon (company 0x0118),
+// eddystone (UID frame: namespace + instance) and service_uuid (a 128-bit service UUID).
+// Every format matches the same 16 bytes as target_uuid; only iBeacons carry rolling codes,
+// so with PALGATE_ROLLING_KEY_HEX set this is ignored and only "ibeacon" applies.
+// Default: "ibeacon". Also settable as adv_formats through /config.
+// #define PALGATE_ADV_FORMATS "ibeacon,eddystone"
+
+// Optional local open path: the scanner also connects to the PalGate unit over BLE
+// and writes the same x-bt-token the cloud request sends; whichever path opens the
+// gate first wins, so the gate still opens when the internet connection is down.
+// Fill in the unit's public BLE address and the GATT service/characteristic the
+// PalGate app writes the token to (e.g. read them from a BLE sniffer log).
+// #define PALGATE_GATE_BLE_ADDR "aa:bb:cc:dd:ee:ff"
+// #define PALGATE_GATE_BLE_SERVICE_UUID "00000000-0000-0000-0000-000000000000"
+// #define PALGATE_GATE_BLE_CHAR_UUID "00000000-0000-0000-0000-000000000000"
+
+// Optional multi-scanner arbitration, for sites with one scanner per gate where a car
+// can be heard by more than one of them. Scanners on the same LAN exchange sightings
+// over UDP multicast and only the one that hears the car strongest opens its gate.
+// Set the same window (ms) and key on every scanner; 0 or unset = standalone. The key
+// (32 hex digits, e.g. from `openssl rand -hex 16`) signs the messages, so nothing else
+// on the LAN can make a scanner stand down; the window only applies when it is set.
+// #define PALGATE_MESH_WINDOW_MS 150
+// #define PALGATE_MESH_KEY_HEX "00000000000000000000000000000000"
+
+// SHA-256 of the PalGate API host's public key (its SubjectPublicKeyInfo), 64 hex digits.
+// The scanner refuses to send the token to a host whose key does not match. Without a pin
+// the host is not authenticated. Compute it with:
+//   openssl s_client -connect api1.pal-es.com:443 -servername api1.pal-es.com </dev/null |
+//     openssl x509 -pubkey -noout | openssl pkey -pubin -outform der | openssl dgst -sha256
+// The backup pin is optional and holds a second key, e.g. the next one when the host rotates.
+// #define PALGATE_API_PIN_SHA256 "0000000000000000000000000000000000000000000000000000000000000000"
+// #define PALGATE_API_PIN_BACKUP_SHA256 "0000000000000000000000000000000000000000000000000000000000000000"
+
+// Optional MQTT export for home automation: sightings of the beacon, which beacon made
+// the gate open and each path's outcome, batched as JSON on <topic>/events (QoS 0 or 1).
+// Unset host = off. All of it is also settable through /config (mqtt_*).
+// #define PALGATE_MQTT_HOST "192.168.1.10"
+// #define PALGATE_MQTT_PORT 1883
+// #define PALGATE_MQTT_TOPIC "palgate"
+// #define PALGATE_MQTT_USER "palgate"
+// #define PALGATE_MQTT_PASS "secret"
+// #define PALGATE_MQTT_QOS 1
@@ -2,24 +2,56 @@
 #include <BLEDevice.h>            	// BLEDevice for BLE init and scan object (BLEDevice::init, BLEDevice::getScan).
 #include <BLEUtils.h>             	// BLE utilities (kept for potential UUID/helpers; e.g. BLEUUID if used).
 #include <BLEScan.h>              	// BLEScan API used: BLEScan class, setInterval(), setWindow(), start(), stop(), clearResults().
-#include <BLEAdvertisedDevice.h>  	// BLEAdvertisedDevice: getManufacturerData(), getRSSI(), getAddress().
+#include <BLEAdvertisedDevice.h>  	// BLEAdvertisedDevice: getPayload(), getRSSI(), getAddress().
 #include <atomic>                 	// std::atomic types used for cross-task flags/timestamps (std::atomic_bool, std::atomic<uint64_t>).
 #include <cstring>                	// C string helpers used: std::memcpy(), std::strncpy().
+#include <algorithm>              	// std::min() for clamping logged durations.
 #include "esp_sleep.h"            	// Light-sleep helpers: esp_sleep_enable_timer_wakeup(), esp_light_sleep_start().
 #include "esp_timer.h"            	// RTC-backed timer: esp_timer_get_time() used to timestamp sightings (microseconds).
+#include "esp_heap_caps.h"			// heap_caps_get_largest_free_block(): heap fragmentation telemetry.
 #include <WiFi.h> 				  	// ESP32 WiFi STA/AP control, connection handling, events.
-#include <HTTPClient.h>				// HTTP client for sending REST API requests.	
-#include <WiFiClientSecure.h>		// HTTP client for sending REST API calls (used for PalGate).
 #include <time.h>					// NTP time functions for syncing time — needed for token timestamps.
+#include <sys/time.h>				// gettimeofday(): millisecond wall clock for the scanner mesh messages.
 #include <Preferences.h>			// NVS key-value storage — persists WiFi SSID/password across reboots.
 #include <WebServer.h>				// Lightweight HTTP server — serves the WiFi configuration portal.
 
 #include "token_generator.h"		// Generates PalGate x-bt-token using session key + timestamp.
 #include "WiFiCredsManager.h"		// Loads/saves WiFi credentials from NVS.
 #include "WiFiProvisioning.h"		// Handles AP mode + webform for entering new WiFi settings.
+#include "WiFiRoaming.h"			// Picks the best known network and reconnects with backoff.
+#include "PhaseAccounting.h"		// Time-in-state and estimated charge per duty-cycle phase.
+#include "Metrics.h"				// Lock-free counters/histograms exported as Prometheus text on /metrics.
+#include "SpanTrace.h"				// Per-event stage timestamps, dumped as Chrome trace JSON.
+#include "FlightRecorder.h"			// Persistent event log in the "flightlog" flash partition.
+#include "PalLog.h"					// Deferred, compile-time-levelled logging (LOG_E/W/I/D).
+#include "RuntimeConfig.h"			// NVS-backed tunables (UUID, timings, gate URL), hot-swapped via /config.
+#include "RollingAuth.h"			// Optional rolling beacon code: O(1) window lookup, replay rejection.
+#include "IBeaconProtocol.h"			// iBeacon layout and the beacon identity, shared with the beacon.
+#include "TimerWheel.h"				// O(1) timer wheel driving scan windows, the awake/sleep cycle and the LED.
+#include "TaskTopology.h"			// Ingest / control / net / local tasks, SPSC queues between them, per-task busy time.
+#include "GateLink.h"				// Local open: GATT write of the token to the PalGate unit, raced against HTTPS.
+#include "PresenceAnalytics.h"		// Fixed-RAM arrivals/dwell, foreign-traffic sketches, distinct devices per hour.
+#include "ScannerMesh.h"			// Multi-scanner arbitration over UDP multicast: only the strongest sighting triggers.
+#include "TriggerPolicy.h"			// Per-beacon cooldown, open in flight and coalescing, in a fixed open-addressing table.
+#include "GateHttp.h"				// The cloud request: HTTPS GET in fixed buffers over a persistent mbedTLS session.
+#include "TlsArena.h"				// Memory reserved at boot that the net task's mbedTLS allocates from.
+#include "AdvDecoder.h"				// Zero-copy AD walker and table-driven decoders: iBeacon, AltBeacon, Eddystone, service UUID.
+#include "MqttExport.h"				// Batched MQTT export of sightings and gate events for home automation.
 #include "config.h"					
 
 #define LED_PIN 2
+#define PHASE_REPORT_PERIOD_MS 60000	// how often the hourly duty-cycle report is checked for a new hour
+#define SIGHTING_REPEAT_MS 500			// ingest forwards the same beacon at most this often (cooldown is far longer)
+#define FORWARD_SLOTS 8					// beacons ingest rate-limits independently (direct-mapped)
+#define ROLLING_IDENTITY 0xFFFFFFFFu	// rolling mode: major/minor carry the code, so all presses are one beacon
+#define NET_TASK_STACK 10240			// token + mbedTLS handshake + GateHttp
+#define HTTP_TIMEOUT_MS 5000			// TLS handshake, and the response (HTTPClient's default)
+#define NET_WAIT_MS 1000				// net task re-checks its queue at least this often (covers a lost wakeup)
+#define CONTROL_WAIT_MS 10				// loop() serves HTTP, the mesh socket and the console at least this often
+#define LOCAL_TASK_STACK 8192			// token + BLEClient connect / service discovery
+#define MQTT_TASK_STACK 4096			// DNS + socket I/O; the batch buffers live in the exporter
+
+static const uint8_t MESH_GROUP[4] = { 239, 255, 71, 71 };	// site-local multicast group shared by all scanners
 
 
 //===========================================================
@@ -41,6 +73,44 @@ struct BeaconInfo
   int8_t txPower;
   int rssi;
   char addrStr[18]; // e.g. "AA:BB:CC:DD:EE:FF\0"
+  uint32_t rolling_counter; // rolling mode: counter the code verified for (0 otherwise)
+  AdFormat format;          // advertisement format it was decoded from
+};
+
+
+// ingest → control: one matching advertisement
+struct SightingEvent
+{
+  BeaconInfo info;
+  uint64_t at_us;           // esp_timer time the packet was delivered
+};
+
+// control → net: open the gate for this detection
+struct TriggerRequest
+{
+  uint32_t trace_id;
+  uint64_t detected_at_us;
+  uint32_t beacon;          // BeaconIdentity(), for the MQTT export
+  uint32_t counter;         // its rolling code counter (0 for a static beacon)
+  AdFormat format;
+};
+
+// which task opened (or tried to open) the gate
+enum class OpenPath : uint8_t
+{
+  Cloud,                    // net task: HTTPS request to the PalGate API
+  Local                     // local task: GATT write to the PalGate unit
+};
+
+// net / local → control: outcome of one TriggerRequest on one path
+struct TriggerResult
+{
+  uint32_t trace_id;
+  OpenPath path;
+  bool opened;              // this path opened the gate
+  bool first;               // ... before the other path did (OpenRace::confirm())
+  int code;                 // Cloud: HTTP status / GateHttp::ERROR_* / 0; Local: GateLink::Result
+  uint32_t elapsed_ms;      // first matching packet -> this outcome
 };
 
 
@@ -50,47 +120,71 @@ struct BeaconInfo
 //===========================================================
 static bool g_led_on = false; 							// Tracks whether the gate-indicator LED is currently lit.
 static bool g_is_time_synced_ok = false; 				// True once NTP time sync succeeded (required for valid PalGate tokens).
-static BeaconInfo g_lastBeacon;							// Stores the most recently parsed iBeacon packet.
 BLEScan* g_manage_scan = nullptr;						// BLE scan manager pointer created by BLEDevice::getScan().
-static const uint32_t SCAN_AWAKE_MS = 200;   			// Scans for 200ms
-static const uint32_t SLEEP_MS      = 2800;  			// Sleeps for 2800ms 
-static const uint16_t SCAN_INTERVAL_MS = SCAN_AWAKE_MS; // 200ms
-static const uint16_t SCAN_WINDOW_MS   = SCAN_AWAKE_MS; // 200ms window scan
 static const uint16_t SCAN_FAKE_DURATION_SEC = 3; 		// Dummy duration for BLEScan.start()
-static unsigned long g_last_trigger_ms = 0;				// Timestamp (ms) of the last successful detection-trigger (for debounce logic).
-static const unsigned long DEBOUNCE_MS = 10000; 		// ignore detections within 6s
-static const unsigned long g_LED_ON_MS = 3000;  		// LED off after this ms without sightings
-static const unsigned long LED_ON_US = 3000 * 1000ULL;  // LED on duration in microseconds
-
-// WiFi credentials manager
-WiFiCredsManager wifi_creds;
-String g_ssid = "";
-String g_pass = "";
 
-// User-defined 16-byte UUID — scanner triggers only on beacons matching this value.
-static const uint8_t target_uuid[16] = 
-{
-  0xBC,0x9A,0x78,0x56,0x34,0x12,0x34,0x12,
-  0x34,0x12,0x34,0x12,0x78,0x56,0x34,0x12
-};
-
-// Apple iBeacon prefix packet / format
-static const uint8_t IBEACON_PREFIX[4] = 
-{
-  0x4C, 0x00, // Apple Company Identifier (0x004C)
-  0x02,       // Data type: iBeacon
-  0x15        // Length of the remaining payload (21 bytes)
-};
-
-// Use an atomic flag for cross-task signalling between BLE callbacks and loop()
-static std::atomic_bool m_detected(false);
+// Scan timings, cooldown, LED time, target UUID and the gate URL/credentials live in
+// g_config (RuntimeConfig.h): defaults from config.h, overridden from NVS, updated via POST /config.
 
-// Prevent reentrant TriggerGate calls (if loop() triggers while a previous HTTP is in flight)
-static std::atomic_bool g_trigger_in_progress(false);
+// WiFi credentials manager (ranked list of known networks)
+WiFiCredsManager wifi_creds;
 
-// last time we saw the beacon (updated from callback) in microseconds.
-// Use atomic because callback runs on another task.
-static std::atomic<uint64_t> g_last_time_gate_opend_us(0);
+// Task topology (TaskTopology.h): the only data paths between the BT task, loop() and the net / local tasks.
+static SpscQueue<SightingEvent, 16> g_sightings;			// ingest → control
+static TaskSignal g_control_signal;							// wakes loop() after a sighting or a trigger result
+static SpscQueue<TriggerRequest, 4> g_trigger_requests;	// control → net
+static SpscQueue<TriggerResult, 4> g_trigger_results;		// net → control (same capacity: never full)
+static TaskSignal g_net_signal;								// wakes the net task after a push
+static SpscQueue<AdvObservation, 64> g_observations;		// ingest → control: every advert, for the analytics
+static SpscQueue<TriggerRequest, 4> g_local_requests;		// control → local
+static SpscQueue<TriggerResult, 4> g_local_results;		// local → control
+static TaskSignal g_local_signal;							// wakes the local task after a push
+static OpenRace g_open_race;								// first path to open the gate wins; the other skips its send
+static BleGattTransport g_gatt;
+static GateLink g_gate_link(g_gatt);
+// Cloud request (net-task-owned): the TLS session and the HTTP buffers are set up once and reused,
+// and the net task's mbedTLS allocations come from g_tls_arena, so a trigger leaves the heap as it found it.
+static TlsArena g_tls_arena;
+static MbedTlsTransport g_tls;
+static GateHttp g_http(g_tls);
+static std::atomic<uint32_t> g_heap_largest_low{UINT32_MAX};	// smallest largest-free-block seen (SampleLargestFreeBlock())
+static TaskStats g_ingest_stats;							// BT task time spent in onResult()
+static TaskStats g_control_stats;							// loop() time spent in timers, HTTP server, results
+static TaskStats g_net_stats;								// net task time spent per trigger
+static TaskStats g_local_stats;								// local task time spent per GATT open
+static uint32_t g_triggers_in_flight = 0;					// control-owned: requests without a result yet
+// MQTT export (MqttExport.h): control posts events, the "mqtt" task batches and publishes them.
+// Idle while mqtt_host is empty.
+static TcpTransport g_mqtt_transport;
+static MqttExporter g_mqtt(g_mqtt_transport);
+static TaskStats g_mqtt_stats;								// mqtt task time spent per service() pass
+
+// Presence analytics (GET /analytics); control-owned, fed from g_observations.
+static PresenceAnalytics g_analytics;
+
+// Multi-scanner arbitration (control-owned). Off while mesh_window_ms is 0 or WiFi is down.
+static UdpMulticastTransport g_mesh_transport;
+static TriggerArbiter g_arbiter(g_mesh_transport);
+static bool g_mesh_joined = false;
+static TriggerRequest g_arbitrated;			// the detection waiting for the arbitration
+static uint8_t g_arbitrated_slot = TriggerPolicy::NO_SLOT;	// its g_policy entry
+static uint32_t g_arbitrated_identity = 0;	// its BeaconIdentity()
+static SightingEvent g_deferred;			// another beacon's detection, held until the arbitration settles
+static bool g_deferred_valid = false;
+static bool g_deferred_resynced = false;
+
+// Per-beacon trigger state (control-owned): one car's cooldown never holds another back,
+// and cars arriving together share one open request.
+static TriggerPolicy g_policy;
+
+// Duty-cycle accounting (time and estimated charge per phase). Only loop()/setup() switch phases.
+static PhaseAccounting g_phase;
+
+// Everything loop() waits for is a timer on this wheel (millis() clock); between the
+// awake period and the next event the scanner light-sleeps until the earliest deadline.
+static TimerWheel g_wheel;
+static bool g_is_scan_running = false;		// a scan window is open
+static bool g_is_awake = false;				// inside loop_awake_ms of the current cycle
 
 
 
@@ -99,10 +193,47 @@ static std::atomic<uint64_t> g_last_time_gate_opend_us(0);
 //===========================================================
 static void printHex(const std::string& s);
 static inline void lightSleepMs(uint32_t ms);
-static void TriggerGate();
-static bool parseIBeacon(const std::string& mfg, BeaconInfo &out);
-static void HandleLed();
+static int TriggerGate(uint32_t trace_id);
+static void NetTask(void* arg);
+static void LocalTask(void* arg);
+static void MqttTask(void* arg);
+static void PostExport(ExportEvent ev);
+static void MakeToken(const RuntimeConfig& conf, char token[GENERATED_TOKEN_CHARS + 1]);
+static uint32_t SampleLargestFreeBlock();
+static GateLinkTarget LocalTarget(const RuntimeConfig& conf);
+static void HandleTriggerResults();
+static void HandleTriggerResult(const TriggerResult& res);
+static inline Phase IdlePhase();
+static bool MatchSighting(const AdSighting& s, BeaconInfo &out);
+static void StartCycle();
+static void StartScan();
+static void HandleDetection();
+static void ConsiderSighting(const SightingEvent& ev, bool resynced);
+static uint32_t BeaconIdentity(const BeaconInfo& info);
+static void OnScanWindowEnd(void* arg);
+static void OnAwakeEnd(void* arg);
+static void OnCycleStart(void* arg);
+static void OnLedOff(void* arg);
+static void OnPhaseReport(void* arg);
+static inline void ScheduleIn(WheelTimer& t, uint32_t ms);
+static void WaitForWork();
 static bool syncTimeOnce();
+static void ReportPhaseTotals();
+static void HandleMetricsRequest();
+static void HandleTraceRequest();
+static void DumpTraceToSerial();
+static void HandleLogExportRequest();
+static void HandleConfigGet();
+static void HandleConfigPost();
+static void DrainObservations();
+static uint32_t AnalyticsHour();
+static void HandleAnalyticsRequest();
+static uint8_t DispatchTrigger(const TriggerRequest& req);
+static void ServiceMesh();
+static void OnArbitrationEnd(void* arg);
+static void HandleArbitration(const TriggerArbiter::Outcome& outcome);
+static uint32_t MeshScannerId(const RuntimeConfig& conf);
+static uint64_t UnixMs();
 
 
 
@@ -113,20 +244,38 @@ static bool syncTimeOnce();
 /**
  * @brief Handles BLE advertisements during scanning.
  *
- * Parses manufacturer data, checks if the packet matches the target iBeacon,
- * and sets the atomic detection flag so loop() can trigger the gate.
+ * Runs on the BT host task ("ingest", core 0): decodes the raw payload in place
+ * (AdvDecoder), checks if it matches the target and queues a SightingEvent for loop().
+ * Every advert is also queued as a 20-byte AdvObservation; the analytics run in loop().
  */
 class ScanCallbacks : public BLEAdvertisedDeviceCallbacks
 {
 	void onResult(BLEAdvertisedDevice dev) override
 	{
-		if (dev.haveManufacturerData())
+		BusyScope busy(g_ingest_stats);
+		g_metrics.adv_seen.inc();
+
+		AdvObservation obs;
+		std::memcpy(obs.mac, *dev.getAddress().getNative(), sizeof(obs.mac));
+		obs.company = AdvObservation::NO_COMPANY;
+		obs.identity = 0;
+		obs.at_ms = millis();
+		obs.rssi = (int8_t)dev.getRSSI();
+		obs.flags = 0;
+
+		AdSighting sighting;
+		const bool decoded = AdvDecoder::decode(dev.getPayload(), dev.getPayloadLength(), cfg().adv_formats, sighting);
+		obs.company = sighting.company;
+
+		if (decoded)
 		{
-			const std::string& mfg = dev.getManufacturerData();
 			BeaconInfo info;
 
-			if (parseIBeacon(mfg, info))
+			if (MatchSighting(sighting, info))
 			{
+				g_metrics.adv_matched.inc();
+				obs.flags |= AdvObservation::TARGET;
+				obs.identity = BeaconIdentity(info);	// all presses of a rolling beacon are one beacon
 				info.rssi = dev.getRSSI();
 				std::string addr = dev.getAddress().toString();
 
@@ -134,79 +283,54 @@ class ScanCallbacks : public BLEAdvertisedDeviceCallbacks
 				std::strncpy(info.addrStr, addr.c_str(), sizeof(info.addrStr)-1);
 				info.addrStr[sizeof(info.addrStr)-1] = '\0';
 
-				// store into g_lastBeacon (POD copy)
-				std::memcpy(&g_lastBeacon, &info, sizeof(BeaconInfo));
-
-						// set atomic flag to notify loop() a target beacon was seen
-						// but avoid re-triggering if we recently triggered (debounce)
-						unsigned long now_ms = millis();
-						if (now_ms - g_last_trigger_ms > DEBOUNCE_MS) 
-						{
-							// record that we detected now so other callbacks within debounce window won't re-arm
-							m_detected.store(true);
-						}
-
+				// forward each beacon's first packet and then at most every SIGHTING_REPEAT_MS (or on a
+				// new rolling counter); the trigger policy decides in control, so this only bounds queue
+				// traffic. Direct-mapped by identity: a collision forwards more often, never holds a beacon back.
+				struct ForwardSlot { uint32_t identity; uint32_t last_ms; uint32_t counter; bool used; };
+				static ForwardSlot s_forwarded[FORWARD_SLOTS];
+				const uint32_t identity = BeaconIdentity(info);
+				ForwardSlot& fwd = s_forwarded[(identity * 2654435769u) >> 29];
+				static_assert(FORWARD_SLOTS == 8, "index uses the top 3 hash bits");
+				uint32_t now_ms = millis();
+				if (!fwd.used || fwd.identity != identity || now_ms - fwd.last_ms >= SIGHTING_REPEAT_MS ||
+					info.rolling_counter != fwd.counter)
+				{
+					SightingEvent ev;
+					ev.info = info;
+					ev.at_us = (uint64_t)esp_timer_get_time();
+					// full: dropped and counted; control still sees the others. Otherwise wake control now
+					// rather than at the end of the scan window: the trigger starts while the scan goes on
+					if (g_sightings.push(ev))
+						g_control_signal.notify();
+
+					fwd.used = true;
+					fwd.identity = identity;
+					fwd.last_ms = now_ms;
+					fwd.counter = info.rolling_counter;
+				}
 			}
 			else
 			{
-				// Debug: print raw manufacturer-data for devices that don't match
-				// Serial.printf("Seen manufacturer data from %s RSSI=%d len=%u: ", dev.getAddress().toString().c_str(), dev.getRSSI(), (unsigned)mfg.size());
-				// const uint8_t* pb = reinterpret_cast<const uint8_t*>(mfg.data());
-				// for (size_t i = 0; i < mfg.size(); ++i) Serial.printf("%02X ", pb[i]);
-				// Serial.println();
+				g_metrics.adv_rejected.inc();
+
+				// Debug: decodable adverts that are not the target (compiled in with PAL_LOG_LEVEL_DEBUG)
+				LOG_D("Seen %s from %s RSSI=%d", AdvDecoder::formatName(sighting.format), dev.getAddress().toString().c_str(), dev.getRSSI());
 			}
 
 		}
+
+		g_observations.push(obs);	// full: dropped and counted (reported by /analytics)
 	}
 };
 
 
 
-/**
- * @brief Lightweight non-blocking delay helper class the loops.
- *
- * Provides wait(duration_ms) which returns false while the delay
- * is still active, and true once the specified time has elapsed.
- * No blocking - allows loop() to stay responsive while
- * timing operations are spaced apart.
- */
-class DelayNonBlocking
-{
-public:
-    // Begins (or continues) a non-blocking delay window.
-    // Returns true AFTER the delay has completed.
-    // Returns false WHILE waiting.
-    bool wait(unsigned long duration_ms)
-    {
-		// start delay for the first time
-        if (!active)
-        {
-            active = true;
-            start_time = millis();
-            return false; 
-        }
-
-		// check if delay time has elapsed
-        if ((millis() - start_time) < duration_ms)
-        {
-            return false; // still within delay window
-        }
-
-        // delay finished
-        active = false;
-
-        return true;
-    }
-
-private:
-    unsigned long start_time = 0;
-    bool active = false;
-};
-
-
-// non-blocking delays
-DelayNonBlocking g_scan_delay;    
-DelayNonBlocking g_loop_delay;  
+static WheelTimer g_scan_window_timer(OnScanWindowEnd);	// scan_window_ms after a scan started
+static WheelTimer g_awake_timer(OnAwakeEnd);				// loop_awake_ms after a cycle started
+static WheelTimer g_cycle_timer(OnCycleStart);				// sleep_ms after the awake period ended
+static WheelTimer g_led_timer(OnLedOff);					// led_on_ms after a successful open
+static WheelTimer g_report_timer(OnPhaseReport);			// periodic duty-cycle report check
+static WheelTimer g_arbitration_timer(OnArbitrationEnd);	// mesh_window_ms after a detection was announced
 
 
 
@@ -219,38 +343,52 @@ void setup()
 	pinMode(0, INPUT_PULLUP);  // BOOT = GPIO0
 	Serial.begin(115200);
 	delay(100); // wait for Serial to initialize
+	PalLog::begin();
+	g_config.begin();
 
 	if (digitalRead(0) == LOW)
 	{
-		Serial.println("BOOT button held on startup — clearing saved WiFi credentials...");
+		LOG_W("BOOT button held on startup — clearing saved WiFi credentials and runtime config...");
 		wifi_creds.clear();
-		Serial.println("WiFi credentials cleared. Rebooting...");
+		g_config.reset();
+		LOG_W("WiFi credentials and runtime config cleared. Rebooting...");
+		PalLog::flush();
 		delay(1000);
 		ESP.restart();
 		return; // should not reach here
 	}
 	// ---- end of FACTORY RESET ----
 
-	Serial.println("ESP32 Scanner ready.  Connecting to WiFi...");
+	if (false == g_flight.begin())
+	{
+		LOG_W("No 'flightlog' partition — event log disabled.");
+	}
+
+	g_rolling.configure(cfg());
+
+	// before WiFi and BLE take their share: the TLS session's memory in one piece, for good
+	if (cfg().tls_arena_kb != 0 && !g_tls_arena.begin((size_t)cfg().tls_arena_kb * 1024))
+	{
+		LOG_W("Could not reserve %u KB for TLS; the cloud request uses the heap.", (unsigned)cfg().tls_arena_kb);
+	}
+
+	LOG_I("ESP32 Scanner ready.  Connecting to WiFi...");
 
-	// Try loading saved WiFi credentials
-	if (false == wifi_creds.load(g_ssid, g_pass))
+	// Try loading saved WiFi networks
+	WiFi.mode(WIFI_STA);
+	if (false == g_wifi_roaming.begin(wifi_creds))
 	{
-		Serial.println("No saved WiFi credentials found!");
+		LOG_W("No saved WiFi credentials found!");
 		startAPMode(); // start AP mode for configuration
 		return; // skip rest of setup — wait for user to configure WiFi
 	}
-	else // credentials found and loaded
+	else // networks found and loaded
 	{
-		Serial.printf("Loaded WiFi config: SSID=%s\n", g_ssid.c_str());
-
-		WiFi.mode(WIFI_STA);
-
 		// Handle WiFi events
         WiFi.onEvent(WiFiEventHandler);
 
-		WiFi.begin(g_ssid.c_str(), g_pass.c_str());
-		Serial.println("Connecting to WiFi...");
+		// first connect: best-ranked network, targeted at its cached channel/BSSID if known
+		g_wifi_roaming.service();
 	}
 
 
@@ -261,16 +399,18 @@ void setup()
 	if (WiFi.getMode() == WIFI_STA)
 	{
 		// Sync time using NTP (Network Time Protocol) to ensure the device has an accurate clock required for generating valid PalGate token timestamps.
+		g_phase.enter(Phase::WiFiConnect);
 		g_is_time_synced_ok = syncTimeOnce();
+		g_phase.enter(Phase::Active);
 		if (false == g_is_time_synced_ok)
 		{
-			Serial.println("NTP sync failed — token timestamps may be invalid!");
+			LOG_E("NTP sync failed — token timestamps may be invalid!");
 			// If we want to halt the system completely in this case:
 			// while (true) { delay(1000); }
 		}
 		else
 		{
-			Serial.println("NTP time sync OK.");
+			LOG_I("NTP time sync OK.");
 		}
 	}
 
@@ -278,16 +418,45 @@ void setup()
 	pinMode(LED_PIN, OUTPUT);
 	digitalWrite(LED_PIN, LOW);
 
-	Serial.println("Looking for iBeacons...");
+	LOG_I("Looking for iBeacons...");
 
 	BLEDevice::init("");
 	g_manage_scan = BLEDevice::getScan();
 	g_manage_scan->setAdvertisedDeviceCallbacks(new ScanCallbacks(), /*wantDuplicates=*/true);
 	g_manage_scan->setActiveScan(true); // not only scan for names, request more data (like manufacturer data)
 
-	g_manage_scan->setInterval(SCAN_INTERVAL_MS); // e.g. 200 ms
-	g_manage_scan->setWindow(SCAN_WINDOW_MS);     // e.g. 200 ms
+	g_manage_scan->setInterval(cfg().scan_hw_interval_ms); // e.g. 200 ms
+	g_manage_scan->setWindow(cfg().scan_hw_window_ms);     // e.g. 200 ms
+
+	// Metrics endpoint for the STA-mode service (the AP portal uses the same server on its own routes)
+	g_webServer.on("/metrics", HTTP_GET, HandleMetricsRequest);
+	g_webServer.on("/trace", HTTP_GET, HandleTraceRequest);
+	g_webServer.on("/log", HTTP_GET, HandleLogExportRequest);
+	g_webServer.on("/analytics", HTTP_GET, HandleAnalyticsRequest);
+	g_webServer.on("/config", HTTP_GET, HandleConfigGet);
+	g_webServer.on("/config", HTTP_POST, HandleConfigPost);
+	g_webServer.begin();
+
+	// HTTP runs off the loop task so a slow TLS handshake never delays scan windows or timers
+	if (!TaskTopology::startPinned("net", NetTask, nullptr, TaskTopology::APP_CORE, 1, NET_TASK_STACK))
+	{
+		LOG_E("Failed to start the net task; gate triggers disabled.");
+	}
+	// local GATT open, raced against the net task's HTTPS request (idle unless gate_ble_addr is set;
+	// not started in the lean profile, which has no GATT client)
+	if (GateLink::AVAILABLE && !TaskTopology::startPinned("local", LocalTask, nullptr, TaskTopology::APP_CORE, 1, LOCAL_TASK_STACK))
+	{
+		LOG_E("Failed to start the local open task.");
+	}
+	// MQTT export: a slow or absent broker only ever stalls this task
+	if (!TaskTopology::startPinned("mqtt", MqttTask, nullptr, TaskTopology::APP_CORE, 1, MQTT_TASK_STACK))
+	{
+		LOG_E("Failed to start the MQTT export task.");
+	}
 
+	g_wheel.begin(millis());
+	ScheduleIn(g_report_timer, PHASE_REPORT_PERIOD_MS);
+	StartCycle();
 }
 
 
@@ -296,12 +465,13 @@ void setup()
 //===========================================================
 void loop() 
 {
-	// If in AP mode → handle webserver
+	// If in AP mode → handle captive DNS + webserver
 	if (WiFi.getMode() == WIFI_AP)
 	{
-		g_webServer.handleClient();
+		handlePortal();
 		if (g_should_reboot)
         {
+            PalLog::flush();
             delay(500);       
             ESP.restart();
         }
@@ -309,89 +479,71 @@ void loop()
 		return;  // do not run scanning when in AP mode
 	}
 
-	static bool is_scan_running = false;
-
-	// If no scan is running, start a new scan (non-blocking)
-    if (false == is_scan_running)
-    {
-        g_manage_scan->start(SCAN_FAKE_DURATION_SEC, /*is_continue=*/true);
-        is_scan_running = true;
-
-        // reset non-blocking delay timer so wait(80) starts "now"
-        g_scan_delay.wait(0); 
-    }
-
-
-	// start(durationSeconds) is blocking unless is_continue=true. therefore:
-	// start() is non-blocking because 'is_continue=true' returns immediately; 
-	// the scan runs in the background and we manually stop it after a short delay.
-
-	// Wait for 80ms before stopping the scan
-    if (false == g_scan_delay.wait(80))
-    {
-        return; // still waiting — comes back next loop cycle
-    }
+	// reconnect / roam if the link dropped (non-blocking)
+	g_wifi_roaming.service();
 
-	// After 80ms → stop scan and process results
-    g_manage_scan->stop();            // manually stop BLE scan
-    g_manage_scan->clearResults();    // clear internal buffer
-    is_scan_running = false;          // allow next scan to start next iteration
+	// a /config update that came within the grace period of the previous one
+	g_config.service();
 
-	// Beacon detected - Trigger logic (If callback set the flag)
-	if (m_detected.load() == true)
 	{
-		unsigned long now = millis();
+		BusyScope busy(g_control_stats);
 
-		// Handle Debounce: ignore triggers that happen too close together
-		// OR trigger if outside debounce window
+		// serve /metrics and /trace (non-blocking; returns immediately when idle)
+		g_webServer.handleClient();
 
-		unsigned long time_passed_since_last_trigger = now - g_last_trigger_ms;
-		if (time_passed_since_last_trigger > DEBOUNCE_MS)
+		// 't' on the serial console dumps the span trace
+		if (Serial.available() > 0 && Serial.read() == 't')
 		{
-			m_detected.store(false);
-			g_last_trigger_ms = now;
+			DumpTraceToSerial();
+		}
 
-			// Log beacon info
+		// run every timer that is due: scan window end, awake end, next cycle, LED off, reports
+		g_wheel.advance(millis());
 
-			// Serial.printf("Detected iBeacon from %s RSSI=%d UUID=", g_lastBeacon.addrStr, g_lastBeacon.rssi);
-			// for (int i = 0; i < 16; ++i)
-			//   Serial.printf("%02X", g_lastBeacon.uuid[i]);
-			// Serial.printf(" major=%u minor=%u tx=%d\n", (unsigned)g_lastBeacon.major, (unsigned)g_lastBeacon.minor, g_lastBeacon.txPower);
-			
-			if (false == g_is_time_synced_ok)
-			{
-				Serial.println("Time not synced; skipping TriggerGate()");
-				m_detected.store(false);
-			}
-			else
-			{
-				TriggerGate();
-			}
+		// sightings as soon as ingest queued them, mid-window included
+		HandleDetection();
 
+		// LED and phase for triggers the net / local tasks have finished
+		HandleTriggerResults();
 
-		} // if (now - g_last_trigger_ms > DEBOUNCE_MS)
-		else
-		{
-      		// Clear the flag if within debounce window but leave g_last_trigger_ms unchanged
-      		m_detected.store(false);
-		}
+		// presence analytics off the BLE callback: consume what ingest queued
+		DrainObservations();
+
+		// other scanners' sightings and claims; may settle a pending arbitration early
+		ServiceMesh();
 	}
 
-  	// Keep LED on while we have seen the beacon recently. 
-	// Turn off after LED_ON_MS without new sightings.
-  	HandleLed();
+	if (g_is_scan_running)
+	{
+		WaitForWork();
+		return; // scan in progress — comes back next loop cycle
+	}
 
-	// flush Serial before sleep to avoid truncating logs
-	Serial.flush();
+	// drain queued log lines outside scan windows and before sleep to avoid truncating them;
+	// skipped entirely when nothing was logged
+	if (PalLog::needsFlush())
+	{
+		g_phase.enter(Phase::SerialFlush);
+		PalLog::flush();
+		g_phase.enter(IdlePhase());
+	}
 
-	// sleeps 2.8 seconds and returns to next cycle
-	if (false == g_loop_delay.wait(200))
+	// awake period over: light-sleep exactly until the next timer (next cycle, LED off, report).
+	// Not while a trigger is in flight: sleep would stall the TLS session or the GATT link.
+	// Not while arbitrating either: the other scanners' datagrams would be missed.
+	uint32_t deadline_ms;
+	if (false == g_is_awake && 0 == g_triggers_in_flight && false == g_arbiter.pending() && g_wheel.nextDeadline(deadline_ms))
 	{
-		return; // waiting non-blocking
+		int32_t sleep_ms = (int32_t)(deadline_ms - millis());
+		if (sleep_ms > 0)
+		{
+			lightSleepMs((uint32_t)sleep_ms);
+			return;
+		}
 	}
 
-	// after 200ms - sleep
-	lightSleepMs(SLEEP_MS);
+	// awake without a scan, or kept up by a trigger / arbitration
+	WaitForWork();
 
 } // end of loop()
 
@@ -407,11 +559,13 @@ void loop()
  */
 static void printHex(const std::string& s) 
 {
-  Serial.print("Manufacturer Data (hex): ");
-  for (size_t i = 0; i < s.size(); ++i) {
-    Serial.printf("%02X ", static_cast<uint8_t>(s[i]));
+  char hex[3 * 31 + 1];	// iBeacon payloads are <= 31 bytes
+  size_t n = 0;
+  for (size_t i = 0; i < s.size() && n + 3 < sizeof(hex); ++i) {
+    n += snprintf(hex + n, sizeof(hex) - n, "%02X ", static_cast<uint8_t>(s[i]));
   }
-  Serial.println();
+  hex[n] = '\0';
+  LOG_D("Manufacturer Data (hex): %s", hex);
 }
 
 
@@ -426,219 +580,879 @@ static inline void lightSleepMs(uint32_t ms)
   esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000ULL);
 
   // start light sleep and wait for timer (keeps RAM, wakes up fast)
+  Phase prev = g_phase.enter(Phase::LightSleep);
   esp_light_sleep_start();
+  g_phase.enter(prev);
 }
 
 
 
-// Parse iBeacon manufacturer data. 
 /**
- * @brief Parse manufacturer-data payload and extract iBeacon fields.
- *        If it matches target_uuid, fills out `out` and returns true.
+ * @brief Check a decoded advertisement against cfg().target_uuid and fill `out` if it matches.
+ *        Every format is matched on its 16-byte id. In rolling mode only an iBeacon with
+ *        a valid one-time code after the fixed prefix matches (validate() already keeps
+ *        the static formats out of adv_formats).
  */
-static bool parseIBeacon(const std::string& mfg, BeaconInfo &out)
-{
-	// iBeacon Manufacturer Data layout:
-	// [0..1]  Company ID (0x004C, little-endian -> 4C 00)
-	// [2]     Type (0x02)
-	// [3]     Length (0x15)
-	// [4..19] UUID (16B)
-	// [20..21] Major (big-endian)
-	// [22..23] Minor (big-endian)
-	// [24]    Measured Power (signed byte)
-
-	if (mfg.size() < 25) 
-		return false;
+static bool MatchSighting(const AdSighting& s, BeaconInfo &out)
+{
+	const uint8_t* target_uuid = cfg().target_uuid;
+	out.rolling_counter = 0;
 
-	const uint8_t* b = reinterpret_cast<const uint8_t*>(mfg.data());
+	if (g_rolling.enabled())
+	{
+		if (s.format != AdFormat::IBeacon)
+			return false;
 
-	// Accept Apple company ibeacon id in either endianess byte order (0x4C,0x00 or 0x00,0x4C)
-	// checks all packets for valid iBeacon prefix
-	bool company_ok = ((b[0] == IBEACON_PREFIX[0] && b[1] == IBEACON_PREFIX[1]) ||
-								(b[0] == IBEACON_PREFIX[1] && b[1] == IBEACON_PREFIX[0]));
+		// Rolling mode: fixed identity prefix, then a one-time code in UUID[10..15]/major/minor
+		if (std::memcmp(s.id, target_uuid, RollingCode::PREFIX_LEN) != 0)
+			return false;
 
-	if (!company_ok || b[2] != IBEACON_PREFIX[2] || b[3] != IBEACON_PREFIX[3]) 
+		// the tag is the UUID tail, then major and minor as sent (big-endian)
+		const size_t tail = IBeacon::UUID_LEN - RollingCode::PREFIX_LEN;
+		static_assert(RollingCode::TAG_LEN == IBeacon::UUID_LEN - RollingCode::PREFIX_LEN + 4, "tag covers UUID tail, major, minor");
+		uint8_t tag[RollingCode::TAG_LEN];
+		std::memcpy(tag, s.id + RollingCode::PREFIX_LEN, tail);
+		tag[tail + 0] = (uint8_t)(s.major >> 8);
+		tag[tail + 1] = (uint8_t)s.major;
+		tag[tail + 2] = (uint8_t)(s.minor >> 8);
+		tag[tail + 3] = (uint8_t)s.minor;
+		if (!g_rolling.match(tag, out.rolling_counter))
+			return false;
+	}
+	else if (std::memcmp(s.id, target_uuid, IBeacon::UUID_LEN) != 0)
 	{
 		return false;
 	}
 
-  // Try direct UUID match first (advertised bytes in expected order)
-	bool is_matched_uuid = true;
-	for (int i = 0; i < 16; ++i) 
-	{
-		if (b[4 + i] != target_uuid[i]) 
-		{ 
-			is_matched_uuid = false; 
-			break; 
-		}
+	std::memcpy(out.uuid, s.id, IBeacon::UUID_LEN);
+	out.major = s.major;
+	out.minor = s.minor;
+	out.txPower = s.tx_power;
+	out.format = s.format;
+
+	return true;
+}
+
+
+
+/**
+ * @brief Perform the HTTP request to open the gate (token generation + TLS request).
+ *        Runs on the net task only, one request at a time.
+ * @return HTTP status, negative GateHttp error, or 0 if no request was sent.
+ */
+static int TriggerGate(uint32_t trace_id)
+{
+	g_metrics.triggers.inc();
+
+	LOG_I("Triggering gate open action...");
+
+	if (WiFi.status() != WL_CONNECTED) {
+		LOG_E("WiFi disconnected, cannot send request.");
+		return 0;
 	}
 
-	if (is_matched_uuid == true) 
+	// private copy: a /config update on loop() may recycle the published buffer mid-request
+	const RuntimeConfig conf = cfg();
+
+
+	/********** Handle Palgate request **********/
+	// Make sure you read the README before running 
+
+	// Generate time-based token
+	char token[GENERATED_TOKEN_CHARS + 1];
+	MakeToken(conf, token);
+	g_trace.mark(trace_id, TraceStage::TokenGenerated, (uint64_t)esp_timer_get_time());
+
+	// The API host is authenticated by its key (api_pin / api_pin_backup), not by its chain.
+	SpkiPins pins;
+	static_assert(sizeof(pins.sha256) == sizeof(conf.api_pins), "api_pins holds one SpkiPins set");
+	std::memcpy(pins.sha256, conf.api_pins, sizeof(pins.sha256));
+	if (!pins.any())
 	{
-		for (int i = 0; i < 16; ++i) 
-			out.uuid[i] = b[4 + i]; // copy as-is
-	} 
-	else 
+		LOG_W("No api_pin set: the API host is not authenticated.");
+	}
+	g_tls.setPins(pins);
+
+	// Connect first so the TLS handshake shows up as its own stage.
+	uint64_t t0 = esp_timer_get_time();
+	g_trace.mark(trace_id, TraceStage::HttpBegin, t0);
+	g_tls.setMaxFragment(conf.tls_max_frag);
+	if (!g_http.connect(conf.gate_host, 443, HTTP_TIMEOUT_MS))
 	{
-		// Try reversed UUID (advertiser may send UUID bytes in reverse order)
-		bool is_matched_uuid_reversed = true;
-		for (int i = 0; i < 16; ++i) 
+		if (g_tls.lastHandshake() == MbedTlsTransport::Handshake::PinMismatch)
 		{
-			if (b[4 + i] != target_uuid[15 - i]) 
-			{ 
-			is_matched_uuid_reversed = false; 
-			break; 
-			}
+			g_metrics.tls_pin_mismatch.inc();
+			LOG_E("TLS: %s presented a key that matches neither api_pin; request not sent", conf.gate_host);
+		}
+		else
+		{
+			LOG_E("TLS connect failed");
 		}
+		g_metrics.http_status.inc(GateHttp::ERROR_CONNECTION_REFUSED);
+		g_flight.log(FlightEvent::HttpResult, GateHttp::ERROR_CONNECTION_REFUSED);
+		return GateHttp::ERROR_CONNECTION_REFUSED;
+	}
+	uint64_t t1 = esp_timer_get_time();
+	const bool resumed = (g_tls.lastHandshake() == MbedTlsTransport::Handshake::Resumed);
+	(resumed ? g_metrics.tls_resumed : g_metrics.tls_full).inc();
+	g_metrics.http_begin_us.record((uint32_t)(t1 - t0));
+	g_trace.mark(trace_id, TraceStage::TlsHandshake, t1);
+	LOG_I("TLS connect took %llu ms (%s)", (unsigned long long)((t1 - t0) / 1000ULL), resumed ? "resumed" : "full handshake");
+
+	// the local path may have opened the gate during the handshake: do not open it twice.
+	// A GATT write still in flight is waited for, never assumed to succeed; NetTask()
+	// confirms or releases the reservation with the response.
+	if (g_open_race.reserve(trace_id, OpenRace::Path::Cloud, BleGattTransport::WRITE_TIMEOUT_MS) == OpenRace::Grant::Decided)
+	{
+		LOG_I("Gate already opened over BLE; skipping the cloud request.");
+		g_http.close();
+		return 0;
+	}
 
-		if (is_matched_uuid_reversed == false) 
-			return false;
+	// Send only the x-bt-token header (matching the working curl script)
+	uint64_t t2 = esp_timer_get_time();
+	g_trace.mark(trace_id, TraceStage::RequestSent, t2);
+	int httpCode = g_http.get(conf.gate_host, conf.gate_path, "x-bt-token", token, HTTP_TIMEOUT_MS);
+	uint64_t t3 = esp_timer_get_time();
+	g_trace.mark(trace_id, TraceStage::FirstResponseByte, t3);
+	g_metrics.http_get_us.record((uint32_t)(t3 - t2));
+	g_metrics.http_status.inc(httpCode);
+	g_flight.log(FlightEvent::HttpResult, (int16_t)httpCode, (uint16_t)std::min<uint64_t>((t3 - t2) / 1000ULL, UINT16_MAX));
+	LOG_I("GET took %llu ms", (unsigned long long)((t3 - t2) / 1000ULL));
+	if (httpCode > 0)
+	{
+		LOG_I("Response [%d]: %s%s", httpCode, g_http.body(), g_http.truncated() ? " (truncated)" : "");
+	}
+	else
+	{
+		LOG_E("HTTP request failed: %s", GateHttp::errorName(httpCode));
+	}
 
-		// Normalize into out.uuid in the canonical target_uuid order
-		for (int i = 0; i < 16; ++i) 
-			out.uuid[i] = target_uuid[i]; // copy reversed order
+	g_http.close();
+	LOG_D("Heap after trigger: %u free, largest block %u; TLS arena peak %u of %u",
+		  (unsigned)ESP.getFreeHeap(), (unsigned)SampleLargestFreeBlock(), (unsigned)g_tls_arena.peak(), (unsigned)g_tls_arena.size());
+	return httpCode;
+}
+
+
+
+/**
+ * @brief Arm `t` for `ms` from now. Uses millis() rather than the wheel's time,
+ *        which lags behind inside a callback that ran long (e.g. TriggerGate()).
+ */
+static inline void ScheduleIn(WheelTimer& t, uint32_t ms)
+{
+	g_wheel.scheduleAt(t, millis() + ms);
+}
+
+
+
+/**
+ * @brief Block loop() until the next timer is due, ingest or a trigger path signals
+ *        control, or CONTROL_WAIT_MS passes. Blocking rather than spinning leaves core 1
+ *        to the net and local tasks while a scan window is open.
+ */
+static void WaitForWork()
+{
+	uint32_t wait_ms = CONTROL_WAIT_MS;
+	uint32_t deadline_ms;
+	if (g_wheel.nextDeadline(deadline_ms))
+	{
+		int32_t until_ms = (int32_t)(deadline_ms - millis());
+		wait_ms = (until_ms <= 0) ? 0 : std::min<uint32_t>((uint32_t)until_ms, CONTROL_WAIT_MS);
+	}
+	if (wait_ms > 0)
+	{
+		g_control_signal.wait(wait_ms);
 	}
+}
 
-	// Parse major, minor, txPower to real numbers and save
-	out.major = (uint16_t(b[20]) << 8) | uint16_t(b[21]);
-	out.minor = (uint16_t(b[22]) << 8) | uint16_t(b[23]);
-	out.txPower = static_cast<int8_t>(b[24]);
 
-	return true;
+
+/**
+ * @brief Start one duty cycle: stay awake for loop_awake_ms, scanning back to back.
+ */
+static void StartCycle()
+{
+	g_is_awake = true;
+	ScheduleIn(g_awake_timer, cfg().loop_awake_ms);
+	StartScan();
 }
 
 
 
 /**
- * @brief Perform the HTTP request to open the gate.
- *        Includes token generation, TLS request, LED indication,
- *        and protection against re-entrant calls.
+ * @brief Open a scan window of scan_window_ms. Radio parameters changed via /config
+ *        are applied here, between scans only.
  */
-static void TriggerGate()
+static void StartScan()
 {
-	// prevent re-entrancy: if a TriggerGate is already running, skip this one
-	bool expected = false;
-	if (!g_trigger_in_progress.compare_exchange_strong(expected, true)) {
-		Serial.println("TriggerGate already in progress, skipping duplicate call.");
-		return;
+	static uint32_t s_applied_generation = 0;
+
+	if (cfg().generation != s_applied_generation)
+	{
+		s_applied_generation = cfg().generation;
+		g_manage_scan->setInterval(cfg().scan_hw_interval_ms);
+		g_manage_scan->setWindow(cfg().scan_hw_window_ms);
+		g_rolling.configure(cfg());
+	}
+
+	// start(durationSeconds) is blocking unless is_continue=true. therefore:
+	// start() is non-blocking because 'is_continue=true' returns immediately; 
+	// the scan runs in the background and OnScanWindowEnd() stops it.
+	g_phase.enter(Phase::Scan);
+	g_manage_scan->start(SCAN_FAKE_DURATION_SEC, /*is_continue=*/true);
+	g_is_scan_running = true;
+
+	ScheduleIn(g_scan_window_timer, cfg().scan_window_ms);
+}
+
+
+
+// Scan window elapsed → stop scan, act on detections, scan again while still awake
+static void OnScanWindowEnd(void* arg)
+{
+	g_manage_scan->stop();            // manually stop BLE scan
+	g_manage_scan->clearResults();    // clear internal buffer
+	g_is_scan_running = false;
+	g_phase.enter(Phase::Active);
+
+	HandleDetection();	// whatever arrived since the last loop() pass
+	g_phase.enter(IdlePhase());
+
+	// persist queued flight-recorder events once a batch is due (never inside the scan window)
+	g_flight.flush();
+
+	if (g_is_awake)
+	{
+		StartScan();
 	}
+}
+
 
-	// RAII guard: ensure g_trigger_in_progress is cleared on every exit path
-	struct Guard 
+
+/**
+ * @brief Act on the sightings ingest queued since the last call (every loop() pass):
+ *        rolling-code resync, then each sighting through the per-beacon trigger policy.
+ */
+static void HandleDetection()
+{
+	// Rolling mode: publish a window slide the grace period held back. A beacon pressed
+	// out of range sends codes beyond the window; two consecutive ones re-anchor it
+	// and count as a detection
+	g_rolling.service();
+	uint32_t resync_counter = 0;
+	uint16_t resync_major = 0;
+	uint16_t resync_minor = 0;
+	if (g_rolling.enabled() && g_rolling.resync(resync_counter, resync_major, resync_minor))
 	{
-		std::atomic_bool &g;
-		Guard(std::atomic_bool &g_) : g(g_) {}
-		~Guard() { g.store(false); }
-	};
-	Guard guard(g_trigger_in_progress);
+		// the press's own major/minor, so a peer scanner that matched it in its window
+		// arbitrates the same beacon
+		SightingEvent ev = SightingEvent();
+		ev.info.format = AdFormat::IBeacon;
+		ev.info.major = resync_major;
+		ev.info.minor = resync_minor;
+		ev.info.rolling_counter = resync_counter;
+		ev.at_us = (uint64_t)esp_timer_get_time();
+		ConsiderSighting(ev, true);
+	}
 
-	Serial.println("Triggering gate open action...");
+	// every sighting feeds the RSSI filter the arbitration compares and goes through the
+	// policy (constant time each), so a second car in the same window is seen as well
+	SightingEvent ev;
+	while (g_sightings.pop(ev))
+	{
+		g_arbiter.sample(ev.info.major, ev.info.minor, ev.info.rssi, (uint32_t)(ev.at_us / 1000));
 
-	if (WiFi.status() != WL_CONNECTED) {
-		Serial.println("WiFi disconnected, cannot send request.");
+		ExportEvent sighting = {};
+		sighting.kind = ExportEvent::Kind::Sighting;
+		sighting.detail = (uint8_t)ev.info.format;
+		sighting.rssi = (int8_t)ev.info.rssi;
+		sighting.beacon = BeaconIdentity(ev.info);
+		sighting.counter = ev.info.rolling_counter;
+		PostExport(sighting);
+
+		ConsiderSighting(ev, false);
+	}
+}
+
+
+
+/**
+ * @brief One sighting: cooldown / coalescing per beacon, then hand the trigger to the
+ *        net and local tasks (after the arbitration when several scanners share a site).
+ */
+static void ConsiderSighting(const SightingEvent& ev, bool resynced)
+{
+	const RuntimeConfig& conf = cfg();
+
+	// several scanners: wait until the beacon is close enough to tell the gates apart
+	// (the sightings stay in the filter; a later window re-checks)
+	const bool arbitrate = conf.mesh_window_ms != 0 && g_mesh_joined;
+	if (arbitrate && !resynced && g_arbiter.filteredRssi(ev.info.major, ev.info.minor, millis()) < conf.mesh_min_rssi)
+		return;
+
+	// one arbitration at a time: another beacon waits for it outside the policy, so it
+	// gets no cooldown without a request (a resync is kept over a plain sighting)
+	const uint32_t identity = BeaconIdentity(ev.info);
+	if (arbitrate && g_arbiter.pending())
+	{
+		if (identity != g_arbitrated_identity && (resynced || false == g_deferred_resynced || false == g_deferred_valid))
+		{
+			g_deferred = ev;
+			g_deferred_valid = true;
+			g_deferred_resynced = resynced;
+		}
 		return;
 	}
 
-	// secure client for HTTPS
-	WiFiClientSecure client;
-	client.setInsecure(); // development only — replace with CA cert in production
-	HTTPClient http;
-	uint8_t session[16];
+	unsigned long now = millis();
+	const TriggerPolicy::Rules rules = { conf.debounce_ms, conf.coalesce_ms };
+	const TriggerPolicy::Decision decision = g_policy.admit(identity, now, rules);
+	switch (decision.verdict)
+	{
+		case TriggerPolicy::Verdict::Open:
+			break;
+		case TriggerPolicy::Verdict::Coalesced:
+		{
+			g_metrics.triggers_coalesced.inc();
+			ExportEvent joined = {};
+			joined.kind = ExportEvent::Kind::Coalesced;
+			joined.detail = (uint8_t)ev.info.format;
+			joined.beacon = identity;
+			joined.counter = ev.info.rolling_counter;
+			PostExport(joined);
+			LOG_I("Beacon %u/%u arrived while the gate is opening; no second request.",
+				  (unsigned)ev.info.major, (unsigned)ev.info.minor);
+			return;
+		}
+		case TriggerPolicy::Verdict::Cooldown:
+			// a car this scanner won keeps its claim fresh for the other scanners meanwhile
+			if (arbitrate)
+				g_arbiter.repeatClaim(ev.info.major, ev.info.minor, now, UnixMs());
+			return;
+		case TriggerPolicy::Verdict::InFlight:
+			return;
+	}
 
+	uint32_t trace_id = g_trace.begin();
+	g_trace.mark(trace_id, TraceStage::AdvReceived, ev.at_us);
+	g_trace.mark(trace_id, TraceStage::LoopPickup, (uint64_t)esp_timer_get_time());
+	g_flight.log(FlightEvent::Sighting, (int16_t)ev.info.major, ev.info.minor, (int8_t)ev.info.rssi);
 
-	/********** Handle Palgate request **********/
-	// Make sure you read the README before running 
+	// Log beacon info
+	LOG_D("Detected %s from %s RSSI=%d major=%u minor=%u tx=%d", AdvDecoder::formatName(ev.info.format), ev.info.addrStr,
+		  ev.info.rssi, (unsigned)ev.info.major, (unsigned)ev.info.minor, ev.info.txPower);
 
-	// Convert hex string to binary
-	if (!hexStringToBytes(PALGATE_SESSION_TOKEN, session, 16))
+	if (false == g_is_time_synced_ok)
 	{
-		Serial.println("Invalid session token format!");
+		LOG_W("Time not synced; skipping TriggerGate()");
+		g_policy.launched(decision.slot, trace_id, 0);
 		return;
 	}
 
-	// Generate time-based token
-		uint32_t ts = static_cast<uint32_t>(time(nullptr));
-		std::string token = generateToken(session, PALGATE_PHONE_NUMBER, PALGATE_TOKEN_TYPE, ts);
+	// burn the code before acting on it: the same advert can never open the gate twice
+	g_rolling.accept(ev.info.rolling_counter);
 
-	// Construct URL
-	String url = "https://api1.pal-es.com/v1/bt/device/4G600106591/open-gate?outputNum=1";
+	TriggerRequest req;
+	req.trace_id = trace_id;
+	req.detected_at_us = ev.at_us;
+	req.beacon = identity;
+	req.counter = ev.info.rolling_counter;
+	req.format = ev.info.format;
 
-	// Make HTTP GET request with headers using secure client
-	Serial.printf("Starting http.begin()...\n");
-	uint64_t t0 = esp_timer_get_time();
-	if (!http.begin(client, url)) {
-		Serial.println("http.begin failed");
+	// several scanners: announce the sighting and trigger only if no peer heard the beacon stronger
+	if (arbitrate)
+	{
+		const uint32_t window_ms = conf.mesh_window_ms;
+		TriggerArbiter::Outcome outcome;
+		g_arbitrated = req;
+		g_arbitrated_slot = decision.slot;
+		g_arbitrated_identity = identity;
+		if (g_arbiter.propose(ev.info.major, ev.info.minor, window_ms, conf.debounce_ms, millis(), UnixMs(), outcome))
+			ScheduleIn(g_arbitration_timer, window_ms);
+		else
+			HandleArbitration(outcome);
 		return;
 	}
-	uint64_t t1 = esp_timer_get_time();
-	Serial.printf("http.begin took %llu ms\n", (unsigned long long)((t1 - t0) / 1000ULL));
 
-		// Send only the x-bt-token header (matching the working curl script)
-		http.addHeader("x-bt-token", token.c_str());
+	g_policy.launched(decision.slot, trace_id, DispatchTrigger(req));
+}
 
-		// Send the request
-		Serial.println("About to call http.GET()...");
-		uint64_t t2 = esp_timer_get_time();
-		int httpCode = http.GET();
-		uint64_t t3 = esp_timer_get_time();
-		Serial.printf("http.GET() took %llu ms\n", (unsigned long long)((t3 - t2) / 1000ULL));
-	if (httpCode > 0)
+
+
+// Key of the trigger policy, the ingest repeat limit and the presence analytics: major/minor
+// of a fixed iBeacon; with rolling codes they change every press, so the rolling beacon is a
+// single identity.
+static_assert(ROLLING_IDENTITY == AdvObservation::ROLLING_BEACON && ROLLING_IDENTITY == ExportEvent::ROLLING_BEACON,
+			  "the analytics and the MQTT export key the rolling beacon the same way");
+static uint32_t BeaconIdentity(const BeaconInfo& info)
+{
+	if (g_rolling.enabled() && info.format == AdFormat::IBeacon)
+		return ROLLING_IDENTITY;
+	return ((uint32_t)info.major << 16) | info.minor;
+}
+
+
+
+/**
+ * @brief Hand a trigger to the net and local tasks; they race, whichever opens the gate first wins (OpenRace).
+ * @return Number of paths the request went out on (each reports one TriggerResult).
+ */
+static uint8_t DispatchTrigger(const TriggerRequest& req)
+{
+	ExportEvent trigger = {};
+	trigger.kind = ExportEvent::Kind::Trigger;
+	trigger.detail = (uint8_t)req.format;
+	trigger.beacon = req.beacon;
+	trigger.counter = req.counter;
+	trigger.trace_id = req.trace_id;
+	PostExport(trigger);
+
+	uint8_t paths = 0;
+	if (g_trigger_requests.push(req))
 	{
-		String payload = http.getString();
-		Serial.printf("Response [%d]: %s\n", httpCode, payload.c_str());
+		++g_triggers_in_flight;
+		++paths;
+		g_net_signal.notify();
+	}
+	else
+	{
+		LOG_W("Net task busy with earlier triggers; no cloud request for this one.");
+	}
 
-		// Only treat 2xx as success — light LED and refresh last-seen timestamp
-		if (httpCode >= 200 && httpCode < 300)
+	if (GateLink::enabled(LocalTarget(cfg())))
+	{
+		if (g_local_requests.push(req))
 		{
-			g_last_time_gate_opend_us.store(esp_timer_get_time());
-			digitalWrite(LED_PIN, HIGH);
-			g_led_on = true;
-			Serial.println("Gate opened (HTTP success). LED ON.");
+			++g_triggers_in_flight;
+			++paths;
+			g_local_signal.notify();
 		}
 		else
 		{
-			Serial.println("Gate open request returned non-success code; not lighting LED.");
+			LOG_W("Local task busy with earlier triggers; no GATT open for this one.");
 		}
 	}
-	else
+	return paths;
+}
+
+
+
+/**
+ * @brief Network task ("net", core 1): runs TriggerGate() for each queued request
+ *        and reports the outcome, so HTTP never blocks scanning or the timers.
+ */
+static void NetTask(void* arg)
+{
+	// from here on the mbedTLS allocations of this task come from the arena, starting with
+	// the record buffers MbedTlsTransport::begin() allocates once
+	if (g_tls_arena.active() && !hookMbedTls(g_tls_arena))
+	{
+		LOG_W("This mbedTLS build has a fixed allocator; TLS uses the heap.");
+	}
+	if (!g_tls.begin())
 	{
-		Serial.printf("HTTP request failed: %s\n", http.errorToString(httpCode).c_str());
+		LOG_E("TLS setup failed; cloud requests will fail.");
 	}
 
-	http.end();
-	// release re-entrancy guard
-	g_trigger_in_progress.store(false);
+	for (;;)
+	{
+		g_net_signal.wait(NET_WAIT_MS);
+
+		TriggerRequest req;
+		while (g_trigger_requests.pop(req))
+		{
+			BusyScope busy(g_net_stats);
+
+			uint64_t start_us = (uint64_t)esp_timer_get_time();
+			uint32_t detect_to_trigger_us = (uint32_t)(start_us - req.detected_at_us);
+			g_metrics.detect_to_trigger_us.record(detect_to_trigger_us);
+			g_flight.log(FlightEvent::Trigger, 0, (uint16_t)std::min<uint32_t>(detect_to_trigger_us / 1000, UINT16_MAX));
+
+			TriggerResult res;
+			res.trace_id = req.trace_id;
+			res.path = OpenPath::Cloud;
+			res.code = TriggerGate(req.trace_id);
+			res.opened = (res.code >= 200 && res.code < 300);
+			if (res.opened)
+			{
+				res.first = g_open_race.confirm(req.trace_id, OpenRace::Path::Cloud);
+			}
+			else
+			{
+				res.first = false;
+				g_open_race.release(req.trace_id, OpenRace::Path::Cloud);	// let a local write go ahead
+			}
+			uint32_t elapsed_us = (uint32_t)((uint64_t)esp_timer_get_time() - req.detected_at_us);
+			res.elapsed_ms = elapsed_us / 1000;
+			if (res.opened)
+			{
+				g_metrics.open_cloud_us.record(elapsed_us);
+			}
+			g_trigger_results.push(res);
+			g_control_signal.notify();
+		}
+	}
 }
 
 
 
 /**
- * @brief Manage LED state based on last successful gate trigger.
- *        Turns LED ON for a fixed window and then OFF automatically.
+ * @brief Local open task ("local", core 1): writes the token straight to the PalGate
+ *        unit over GATT while the net task makes the cloud request.
  */
-static void HandleLed()
+static void LocalTask(void* arg)
 {
-	
-	uint64_t now_us = esp_timer_get_time();
-  	uint64_t last_time_opened = g_last_time_gate_opend_us.load();
-  	uint64_t time_passed_since_last_opened = now_us - last_time_opened;
+	for (;;)
+	{
+		g_local_signal.wait(NET_WAIT_MS);
+
+		TriggerRequest req;
+		while (g_local_requests.pop(req))
+		{
+			BusyScope busy(g_local_stats);
+
+			// private copy, as in TriggerGate()
+			const RuntimeConfig conf = cfg();
+			char token[GENERATED_TOKEN_CHARS + 1];
+			MakeToken(conf, token);
+
+			GateLink::Timing timing;
+			GateLink::Result result = g_gate_link.open(LocalTarget(conf), reinterpret_cast<const uint8_t*>(token),
+													   GENERATED_TOKEN_CHARS, req.trace_id, g_open_race, timing);
+			uint64_t done_us = (uint64_t)esp_timer_get_time();
+
+			switch (result)
+			{
+				case GateLink::Result::Opened:			g_metrics.local_opened.inc(); break;
+				case GateLink::Result::ConnectFailed:	g_metrics.local_connect_failed.inc(); break;
+				case GateLink::Result::WriteFailed:		g_metrics.local_write_failed.inc(); break;
+				case GateLink::Result::Cancelled:		g_metrics.local_cancelled.inc(); break;
+				case GateLink::Result::Disabled:		break;
+			}
+			if (timing.connect_us)
+				g_metrics.gatt_connect_us.record(timing.connect_us);
+			if (timing.write_us)
+				g_metrics.gatt_write_us.record(timing.write_us);
+			g_flight.log(FlightEvent::GattResult, (int16_t)result,
+						 (uint16_t)std::min<uint32_t>((timing.connect_us + timing.write_us) / 1000, UINT16_MAX));
+			LOG_I("Local open: %s (connect %u ms, write %u ms)", GateLink::resultName(result),
+				  (unsigned)(timing.connect_us / 1000), (unsigned)(timing.write_us / 1000));
+
+			TriggerResult res;
+			res.trace_id = req.trace_id;
+			res.path = OpenPath::Local;
+			res.code = (int)result;
+			res.opened = (result == GateLink::Result::Opened);
+			res.first = res.opened && g_open_race.wonBy(req.trace_id, OpenRace::Path::Local);	// open() confirmed it
+			res.elapsed_ms = (uint32_t)((done_us - req.detected_at_us) / 1000);
+			if (res.opened)
+			{
+				g_metrics.open_local_us.record((uint32_t)(done_us - req.detected_at_us));
+			}
+			g_local_results.push(res);
+			g_control_signal.notify();
+		}
+	}
+}
 
-	if (last_time_opened != 0 && (time_passed_since_last_opened < (uint64_t)LED_ON_US)) 
+
+
+/**
+ * @brief MQTT export task ("mqtt", core 1): batches what control posts and publishes it
+ *        (MqttExporter), so a slow or absent broker never holds up scanning or TriggerGate().
+ */
+static void MqttTask(void* arg)
+{
+	static_assert(sizeof(MqttSettings::host) == sizeof(RuntimeConfig::mqtt_host) &&
+				  sizeof(MqttSettings::topic) == sizeof(RuntimeConfig::mqtt_topic) &&
+				  sizeof(MqttSettings::user) == sizeof(RuntimeConfig::mqtt_user) &&
+				  sizeof(MqttSettings::pass) == sizeof(RuntimeConfig::mqtt_pass), "MqttSettings mirrors the mqtt_* fields");
+
+	for (;;)
 	{
-		if (false == g_led_on) 
+		uint32_t wait_ms;
 		{
-			digitalWrite(LED_PIN, HIGH);
-			g_led_on = true;
+			BusyScope busy(g_mqtt_stats);
+
+			// private copy: service() can wait on the broker far longer than one grace period
+			MqttSettings s = {};
+			{
+				const RuntimeConfig& conf = cfg();
+				memcpy(s.host, conf.mqtt_host, sizeof(s.host));
+				memcpy(s.topic, conf.mqtt_topic, sizeof(s.topic));
+				memcpy(s.user, conf.mqtt_user, sizeof(s.user));
+				memcpy(s.pass, conf.mqtt_pass, sizeof(s.pass));
+				s.port = conf.mqtt_port;
+				s.qos = conf.mqtt_qos;
+				s.batch_ms = conf.mqtt_batch_ms;
+				s.keepalive_s = conf.mqtt_keepalive_s;
+				snprintf(s.client_id, sizeof(s.client_id), "palgate-%08x", (unsigned)MeshScannerId(conf));
+			}
+			wait_ms = g_mqtt.service(s, WiFi.status() == WL_CONNECTED);
 		}
-	} 
-  	else 
+		g_mqtt.wait(wait_ms);
+	}
+}
+
+
+
+/**
+ * @brief Queue an event for the MQTT export (control task only); a no-op while mqtt_host
+ *        is empty. Never blocks: under backpressure the exporter sheds sightings first.
+ */
+static void PostExport(ExportEvent ev)
+{
+	if (cfg().mqtt_host[0] == '\0')
+		return;
+	ev.unix_ms = UnixMs();
+	g_mqtt.post(ev);
+}
+
+
+
+/**
+ * @brief Time-based x-bt-token for the gate; the cloud request and the GATT write carry the same one.
+ */
+static void MakeToken(const RuntimeConfig& conf, char token[GENERATED_TOKEN_CHARS + 1])
+{
+	// session token was parsed from hex once, when the config was loaded
+	uint32_t ts = static_cast<uint32_t>(time(nullptr));
+	generateToken(token, conf.session, conf.phone_number, conf.token_type, ts);
+}
+
+
+
+/**
+ * @brief Largest allocatable heap block, folded into its low water (g_heap_largest_low).
+ *        Sampled after every trigger and at every /metrics scrape; any task.
+ */
+static uint32_t SampleLargestFreeBlock()
+{
+	uint32_t largest = (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+	uint32_t low = g_heap_largest_low.load(std::memory_order_relaxed);
+	while (largest < low && !g_heap_largest_low.compare_exchange_weak(low, largest, std::memory_order_relaxed))
+	{
+	}
+	return largest;
+}
+
+
+
+static GateLinkTarget LocalTarget(const RuntimeConfig& conf)
+{
+	GateLinkTarget target;
+	memcpy(target.addr, conf.gate_ble_addr, sizeof(target.addr));
+	memcpy(target.service, conf.gate_ble_service, sizeof(target.service));
+	memcpy(target.characteristic, conf.gate_ble_char, sizeof(target.characteristic));
+	target.timeout_ms = conf.gate_ble_timeout_ms;
+	return target;
+}
+
+
+
+/**
+ * @brief Control side of a finished trigger: LED on success, back to the idle phase.
+ */
+static void HandleTriggerResults()
+{
+	TriggerResult res;
+	while (g_trigger_results.pop(res))
+		HandleTriggerResult(res);
+	while (g_local_results.pop(res))
+		HandleTriggerResult(res);
+}
+
+
+
+static void HandleTriggerResult(const TriggerResult& res)
+{
+	--g_triggers_in_flight;
+	g_policy.finished(res.trace_id);
+	const char* path = (res.path == OpenPath::Local) ? "BLE" : "HTTP";
+
+	ExportEvent outcome = {};
+	outcome.kind = ExportEvent::Kind::Result;
+	outcome.detail = (res.path == OpenPath::Local ? ExportEvent::PATH_LOCAL : 0) |
+					 (res.opened ? ExportEvent::OPENED : 0) | (res.first ? ExportEvent::FIRST : 0);
+	outcome.code = res.code;
+	outcome.trace_id = res.trace_id;
+	outcome.elapsed_ms = res.elapsed_ms;
+	PostExport(outcome);
+
+	// the first successful path lights the LED for led_on_ms; the other one only confirms
+	if (res.first)
+	{
+		(res.path == OpenPath::Local ? g_metrics.open_wins_local : g_metrics.open_wins_cloud).inc();
+		digitalWrite(LED_PIN, HIGH);
+		g_led_on = true;
+		ScheduleIn(g_led_timer, cfg().led_on_ms);	// re-arming extends the window
+		g_trace.mark(res.trace_id, TraceStage::LedOn, (uint64_t)esp_timer_get_time());
+		LOG_I("Gate opened (%s success). LED ON.", path);
+	}
+	else if (res.opened)
+	{
+		LOG_D("Gate also opened via %s.", path);
+	}
+	else if (res.path == OpenPath::Cloud && res.code > 0)
+	{
+		LOG_W("Gate open request returned non-success code; not lighting LED.");
+	}
+
+	if (!g_is_scan_running)
+		g_phase.enter(IdlePhase());
+}
+
+
+
+// Phase accounting is control-owned: while the net or local task works on a trigger, control's
+// non-scan time is accounted as Http (the radio is busy with WiFi either way).
+static inline Phase IdlePhase()
+{
+	return g_triggers_in_flight ? Phase::Http : Phase::Active;
+}
+
+
+
+/**
+ * @brief Join the multicast group once WiFi is up (again after every reconnect or port
+ *        change) and feed received sightings and claims to the arbiter.
+ */
+static void ServiceMesh()
+{
+	static uint32_t s_joined_ip = 0;
+	static uint16_t s_joined_port = 0;
+
+	const RuntimeConfig& conf = cfg();
+	uint32_t ip = (conf.mesh_window_ms != 0 && WiFi.status() == WL_CONNECTED) ? (uint32_t)WiFi.localIP() : 0;
+	if (ip != s_joined_ip || conf.mesh_port != s_joined_port)
 	{
-   	if (g_led_on) 
+		s_joined_ip = ip;
+		s_joined_port = conf.mesh_port;
+		g_mesh_joined = (ip != 0) && g_mesh_transport.begin(MESH_GROUP, conf.mesh_port);
+		g_arbiter.setScannerId(MeshScannerId(conf));
+		if (ip != 0)
 		{
-      	digitalWrite(LED_PIN, LOW);
-      	g_led_on = false;
-    	}
+			LOG_I("Scanner mesh: %s as %08x on port %u", g_mesh_joined ? "joined" : "failed to join",
+				  (unsigned)g_arbiter.scannerId(), (unsigned)conf.mesh_port);
+		}
+	}
+
+	if (false == g_mesh_joined)
+		return;
+
+	g_arbiter.setKey(conf.mesh_key);	// /config may have changed it
+	TriggerArbiter::Outcome outcome;
+	if (g_arbiter.poll(millis(), UnixMs(), outcome))
+	{
+		g_wheel.cancel(g_arbitration_timer);
+		HandleArbitration(outcome);
+	}
+}
+
+
+
+// mesh_window_ms after the announcement: nobody stronger spoke up → this scanner opens
+static void OnArbitrationEnd(void* arg)
+{
+	TriggerArbiter::Outcome outcome;
+	if (g_arbiter.decide(millis(), UnixMs(), outcome))
+		HandleArbitration(outcome);
+}
+
+
+
+static void HandleArbitration(const TriggerArbiter::Outcome& outcome)
+{
+	g_metrics.arbitration_ms.record(outcome.latency_ms);
+	g_flight.log(FlightEvent::Arbitration, (int16_t)outcome.decision, (uint16_t)std::min<uint32_t>(outcome.latency_ms, UINT16_MAX));
+
+	switch (outcome.decision)
+	{
+		case TriggerArbiter::Decision::Won:
+			g_metrics.arbitration_won.inc();
+			g_policy.launched(g_arbitrated_slot, g_arbitrated.trace_id, DispatchTrigger(g_arbitrated));
+			break;
+		case TriggerArbiter::Decision::Outscored:
+			g_metrics.arbitration_outscored.inc();
+			g_policy.launched(g_arbitrated_slot, g_arbitrated.trace_id, 0);
+			break;
+		case TriggerArbiter::Decision::Claimed:
+			g_metrics.arbitration_claimed.inc();
+			g_policy.launched(g_arbitrated_slot, g_arbitrated.trace_id, 0);
+			break;
+	}
+	if (outcome.decision != TriggerArbiter::Decision::Won)
+	{
+		LOG_I("Standing down for beacon %u/%u: %s by scanner %08x after %u ms", (unsigned)outcome.major,
+			  (unsigned)outcome.minor, TriggerArbiter::decisionName(outcome.decision), (unsigned)outcome.winner_id,
+			  (unsigned)outcome.latency_ms);
 	}
+
+	// the beacon that arrived meanwhile gets its turn now
+	if (g_deferred_valid)
+	{
+		const SightingEvent deferred = g_deferred;
+		g_deferred_valid = false;
+		ConsiderSighting(deferred, g_deferred_resynced);
+	}
+}
+
+
+
+// mesh_id from /config, else bytes 2..5 of the factory MAC (bytes 0..2 are Espressif's OUI)
+static uint32_t MeshScannerId(const RuntimeConfig& conf)
+{
+	if (conf.mesh_id != 0)
+		return conf.mesh_id;
+	return (uint32_t)(ESP.getEfuseMac() >> 16);
+}
+
+
+
+// Wall clock for the mesh messages' staleness check and the MQTT export; 0 until NTP synced.
+static uint64_t UnixMs()
+{
+	if (false == g_is_time_synced_ok)
+		return 0;
+	struct timeval tv;
+	gettimeofday(&tv, nullptr);
+	return (uint64_t)tv.tv_sec * 1000ULL + (uint64_t)tv.tv_usec / 1000ULL;
+}
+
+
+
+// loop_awake_ms elapsed → no new scan windows; the next cycle starts sleep_ms from now
+static void OnAwakeEnd(void* arg)
+{
+	g_is_awake = false;
+	ScheduleIn(g_cycle_timer, cfg().sleep_ms);
+}
+
+
+
+static void OnCycleStart(void* arg)
+{
+	StartCycle();
+}
+
+
+
+// led_on_ms after the last successful open
+static void OnLedOff(void* arg)
+{
+	digitalWrite(LED_PIN, LOW);
+	g_led_on = false;
+}
+
+
+
+// once per uptime hour, print where the previous hour went (checked every PHASE_REPORT_PERIOD_MS)
+static void OnPhaseReport(void* arg)
+{
+	ReportPhaseTotals();
+	ScheduleIn(g_report_timer, PHASE_REPORT_PERIOD_MS);
 }
 
 
@@ -658,7 +1472,7 @@ static bool syncTimeOnce()
 
 		if (now > 1000000000)
 		{
-			Serial.println("Time synchronized successfully via NTP.");
+			LOG_I("Time synchronized successfully via NTP.");
 			return true;
 		}
 
@@ -666,12 +1480,350 @@ static bool syncTimeOnce()
 		yield();    
 	}
 
-	Serial.println("Failed to synchronize time via NTP.");
+	LOG_E("Failed to synchronize time via NTP.");
 	return false;
 }
 
 
 
+/**
+ * @brief Print the previous uptime hour's phase totals once the hour rolls over.
+ *        Called after each light-sleep so the report never lands inside a scan window.
+ */
+static void ReportPhaseTotals()
+{
+	static uint32_t s_reported_hour = 0;
+
+	g_phase.sync();
+	uint32_t hour = g_phase.currentHour();
+	if (hour == s_reported_hour)
+		return;
+
+	s_reported_hour = hour;
+
+	const PhaseAccounting::Totals* prev = g_phase.hour(1);
+	if (prev == nullptr)
+		return;
+
+	char report[512];
+	PhaseAccounting::format(*prev, report, sizeof(report));
+
+	// one log entry per line: a whole report would not fit one entry's argument space
+	LOG_I("Duty cycle, uptime hour %u:", (unsigned)prev->hour);
+	for (char* line = strtok(report, "\n"); line != nullptr; line = strtok(nullptr, "\n"))
+	{
+		LOG_I("  %s", line);
+	}
+}
+
+
+
+/**
+ * @brief Serve GET /metrics in Prometheus text format.
+ *        Counters/histograms come from g_metrics; heap and duty-cycle gauges are sampled here.
+ */
+static void HandleMetricsRequest()
+{
+	std::string body;
+	body.reserve(4096);
+
+	renderPrometheus(g_metrics, body);
+
+	promHeader(body, "palgate_heap_free_bytes", "gauge", "Current free heap.");
+	promSample(body, "palgate_heap_free_bytes", nullptr, ESP.getFreeHeap());
+	promHeader(body, "palgate_heap_min_free_bytes", "gauge", "Lowest free heap since boot.");
+	promSample(body, "palgate_heap_min_free_bytes", nullptr, ESP.getMinFreeHeap());
+	promHeader(body, "palgate_heap_max_used_bytes", "gauge", "Most heap in use at once since boot.");
+	promSample(body, "palgate_heap_max_used_bytes", nullptr, ESP.getHeapSize() - ESP.getMinFreeHeap());
+	uint32_t largest_free = SampleLargestFreeBlock();
+	promHeader(body, "palgate_heap_largest_free_block_bytes", "gauge", "Largest heap block that can be allocated.");
+	promSample(body, "palgate_heap_largest_free_block_bytes", nullptr, largest_free);
+	promHeader(body, "palgate_heap_largest_free_block_min_bytes", "gauge", "Smallest largest-free-block seen after a trigger or at a scrape.");
+	promSample(body, "palgate_heap_largest_free_block_min_bytes", nullptr, g_heap_largest_low.load(std::memory_order_relaxed));
+
+	// TLS arena (TlsArena.h): peak against size says how much of tls_arena_kb the session needs
+	promHeader(body, "palgate_tls_arena_bytes", "gauge", "TLS arena size, bytes in use, and the most in use at once.");
+	promSample(body, "palgate_tls_arena_bytes", "state=\"size\"", g_tls_arena.size());
+	promSample(body, "palgate_tls_arena_bytes", "state=\"used\"", g_tls_arena.used());
+	promSample(body, "palgate_tls_arena_bytes", "state=\"peak\"", g_tls_arena.peak());
+	promHeader(body, "palgate_tls_arena_allocations_total", "counter", "mbedTLS allocations served by the TLS arena.");
+	promSample(body, "palgate_tls_arena_allocations_total", nullptr, g_tls_arena.allocations());
+	promHeader(body, "palgate_tls_arena_fallbacks_total", "counter", "mbedTLS allocations of the net task that did not fit the arena and went to the heap.");
+	promSample(body, "palgate_tls_arena_fallbacks_total", nullptr, g_tls_arena.fallbacks());
+
+	g_phase.sync();
+	const PhaseAccounting::Totals& life = g_phase.lifetime();
+	char labels[32];
+
+	promHeader(body, "palgate_phase_seconds_total", "counter", "Time spent in each duty-cycle phase.");
+	for (size_t i = 0; i < PhaseAccounting::PHASE_COUNT; ++i)
+	{
+		snprintf(labels, sizeof(labels), "phase=\"%s\"", PhaseAccounting::phaseName(static_cast<Phase>(i)));
+		promSample(body, "palgate_phase_seconds_total", labels, life.us[i] / 1e6);
+	}
+
+	promHeader(body, "palgate_phase_charge_mah_total", "counter", "Estimated charge per duty-cycle phase.");
+	for (size_t i = 0; i < PhaseAccounting::PHASE_COUNT; ++i)
+	{
+		snprintf(labels, sizeof(labels), "phase=\"%s\"", PhaseAccounting::phaseName(static_cast<Phase>(i)));
+		promSample(body, "palgate_phase_charge_mah_total", labels, PhaseAccounting::toMilliampHours(life.charge_pC[i]));
+	}
+
+	// task topology: per-task busy time and queue pressure (TaskTopology.h)
+	struct TaskRow { const char* name; const TaskStats& stats; };
+	const TaskRow tasks[] = { {"ingest", g_ingest_stats}, {"control", g_control_stats}, {"net", g_net_stats}, {"local", g_local_stats},
+							  {"mqtt", g_mqtt_stats} };
+
+	promHeader(body, "palgate_task_busy_seconds_total", "counter", "CPU time each task spent doing work.");
+	for (const TaskRow& t : tasks)
+	{
+		snprintf(labels, sizeof(labels), "task=\"%s\"", t.name);
+		promSample(body, "palgate_task_busy_seconds_total", labels, t.stats.busyMs() / 1e3);
+	}
+	promHeader(body, "palgate_task_runs_total", "counter", "Work items handled by each task.");
+	for (const TaskRow& t : tasks)
+	{
+		snprintf(labels, sizeof(labels), "task=\"%s\"", t.name);
+		promSample(body, "palgate_task_runs_total", labels, t.stats.runs());
+	}
+
+	struct QueueRow { const char* name; uint32_t depth, high_water, dropped; };
+	const QueueRow queues[] = {
+		{"sightings", g_sightings.depth(), g_sightings.highWater(), g_sightings.dropped()},
+		{"observations", g_observations.depth(), g_observations.highWater(), g_observations.dropped()},
+		{"trigger_requests", g_trigger_requests.depth(), g_trigger_requests.highWater(), g_trigger_requests.dropped()},
+		{"trigger_results", g_trigger_results.depth(), g_trigger_results.highWater(), g_trigger_results.dropped()},
+		{"local_requests", g_local_requests.depth(), g_local_requests.highWater(), g_local_requests.dropped()},
+		{"local_results", g_local_results.depth(), g_local_results.highWater(), g_local_results.dropped()},
+		{"mqtt_events", g_mqtt.depth(), g_mqtt.highWater(), g_metrics.mqtt_events_dropped.get()},
+	};
+
+	promHeader(body, "palgate_queue_depth", "gauge", "Items waiting in each inter-task queue.");
+	for (const QueueRow& q : queues)
+	{
+		snprintf(labels, sizeof(labels), "queue=\"%s\"", q.name);
+		promSample(body, "palgate_queue_depth", labels, q.depth);
+	}
+	promHeader(body, "palgate_queue_high_water", "gauge", "Deepest each inter-task queue has been since boot.");
+	for (const QueueRow& q : queues)
+	{
+		snprintf(labels, sizeof(labels), "queue=\"%s\"", q.name);
+		promSample(body, "palgate_queue_high_water", labels, q.high_water);
+	}
+	promHeader(body, "palgate_queue_dropped_total", "counter", "Items rejected because the queue was full.");
+	for (const QueueRow& q : queues)
+	{
+		snprintf(labels, sizeof(labels), "queue=\"%s\"", q.name);
+		promSample(body, "palgate_queue_dropped_total", labels, q.dropped);
+	}
+
+	// scanner mesh datagrams (ScannerMesh.h); rejected = malformed or stale, forged = tag mismatch
+	const TriggerArbiter::Stats& mesh = g_arbiter.stats();
+	promHeader(body, "palgate_mesh_messages_total", "counter", "Arbitration datagrams exchanged with other scanners.");
+	promSample(body, "palgate_mesh_messages_total", "dir=\"tx\"", mesh.tx);
+	promSample(body, "palgate_mesh_messages_total", "dir=\"rx\"", mesh.rx);
+	promSample(body, "palgate_mesh_messages_total", "dir=\"rejected\"", mesh.rejected);
+	promSample(body, "palgate_mesh_messages_total", "dir=\"forged\"", mesh.forged);
+
+	// MQTT export (MqttExport.h); its queue is palgate_queue_depth{queue="mqtt_events"}
+	promHeader(body, "palgate_mqtt_connected", "gauge", "1 while the MQTT export has a broker session.");
+	promSample(body, "palgate_mqtt_connected", nullptr, g_mqtt.connected() ? 1 : 0);
+	promHeader(body, "palgate_mqtt_batch_events", "gauge", "Events taken off the queue for the next MQTT batch.");
+	promSample(body, "palgate_mqtt_batch_events", nullptr, g_mqtt.staged());
+
+	// per-beacon trigger state (TriggerPolicy.h)
+	promHeader(body, "palgate_trigger_policy_entries", "gauge", "Beacons in cooldown or with an open in flight.");
+	promSample(body, "palgate_trigger_policy_entries", nullptr, g_policy.live(millis()));
+	promHeader(body, "palgate_trigger_policy_recycled_total", "counter", "Live beacon entries taken over because the table was full.");
+	promSample(body, "palgate_trigger_policy_recycled_total", nullptr, g_policy.recycled());
+
+	g_webServer.send(200, "text/plain; version=0.0.4", body.c_str());
+}
+
+
+
+// Buffers trace JSON into ~1KB HTTP chunks instead of one chunk per event.
+struct TraceChunkWriter
+{
+	char buf[1024];
+	size_t used = 0;
+
+	void flush()
+	{
+		if (used > 0)
+			g_webServer.sendContent(buf, used);
+		used = 0;
+	}
+
+	static void write(const char* data, size_t len, void* ctx)
+	{
+		TraceChunkWriter* w = static_cast<TraceChunkWriter*>(ctx);
+		if (w->used + len > sizeof(w->buf))
+			w->flush();
+		if (len > sizeof(w->buf))
+		{
+			g_webServer.sendContent(data, len);
+			return;
+		}
+		std::memcpy(w->buf + w->used, data, len);
+		w->used += len;
+	}
+};
+
+
+
+/**
+ * @brief Serve GET /trace: the span ring as Chrome/Perfetto trace JSON (chunked).
+ */
+static void HandleTraceRequest()
+{
+	g_webServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	g_webServer.send(200, "application/json", "");
+
+	TraceChunkWriter writer;
+	g_trace.dumpChromeJson(&TraceChunkWriter::write, &writer, WiFi.macAddress().c_str());
+	writer.flush();
+	g_webServer.sendContent("");	// terminating chunk
+}
 
 
 
+/**
+ * @brief Dump the span ring to Serial, framed so it can be cut out of a console log.
+ */
+static void DumpTraceToSerial()
+{
+	PalLog::flush();	// bulk dump goes straight to the UART; don't interleave with queued lines
+	Serial.println("---- BEGIN TRACE ----");
+	g_trace.dumpChromeJson([](const char* data, size_t len, void*) {
+		Serial.write(reinterpret_cast<const uint8_t*>(data), len);
+	}, nullptr, WiFi.macAddress().c_str());
+	Serial.println("---- END TRACE ----");
+}
+
+
+
+/**
+ * @brief Serve GET /log[?since=<unix seconds>]: raw flight-recorder sectors, oldest first.
+ *        Decode with tools/flightlog_decode.py. Streams one 4 KB sector per chunk.
+ */
+static void HandleLogExportRequest()
+{
+	static uint8_t sector[FlightRecorder::SECTOR_SIZE];	// static: too large for the loop task stack
+
+	uint32_t since = 0;
+	if (g_webServer.hasArg("since"))
+		since = (uint32_t)g_webServer.arg("since").toInt();
+
+	g_flight.flush(true);	// include events still queued in RAM
+
+	g_webServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	g_webServer.send(200, "application/octet-stream", "");
+
+	uint32_t cursor = 0;
+	while (g_flight.readSector(cursor, sector, since))
+	{
+		g_webServer.sendContent(reinterpret_cast<const char*>(sector), sizeof(sector));
+	}
+	g_webServer.sendContent("");	// terminating chunk
+}
+
+
+
+/**
+ * @brief Feed queued advertisements to the presence analytics and close finished visits.
+ */
+static void DrainObservations()
+{
+	AdvObservation obs;
+	uint32_t hour = AnalyticsHour();
+	while (g_observations.pop(obs))
+	{
+		g_analytics.observe(obs, hour);
+	}
+	g_analytics.tick(millis());
+}
+
+
+
+// UNIX hours once NTP synced (so hour-of-day is UTC), uptime hours before.
+static uint32_t AnalyticsHour()
+{
+	if (g_is_time_synced_ok)
+		return (uint32_t)(time(nullptr) / 3600);
+	return millis() / 3600000UL;
+}
+
+
+
+/**
+ * @brief Serve GET /analytics: per-beacon arrivals and dwell, top foreign
+ *        manufacturers/MACs, distinct devices per hour (JSON).
+ */
+static void HandleAnalyticsRequest()
+{
+	std::string body;
+	body.reserve(2048);
+	g_analytics.toJson(body, millis(), AnalyticsHour(), g_observations.dropped());
+	g_webServer.send(200, "application/json", body.c_str());
+}
+
+
+
+/**
+ * @brief Serve GET /config: the runtime configuration as JSON (credentials masked), including
+ *        an update that still waits out RuntimeConfigStore::GRACE_MS before it is published.
+ */
+static void HandleConfigGet()
+{
+	std::string body;
+	RuntimeConfigStore::toJson(g_config.latest(), body);
+	g_webServer.send(200, "application/json", body.c_str());
+}
+
+
+
+/**
+ * @brief Serve POST /config (HTTP basic auth, user "admin", password PALGATE_CONFIG_PASSWORD).
+ *        Form fields named like the JSON keys overwrite a copy of the active config; the copy
+ *        is validated as a whole, persisted to NVS and swapped in — no reboot needed.
+ */
+static void HandleConfigPost()
+{
+#ifdef PALGATE_CONFIG_PASSWORD
+	if (!g_webServer.authenticate("admin", PALGATE_CONFIG_PASSWORD))
+	{
+		g_webServer.requestAuthentication();
+		return;
+	}
+#else
+	g_webServer.send(403, "text/plain", "Define PALGATE_CONFIG_PASSWORD in config.h to enable updates\n");
+	return;
+#endif
+
+	RuntimeConfig next = g_config.latest();	// on top of an update still waiting to be published
+	const char* error = nullptr;
+
+	for (int i = 0; i < g_webServer.args(); ++i)
+	{
+		String key = g_webServer.argName(i);
+		if (key == "plain")
+			continue;	// raw body, added by WebServer for non-form posts
+
+		if (!RuntimeConfigStore::setField(next, key.c_str(), g_webServer.arg(i).c_str(), error))
+		{
+			String msg = key + ": " + error + "\n";
+			g_webServer.send(400, "text/plain", msg);
+			return;
+		}
+	}
+
+	if (!g_config.apply(next, error))
+	{
+		g_webServer.send(400, "text/plain", String(error) + "\n");
+		return;
+	}
+
+	LOG_I("Runtime config updated (generation %u)", (unsigned)g_config.latest().generation);
+	HandleConfigGet();
+}
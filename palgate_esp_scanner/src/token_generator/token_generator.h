@@ -1,10 +1,15 @@
 #pragma once
 #include <stdint.h>
+#include <stddef.h>
 #include <string>
 #include <array>
 
 // tokenType: 0 = SMS, 1 = PRIMARY, 2 = SECONDARY
 std::string generateToken(const uint8_t sessionToken[16], uint64_t phoneNumber, int tokenType, uint32_t timestampSecs = 0, int timestampOffset = 2);
 
+// same token into a caller's buffer of GENERATED_TOKEN_CHARS + 1 bytes (NUL-terminated, no heap)
+static const size_t GENERATED_TOKEN_CHARS = 46;
+void generateToken(char* out, const uint8_t sessionToken[16], uint64_t phoneNumber, int tokenType, uint32_t timestampSecs = 0, int timestampOffset = 2);
+
 // helper: parse hex string -> bytes (returns true on success)
 bool hexStringToBytes(const std::string &hex, uint8_t *out, size_t outLen);
@@ -0,0 +1,233 @@
+// Host benchmark for the advertisement decoders (src/AdvDecoder).
+//
+// Decodes a typical raw payload of every supported format, and of common traffic
+// no decoder accepts (Apple Continuity and Google Fast Pair, which share a key with
+// a decoder, and Microsoft CDP and a name-only advert, which do not). Reports
+// ns/advert and adverts/s per payload, and compares iBeacon with the previous path:
+// copying the manufacturer data into a std::string (getManufacturerData()) and
+// checking IBeacon::isIBeacon().
+//
+// Also checks every payload decodes to the expected format and id, and that
+// truncated and random payloads never decode out of bounds (build with
+// -fsanitize=address to make the latter strict).
+//
+// Build and run from palgate_esp_scanner/:
+//   g++ -O2 -std=gnu++17 -Isrc/AdvDecoder -I../shared/IBeaconProtocol -o /tmp/adv_decode_bench
+//       tools/adv_decode_bench.cpp src/AdvDecoder/AdvDecoder.cpp
+//   /tmp/adv_decode_bench [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AdvDecoder.h"
+#include "IBeaconProtocol.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double nsSince(Clock::time_point t0, uint64_t iterations)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (double)iterations;
+}
+
+static const uint8_t ID[16] =
+    { 0x12, 0x34, 0x56, 0x78, 0x12, 0x34, 0x12, 0x34, 0x12, 0x34, 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc };
+
+struct Sample
+{
+    const char* name;
+    std::vector<uint8_t> payload;
+    bool decodes;
+    AdFormat format;
+};
+
+static void addAd(std::vector<uint8_t>& p, uint8_t type, const std::vector<uint8_t>& data)
+{
+    p.push_back((uint8_t)(data.size() + 1));
+    p.push_back(type);
+    p.insert(p.end(), data.begin(), data.end());
+}
+
+static std::vector<uint8_t> flags()
+{
+    return { 0x02, 0x01, 0x06 };
+}
+
+static std::vector<Sample> samples()
+{
+    std::vector<Sample> out;
+
+    out.push_back({ "ibeacon", std::vector<uint8_t>(IBeacon::BEACON_ADV.bytes, IBeacon::BEACON_ADV.bytes + IBeacon::ADV_LEN),
+                    true, AdFormat::IBeacon });
+
+    std::vector<uint8_t> alt = flags();
+    std::vector<uint8_t> mfg = { 0x18, 0x01, 0xBE, 0xAC };
+    mfg.insert(mfg.end(), ID, ID + 16);
+    mfg.insert(mfg.end(), { 0x00, 0x01, 0x00, 0x02, 0xC5, 0x00 });
+    addAd(alt, 0xFF, mfg);
+    out.push_back({ "altbeacon", alt, true, AdFormat::AltBeacon });
+
+    std::vector<uint8_t> eddy = flags();
+    addAd(eddy, 0x03, { 0xAA, 0xFE });                    // complete 16-bit service list
+    std::vector<uint8_t> sd = { 0xAA, 0xFE, 0x00, 0xEE };
+    sd.insert(sd.end(), ID, ID + 16);
+    sd.insert(sd.end(), { 0x00, 0x00 });
+    addAd(eddy, 0x16, sd);
+    out.push_back({ "eddystone", eddy, true, AdFormat::EddystoneUid });
+
+    std::vector<uint8_t> svc = flags();
+    std::vector<uint8_t> uuid(ID, ID + 16);
+    std::vector<uint8_t> le(uuid.rbegin(), uuid.rend());
+    addAd(svc, 0x07, le);
+    addAd(svc, 0x09, { 'P', 'h', 'o', 'n', 'e' });
+    out.push_back({ "service_uuid", svc, true, AdFormat::ServiceUuid });
+
+    std::vector<uint8_t> continuity = flags();
+    addAd(continuity, 0xFF, { 0x4C, 0x00, 0x10, 0x05, 0x01, 0x18, 0x2A, 0x3B, 0x4C });
+    out.push_back({ "apple_continuity", continuity, false, AdFormat::IBeacon });
+
+    std::vector<uint8_t> fastpair = flags();
+    addAd(fastpair, 0x16, { 0x2C, 0xFE, 0x00, 0x0A, 0x1B });
+    out.push_back({ "google_fastpair", fastpair, false, AdFormat::IBeacon });
+
+    std::vector<uint8_t> cdp;
+    addAd(cdp, 0xFF, { 0x06, 0x00, 0x01, 0x09, 0x20, 0x02, 0x5F, 0x7D, 0x3C, 0x11, 0x8A, 0x9E, 0x00, 0x01,
+                       0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0x10, 0x32, 0x54, 0x76, 0x98, 0xBA });
+    out.push_back({ "microsoft_cdp", cdp, false, AdFormat::IBeacon });
+
+    std::vector<uint8_t> name = flags();
+    addAd(name, 0x09, { 'W', 'H', '-', '1', '0', '0', '0', 'X', 'M', '4' });
+    out.push_back({ "name_only", name, false, AdFormat::IBeacon });
+
+    return out;
+}
+
+// The previous ingest path for the iBeacon: manufacturer data copied into a new std::string.
+static bool legacyIBeacon(const std::vector<uint8_t>& payload)
+{
+    AdWalker walker(payload.data(), payload.size());
+    AdStructure ad;
+    while (walker.next(ad))
+    {
+        if (ad.type == 0xFF)
+        {
+            std::string mfg(reinterpret_cast<const char*>(ad.data), ad.len);
+            const uint8_t* b = reinterpret_cast<const uint8_t*>(mfg.data());
+            return IBeacon::isIBeacon(b, mfg.size()) &&
+                   memcmp(b + IBeacon::MFG_UUID_OFFSET, IBeacon::BEACON_UUID.bytes, IBeacon::UUID_LEN) == 0;
+        }
+    }
+    return false;
+}
+
+static bool checkSamples(const std::vector<Sample>& all)
+{
+    bool ok = true;
+    for (const Sample& s : all)
+    {
+        AdSighting out;
+        bool decoded = AdvDecoder::decode(s.payload.data(), s.payload.size(), AdvDecoder::ALL_FORMATS, out);
+        bool right = decoded == s.decodes;
+        if (decoded && s.decodes)
+        {
+            const uint8_t* want = (s.format == AdFormat::IBeacon) ? IBeacon::BEACON_UUID.bytes : ID;
+            right = out.format == s.format && memcmp(out.id, want, sizeof(out.id)) == 0;
+        }
+        // a disabled format is skipped
+        if (s.decodes && AdvDecoder::decode(s.payload.data(), s.payload.size(),
+                                            (uint8_t)(AdvDecoder::ALL_FORMATS & ~formatBit(s.format)), out))
+            right = false;
+        if (!right)
+        {
+            printf("FAIL: %s decoded wrong\n", s.name);
+            ok = false;
+        }
+
+        // every truncation: no read past the end (checked under -fsanitize=address)
+        for (size_t len = 0; len < s.payload.size(); ++len)
+        {
+            std::vector<uint8_t> cut(s.payload.begin(), s.payload.begin() + len);
+            AdvDecoder::decode(cut.data(), cut.size(), AdvDecoder::ALL_FORMATS, out);
+        }
+    }
+
+    uint8_t formats = 0;
+    char text[64];
+    AdvDecoder::formatsToString(AdvDecoder::ALL_FORMATS, text, sizeof(text));
+    if (!AdvDecoder::parseFormats(text, formats) || formats != AdvDecoder::ALL_FORMATS ||
+        AdvDecoder::parseFormats("ibeacon,", formats) == false || formats != AdvDecoder::DEFAULT_FORMATS ||
+        AdvDecoder::parseFormats("ibeacon,,eddystone", formats) || AdvDecoder::parseFormats("", formats) ||
+        AdvDecoder::parseFormats("nfc", formats))
+    {
+        printf("FAIL: format list parsing (\"%s\")\n", text);
+        ok = false;
+    }
+    return ok;
+}
+
+static uint64_t fuzz(uint64_t rounds)
+{
+    static const uint8_t DECODER_TYPES[] = { 0xFF, 0x16, 0x07, 0x06 };
+    std::mt19937 rng(7);
+    uint64_t decoded = 0;
+    for (uint64_t i = 0; i < rounds; ++i)
+    {
+        // exact-size heap buffer, so AddressSanitizer catches any overread
+        size_t len = rng() % 63;
+        std::vector<uint8_t> p(len);
+        for (uint8_t& b : p)
+            b = (uint8_t)rng();
+        if (len > 1 && rng() % 2)
+            p[1] = DECODER_TYPES[rng() % 4];    // steer into the decoders
+        AdSighting out;
+        decoded += AdvDecoder::decode(p.data(), p.size(), AdvDecoder::ALL_FORMATS, out);
+    }
+    return decoded;
+}
+
+int main(int argc, char** argv)
+{
+    const uint64_t N = (argc > 1) ? strtoull(argv[1], nullptr, 10) : 5000000ULL;
+    const std::vector<Sample> all = samples();
+
+    bool ok = checkSamples(all);
+    uint64_t fuzz_decoded = fuzz(200000);
+    printf("checks: %s (fuzz: 200000 random payloads, %llu decoded)\n\n", ok ? "OK" : "FAILED",
+           (unsigned long long)fuzz_decoded);
+
+    printf("%-18s %5s %10s %12s\n", "payload", "bytes", "ns/advert", "adverts/s");
+    uint64_t sink = 0;
+    for (const Sample& s : all)
+    {
+        AdSighting out;
+        auto t0 = Clock::now();
+        for (uint64_t i = 0; i < N; ++i)
+        {
+            // the payload pointer is opaque to the optimiser, as a fresh scan result would be
+            const uint8_t* p = s.payload.data();
+            asm volatile("" : "+r"(p));
+            sink += AdvDecoder::decode(p, s.payload.size(), AdvDecoder::ALL_FORMATS, out);
+        }
+        double ns = nsSince(t0, N);
+        printf("%-18s %5zu %10.1f %12.3g\n", s.name, s.payload.size(), ns, 1e9 / ns);
+    }
+
+    auto t0 = Clock::now();
+    for (uint64_t i = 0; i < N; ++i)
+    {
+        const std::vector<uint8_t>* p = &all[0].payload;
+        asm volatile("" : "+r"(p));
+        sink += legacyIBeacon(*p);
+    }
+    double legacy_ns = nsSince(t0, N);
+    printf("%-18s %5zu %10.1f %12.3g   (std::string copy + isIBeacon, the previous path)\n",
+           "ibeacon_legacy", all[0].payload.size(), legacy_ns, 1e9 / legacy_ns);
+
+    if (sink == 0)
+        printf("\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+// Host benchmark for the scanner's presence analytics (src/PresenceAnalytics).
+//
+// Replays a synthetic advertisement stream -- a few target beacons coming and going
+// among a Zipf-distributed crowd of foreign devices -- and measures what loop() pays
+// per advertisement in PresenceAnalytics::observe(). Also checks the sketches against
+// exact counts: count-min error of the heaviest MACs and manufacturer IDs, and
+// HyperLogLog error per hour for growing numbers of distinct devices.
+//
+// Build and run from palgate_esp_scanner/:
+//   g++ -O2 -std=gnu++17 -Isrc/PresenceAnalytics -o /tmp/analytics_bench
+//       tools/analytics_bench.cpp src/PresenceAnalytics/PresenceAnalytics.cpp
+//   /tmp/analytics_bench [adverts] [devices]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "PresenceAnalytics.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const uint64_t SEED = 0x2545F4914F6CDD1DULL;    // bench-only sketches
+
+struct Device
+{
+    uint8_t mac[6];
+    uint16_t company;
+};
+
+static uint64_t packMac(const uint8_t mac[6])
+{
+    uint64_t k = 0;
+    for (int i = 0; i < 6; ++i)
+        k = (k << 8) | mac[i];
+    return k;
+}
+
+static std::vector<AdvObservation> makeStream(uint32_t adverts, uint32_t devices, std::mt19937& rng)
+{
+    static const uint16_t COMPANIES[] = { 0x004C, 0x0006, 0x0075, 0x00E0, 0x0087, 0x0157, 0x02E5, 0x0171 };
+
+    std::vector<Device> crowd(devices);
+    for (Device& d : crowd)
+    {
+        for (uint8_t& b : d.mac)
+            b = (uint8_t)rng();
+        d.company = COMPANIES[std::min<size_t>(std::geometric_distribution<int>(0.45)(rng), 7)];
+    }
+
+    // Zipf(s = 1): a handful of chatty devices, a long tail heard once or twice
+    std::vector<double> weights(devices);
+    for (uint32_t i = 0; i < devices; ++i)
+        weights[i] = 1.0 / (i + 1);
+    std::discrete_distribution<uint32_t> pick(weights.begin(), weights.end());
+
+    std::vector<AdvObservation> stream(adverts);
+    uint32_t now_ms = 0;
+    for (uint32_t i = 0; i < adverts; ++i)
+    {
+        AdvObservation& o = stream[i];
+        memset(&o, 0, sizeof(o));
+        now_ms += 5;
+        o.at_ms = now_ms;
+        o.rssi = (int8_t)(-40 - (int)(rng() % 50));
+
+        // 1 in 50 adverts is one of 4 target beacons
+        if (rng() % 50 == 0)
+        {
+            o.flags = AdvObservation::TARGET;
+            o.identity = (1u << 16) | (uint32_t)(rng() % 4);   // major 1, minor 0..3
+            o.company = 0x004C;
+            continue;
+        }
+        const Device& d = crowd[pick(rng)];
+        memcpy(o.mac, d.mac, 6);
+        o.company = d.company;
+    }
+    return stream;
+}
+
+static void benchObserve(const std::vector<AdvObservation>& stream)
+{
+    PresenceAnalytics analytics;
+    auto t0 = Clock::now();
+    for (const AdvObservation& o : stream)
+    {
+        analytics.observe(o, o.at_ms / 3600000u);
+        if ((o.at_ms & 0x3FF) == 0)
+            analytics.tick(o.at_ms);
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (double)stream.size();
+
+    std::string json;
+    t0 = Clock::now();
+    analytics.toJson(json, stream.back().at_ms, stream.back().at_ms / 3600000u, 0);
+    double json_us = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+
+    printf("observe(): %.1f ns/advert over %zu adverts (%zu bytes of state)\n", ns, stream.size(), sizeof(PresenceAnalytics));
+    printf("toJson():  %.1f us, %zu bytes\n\n", json_us, json.size());
+}
+
+// Count-min error of the 8 heaviest keys relative to their exact counts. The exact
+// counts are halved whenever the sketch halves, so both decay the same way.
+template <typename KeyOf>
+static void checkSketch(const char* label, const std::vector<AdvObservation>& stream, KeyOf keyOf)
+{
+    CountMinSketch cms;
+    std::unordered_map<uint64_t, uint32_t> exact;
+    uint32_t total = 0;
+    for (const AdvObservation& o : stream)
+    {
+        if (o.flags & AdvObservation::TARGET)
+            continue;
+        uint64_t k = keyOf(o);
+        uint32_t halvings = cms.halvings();
+        cms.add(PresenceAnalytics::hashKey(k, SEED));
+        if (cms.halvings() != halvings)
+        {
+            for (auto& e : exact)
+                e.second >>= 1;
+        }
+        ++exact[k];
+        ++total;
+    }
+
+    std::vector<std::pair<uint32_t, uint64_t>> heavy;
+    for (const auto& e : exact)
+    {
+        if (e.second != 0)
+            heavy.push_back({ e.second, e.first });
+    }
+    std::sort(heavy.rbegin(), heavy.rend());
+    heavy.resize(std::min<size_t>(heavy.size(), 8));
+
+    double worst = 0.0;
+    for (const auto& h : heavy)
+    {
+        double est = (double)cms.estimate(PresenceAnalytics::hashKey(h.second, SEED));
+        worst = std::max(worst, std::fabs(est - h.first) / h.first);
+    }
+    printf("count-min %-9s %6zu keys, %7u adverts, %u halvings: top-8 worst error %.2f %% (overcount bound e/W*N = %.0f)\n",
+           label, exact.size(), total, cms.halvings(), 100.0 * worst, std::exp(1.0) / CountMinSketch::WIDTH * total);
+}
+
+static void checkHll(std::mt19937& rng)
+{
+    for (uint32_t n : { 10u, 100u, 1000u, 10000u, 100000u })
+    {
+        const int runs = 20;
+        double err_sum = 0.0;
+        for (int r = 0; r < runs; ++r)
+        {
+            HyperLogLog hll;
+            for (uint32_t i = 0; i < n; ++i)
+                hll.add(PresenceAnalytics::hashKey(((uint64_t)rng() << 16) ^ rng(), SEED));
+            err_sum += std::fabs(hll.estimate() - n) / n;
+        }
+        printf("HyperLogLog %6u distinct: mean abs error %.1f %% (%u registers)\n", n, 100.0 * err_sum / runs,
+               HyperLogLog::REGISTERS);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t adverts = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 10) : 1000000;
+    uint32_t devices = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 10) : 5000;
+    if (adverts == 0 || devices == 0)
+    {
+        printf("usage: analytics_bench [adverts] [devices]\n");
+        return 2;
+    }
+
+    std::mt19937 rng(1);
+    std::vector<AdvObservation> stream = makeStream(adverts, devices, rng);
+
+    benchObserve(stream);
+    checkSketch("MACs", stream, [](const AdvObservation& o) { return packMac(o.mac); });
+    checkSketch("companies", stream, [](const AdvObservation& o) { return (uint64_t)o.company; });
+    printf("\n");
+    checkHll(rng);
+    return 0;
+}
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""
+Minify and gzip the provisioning-portal assets into a PROGMEM header.
+
+Every file under portal/ becomes one entry of the table in
+src/PortalAssets/PortalAssetsData.h: the gzipped bytes, the MIME type and
+a strong ETag (a hash of the compressed bytes). The firmware serves the
+bytes straight from flash with "Content-Encoding: gzip" and answers 304
+when the browser already has that ETag. portal/index.html is also served
+at "/".
+
+Runs automatically before every PlatformIO build (extra_scripts = pre:...).
+The header is only rewritten when its content changes, so it does not
+trigger rebuilds. It can also be run by hand:
+
+usage: build_portal_assets.py [--check]
+"""
+
+import argparse
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+MIME_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".svg": "image/svg+xml",
+    ".json": "application/json",
+    ".ico": "image/x-icon",
+}
+
+
+def project_dir():
+    try:
+        return env.subst("$PROJECT_DIR")  # noqa: F821 (SCons-provided when run as extra_script)
+    except NameError:
+        return os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{};:,>])\s*", r"\1", text)
+    return text.replace(";}", "}").strip()
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    text = re.sub(r"(<style[^>]*>)(.*?)(</style>)",
+                  lambda m: m.group(1) + minify_css(m.group(2)) + m.group(3),
+                  text, flags=re.S | re.I)
+    text = re.sub(r">\s+<", "><", text)
+    text = re.sub(r"\s+", " ", text)
+    return text.strip()
+
+
+def minify(name, data):
+    ext = os.path.splitext(name)[1]
+    if ext == ".html":
+        return minify_html(data.decode("utf-8")).encode("utf-8")
+    if ext == ".css":
+        return minify_css(data.decode("utf-8")).encode("utf-8")
+    return data
+
+
+def c_ident(name):
+    return re.sub(r"[^0-9A-Za-z]", "_", name)
+
+
+def build(portal_dir):
+    """Returns (header text, [(name, raw, minified, gzipped)])."""
+    entries = []
+    stats = []
+    for root, _, files in os.walk(portal_dir):
+        for f in sorted(files):
+            full = os.path.join(root, f)
+            name = "/" + os.path.relpath(full, portal_dir).replace(os.sep, "/")
+            ext = os.path.splitext(f)[1]
+            if ext not in MIME_TYPES:
+                continue
+
+            with open(full, "rb") as fh:
+                raw = fh.read()
+            small = minify(name, raw)
+            # mtime=0: identical input gives identical bytes, so the ETag only changes with content
+            gz = gzip.compress(small, compresslevel=9, mtime=0)
+            etag = '"' + hashlib.sha256(gz).hexdigest()[:16] + '"'
+            entries.append((name, MIME_TYPES[ext], gz, etag))
+            stats.append((name, len(raw), len(small), len(gz)))
+
+    entries.sort()
+    out = []
+    out.append("// GENERATED by tools/build_portal_assets.py from portal/ — do not edit.")
+    out.append("#ifndef PORTAL_ASSETS_DATA_H")
+    out.append("#define PORTAL_ASSETS_DATA_H")
+    out.append("")
+    out.append("#include <pgmspace.h>")
+    out.append("#include \"PortalAssets.h\"")
+    out.append("")
+
+    for name, _, gz, _ in entries:
+        out.append("static const uint8_t ASSET_%s[%d] PROGMEM = {" % (c_ident(name), len(gz)))
+        for i in range(0, len(gz), 16):
+            out.append("    " + ",".join("0x%02x" % b for b in gz[i:i + 16]) + ",")
+        out.append("};")
+        out.append("")
+
+    out.append("static const PortalAsset PORTAL_ASSETS[] = {")
+    for name, mime, gz, etag in entries:
+        out.append("    { \"%s\", \"%s\", ASSET_%s, sizeof(ASSET_%s), \"%s\" },"
+                   % (name, mime, c_ident(name), c_ident(name), etag.replace('"', '\\"')))
+    out.append("};")
+    out.append("")
+    out.append("#endif // #ifndef PORTAL_ASSETS_DATA_H")
+    out.append("")
+    return "\n".join(out), stats
+
+
+def main(check=False):
+    base = project_dir()
+    portal_dir = os.path.join(base, "portal")
+    header = os.path.join(base, "src", "PortalAssets", "PortalAssetsData.h")
+
+    text, stats = build(portal_dir)
+
+    old = None
+    if os.path.exists(header):
+        with open(header, "r", encoding="utf-8") as fh:
+            old = fh.read()
+
+    for name, raw, small, gz in stats:
+        print("portal asset %-20s %6d -> %6d minified -> %6d gzip" % (name, raw, small, gz))
+
+    if old == text:
+        return 0
+    if check:
+        print("%s is stale; run tools/build_portal_assets.py" % header, file=sys.stderr)
+        return 1
+
+    with open(header, "w", encoding="utf-8") as fh:
+        fh.write(text)
+    print("wrote %s" % header)
+    return 0
+
+
+try:
+    Import("env")  # noqa: F821 (SCons builtin: present only when run by PlatformIO)
+    IN_PLATFORMIO = True
+except NameError:
+    IN_PLATFORMIO = False
+
+if IN_PLATFORMIO:
+    main()
+elif __name__ == "__main__":
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--check", action="store_true", help="fail if the generated header is out of date")
+    sys.exit(main(ap.parse_args().check))
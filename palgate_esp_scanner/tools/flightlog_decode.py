@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""
+Decode the scanner flight recorder.
+
+Input is either the stream served by GET /log or a raw dump of the
+"flightlog" partition, e.g.:
+
+    esptool.py read_flash 0x310000 0xF0000 flightlog.bin
+
+Sectors are ordered by their sequence number and binary-searched by the
+first_epoch in their header, so a --from/--to query only reads the sectors
+that overlap the range, no matter how many months the log covers.
+
+usage: flightlog_decode.py flightlog.bin [--from 2025-03-01T07:30] [--to 2025-03-01T08:00] [--csv]
+"""
+
+import argparse
+import bisect
+import datetime
+import mmap
+import struct
+import sys
+
+SECTOR_SIZE = 4096
+HEADER = struct.Struct("<IIIHH")        # magic, seq, first_epoch, version, crc
+RECORD = struct.Struct("<IIBbhHBB")     # epoch, uptime_ms, type, rssi, code, arg, reserved, crc
+MAGIC = 0x52464750
+RECORDS_PER_SECTOR = (SECTOR_SIZE - HEADER.size) // RECORD.size
+
+EVENT_NAMES = {1: "sighting", 2: "trigger", 3: "http_result", 4: "reboot", 5: "gatt_result", 6: "arbitration"}
+GATT_RESULTS = {0: "opened", 1: "disabled", 2: "connect_failed", 3: "write_failed", 4: "cancelled"}
+ARBITRATION = {0: "won", 1: "outscored", 2: "claimed"}
+
+
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def parse_time(text):
+    if text is None:
+        return None
+    if text.isdigit():
+        return int(text)
+    return int(datetime.datetime.fromisoformat(text).timestamp())
+
+
+def load_sectors(buf):
+    """Return [(seq, first_epoch, offset)] for valid sectors, oldest first."""
+    sectors = []
+    for off in range(0, len(buf) - SECTOR_SIZE + 1, SECTOR_SIZE):
+        hdr = buf[off:off + HEADER.size]
+        magic, seq, first_epoch, _version, crc = HEADER.unpack(hdr)
+        if magic == MAGIC and crc == crc8(hdr[:14]):
+            sectors.append((seq, first_epoch, off))
+    sectors.sort()
+    return sectors
+
+
+def records(buf, offset):
+    for i in range(RECORDS_PER_SECTOR):
+        pos = offset + HEADER.size + i * RECORD.size
+        raw = buf[pos:pos + RECORD.size]
+        if raw[8] == 0xFF:          # erased slot: end of this sector
+            return
+        if crc8(raw[:15]) != raw[15]:
+            continue                # torn write (power loss mid-program)
+        yield RECORD.unpack(raw)
+
+
+def describe(rec):
+    epoch, uptime_ms, etype, rssi, code, arg, _res, _crc = rec
+    name = EVENT_NAMES.get(etype, "type%d" % etype)
+    if etype == 1:
+        detail = "major=%d minor=%d rssi=%d" % (code & 0xFFFF, arg, rssi)
+    elif etype == 2:
+        detail = "detect_to_trigger_ms=%d" % arg
+    elif etype == 3:
+        detail = "status=%d get_ms=%d" % (code, arg)
+    elif etype == 4:
+        detail = "reset_reason=%d" % code
+    elif etype == 5:
+        result = GATT_RESULTS.get(code, str(code))
+        detail = "result=%s gatt_ms=%d" % (result, arg)
+    elif etype == 6:
+        detail = "decision=%s arbitration_ms=%d" % (ARBITRATION.get(code, str(code)), arg)
+    else:
+        detail = "code=%d arg=%d rssi=%d" % (code, arg, rssi)
+    return name, detail
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("dump")
+    ap.add_argument("--from", dest="t_from", help="ISO time or UNIX seconds (local time)")
+    ap.add_argument("--to", dest="t_to", help="ISO time or UNIX seconds (local time)")
+    ap.add_argument("--csv", action="store_true")
+    args = ap.parse_args()
+
+    t_from = parse_time(args.t_from)
+    t_to = parse_time(args.t_to)
+
+    with open(args.dump, "rb") as f:
+        buf = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        sectors = load_sectors(buf)
+
+        start = 0
+        if t_from is not None:
+            # last sector whose first record is <= t_from. Sectors opened before NTP
+            # sync after a reboot have first_epoch 0; carry the previous value forward
+            # so the key stays monotonic for the binary search.
+            firsts = []
+            for s in sectors:
+                firsts.append(max(s[1], firsts[-1] if firsts else 0))
+            start = max(bisect.bisect_right(firsts, t_from) - 1, 0)
+
+        if args.csv:
+            print("epoch,time,uptime_ms,event,detail")
+
+        for seq, first_epoch, off in sectors[start:]:
+            if t_to is not None and first_epoch > t_to:
+                break
+            for rec in records(buf, off):
+                epoch = rec[0]
+                if epoch and t_from is not None and epoch < t_from:
+                    continue
+                if epoch and t_to is not None and epoch > t_to:
+                    break
+                if not epoch and (t_from is not None or t_to is not None):
+                    continue    # unsynced clock: cannot place it in the range
+                when = datetime.datetime.fromtimestamp(epoch).isoformat(" ") if epoch else "(no time)"
+                name, detail = describe(rec)
+                if args.csv:
+                    print('%d,%s,%d,%s,"%s"' % (epoch, when, rec[1], name, detail))
+                else:
+                    print("%-19s %10.3fs  %-12s %s" % (when, rec[1] / 1000.0, name, detail))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
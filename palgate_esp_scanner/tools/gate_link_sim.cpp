@@ -0,0 +1,299 @@
+// Host simulation of the scanner's two gate-open paths (src/GateLink), BlueZ-free.
+//
+// A SimulatedPalGate implements GattTransport: connection setup and the token write
+// take log-normally distributed time and fail with configurable probability, and the
+// unit checks every written token against generateToken() for the current second,
+// answering the write with an error for a bad token or (--gatt-reject) at random.
+// Each trial races GateLink::open() against a simulated cloud request (TLS handshake
+// + GET, or a dead uplink) through the same OpenRace reserve / confirm / release the
+// firmware uses, then reports per-path latency (detection -> opened), which path won,
+// and how often the gate was opened twice. Delays are real sleeps scaled by --scale
+// (reported times are unscaled).
+//
+// Runs the configured scenario and the same one with the internet down. Exits
+// non-zero if the unit saw an invalid token, a trial had no / two winners, the gate
+// opened twice, or a local write that was not acknowledged cancelled the cloud request.
+//
+// Build and run from palgate_esp_scanner/:
+//   g++ -O2 -std=gnu++17 -pthread -Isrc/GateLink -Isrc/TaskTopology -Isrc/token_generator
+//       -I../shared/Aes128 -o /tmp/gate_link_sim tools/gate_link_sim.cpp src/GateLink/GateLink.cpp
+//       src/TaskTopology/TaskTopology.cpp src/token_generator/token_generator.cpp ../shared/Aes128/Aes128.cpp
+//   /tmp/gate_link_sim [--trials 100] [--gatt-connect-ms 250] [--gatt-reject 0.05] [--tls-ms 700] ...
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GateLink.h"
+#include "TaskTopology.h"
+#include "token_generator.h"
+
+struct Options
+{
+    uint32_t trials = 100;
+    double scale = 0.05;            // sleep this fraction of each simulated delay
+    double gatt_connect_ms = 250;   // median connection setup (scan for the unit + connect)
+    double gatt_write_ms = 60;      // median service lookup + write with response
+    double gatt_fail = 0.05;        // connection attempts that fail
+    double gatt_reject = 0.02;      // writes the unit answers with an ATT error
+    double tls_ms = 700;            // median DNS + TCP + TLS handshake
+    double get_ms = 180;            // median GET round trip
+    double cloud_fail = 0.02;       // cloud requests that fail (timeout, 5xx)
+};
+
+static const uint8_t SESSION[16] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+                                     0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe };
+static const uint64_t PHONE = 972500000000ULL;
+static const double GATT_WRITE_TIMEOUT_MS = 2000;   // BleGattTransport::WRITE_TIMEOUT_MS
+static const int TOKEN_TYPE = 1;
+
+static const GateLinkTarget TARGET = {
+    { 0xaa, 0xbb, 0xcc, 0x00, 0x11, 0x22 },
+    { 0x00, 0x00, 0xfe, 0x01, 0, 0, 0x10, 0, 0x80, 0, 0, 0x80, 0x5f, 0x9b, 0x34, 0xfb },
+    { 0x00, 0x00, 0xfe, 0x02, 0, 0, 0x10, 0, 0x80, 0, 0, 0x80, 0x5f, 0x9b, 0x34, 0xfb },
+    3000,       // connect timeout (firmware default gate_ble_timeout_ms)
+};
+
+static void sleepMs(double ms, double scale)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(ms * scale * 1000.0)));
+}
+
+static double logNormal(std::mt19937& rng, double median, double sigma = 0.35)
+{
+    std::lognormal_distribution<double> d(std::log(median), sigma);
+    return d(rng);
+}
+
+static std::string tokenNow()
+{
+    return generateToken(SESSION, PHONE, TOKEN_TYPE, (uint32_t)time(nullptr));
+}
+
+
+/**
+ * @brief The PalGate unit's BLE side: one open characteristic that takes an x-bt-token.
+ */
+class SimulatedPalGate : public GattTransport
+{
+public:
+    SimulatedPalGate(const Options& opt, uint32_t seed) : m_opt(opt), m_rng(seed) {}
+
+    bool connect(const uint8_t addr[6], uint32_t timeout_ms) override
+    {
+        double ms = logNormal(m_rng, m_opt.gatt_connect_ms);
+        bool fails = std::uniform_real_distribution<double>(0, 1)(m_rng) < m_opt.gatt_fail;
+        if (fails || ms > timeout_ms || memcmp(addr, TARGET.addr, 6) != 0)
+        {
+            sleepMs(std::min<double>(timeout_ms, fails ? timeout_ms : ms), m_opt.scale);
+            return false;
+        }
+        sleepMs(ms, m_opt.scale);
+        m_connected = true;
+        return true;
+    }
+
+    bool write(const uint8_t service[16], const uint8_t characteristic[16], const uint8_t* data, size_t len) override
+    {
+        if (!m_connected || memcmp(service, TARGET.service, 16) != 0 || memcmp(characteristic, TARGET.characteristic, 16) != 0)
+            return false;
+        sleepMs(logNormal(m_rng, m_opt.gatt_write_ms), m_opt.scale);
+
+        // the unit accepts tokens of the current or the previous second
+        std::string got((const char*)data, len);
+        uint32_t now = (uint32_t)time(nullptr);
+        bool valid = got == generateToken(SESSION, PHONE, TOKEN_TYPE, now) ||
+                     got == generateToken(SESSION, PHONE, TOKEN_TYPE, now - 1);
+        valid ? ++accepted : ++rejected;
+
+        // the write response carries the unit's verdict (or a random ATT error)
+        bool error = std::uniform_real_distribution<double>(0, 1)(m_rng) < m_opt.gatt_reject;
+        nacked += (valid && error);
+        return valid && !error;
+    }
+
+    void disconnect() override { m_connected = false; }
+
+    uint32_t accepted = 0;
+    uint32_t rejected = 0;
+    uint32_t nacked = 0;            // valid tokens answered with an error (the gate did not open)
+
+private:
+    const Options& m_opt;
+    std::mt19937 m_rng;
+    bool m_connected = false;
+};
+
+
+struct PathStats
+{
+    uint32_t opened = 0;
+    uint32_t wins = 0;
+    std::vector<double> open_ms;    // detection -> this path opened the gate
+};
+
+static double percentile(std::vector<double> v, double p)
+{
+    if (v.empty())
+        return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * (double)(v.size() - 1) + 0.5))];
+}
+
+static void printPath(const char* name, const PathStats& s, uint32_t trials)
+{
+    printf("  %-6s opened %5.1f %%  won %5.1f %%  p50 %6.0f ms  p90 %6.0f ms  p99 %6.0f ms\n", name,
+           100.0 * s.opened / trials, 100.0 * s.wins / trials, percentile(s.open_ms, 0.5),
+           percentile(s.open_ms, 0.9), percentile(s.open_ms, 0.99));
+}
+
+// Mirrors NetTask() + TriggerGate(): handshake, reserve (waiting out a GATT write in
+// flight), GET, then confirm or release.
+static bool cloudOpen(const Options& opt, std::mt19937& rng, bool uplink, uint32_t trace_id, OpenRace& race, bool& first, bool& skipped)
+{
+    double tls = logNormal(rng, opt.tls_ms);
+    if (!uplink)
+    {
+        sleepMs(5000, opt.scale);   // connect timeout
+        return false;
+    }
+    sleepMs(tls, opt.scale);
+    uint32_t wait_ms = (uint32_t)(GATT_WRITE_TIMEOUT_MS * opt.scale) + 1;
+    if (race.reserve(trace_id, OpenRace::Path::Cloud, wait_ms) == OpenRace::Grant::Decided)
+    {
+        skipped = true;             // firmware: "Gate already opened over BLE"
+        return false;
+    }
+    sleepMs(logNormal(rng, opt.get_ms), opt.scale);
+    if (std::uniform_real_distribution<double>(0, 1)(rng) < opt.cloud_fail)
+    {
+        race.release(trace_id, OpenRace::Path::Cloud);
+        return false;
+    }
+    first = race.confirm(trace_id, OpenRace::Path::Cloud);
+    return true;
+}
+
+static bool runScenario(const char* label, const Options& opt, bool uplink)
+{
+    SimulatedPalGate unit(opt, 7);
+    GateLink link(unit);
+    OpenRace race;
+    std::mt19937 cloud_rng(11);
+
+    PathStats cloud, local;
+    std::vector<double> race_ms;
+    uint32_t double_opens = 0, no_open = 0, cancelled = 0, skipped = 0, bad_winners = 0, bad_skips = 0;
+
+    for (uint32_t trial = 0; trial < opt.trials; ++trial)
+    {
+        const uint32_t trace_id = trial + 1;
+        const uint64_t detected_us = TaskTopology::nowUs();
+        bool cloud_ok = false, cloud_first = false, cloud_skipped = false, local_first = false;
+        double cloud_ms = 0, local_ms = 0;
+
+        std::thread net([&] {
+            cloud_ok = cloudOpen(opt, cloud_rng, uplink, trace_id, race, cloud_first, cloud_skipped);
+            cloud_ms = (TaskTopology::nowUs() - detected_us) / 1e3 / opt.scale;
+        });
+
+        std::string token = tokenNow();
+        GateLink::Timing timing;
+        GateLink::Result r = link.open(TARGET, (const uint8_t*)token.data(), token.size(), trace_id, race, timing);
+        bool local_ok = (r == GateLink::Result::Opened);
+        local_first = local_ok && race.wonBy(trace_id, OpenRace::Path::Local);
+        local_ms = (TaskTopology::nowUs() - detected_us) / 1e3 / opt.scale;
+        cancelled += (r == GateLink::Result::Cancelled);
+
+        net.join();
+        skipped += cloud_skipped;
+        bad_skips += (cloud_skipped && !local_ok);  // only an acknowledged write may cancel the cloud
+
+        if (cloud_ok)
+        {
+            ++cloud.opened;
+            cloud.open_ms.push_back(cloud_ms);
+        }
+        if (local_ok)
+        {
+            ++local.opened;
+            local.open_ms.push_back(local_ms);
+        }
+        cloud.wins += cloud_first;
+        local.wins += local_first;
+
+        if ((cloud_ok || local_ok) && (cloud_first + local_first) != 1)
+            ++bad_winners;
+        if (cloud_ok && local_ok)
+            ++double_opens;
+        if (!cloud_ok && !local_ok)
+            ++no_open;
+        else
+            race_ms.push_back(cloud_first ? cloud_ms : local_ms);
+    }
+
+    printf("%s: %u trials\n", label, opt.trials);
+    printPath("cloud", cloud, opt.trials);
+    printPath("local", local, opt.trials);
+    printf("  race   opened %5.1f %%              p50 %6.0f ms  p90 %6.0f ms  p99 %6.0f ms\n",
+           100.0 * (opt.trials - no_open) / opt.trials, percentile(race_ms, 0.5), percentile(race_ms, 0.9),
+           percentile(race_ms, 0.99));
+    printf("  cloud requests skipped %u, local writes cancelled %u, gate opened twice %u\n", skipped, cancelled, double_opens);
+    printf("  unit accepted %u / rejected %u tokens, answered %u writes with an error\n", unit.accepted, unit.rejected, unit.nacked);
+    printf("  cloud requests cancelled by an unacknowledged write %u\n\n", bad_skips);
+
+    return unit.rejected == 0 && bad_winners == 0 && double_opens == 0 && bad_skips == 0;
+}
+
+static void usage()
+{
+    printf("usage: gate_link_sim [--trials N] [--scale F] [--gatt-connect-ms MS] [--gatt-write-ms MS]\n"
+           "                     [--gatt-fail P] [--gatt-reject P] [--tls-ms MS] [--get-ms MS] [--cloud-fail P]\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; i += 2)
+    {
+        const char* a = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 2;
+        }
+        double v = strtod(argv[i + 1], nullptr);
+        if (!strcmp(a, "--trials")) opt.trials = (uint32_t)v;
+        else if (!strcmp(a, "--scale")) opt.scale = v;
+        else if (!strcmp(a, "--gatt-connect-ms")) opt.gatt_connect_ms = v;
+        else if (!strcmp(a, "--gatt-write-ms")) opt.gatt_write_ms = v;
+        else if (!strcmp(a, "--gatt-fail")) opt.gatt_fail = v;
+        else if (!strcmp(a, "--gatt-reject")) opt.gatt_reject = v;
+        else if (!strcmp(a, "--tls-ms")) opt.tls_ms = v;
+        else if (!strcmp(a, "--get-ms")) opt.get_ms = v;
+        else if (!strcmp(a, "--cloud-fail")) opt.cloud_fail = v;
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (opt.trials == 0 || opt.scale <= 0)
+    {
+        usage();
+        return 2;
+    }
+
+    bool ok = runScenario("internet up", opt, true);
+    ok = runScenario("internet down", opt, false) && ok;
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,343 @@
+// Host simulation of multi-scanner arbitration (src/ScannerMesh) over real UDP multicast
+// on the loopback interface.
+//
+// Several scanners stand along one fence, one per gate. Cars drive up to a random gate;
+// every scanner hears them through a log-distance path-loss model with shadowing and
+// runs the firmware's detection path on simulated time: 100 ms scan windows at random
+// phase, the 500 ms ingest repeat limit, the mesh_min_rssi floor, debounce, then TriggerArbiter::propose(),
+// poll() and decide() with its own UdpMulticastTransport bound to 127.0.0.1. Received
+// datagrams can be dropped at random (--loss) to model a lossy WLAN. In the last
+// scenario a rogue host on the LAN multicasts Claims for the car under the wrong key.
+//
+// Reports, per scenario, how many passes opened exactly one gate, opened the gate the
+// car drove to, opened duplicates or nothing, and the arbitration latency. The
+// standalone scenario (no arbitration) is the baseline. Exits non-zero if a pass was
+// missed, if duplicates happened without datagram loss, or if a forged Claim got through.
+//
+// Build and run from palgate_esp_scanner/:
+//   g++ -O2 -std=gnu++17 -Isrc/ScannerMesh -I../shared/Aes128 -o /tmp/mesh_sim tools/mesh_sim.cpp
+//       src/ScannerMesh/ScannerMesh.cpp ../shared/Aes128/Aes128.cpp
+//   /tmp/mesh_sim [--passes 200] [--scanners 3] [--spacing 12] [--window 150] [--min-rssi -80] [--loss 0.2]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+#include "ScannerMesh.h"
+
+struct Options
+{
+    uint32_t passes = 200;
+    uint32_t scanners = 3;
+    double spacing_m = 12;      // between neighbouring gates
+    uint32_t window_ms = 150;   // mesh_window_ms
+    int min_rssi = -80;         // mesh_min_rssi
+    double loss = 0.2;          // received datagrams dropped in the lossy scenario
+};
+
+static const uint8_t GROUP[4] = { 239, 255, 71, 71 };
+static const uint32_t STEP_MS = 10;
+static const uint32_t SCAN_WINDOW_MS = 100;
+static const uint32_t REPEAT_MS = 500;          // SIGHTING_REPEAT_MS
+static const uint32_t DEBOUNCE_MS = 10000;
+static const double SPEED_MPS = 4.0;
+static const double START_M = 80.0;             // cars start this far from the fence
+static const double STOP_M = 3.0;               // ... and stop this far in front of their gate
+static const uint32_t DWELL_MS = 8000;          // waiting at the gate
+static const uint32_t GAP_MS = 20000;           // between passes: debounce and claims expire
+static const uint8_t SITE_KEY[MeshMessage::KEY_LEN] = { 0x5a, 0x17, 0xc3, 0x08, 0x9e, 0x41, 0xb2, 0x6d,
+                                                         0x73, 0xe0, 0x2f, 0x94, 0x1c, 0xa8, 0x55, 0x3b };
+static const uint8_t ROGUE_KEY[MeshMessage::KEY_LEN] = {};
+
+
+/**
+ * @brief Drops received datagrams with probability `loss` (per receiver, like WLAN loss).
+ */
+class LossyTransport : public MeshTransport
+{
+public:
+    LossyTransport(double loss, uint32_t seed) : m_loss(loss), m_rng(seed) {}
+
+    bool begin(const uint8_t group[4], uint16_t port) override { return m_udp.begin(group, port); }
+    bool send(const uint8_t* data, size_t len) override { return m_udp.send(data, len); }
+
+    size_t receive(uint8_t* buf, size_t cap) override
+    {
+        size_t n;
+        while ((n = m_udp.receive(buf, cap)) > 0)
+        {
+            if (std::uniform_real_distribution<double>(0, 1)(m_rng) >= m_loss)
+                return n;
+        }
+        return 0;
+    }
+
+private:
+    UdpMulticastTransport m_udp;
+    double m_loss;
+    std::mt19937 m_rng;
+};
+
+
+struct Scanner
+{
+    Scanner(double loss, uint32_t id) : transport(loss, id * 7919), arbiter(transport)
+    {
+        arbiter.setScannerId(id);
+        arbiter.setKey(SITE_KEY);
+    }
+
+    LossyTransport transport;
+    TriggerArbiter arbiter;
+    double x = 0;
+    uint32_t phase_ms = 0;
+    uint32_t last_sighting_ms = 0;      // ingest repeat limit
+    bool have_sighting = false;         // queued in the current scan window
+    uint32_t last_trigger_ms = 0;       // debounce (set on every detection, as in HandleDetection())
+    bool debounced = false;
+    bool arbitrating = false;
+    uint32_t deadline_ms = 0;
+};
+
+struct Tally
+{
+    uint32_t passes = 0;
+    uint32_t exactly_one = 0;
+    uint32_t right_gate = 0;            // exactly one, and it was the gate the car drove to
+    uint32_t duplicates = 0;            // passes that opened more than one gate (re-opening the same one after debounce is not counted)
+    uint32_t missed = 0;
+    uint32_t suppressed = 0;            // detections that stood down
+    std::vector<double> latency_ms;
+};
+
+static double percentile(std::vector<double> v, double p)
+{
+    if (v.empty())
+        return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * (double)(v.size() - 1) + 0.5))];
+}
+
+// Log-distance path loss: -59 dBm at 1 m, exponent 2.2, 4 dB shadowing.
+static int rssiAt(double d, std::mt19937& rng)
+{
+    std::normal_distribution<double> shadow(0.0, 4.0);
+    return (int)std::lround(-59.0 - 22.0 * std::log10(std::max(d, 1.0)) + shadow(rng));
+}
+
+static bool runScenario(const char* label, const Options& opt, bool arbitrate, double loss, uint16_t port,
+                        bool rogue = false)
+{
+    std::mt19937 rng(42);
+    std::vector<Scanner*> scanners;
+    for (uint32_t i = 0; i < opt.scanners; ++i)
+    {
+        Scanner* s = new Scanner(loss, i + 1);
+        s->x = i * opt.spacing_m;
+        s->phase_ms = (uint32_t)(rng() % (SCAN_WINDOW_MS / STEP_MS)) * STEP_MS;
+        if (arbitrate && !s->transport.begin(GROUP, port))
+        {
+            printf("%s: cannot join the multicast group on 127.0.0.1\n", label);
+            return false;
+        }
+        scanners.push_back(s);
+    }
+    UdpMulticastTransport rogue_udp;
+    if (rogue && !rogue_udp.begin(GROUP, port))
+    {
+        printf("%s: cannot join the multicast group on 127.0.0.1\n", label);
+        return false;
+    }
+
+    Tally t;
+    uint32_t now = 1000000;
+    for (uint32_t pass = 0; pass < opt.passes; ++pass)
+    {
+        const uint32_t target = rng() % opt.scanners;
+        const double gate_x = target * opt.spacing_m;
+        const uint32_t drive_ms = (uint32_t)((START_M - STOP_M) / SPEED_MPS * 1000.0);
+        const uint32_t pass_start = now;
+        std::vector<uint32_t> opened;
+
+        for (; now - pass_start < drive_ms + DWELL_MS; now += STEP_MS)
+        {
+            double y = std::max(STOP_M, START_M - SPEED_MPS * (now - pass_start) / 1000.0);
+
+            // the rogue claims the car every 100 ms, as the stronger scanner would
+            if (rogue && (now - pass_start) % 100 == 0)
+            {
+                MeshMessage forged = {};
+                forged.kind = (now / 100) % 2 ? MeshMessage::Kind::Claim : MeshMessage::Kind::Sighting;
+                forged.scanner_id = 99;
+                forged.major = 1;
+                forged.minor = 7;
+                forged.rssi_q4 = -30 * 4;
+                forged.samples = UINT8_MAX;
+                uint8_t buf[MeshMessage::WIRE_SIZE];
+                forged.encode(ROGUE_KEY, buf);
+                rogue_udp.send(buf, sizeof(buf));
+            }
+
+            for (Scanner* s : scanners)
+            {
+                uint32_t id = s->arbiter.scannerId();
+                TriggerArbiter::Outcome out;
+
+                // ingest: adverts every 100 ms, forwarded at most every REPEAT_MS
+                if ((now - pass_start) % 100 == 0 && now - s->last_sighting_ms >= REPEAT_MS)
+                {
+                    double d = std::hypot(s->x - gate_x, y);
+                    int rssi = rssiAt(d, rng);
+                    if (rssi > -95)
+                    {
+                        s->last_sighting_ms = now;
+                        s->have_sighting = true;
+                        s->arbiter.sample(1, 7, rssi, now);
+                    }
+                }
+
+                // control: scan window end -> HandleDetection()
+                if ((now + s->phase_ms) % SCAN_WINDOW_MS == 0 && s->have_sighting)
+                {
+                    s->have_sighting = false;
+                    if (arbitrate && s->arbiter.filteredRssi(1, 7, now) < opt.min_rssi)
+                        continue;   // too far to tell the gates apart yet
+                    if (s->debounced && now - s->last_trigger_ms <= DEBOUNCE_MS)
+                    {
+                        if (arbitrate)
+                            s->arbiter.repeatClaim(1, 7, now, 0);
+                    }
+                    else
+                    {
+                        s->debounced = true;
+                        s->last_trigger_ms = now;
+                        if (!arbitrate)
+                            opened.push_back(id);
+                        else if (!s->arbiter.pending())
+                        {
+                            if (s->arbiter.propose(1, 7, opt.window_ms, DEBOUNCE_MS, now, 0, out))
+                            {
+                                s->arbitrating = true;
+                                s->deadline_ms = now + opt.window_ms;
+                            }
+                            else
+                            {
+                                ++t.suppressed;
+                                t.latency_ms.push_back(out.latency_ms);
+                            }
+                        }
+                    }
+                }
+
+                if (!arbitrate)
+                    continue;
+
+                // control: ServiceMesh(), then the arbitration timer
+                if (s->arbiter.poll(now, 0, out))
+                {
+                    s->arbitrating = false;
+                    ++t.suppressed;
+                    t.latency_ms.push_back(out.latency_ms);
+                }
+                if (s->arbitrating && (int32_t)(now - s->deadline_ms) >= 0 && s->arbiter.decide(now, 0, out))
+                {
+                    s->arbitrating = false;
+                    opened.push_back(id);
+                    t.latency_ms.push_back(out.latency_ms);
+                }
+            }
+        }
+
+        ++t.passes;
+        std::sort(opened.begin(), opened.end());
+        opened.erase(std::unique(opened.begin(), opened.end()), opened.end());
+        if (opened.empty())
+            ++t.missed;
+        else if (opened.size() > 1)
+            ++t.duplicates;
+        else
+        {
+            ++t.exactly_one;
+            t.right_gate += (opened[0] == target + 1);
+        }
+
+        // let debounce and claims expire; drain what is still in flight
+        now += GAP_MS;
+        TriggerArbiter::Outcome out;
+        for (Scanner* s : scanners)
+            s->arbiter.poll(now, 0, out);
+    }
+
+    printf("%s: %u passes, %u scanners %.0f m apart\n", label, t.passes, opt.scanners, opt.spacing_m);
+    printf("  one gate opened %5.1f %% (the car's gate %5.1f %%), duplicates %5.1f %%, missed %5.1f %%\n",
+           100.0 * t.exactly_one / t.passes, 100.0 * t.right_gate / t.passes, 100.0 * t.duplicates / t.passes,
+           100.0 * t.missed / t.passes);
+    if (arbitrate)
+    {
+        printf("  duplicates suppressed %u, arbitration p50 %.0f ms  p99 %.0f ms  max %.0f ms\n", t.suppressed,
+               percentile(t.latency_ms, 0.5), percentile(t.latency_ms, 0.99), percentile(t.latency_ms, 1.0));
+    }
+    uint32_t forged = 0;
+    for (Scanner* s : scanners)
+        forged += s->arbiter.stats().forged;
+    if (rogue)
+        printf("  forged datagrams dropped %u\n", forged);
+    printf("\n");
+
+    for (Scanner* s : scanners)
+        delete s;
+    return t.missed == 0 && (loss > 0 || !arbitrate || t.duplicates == 0) && (rogue ? forged > 0 : forged == 0);
+}
+
+static void usage()
+{
+    printf("usage: mesh_sim [--passes N] [--scanners N] [--spacing M] [--window MS] [--min-rssi DBM] [--loss P]\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; i += 2)
+    {
+        const char* a = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 2;
+        }
+        double v = strtod(argv[i + 1], nullptr);
+        if (!strcmp(a, "--passes")) opt.passes = (uint32_t)v;
+        else if (!strcmp(a, "--scanners")) opt.scanners = (uint32_t)v;
+        else if (!strcmp(a, "--spacing")) opt.spacing_m = v;
+        else if (!strcmp(a, "--window")) opt.window_ms = (uint32_t)v;
+        else if (!strcmp(a, "--min-rssi")) opt.min_rssi = (int)v;
+        else if (!strcmp(a, "--loss")) opt.loss = v;
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (opt.passes == 0 || opt.scanners == 0 || opt.window_ms == 0 || opt.loss < 0 || opt.loss >= 1)
+    {
+        usage();
+        return 2;
+    }
+
+    // a port of our own, so parallel runs do not hear each other
+    uint16_t port = (uint16_t)(40000 + getpid() % 20000);
+
+    bool ok = runScenario("standalone (no arbitration)", opt, false, 0.0, port);
+    ok = runScenario("arbitrated", opt, true, 0.0, port) && ok;
+    char label[48];
+    snprintf(label, sizeof(label), "arbitrated, %.0f %% datagram loss", 100.0 * opt.loss);
+    ok = runScenario(label, opt, true, opt.loss, port + 1) && ok;
+    ok = runScenario("arbitrated, rogue host claiming every car", opt, true, 0.0, port + 2, true) && ok;
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,547 @@
+// Soak test of the MQTT export (src/MqttExport) on Linux.
+//
+// A producer thread plays the control task and posts a steady flood of events (19 of
+// every 20 sightings, the rest trigger / outcome pairs) through MqttExporter::post(),
+// timing every call. The exporter runs on its own TaskTopology thread, exactly as
+// MqttTask() does on the device, over the firmware's TcpTransport.
+//
+// By default the broker is a minimal MQTT 3.1.1 broker embedded here on 127.0.0.1
+// (CONNECT/CONNACK, PUBLISH/PUBACK, PINGREQ/PINGRESP, DISCONNECT). It can go away in
+// the middle of the run (--outage-ms, refusing sessions for that long), acknowledge
+// late (--ack-delay-ms) or not at all (--ack-loss percent), and it checks the stream:
+// seq numbers without gaps, repeats only as DUP resends, and at the end every event
+// posted either delivered once or counted in a batch's "lost" (QoS 0 may also lose
+// whole batches to a dropped connection; those show up as seq gaps).
+//
+// --broker host:port publishes to a real broker instead (e.g. mosquitto -v, and
+// mosquitto_sub -t 'palgate/#' -v to watch); the stream is then not checked.
+//
+// Build and run from palgate_esp_scanner/:
+//   g++ -O2 -std=gnu++17 -pthread -Isrc/MqttExport -Isrc/TaskTopology -Isrc/Metrics -Isrc/AdvDecoder
+//       -I../shared/IBeaconProtocol -o /tmp/mqtt_soak tools/mqtt_soak.cpp src/MqttExport/MqttExport.cpp
+//       src/TaskTopology/TaskTopology.cpp src/Metrics/Metrics.cpp src/AdvDecoder/AdvDecoder.cpp
+//   /tmp/mqtt_soak [--seconds 10] [--rate 2000] [--qos 1] [--batch-ms 250] [--outage-ms 0]
+//                  [--ack-delay-ms 0] [--ack-loss 0] [--broker host:port]
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Metrics.h"
+#include "MqttExport.h"
+#include "TaskTopology.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    uint32_t seconds = 10;
+    uint32_t rate = 2000;           // events/s
+    uint32_t qos = 1;
+    uint32_t batch_ms = 250;
+    uint32_t outage_ms = 0;         // broker away for this long, starting at a third of the run
+    uint32_t ack_delay_ms = 0;
+    uint32_t ack_loss = 0;          // percent of PUBACKs never sent
+    std::string broker;             // host:port; empty = the embedded one
+};
+
+
+// ---- embedded broker ----
+
+class MockBroker
+{
+public:
+    struct Stats
+    {
+        uint32_t sessions = 0;
+        uint32_t refused = 0;
+        uint32_t batches = 0;       // new seq numbers
+        uint32_t dup_resends = 0;   // repeated seq with DUP set
+        uint32_t bad_repeats = 0;   // repeated seq without DUP, or out of order
+        uint32_t seq_gaps = 0;      // batches never received
+        uint64_t events = 0;        // in new batches
+        uint64_t lost = 0;          // sum of "lost" of new batches
+        uint32_t malformed = 0;
+    };
+
+    bool start(const Options& opt)
+    {
+        m_opt = opt;
+        m_listen = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (m_listen < 0 || setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+            bind(m_listen, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(m_listen, 4) != 0 ||
+            getsockname(m_listen, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+            return false;
+        m_port = ntohs(addr.sin_port);
+        m_thread = std::thread([this] { run(); });
+        return true;
+    }
+
+    void stop()
+    {
+        m_stop = true;
+        m_thread.join();
+        close(m_listen);
+    }
+
+    void setDown(bool down) { m_down = down; }
+    uint16_t port() const { return m_port; }
+    Stats stats() const { return m_stats; }     // after stop()
+
+private:
+    void run()
+    {
+        while (!m_stop)
+        {
+            pollfd p = { m_listen, POLLIN, 0 };
+            if (poll(&p, 1, 50) <= 0)
+                continue;
+            int fd = accept(m_listen, nullptr, nullptr);
+            if (fd < 0)
+                continue;
+            if (m_down)
+            {
+                ++m_stats.refused;
+                close(fd);
+                continue;
+            }
+            ++m_stats.sessions;
+            serve(fd);
+            close(fd);
+        }
+    }
+
+    void serve(int fd)
+    {
+        std::vector<uint8_t> in;
+        uint8_t buf[4096];
+        while (!m_stop && !m_down)
+        {
+            pollfd p = { fd, POLLIN, 0 };
+            if (poll(&p, 1, 50) <= 0)
+                continue;
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+                return;
+            in.insert(in.end(), buf, buf + n);
+
+            // every complete packet in the buffer
+            for (;;)
+            {
+                size_t used = 1;
+                uint32_t remaining = 0;
+                bool complete = false;
+                for (int shift = 0; used < in.size() && shift <= 21; shift += 7)
+                {
+                    uint8_t b = in[used++];
+                    remaining |= (uint32_t)(b & 0x7F) << shift;
+                    if (!(b & 0x80))
+                    {
+                        complete = in.size() >= used + remaining;
+                        break;
+                    }
+                }
+                if (!complete)
+                    break;
+                if (!handle(fd, in[0], in.data() + used, remaining))
+                    return;
+                in.erase(in.begin(), in.begin() + used + remaining);
+            }
+        }
+    }
+
+    static void sendPacket(int fd, const uint8_t* p, size_t len)
+    {
+        send(fd, p, len, MSG_NOSIGNAL);
+    }
+
+    bool handle(int fd, uint8_t first, const uint8_t* body, uint32_t len)
+    {
+        switch (first >> 4)
+        {
+            case MqttCodec::CONNECT:
+            {
+                static const uint8_t CONNACK[4] = { MqttCodec::CONNACK << 4, 2, 0, 0 };
+                bool ok = len >= 10 && memcmp(body, "\x00\x04MQTT\x04", 7) == 0;
+                if (!ok)
+                    ++m_stats.malformed;
+                sendPacket(fd, CONNACK, sizeof(CONNACK));
+                return ok;
+            }
+            case MqttCodec::PUBLISH:
+            {
+                const uint8_t qos = (first >> 1) & 3;
+                const bool dup = (first & 0x08) != 0;
+                if (len < 2)
+                    return false;
+                size_t topic_len = (size_t)(body[0] << 8 | body[1]);
+                size_t off = 2 + topic_len + (qos ? 2 : 0);
+                if (off > len)
+                    return false;
+                uint16_t packet_id = qos ? (uint16_t)(body[2 + topic_len] << 8 | body[3 + topic_len]) : 0;
+                record(std::string(reinterpret_cast<const char*>(body + off), len - off), dup);
+
+                if (qos)
+                {
+                    if (m_opt.ack_loss && (uint32_t)(rand() % 100) < m_opt.ack_loss)
+                        return true;
+                    if (m_opt.ack_delay_ms)
+                        std::this_thread::sleep_for(std::chrono::milliseconds(m_opt.ack_delay_ms));
+                    const uint8_t puback[4] = { MqttCodec::PUBACK << 4, 2, (uint8_t)(packet_id >> 8), (uint8_t)packet_id };
+                    sendPacket(fd, puback, sizeof(puback));
+                }
+                return true;
+            }
+            case MqttCodec::PINGREQ:
+            {
+                static const uint8_t PINGRESP[2] = { MqttCodec::PINGRESP << 4, 0 };
+                sendPacket(fd, PINGRESP, sizeof(PINGRESP));
+                return true;
+            }
+            case MqttCodec::DISCONNECT:
+                return false;
+        }
+        ++m_stats.malformed;
+        return false;
+    }
+
+    void record(const std::string& payload, bool dup)
+    {
+        unsigned seq, lost;
+        if (sscanf(payload.c_str(), "{\"seq\":%u,\"lost\":%u,\"ev\":[", &seq, &lost) != 2 ||
+            payload.compare(payload.size() - 2, 2, "]}") != 0)
+        {
+            ++m_stats.malformed;
+            return;
+        }
+
+        if (m_have_seq && seq == m_last_seq)
+        {
+            if (dup || m_opt.qos == 0)      // QoS 0 resends cannot carry DUP
+                ++m_stats.dup_resends;
+            else
+                ++m_stats.bad_repeats;
+            return;
+        }
+        if (m_have_seq && seq < m_last_seq)
+        {
+            ++m_stats.bad_repeats;
+            return;
+        }
+        if (m_have_seq)
+            m_stats.seq_gaps += seq - m_last_seq - 1;
+        m_have_seq = true;
+        m_last_seq = seq;
+
+        ++m_stats.batches;
+        m_stats.lost += lost;
+        for (size_t at = payload.find("{\"k\":"); at != std::string::npos; at = payload.find("{\"k\":", at + 1))
+            ++m_stats.events;
+    }
+
+    Options m_opt;
+    int m_listen = -1;
+    uint16_t m_port = 0;
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_down{false};
+    Stats m_stats;
+    bool m_have_seq = false;
+    uint32_t m_last_seq = 0;
+};
+
+
+// ---- exporter task ----
+
+static TcpTransport g_transport;
+static MqttExporter g_exporter(g_transport);
+static MqttSettings g_settings = {};
+static std::atomic<bool> g_stop{false};
+static std::atomic<bool> g_stopped{false};
+
+static void exporterTask(void*)
+{
+    while (!g_stop.load(std::memory_order_relaxed))
+        g_exporter.wait(g_exporter.service(g_settings, true));
+    g_stopped = true;
+}
+
+
+// ---- producer ----
+
+struct ProducerStats
+{
+    uint64_t posted = 0;
+    uint64_t accepted = 0;
+    uint64_t gate_posted = 0;
+    uint64_t gate_rejected = 0;
+    uint64_t post_ns_total = 0;
+    uint64_t post_ns_max = 0;
+    LogHistogram post_ns;
+};
+
+static void postTimed(ProducerStats& st, const ExportEvent& ev)
+{
+    auto t0 = Clock::now();
+    bool ok = g_exporter.post(ev);
+    uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+    st.post_ns.record((uint32_t)ns);
+    st.post_ns_total += ns;
+    if (ns > st.post_ns_max)
+        st.post_ns_max = ns;
+    ++st.posted;
+    st.accepted += ok;
+    if (ev.kind != ExportEvent::Kind::Sighting)
+    {
+        ++st.gate_posted;
+        st.gate_rejected += !ok;
+    }
+}
+
+static ExportEvent makeEvent(uint64_t i)
+{
+    ExportEvent ev = {};
+    ev.beacon = (1u << 16) | (uint32_t)(1 + i % 3);
+    if (i % 7 == 0)
+    {
+        ev.beacon = ExportEvent::ROLLING_BEACON;
+        ev.counter = (uint32_t)(i / 7);
+    }
+    ev.unix_ms = 1718000000000ULL + i;
+    switch (i % 20)
+    {
+        case 0:
+            ev.kind = ExportEvent::Kind::Trigger;
+            ev.trace_id = (uint32_t)(i / 20);
+            break;
+        case 1:
+            ev.kind = ExportEvent::Kind::Result;
+            ev.trace_id = (uint32_t)(i / 20);
+            ev.detail = ExportEvent::OPENED | ExportEvent::FIRST;
+            ev.code = 200;
+            ev.elapsed_ms = 412;
+            break;
+        default:
+            ev.kind = ExportEvent::Kind::Sighting;
+            ev.rssi = (int8_t)(-60 - (int)(i % 25));
+            break;
+    }
+    return ev;
+}
+
+
+// ---- report ----
+
+static uint32_t quantile(const LogHistogram& h, double q)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < LogHistogram::BUCKETS; ++i)
+        total += h.bucketCount(i);
+    if (total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)std::ceil(q * (double)total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LogHistogram::BUCKETS; ++i)
+    {
+        seen += h.bucketCount(i);
+        if (seen >= rank)
+            return LogHistogram::bucketUpperBound(i);
+    }
+    return LogHistogram::bucketUpperBound(LogHistogram::BUCKETS - 1);
+}
+
+static bool drained()
+{
+    return g_exporter.depth() == 0 && g_exporter.staged() == 0;
+}
+
+static bool waitDrained(uint32_t timeout_ms)
+{
+    auto until = Clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!drained() && Clock::now() < until)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return drained();
+}
+
+static void usage()
+{
+    printf("usage: mqtt_soak [--seconds 10] [--rate 2000] [--qos 0|1] [--batch-ms 250] [--outage-ms 0]\n"
+           "                 [--ack-delay-ms 0] [--ack-loss 0..100] [--broker host:port]\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* a = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 2;
+        }
+        const char* v = argv[++i];
+        if (!strcmp(a, "--broker")) opt.broker = v;
+        else if (!strcmp(a, "--seconds")) opt.seconds = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--rate")) opt.rate = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--qos")) opt.qos = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--batch-ms")) opt.batch_ms = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--outage-ms")) opt.outage_ms = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--ack-delay-ms")) opt.ack_delay_ms = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--ack-loss")) opt.ack_loss = (uint32_t)strtoul(v, nullptr, 10);
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (opt.seconds == 0 || opt.rate == 0 || opt.qos > 1 || opt.batch_ms > 60000 || opt.ack_loss > 100)
+    {
+        usage();
+        return 2;
+    }
+
+    MockBroker broker;
+    const bool mock = opt.broker.empty();
+    uint16_t port;
+    if (mock)
+    {
+        if (!broker.start(opt))
+        {
+            printf("cannot start the embedded broker\n");
+            return 1;
+        }
+        strcpy(g_settings.host, "127.0.0.1");
+        port = broker.port();
+    }
+    else
+    {
+        size_t colon = opt.broker.rfind(':');
+        snprintf(g_settings.host, sizeof(g_settings.host), "%s", opt.broker.substr(0, colon).c_str());
+        port = colon == std::string::npos ? 1883 : (uint16_t)atoi(opt.broker.c_str() + colon + 1);
+    }
+    g_settings.port = port;
+    g_settings.qos = (uint8_t)opt.qos;
+    g_settings.batch_ms = (uint16_t)opt.batch_ms;
+    g_settings.keepalive_s = 5;
+    strcpy(g_settings.topic, "palgate");
+    strcpy(g_settings.client_id, "palgate-soak");
+
+    printf("%u s at %u events/s, QoS %u, batch %u ms, broker %s:%u%s", opt.seconds, opt.rate, opt.qos, opt.batch_ms,
+           g_settings.host, port, mock ? " (embedded)" : "");
+    if (opt.outage_ms)
+        printf(", outage %u ms", opt.outage_ms);
+    if (opt.ack_delay_ms || opt.ack_loss)
+        printf(", PUBACK delay %u ms loss %u%%", opt.ack_delay_ms, opt.ack_loss);
+    printf("\n");
+
+    TaskTopology::startPinned("mqtt", exporterTask, nullptr, TaskTopology::APP_CORE, 1, 4096);
+
+    // producer: 1 ms ticks, as the control task posts from loop()
+    ProducerStats ps;
+    const auto t0 = Clock::now();
+    const uint64_t total = (uint64_t)opt.rate * opt.seconds;
+    const uint64_t outage_at = opt.seconds * 1000ULL / 3;
+    uint32_t max_depth = 0;
+    bool down = false;
+    for (uint64_t i = 0; i < total; )
+    {
+        uint64_t ms = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - t0).count();
+        if (mock && opt.outage_ms)
+        {
+            bool want_down = ms >= outage_at && ms < outage_at + opt.outage_ms;
+            if (want_down != down)
+                broker.setDown(down = want_down);
+        }
+        for (uint64_t due = std::min(total, (ms + 1) * opt.rate / 1000); i < due; ++i)
+            postTimed(ps, makeEvent(i));
+        if (g_exporter.depth() > max_depth)
+            max_depth = g_exporter.depth();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (down)
+        broker.setDown(false);
+
+    // drain; then one last event carries the lost count of the tail
+    bool ok = waitDrained(opt.outage_ms + 15000);
+    ExportEvent flush = makeEvent(0);
+    postTimed(ps, flush);
+    ok = waitDrained(5000) && ok;
+    const double total_s = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    g_stop = true;
+    g_exporter.wait(0);
+    while (!g_stopped)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    const ScannerMetrics& m = g_metrics;
+    const uint64_t rejected = ps.posted - ps.accepted;
+    printf("\nproducer   %llu posted, %llu queued, %u shed (sightings), %u dropped (queue full)\n",
+           (unsigned long long)ps.posted, (unsigned long long)ps.accepted, m.mqtt_sightings_shed.get(),
+           m.mqtt_events_dropped.get());
+    printf("           gate events: %llu posted, %llu rejected\n", (unsigned long long)ps.gate_posted,
+           (unsigned long long)ps.gate_rejected);
+    printf("           post(): mean %.0f ns, p99 %u ns, max %.1f us\n", (double)ps.post_ns_total / (double)ps.posted,
+           quantile(ps.post_ns, 0.99), (double)ps.post_ns_max / 1000.0);
+    printf("queue      high water %u / %zu (producer saw %u)\n", g_exporter.highWater(), MqttExporter::QUEUE_CAP,
+           max_depth);
+    printf("exporter   %u batches, %u events (%.1f per batch), %u KB payload\n", m.mqtt_batches.get(),
+           m.mqtt_events.get(), m.mqtt_batches.get() ? (double)m.mqtt_events.get() / m.mqtt_batches.get() : 0.0,
+           m.mqtt_bytes.get() / 1024);
+    printf("           %.0f events/s, %.1f batches/s, %.1f KB/s over %.1f s\n", m.mqtt_events.get() / total_s,
+           m.mqtt_batches.get() / total_s, m.mqtt_bytes.get() / 1024.0 / total_s, total_s);
+    printf("           connects %u ok / %u failed, %u publish failures\n", m.mqtt_connects.get(),
+           m.mqtt_connect_failed.get(), m.mqtt_publish_failed.get());
+    printf("           publish p50 %u us p99 %u us; event age p50 %u ms p99 %u ms\n",
+           quantile(m.mqtt_publish_us, 0.5), quantile(m.mqtt_publish_us, 0.99), quantile(m.mqtt_event_age_ms, 0.5),
+           quantile(m.mqtt_event_age_ms, 0.99));
+
+    if (!ok)
+        printf("FAIL: the queue did not drain\n");
+    if (ps.gate_rejected && !opt.outage_ms && !opt.ack_delay_ms && !opt.ack_loss)
+    {
+        printf("FAIL: gate events rejected without backpressure\n");
+        ok = false;
+    }
+
+    if (mock)
+    {
+        broker.stop();
+        MockBroker::Stats b = broker.stats();
+        printf("broker     %u sessions (%u refused), %u batches, %u DUP resends, %u seq gaps, %llu events, %llu lost\n",
+               b.sessions, b.refused, b.batches, b.dup_resends, b.seq_gaps, (unsigned long long)b.events,
+               (unsigned long long)b.lost);
+
+        // without gaps every event is accounted for; a QoS 0 gap takes its events and lost count along
+        bool stream_ok = b.malformed == 0 && b.bad_repeats == 0;
+        if (b.seq_gaps == 0)
+            stream_ok = stream_ok && b.events == ps.accepted && b.lost == rejected;
+        else
+            stream_ok = stream_ok && opt.qos == 0 && b.events < ps.accepted && b.lost <= rejected;
+        if (!stream_ok)
+            printf("FAIL: stream (malformed %u, bad repeats %u, lost %llu vs %llu rejected, events %llu vs %llu queued)\n",
+                   b.malformed, b.bad_repeats, (unsigned long long)b.lost, (unsigned long long)rejected,
+                   (unsigned long long)b.events, (unsigned long long)ps.accepted);
+        ok = ok && stream_ok;
+    }
+
+    printf("\n%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
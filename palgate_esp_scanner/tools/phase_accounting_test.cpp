@@ -0,0 +1,219 @@
+// Deterministic host test for PhaseAccounting (shared/PhaseAccounting), driven by a virtual clock.
+//
+// Random phase switches (enter()), reporting syncs (sync()) and current-model changes
+// while the virtual clock advances by random steps (microseconds up to a 40-minute light
+// sleep), over more than HOURS hours. Checks against a separate model that
+//   - lifetime time per phase equals the virtual time spent in it, and adds up to uptime,
+//   - lifetime charge equals the sum of time x current at the rate in force at the time
+//     (a model change charges what elapsed before it at the old rate),
+//   - every recorded hour bucket holds exactly the time and charge of that hour, and a
+//     complete hour adds up to one hour; hours older than HOURS are no longer returned,
+//   - averageMicroamps(), PhaseScope and format()'s snprintf semantics.
+// Comparing the charge model of two firmware builds then only needs the same trace.
+//
+// Build and run from palgate_esp_scanner/:
+//   g++ -O2 -std=gnu++17 -I../shared/PhaseAccounting -o /tmp/phase_accounting_test
+//       tools/phase_accounting_test.cpp ../shared/PhaseAccounting/PhaseAccounting.cpp
+//   /tmp/phase_accounting_test [steps] [seed]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+
+#include "PhaseAccounting.h"
+
+static const size_t N = PhaseAccounting::PHASE_COUNT;
+
+static uint64_t g_now_us = 0;
+
+static uint64_t virtualClock()
+{
+    return g_now_us;
+}
+
+struct Bucket
+{
+    uint64_t us[N] = {};
+    uint64_t pC[N] = {};
+};
+
+// Reference: credit [from, to) to `phase` one hour at a time.
+struct Model
+{
+    Phase phase = Phase::Active;
+    uint64_t since_us = 0;
+    CurrentModel current = {};
+    Bucket lifetime;
+    std::map<uint32_t, Bucket> hours;
+
+    void credit(uint64_t to_us)
+    {
+        const size_t i = (size_t)phase;
+        for (uint64_t t = since_us; t < to_us; )
+        {
+            uint32_t h = (uint32_t)(t / PhaseAccounting::US_PER_HOUR);
+            uint64_t end = std::min<uint64_t>(to_us, (uint64_t)(h + 1) * PhaseAccounting::US_PER_HOUR);
+            Bucket& b = hours[h];
+            b.us[i] += end - t;
+            b.pC[i] += (end - t) * current.uA[i];
+            lifetime.us[i] += end - t;
+            lifetime.pC[i] += (end - t) * current.uA[i];
+            t = end;
+        }
+        since_us = to_us;
+    }
+};
+
+static int g_failures = 0;
+
+static void check(bool ok, const char* what, uint64_t step)
+{
+    if (!ok && g_failures++ < 10)
+        printf("FAIL at step %llu: %s\n", (unsigned long long)step, what);
+}
+
+static bool sameTotals(const PhaseAccounting::Totals& t, const Bucket& b)
+{
+    for (size_t i = 0; i < N; ++i)
+        if (t.us[i] != b.us[i] || t.charge_pC[i] != b.pC[i])
+            return false;
+    return true;
+}
+
+static CurrentModel randomModel(std::mt19937_64& rng)
+{
+    CurrentModel m;
+    for (size_t i = 0; i < N; ++i)
+        m.uA[i] = 500 + (uint32_t)(rng() % 200000);
+    return m;
+}
+
+static void checkHelpers()
+{
+    // averageMicroamps: 1 s at 100 mA and 3 s at 2 mA average to 26.5 mA
+    PhaseAccounting::Totals t = {};
+    t.us[(size_t)Phase::Scan] = 1000000;
+    t.charge_pC[(size_t)Phase::Scan] = 1000000ULL * 100000;
+    t.us[(size_t)Phase::LightSleep] = 3000000;
+    t.charge_pC[(size_t)Phase::LightSleep] = 3000000ULL * 2000;
+    uint32_t both = PhaseAccounting::phaseBit(Phase::Scan) | PhaseAccounting::phaseBit(Phase::LightSleep);
+    check(PhaseAccounting::averageMicroamps(t, both) == 26500, "averageMicroamps of a mix", 0);
+    check(PhaseAccounting::averageMicroamps(t, PhaseAccounting::phaseBit(Phase::Http)) == 0,
+          "averageMicroamps of an unused phase", 0);
+
+    // format(): snprintf semantics, phases without time skipped
+    char big[1024];
+    size_t full = PhaseAccounting::format(t, big, sizeof(big));
+    char small[16];
+    check(PhaseAccounting::format(t, small, sizeof(small)) == full && strlen(small) == sizeof(small) - 1,
+          "format() truncates and returns the full length", 0);
+    check(strstr(big, "scan") && strstr(big, "light_sleep") && strstr(big, "total") && !strstr(big, "http"),
+          "format() lists the used phases and the total", 0);
+
+    // PhaseScope restores the phase it interrupted
+    g_now_us = 0;
+    PhaseAccounting acc(virtualClock);
+    acc.enter(Phase::Scan);
+    {
+        PhaseScope scope(acc, Phase::SerialFlush);
+        g_now_us += 1000;
+        check(acc.current() == Phase::SerialFlush, "PhaseScope enters its phase", 0);
+    }
+    check(acc.current() == Phase::Scan && acc.lifetime().us[(size_t)Phase::SerialFlush] == 1000,
+          "PhaseScope returns to the previous phase", 0);
+}
+
+int main(int argc, char** argv)
+{
+    const uint64_t steps = (argc > 1) ? strtoull(argv[1], nullptr, 10) : 200000ULL;
+    const uint64_t seed = (argc > 2) ? strtoull(argv[2], nullptr, 10) : 1;
+    std::mt19937_64 rng(seed);
+
+    checkHelpers();
+
+    // start a little before an hour boundary, as after a light sleep
+    g_now_us = 5 * PhaseAccounting::US_PER_HOUR - 1234;
+    PhaseAccounting acc(virtualClock);
+    Model model;
+    model.since_us = g_now_us;
+    model.current = acc.currentModel();
+    const uint64_t boot_us = g_now_us;
+
+    for (uint64_t step = 0; step < steps; ++step)
+    {
+        // mostly short awake steps, sometimes a long sleep
+        uint64_t r = rng() % 100;
+        g_now_us += (r < 90) ? rng() % 300000 : (r < 99) ? rng() % 60000000 : rng() % (40ULL * 60 * 1000000);
+
+        r = rng() % 100;
+        if (r < 60)
+        {
+            Phase next = (Phase)(rng() % N);
+            model.credit(g_now_us);
+            Phase prev = acc.enter(next);
+            check(prev == model.phase, "enter() returns the previous phase", step);
+            model.phase = next;
+        }
+        else if (r < 99)
+        {
+            acc.sync();
+            model.credit(g_now_us);
+        }
+        else
+        {
+            CurrentModel m = randomModel(rng);
+            acc.setCurrentModel(m);
+            model.credit(g_now_us);
+            model.current = m;
+        }
+
+        if (step % 1000 == 0 || step + 1 == steps)
+        {
+            check(sameTotals(acc.lifetime(), model.lifetime), "lifetime totals", step);
+            uint64_t total = 0;
+            for (size_t i = 0; i < N; ++i)
+                total += acc.lifetime().us[i];
+            check(total == g_now_us - boot_us, "lifetime time adds up to uptime", step);
+
+            const uint32_t current = acc.currentHour();
+            check(current == (uint32_t)(g_now_us / PhaseAccounting::US_PER_HOUR) || g_now_us % PhaseAccounting::US_PER_HOUR == 0,
+                  "currentHour() follows the clock", step);
+            for (size_t ago = 0; ago <= PhaseAccounting::HOURS; ++ago)
+            {
+                const PhaseAccounting::Totals* t = acc.hour(ago);
+                if (ago == PhaseAccounting::HOURS || ago > current)
+                {
+                    check(t == nullptr, "no bucket beyond the history", step);
+                    continue;
+                }
+                auto it = model.hours.find(current - (uint32_t)ago);
+                if (it == model.hours.end())
+                {
+                    // an hour slept through entirely (bucket recycled or never credited)
+                    check(t == nullptr || t->hour != current - ago || sameTotals(*t, Bucket()), "empty hour", step);
+                    continue;
+                }
+                check(t != nullptr && sameTotals(*t, it->second), "hour bucket totals", step);
+                if (t && ago > 0 && current - ago > (uint32_t)(boot_us / PhaseAccounting::US_PER_HOUR))
+                {
+                    uint64_t hour_us = 0;
+                    for (size_t i = 0; i < N; ++i)
+                        hour_us += t->us[i];
+                    check(hour_us == PhaseAccounting::US_PER_HOUR, "a complete hour adds up to one hour", step);
+                }
+            }
+        }
+    }
+
+    const PhaseAccounting::Totals& life = acc.lifetime();
+    double mah = 0;
+    for (size_t i = 0; i < N; ++i)
+        mah += PhaseAccounting::toMilliampHours(life.charge_pC[i]);
+    printf("%llu steps over %.1f virtual hours, %.2f mAh estimated\n", (unsigned long long)steps,
+           (double)(g_now_us - boot_us) / PhaseAccounting::US_PER_HOUR, mah);
+    printf("%s\n", g_failures ? "FAILED" : "OK");
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+// Host benchmark for the rolling beacon code (shared/RollingCode).
+//
+// Measures what the scanner pays per advertisement -- one RollingWindow lookup --
+// against verifying by AES directly (one RollingCode::tag() per counter in the
+// window), the cost of sliding the window after an accept, and the false-accept
+// rate of random adverts against a full window.
+//
+// Build and run from palgate_esp_scanner/:
+//   g++ -O2 -std=gnu++17 -I../shared/Aes128 -I../shared/RollingCode -o /tmp/rolling_bench
+//       tools/rolling_bench.cpp ../shared/Aes128/Aes128.cpp ../shared/RollingCode/RollingCode.cpp
+//   /tmp/rolling_bench [window] [random_trials]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unordered_set>
+
+#include "RollingCode.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double nsSince(Clock::time_point t0, uint64_t iterations)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (double)iterations;
+}
+
+int main(int argc, char** argv)
+{
+    const uint16_t window = (argc > 1) ? (uint16_t)atoi(argv[1]) : 32;
+    const uint64_t trials = (argc > 2) ? strtoull(argv[2], nullptr, 10) : 20000000ULL;
+
+    std::mt19937_64 rng(12345);
+    uint8_t key[16];
+    for (uint8_t& b : key) b = (uint8_t)rng();
+
+    RollingWindow w;
+    w.reset(key, 1000, window);
+
+    // ---- verification cost ----
+    const uint64_t N = 2000000;
+    uint8_t tags[64][RollingCode::TAG_LEN];
+    for (uint32_t i = 0; i < 64; ++i)
+        RollingCode::tag(key, 1001 + (i % window), tags[i]);
+
+    uint32_t counter = 0;
+    uint64_t hits = 0;
+    auto t0 = Clock::now();
+    for (uint64_t i = 0; i < N; ++i)
+        hits += w.lookup(tags[i & 63], counter);
+    double lookup_hit_ns = nsSince(t0, N);
+
+    uint8_t miss[RollingCode::TAG_LEN];
+    uint64_t misses = 0;
+    t0 = Clock::now();
+    for (uint64_t i = 0; i < N; ++i)
+    {
+        uint64_t r = rng();
+        memcpy(miss, &r, 8);
+        miss[8] = (uint8_t)i;
+        miss[9] = (uint8_t)(i >> 8);
+        misses += !w.lookup(miss, counter);
+    }
+    double lookup_miss_ns = nsSince(t0, N);
+
+    const uint64_t A = 200000;
+    uint8_t out[RollingCode::TAG_LEN];
+    uint64_t sink = 0;
+    t0 = Clock::now();
+    for (uint64_t i = 0; i < A; ++i)
+    {
+        RollingCode::tag(key, (uint32_t)i, out);
+        sink += out[0];
+    }
+    double aes_ns = nsSince(t0, A);
+
+    const uint64_t S = 100000;
+    RollingWindow slide;
+    slide.reset(key, 0, window);
+    t0 = Clock::now();
+    for (uint64_t i = 1; i <= S; ++i)
+        slide.advance((uint32_t)i);
+    double advance_ns = nsSince(t0, S);
+
+    printf("window %u (MAX %u)\n", (unsigned)window, (unsigned)RollingWindow::MAX_WINDOW);
+    printf("  lookup, hit              %8.1f ns  (%llu/%llu hits)\n", lookup_hit_ns, (unsigned long long)hits, (unsigned long long)N);
+    printf("  lookup, miss             %8.1f ns\n", lookup_miss_ns);
+    printf("  one AES tag              %8.1f ns\n", aes_ns);
+    printf("  AES verify, hit (avg)    %8.1f ns  (window/2 tags)\n", aes_ns * window / 2.0);
+    printf("  AES verify, miss         %8.1f ns  (window tags)\n", aes_ns * window);
+    printf("  advance by 1 (accept)    %8.1f ns\n", advance_ns);
+
+    // ---- false accepts, full 80-bit tag: expect none ----
+    uint64_t false_accepts = 0;
+    for (uint64_t i = 0; i < trials; ++i)
+    {
+        uint64_t r1 = rng(), r2 = rng();
+        memcpy(miss, &r1, 8);
+        memcpy(miss + 8, &r2, 2);
+        false_accepts += w.lookup(miss, counter);
+    }
+    printf("false accepts, 80-bit tag: %llu / %llu random adverts (theory %.3g per advert)\n",
+           (unsigned long long)false_accepts, (unsigned long long)trials,
+           window / std::pow(2.0, 8.0 * RollingCode::TAG_LEN));
+
+    // ---- same experiment with the tag cut to 16 bits, to check the window/2^bits model ----
+    std::unordered_set<uint16_t> short_tags;
+    for (uint32_t c = 1001; c <= 1000u + window; ++c)
+    {
+        RollingCode::tag(key, c, out);
+        short_tags.insert((uint16_t)(out[0] | (out[1] << 8)));
+    }
+    uint64_t short_accepts = 0;
+    for (uint64_t i = 0; i < trials; ++i)
+        short_accepts += short_tags.count((uint16_t)rng());
+    printf("false accepts, 16-bit tag: %.3g measured vs %.3g theory (window/65536)\n",
+           (double)short_accepts / (double)trials, (double)short_tags.size() / 65536.0);
+
+    return (int)(sink & 0);
+}
@@ -0,0 +1,316 @@
+#!/usr/bin/env python3
+"""
+Flash and RAM per module (or per symbol) from the linker map, checked against
+the custom_size_budget of a platformio.ini environment.
+
+Every input section of the map is attributed to a module: src/<Module> for the
+scanner's own code, the archive name for libraries (libBLE.a, libbt.a,
+libmbedtls.a, libstdc++.a, ...). Regions:
+
+  flash  bytes in the app image: code, rodata, IRAM code and initialised data
+  iram   IRAM code (loaded from flash at boot)
+  dram   static RAM: .data + .bss
+
+The total flash is always checked against the app partition of the
+environment's board_build.partitions. Further limits come from
+custom_size_budget, one per line:
+
+  <pattern> <region> <limit>    e.g.  src/*  flash  192K
+                                      sym:*basic_ostream*  flash  0
+
+A pattern matches module names (shell wildcards, summed over all matches);
+"total" is the whole image; "sym:" patterns match demangled symbol names.
+
+As a PlatformIO post script it adds -Wl,-Map to the link and a target:
+  pio run -e esp32dev_lean -t size_budget
+It also runs on its own, on any map:
+
+usage: size_budget.py MAP [--ini platformio.ini] [--env NAME] [--top N] [--symbols]
+"""
+
+import argparse
+import configparser
+import fnmatch
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+# output section -> region
+SECTIONS = {
+    ".flash.text": "code",
+    ".flash.rodata": "rodata",
+    ".flash.appdesc": "rodata",
+    ".iram0.vectors": "iram",
+    ".iram0.text": "iram",
+    ".dram0.data": "data",
+    ".dram0.bss": "bss",
+    ".noinit": "bss",
+    ".rtc.text": "rtc",
+    ".rtc.force_fast": "rtc",
+    ".rtc.data": "rtc",
+    ".rtc_noinit": "rtc_bss",
+    ".rtc.bss": "rtc_bss",
+}
+
+# sections that add up to each budget region
+REGIONS = {
+    "flash": ("code", "rodata", "iram", "data", "rtc"),
+    "iram": ("iram",),
+    "dram": ("data", "bss"),
+}
+
+SECTION_PREFIXES = re.compile(r"^\.(literal|text|rodata|data|bss|sbss|sdata|iram1|dram1|rtc\.\w+)\.")
+
+OUTPUT_RE = re.compile(r"^(\.\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+OUTPUT_NAME_RE = re.compile(r"^(\.\S+)\s*$")
+INPUT_RE = re.compile(r"^ (\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+INPUT_NAME_RE = re.compile(r"^ (\S+)\s*$")
+CONTINUATION_RE = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+
+
+def module_of(path):
+    path = path.strip()
+    m = re.search(r"([^/\\]+\.a)\(([^)]+)\)$", path)
+    if m:
+        return m.group(1)
+    m = re.search(r"[/\\]src[/\\](.+?)\.(?:c|cc|cpp|S)\.o$", path)
+    if m:
+        parts = re.split(r"[/\\]", m.group(1))
+        return "src/" + parts[0]
+    return os.path.basename(path)
+
+
+def symbol_of(section):
+    if section in ("*fill*", "COMMON"):
+        return section
+    return SECTION_PREFIXES.sub("", section)
+
+
+def parse_map(path):
+    """Returns [(module, symbol, section kind, bytes)]."""
+    entries = []
+    out_kind = None
+    pending_input = None
+    started = False
+    with open(path, "r", errors="replace") as fh:
+        for line in fh:
+            line = line.rstrip("\n")
+            if not started:
+                started = line.startswith("Linker script and memory map")
+                continue
+
+            if line and not line[0].isspace():
+                m = OUTPUT_RE.match(line) or OUTPUT_NAME_RE.match(line)
+                out_kind = SECTIONS.get(m.group(1)) if m else None
+                pending_input = None
+                continue
+            if out_kind is None:
+                continue
+
+            m = INPUT_RE.match(line)
+            if m and not m.group(1).startswith("*("):
+                size = int(m.group(3), 16)
+                if size:
+                    entries.append((module_of(m.group(4)), symbol_of(m.group(1)), out_kind, size))
+                pending_input = None
+                continue
+            m = INPUT_NAME_RE.match(line)
+            if m and not m.group(1).startswith("*("):
+                pending_input = m.group(1)
+                continue
+            m = CONTINUATION_RE.match(line)
+            if m and pending_input is not None:
+                size = int(m.group(2), 16)
+                if size:
+                    entries.append((module_of(m.group(3)), symbol_of(pending_input), out_kind, size))
+                pending_input = None
+    if not started:
+        raise ValueError("%s is not a GNU ld map (no memory map section)" % path)
+    return entries
+
+
+def demangle(names):
+    tool = shutil.which("xtensa-esp32-elf-c++filt") or shutil.which("c++filt")
+    if tool is None or not names:
+        return {n: n for n in names}
+    res = subprocess.run([tool], input="\n".join(names), capture_output=True, text=True)
+    plain = res.stdout.splitlines()
+    if res.returncode != 0 or len(plain) != len(names):
+        return {n: n for n in names}
+    return dict(zip(names, plain))
+
+
+def tally(entries, key):
+    rows = {}
+    for e in entries:
+        row = rows.setdefault(key(e), {})
+        row[e[2]] = row.get(e[2], 0) + e[3]
+    return rows
+
+
+def region(row, name):
+    return sum(row.get(k, 0) for k in REGIONS[name])
+
+
+def parse_size(text):
+    m = re.match(r"^(0x[0-9a-fA-F]+|\d+)([KkMm]?)$", text.strip())
+    if not m:
+        raise ValueError("bad size %r" % text)
+    v = int(m.group(1), 0)
+    return v * {"": 1, "k": 1024, "m": 1024 * 1024}[m.group(2).lower()]
+
+
+# ---- platformio.ini ----
+
+def load_ini(path):
+    ini = configparser.ConfigParser(interpolation=None, inline_comment_prefixes=(";",), strict=False)
+    ini.read(path)
+    return ini
+
+
+def ini_get(ini, section, key, depth=0):
+    """Option of an environment, following `extends` and expanding ${section.key}."""
+    if depth > 8 or not ini.has_section(section):
+        return None
+    if ini.has_option(section, key):
+        value = ini.get(section, key)
+    else:
+        value = None
+        for parent in (ini.get(section, "extends", fallback="") or "").split(","):
+            parent = parent.strip()
+            if parent:
+                value = ini_get(ini, parent, key, depth + 1)
+                if value is not None:
+                    break
+        if value is None and section != "env" and ini.has_section("env"):
+            value = ini_get(ini, "env", key, depth + 1)
+        return value
+
+    def expand(m):
+        sec, opt = m.group(1).rsplit(".", 1)
+        return ini_get(ini, sec, opt, depth + 1) or ""
+    return re.sub(r"\$\{([^}]+\.[^}.]+)\}", expand, value)
+
+
+def app_partition(csv_path):
+    """(name, size) of the first app partition, None if the table is not in the project."""
+    if not os.path.exists(csv_path):
+        return None
+    with open(csv_path) as fh:
+        for line in fh:
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            cols = [c.strip() for c in line.split(",")]
+            if len(cols) >= 5 and cols[1] == "app":
+                return cols[0], parse_size(cols[4])
+    return None
+
+
+def parse_budget(text):
+    budget = []
+    for line in (text or "").splitlines():
+        line = line.split(";", 1)[0].strip()
+        if not line:
+            continue
+        parts = line.split()
+        if len(parts) != 3 or parts[1] not in REGIONS:
+            raise ValueError("custom_size_budget: expected '<pattern> <flash|iram|dram> <limit>', got %r" % line)
+        budget.append((parts[0], parts[1], parse_size(parts[2])))
+    return budget
+
+
+# ---- report ----
+
+def report(map_path, ini_path, env_name, top, symbols):
+    entries = parse_map(map_path)
+    names = demangle(sorted({e[1] for e in entries}))
+    entries = [(m, names[s], k, n) for m, s, k, n in entries]
+
+    modules = tally(entries, lambda e: e[0])
+    whole = tally(entries, lambda e: "total")["total"]
+
+    print("%s: image %d B (code %d, rodata %d, iram %d, data %d), static RAM %d B"
+          % (os.path.basename(map_path), region(whole, "flash"), whole.get("code", 0), whole.get("rodata", 0),
+             whole.get("iram", 0), whole.get("data", 0), region(whole, "dram")))
+    print()
+
+    rows = tally(entries, lambda e: (e[0], e[1])) if symbols else modules
+    label = "symbol" if symbols else "module"
+    ordered = sorted(rows.items(), key=lambda kv: -region(kv[1], "flash") - region(kv[1], "dram"))
+    print("%-56s %9s %8s %8s" % (label, "flash", "iram", "dram"))
+    for key, row in ordered[:top]:
+        name = "%s  %s" % key if symbols else key
+        print("%-56s %9d %8d %8d" % (name[:56], region(row, "flash"), region(row, "iram"), region(row, "dram")))
+    if len(ordered) > top:
+        rest = [r for _, r in ordered[top:]]
+        print("%-56s %9d %8d %8d" % ("(%d more)" % len(rest), sum(region(r, "flash") for r in rest),
+                                     sum(region(r, "iram") for r in rest), sum(region(r, "dram") for r in rest)))
+    print()
+
+    checks = []
+    if ini_path and env_name:
+        ini = load_ini(ini_path)
+        section = "env:" + env_name
+        if not ini.has_section(section):
+            raise ValueError("%s has no [%s]" % (ini_path, section))
+        table = ini_get(ini, section, "board_build.partitions")
+        if table:
+            app = app_partition(os.path.join(os.path.dirname(os.path.abspath(ini_path)), table))
+            if app:
+                checks.append(("total flash (%s of %s)" % (app[0], table), region(whole, "flash"), app[1]))
+        for pattern, reg, limit in parse_budget(ini_get(ini, section, "custom_size_budget")):
+            if pattern == "total":
+                used = region(whole, reg)
+            elif pattern.startswith("sym:"):
+                used = sum(e[3] for e in entries if e[2] in REGIONS[reg] and fnmatch.fnmatchcase(e[1], pattern[4:]))
+            else:
+                used = sum(region(row, reg) for mod, row in modules.items() if fnmatch.fnmatchcase(mod, pattern))
+            checks.append(("%s %s" % (pattern, reg), used, limit))
+
+    over = 0
+    if checks:
+        print("%-56s %9s %9s" % ("budget", "used", "limit"))
+        for name, used, limit in checks:
+            ok = used <= limit
+            over += not ok
+            print("%-56s %9d %9d  %s" % (name[:56], used, limit,
+                                          "ok (%.1f %%)" % (100.0 * used / limit) if ok and limit else
+                                          "ok" if ok else "OVER by %d B" % (used - limit)))
+    return 1 if over else 0
+
+
+def main(argv=None):
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("map", help="linker map (.pio/build/<env>/firmware.map)")
+    ap.add_argument("--ini", help="platformio.ini with the budget")
+    ap.add_argument("--env", help="environment whose budget and partition table apply")
+    ap.add_argument("--top", type=int, default=25, help="rows to list (default 25)")
+    ap.add_argument("--symbols", action="store_true", help="list symbols instead of modules")
+    args = ap.parse_args(argv)
+    try:
+        return report(args.map, args.ini, args.env, args.top, args.symbols)
+    except (OSError, ValueError) as e:
+        print("size_budget: %s" % e, file=sys.stderr)
+        return 2
+
+
+try:
+    Import("env")  # noqa: F821 (SCons builtin: present only when run by PlatformIO)
+    IN_PLATFORMIO = True
+except NameError:
+    IN_PLATFORMIO = False
+
+if IN_PLATFORMIO:
+    env.Append(LINKFLAGS=["-Wl,-Map,${BUILD_DIR}/${PROGNAME}.map"])  # noqa: F821
+    env.AddCustomTarget(  # noqa: F821
+        name="size_budget",
+        dependencies="$BUILD_DIR/${PROGNAME}.elf",
+        actions='"$PYTHONEXE" "$PROJECT_DIR/tools/size_budget.py" "$BUILD_DIR/${PROGNAME}.map" '
+                '--ini "$PROJECT_DIR/platformio.ini" --env "$PIOENV"',
+        title="Size budget",
+        description="Flash and RAM per module from the linker map, checked against custom_size_budget")
+elif __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,210 @@
+// Deterministic host test for the scanner's TimerWheel, driven by a virtual clock.
+//
+// Schedules (relative and absolute), re-arms and cancels random timers (1 ms .. 2 h, plus callbacks that
+// re-arm themselves) while the virtual clock jumps forward by random amounts, the
+// way loop() advances after a light sleep. Checks against a brute-force model that
+//   - every timer fires exactly once per arming, at wheel time == its expiry,
+//   - nothing fires early or is skipped by an advance() that passed its expiry,
+//   - timers fire in expiry order within one advance(),
+//   - nextDeadline() equals the earliest pending expiry,
+// starting just below the 32-bit millis() wrap. Then reports per-operation cost.
+//
+// Build and run from palgate_esp_scanner/:
+//   g++ -O2 -std=gnu++17 -Isrc/TimerWheel -o /tmp/timer_wheel_test
+//       tools/timer_wheel_test.cpp src/TimerWheel/TimerWheel.cpp
+//   /tmp/timer_wheel_test [steps] [seed]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "TimerWheel.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t TIMERS = 512;
+
+struct Model
+{
+    bool pending = false;
+    uint32_t expires = 0;
+    bool periodic = false;      // re-arms itself from the callback
+    uint32_t period = 0;
+};
+
+static TimerWheel g_wheel;
+static WheelTimer g_timers[TIMERS];
+static Model g_model[TIMERS];
+static uint32_t g_last_fired_at = 0;
+static bool g_fired_this_advance = false;
+static uint64_t g_fired = 0;
+static uint64_t g_failures = 0;
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        if (!(cond)) {                                      \
+            if (g_failures++ < 10) {                        \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+                printf(__VA_ARGS__);                        \
+                printf("\n");                               \
+            }                                               \
+        }                                                   \
+    } while (0)
+
+static void onFire(void* arg)
+{
+    size_t i = (size_t)(uintptr_t)arg;
+    Model& m = g_model[i];
+
+    CHECK(m.pending, "timer %zu fired while not armed", i);
+    CHECK(g_wheel.now() == m.expires, "timer %zu fired at %u, expected %u", i, g_wheel.now(), m.expires);
+    CHECK(!g_fired_this_advance || (int32_t)(m.expires - g_last_fired_at) >= 0,
+          "timer %zu out of order (%u after %u)", i, m.expires, g_last_fired_at);
+
+    g_last_fired_at = m.expires;
+    g_fired_this_advance = true;
+    m.pending = false;
+    ++g_fired;
+
+    if (m.periodic)
+    {
+        g_wheel.schedule(g_timers[i], m.period);
+        m.pending = true;
+        m.expires = g_wheel.now() + m.period;
+    }
+}
+
+static bool modelNextDeadline(uint32_t now, uint32_t& at)
+{
+    bool found = false;
+    for (const Model& m : g_model)
+    {
+        if (m.pending && (!found || (m.expires - now) < (at - now)))
+        {
+            at = m.expires;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static uint32_t randomDelay(std::mt19937& rng)
+{
+    // mostly loop-scale delays, some long background jobs
+    switch (rng() % 4)
+    {
+        case 0:  return 1 + rng() % 100;
+        case 1:  return 1 + rng() % 5000;
+        case 2:  return 1 + rng() % 300000;
+        default: return 1 + rng() % 7200000;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const uint32_t steps = (argc > 1) ? (uint32_t)strtoul(argv[1], nullptr, 10) : 200000;
+    const uint32_t seed = (argc > 2) ? (uint32_t)strtoul(argv[2], nullptr, 10) : 1;
+
+    std::mt19937 rng(seed);
+    uint32_t now = 0xFFFFFFFFu - 100000;     // cross the millis() wrap early
+    g_wheel.begin(now);
+
+    for (size_t i = 0; i < TIMERS; ++i)
+        g_timers[i] = WheelTimer(onFire, (void*)(uintptr_t)i);
+
+    uint64_t ops = 0;
+    uint64_t elapsed_ms = 0;
+    auto t0 = Clock::now();
+
+    for (uint32_t step = 0; step < steps; ++step)
+    {
+        // a few schedule / cancel operations per loop iteration
+        for (int k = 0; k < 3; ++k)
+        {
+            size_t i = rng() % TIMERS;
+            Model& m = g_model[i];
+            if (rng() % 4 == 0)
+            {
+                g_wheel.cancel(g_timers[i]);
+                m.pending = false;
+            }
+            else
+            {
+                uint32_t d = randomDelay(rng);
+                if (rng() % 2)
+                    g_wheel.schedule(g_timers[i], d);
+                else
+                    g_wheel.scheduleAt(g_timers[i], now + d);
+                m.pending = true;
+                m.expires = now + d;
+                m.periodic = (rng() % 8 == 0);
+                m.period = m.periodic ? 1 + rng() % 3000 : 0;
+            }
+            ++ops;
+        }
+
+        uint32_t expected = 0, actual = 0;
+        bool has_expected = modelNextDeadline(now, expected);
+        bool has_actual = g_wheel.nextDeadline(actual);
+        CHECK(has_expected == has_actual && (!has_expected || expected == actual),
+              "nextDeadline %u (%d), expected %u (%d)", actual, has_actual, expected, has_expected);
+
+        // loop() either spins (1 ms), wakes at the deadline, or sleeps past it
+        uint32_t jump;
+        switch (rng() % 3)
+        {
+            case 0:  jump = 1; break;
+            case 1:  jump = has_actual ? actual - now : 1; break;
+            default: jump = 1 + rng() % 4000; break;
+        }
+        now += jump;
+        elapsed_ms += jump;
+
+        g_fired_this_advance = false;
+        g_wheel.advance(now);
+        ++ops;
+
+        for (size_t i = 0; i < TIMERS; ++i)
+        {
+            const Model& m = g_model[i];
+            CHECK(!m.pending || (int32_t)(m.expires - now) > 0, "timer %zu (expiry %u) still pending at %u", i, m.expires, now);
+        }
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+
+    size_t model_pending = 0;
+    for (const Model& m : g_model)
+        model_pending += m.pending;
+    CHECK(model_pending == g_wheel.pendingCount(), "pending %zu, expected %zu", g_wheel.pendingCount(), model_pending);
+
+    printf("%u steps, %llu timers fired, %zu pending, virtual time %.1f h\n", steps,
+           (unsigned long long)g_fired, g_wheel.pendingCount(), (double)elapsed_ms / 3.6e6);
+    printf("%.0f ns per operation including the O(n) model checks\n", ns / (double)ops);
+
+    // raw cost without the model
+    TimerWheel w;
+    static WheelTimer bench[TIMERS];
+    w.begin(0);
+    uint32_t t = 0;
+    const uint32_t N = 2000000;
+    auto t1 = Clock::now();
+    for (uint32_t k = 0; k < N; ++k)
+        w.schedule(bench[k % TIMERS], 1 + (k * 2654435761u) % 10000);
+    double schedule_ns = std::chrono::duration<double, std::nano>(Clock::now() - t1).count() / N;
+    t1 = Clock::now();
+    size_t ran = 0;
+    for (uint32_t k = 0; k < 20000; ++k)
+        ran += w.advance(t += 1 + k % 3000);
+    double advance_ns = std::chrono::duration<double, std::nano>(Clock::now() - t1).count() / 20000;
+    printf("schedule %.1f ns, advance (avg 1.5 s jump) %.0f ns, %zu fired\n", schedule_ns, advance_ns, ran);
+
+    if (g_failures)
+    {
+        printf("%llu FAILURES\n", (unsigned long long)g_failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,517 @@
+// Handshake cost of the ways the scanner can authenticate the PalGate API host, on
+// Linux against a local TLS stand-in:
+//
+//   insecure      no verification (the firmware before api_pin)
+//   pinned        full handshake, then SHA-256 of the leaf's SubjectPublicKeyInfo
+//                 checked against SpkiPins (src/GateHttp), as MbedTlsTransport does
+//   pinned+resume the session of the last pinned handshake is offered; when the
+//                 server resumes it the pin check is skipped (the firmware default)
+//   full-chain    chain validation against a trust store (the system CA bundle plus
+//                 the stand-in's root) and a host name check
+//
+// The stand-in is an OpenSSL TLS 1.2 server on 127.0.0.1 with a throwaway root CA, an
+// intermediate and a leaf for api1.pal-es.com (RSA-2048 like the real host, --ec for
+// P-256); it sends leaf and intermediate, like a public web server. Every mode runs the
+// same number of connections; each is timed from TCP connect to the finished handshake
+// (wall clock) and by the client thread's CPU time, the part the ESP32 pays for itself.
+// The absolute numbers are a PC's, the ratios are what carries over.
+//
+// It also checks that pinning does its job: a server with another key is refused by
+// "pinned" and "full-chain", a set whose backup slot holds the key is accepted.
+//
+// Build and run from palgate_esp_scanner/:
+//   g++ -O2 -std=gnu++17 -pthread -Isrc/GateHttp -Isrc/TaskTopology -o /tmp/tls_pin_bench
+//       tools/tls_pin_bench.cpp src/GateHttp/GateHttp.cpp src/TaskTopology/TaskTopology.cpp -lssl -lcrypto
+//   /tmp/tls_pin_bench [--handshakes 500] [--ec] [--ca-file /etc/ssl/certs/ca-certificates.crt]
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include "GateHttp.h"
+#include "TaskTopology.h"
+
+struct Options
+{
+    uint32_t handshakes = 500;
+    bool ec = false;
+    const char* ca_file = "/etc/ssl/certs/ca-certificates.crt";
+};
+
+static const char* HOST = "api1.pal-es.com";
+
+
+//===========================================================
+// certificates
+//===========================================================
+
+static EVP_PKEY* newKey(bool ec)
+{
+    return ec ? EVP_EC_gen("P-256") : EVP_RSA_gen(2048);
+}
+
+static X509* issue(const char* cn, EVP_PKEY* key, X509* issuer, EVP_PKEY* issuer_key, bool ca, long serial)
+{
+    X509* crt = X509_new();
+    X509_set_version(crt, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(crt), serial);
+    X509_gmtime_adj(X509_getm_notBefore(crt), -60);
+    X509_gmtime_adj(X509_getm_notAfter(crt), 86400);
+    X509_set_pubkey(crt, key);
+    X509_NAME* name = X509_get_subject_name(crt);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)cn, -1, -1, 0);
+    X509_set_issuer_name(crt, issuer != nullptr ? X509_get_subject_name(issuer) : name);
+
+    X509V3_CTX v3;
+    X509V3_set_ctx_nodb(&v3);
+    X509V3_set_ctx(&v3, issuer != nullptr ? issuer : crt, crt, nullptr, nullptr, 0);
+    char san[96];
+    snprintf(san, sizeof(san), "DNS:%s", cn);
+    const char* exts[][2] = {
+        { "basicConstraints", ca ? "critical,CA:TRUE" : "CA:FALSE" },
+        { "keyUsage", ca ? "critical,keyCertSign,cRLSign" : "critical,digitalSignature,keyEncipherment" },
+        { "subjectAltName", ca ? nullptr : san },
+    };
+    for (auto& e : exts)
+    {
+        if (e[1] == nullptr)
+            continue;
+        X509_EXTENSION* ext = X509V3_EXT_conf(nullptr, &v3, e[0], e[1]);
+        X509_add_ext(crt, ext, -1);
+        X509_EXTENSION_free(ext);
+    }
+
+    X509_sign(crt, issuer_key != nullptr ? issuer_key : key, EVP_sha256());
+    return crt;
+}
+
+// SHA-256 of the DER SubjectPublicKeyInfo: what api_pin holds.
+static bool spkiSha256(X509* crt, uint8_t out[SpkiPins::DIGEST_LEN])
+{
+    unsigned char* der = nullptr;
+    int len = i2d_X509_PUBKEY(X509_get_X509_PUBKEY(crt), &der);
+    if (len <= 0)
+        return false;
+    SHA256(der, (size_t)len, out);
+    OPENSSL_free(der);
+    return true;
+}
+
+
+//===========================================================
+// stand-in server
+//===========================================================
+
+class StandIn
+{
+public:
+    // `chain` = leaf + intermediate, or a self-signed leaf alone (the impostor).
+    bool start(EVP_PKEY* key, X509* leaf, X509* intermediate)
+    {
+        m_ctx = SSL_CTX_new(TLS_server_method());
+        if (m_ctx == nullptr || !SSL_CTX_set_max_proto_version(m_ctx, TLS1_2_VERSION) ||
+            SSL_CTX_use_certificate(m_ctx, leaf) != 1 || SSL_CTX_use_PrivateKey(m_ctx, key) != 1 ||
+            (intermediate != nullptr && SSL_CTX_add1_chain_cert(m_ctx, intermediate) != 1))
+        {
+            return false;
+        }
+        // session cache and tickets stay at OpenSSL's defaults (both on), as on a web server
+
+        m_fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (bind(m_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(m_fd, 8) != 0 ||
+            getsockname(m_fd, (sockaddr*)&addr, &len) != 0)
+        {
+            return false;
+        }
+        m_port = ntohs(addr.sin_port);
+        m_thread = std::thread([this] { run(); });
+        return true;
+    }
+
+    void stop()
+    {
+        m_stop = true;
+        if (m_thread.joinable())
+            m_thread.join();
+        close(m_fd);
+        SSL_CTX_free(m_ctx);
+    }
+
+    uint16_t port() const { return m_port; }
+
+private:
+    void run()
+    {
+        while (!m_stop)
+        {
+            pollfd p = { m_fd, POLLIN, 0 };
+            if (poll(&p, 1, 50) <= 0)
+                continue;
+            int fd = accept(m_fd, nullptr, nullptr);
+            if (fd < 0)
+                continue;
+            SSL* ssl = SSL_new(m_ctx);
+            SSL_set_fd(ssl, fd);
+            if (SSL_accept(ssl) == 1)
+            {
+                char c;
+                SSL_read(ssl, &c, 1);   // until the client's close_notify
+                SSL_shutdown(ssl);
+            }
+            SSL_free(ssl);
+            ERR_clear_error();
+            close(fd);
+        }
+    }
+
+    SSL_CTX* m_ctx = nullptr;
+    int m_fd = -1;
+    uint16_t m_port = 0;
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+};
+
+
+//===========================================================
+// client
+//===========================================================
+
+enum class Mode
+{
+    Insecure,
+    Pinned,
+    PinnedResume,
+    FullChain,
+};
+
+static const char* modeName(Mode m)
+{
+    switch (m)
+    {
+        case Mode::Insecure:     return "insecure";
+        case Mode::Pinned:       return "pinned";
+        case Mode::PinnedResume: return "pinned+resume";
+        case Mode::FullChain:    return "full-chain";
+    }
+    return "?";
+}
+
+class Client
+{
+public:
+    // `store`: trust store for FullChain (owned by the caller).
+    bool begin(Mode mode, const SpkiPins& pins, X509_STORE* store)
+    {
+        m_mode = mode;
+        m_pins = pins;
+        m_ctx = SSL_CTX_new(TLS_client_method());
+        if (m_ctx == nullptr || !SSL_CTX_set_max_proto_version(m_ctx, TLS1_2_VERSION))
+            return false;
+        if (mode == Mode::FullChain)
+        {
+            X509_STORE_up_ref(store);
+            SSL_CTX_set_cert_store(m_ctx, store);
+            SSL_CTX_set_verify(m_ctx, SSL_VERIFY_PEER, nullptr);
+        }
+        else
+        {
+            SSL_CTX_set_verify(m_ctx, SSL_VERIFY_NONE, nullptr);
+        }
+        // sessions are kept by hand (as MbedTlsTransport does), not by OpenSSL's cache
+        SSL_CTX_set_session_cache_mode(m_ctx, SSL_SESS_CACHE_OFF);
+        return true;
+    }
+
+    void end()
+    {
+        SSL_SESSION_free(m_session);
+        SSL_CTX_free(m_ctx);
+    }
+
+    // One connection: TCP connect, handshake, authentication, close.
+    bool handshake(uint16_t port, bool& resumed)
+    {
+        resumed = false;
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || ::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            return false;
+        }
+
+        SSL* ssl = SSL_new(m_ctx);
+        SSL_set_fd(ssl, fd);
+        SSL_set_tlsext_host_name(ssl, HOST);
+        if (m_mode == Mode::FullChain)
+            SSL_set1_host(ssl, HOST);
+        if (m_mode == Mode::PinnedResume && m_session != nullptr)
+            SSL_set_session(ssl, m_session);
+
+        bool ok = SSL_connect(ssl) == 1;
+        if (ok && (m_mode == Mode::Pinned || m_mode == Mode::PinnedResume))
+        {
+            resumed = SSL_session_reused(ssl) == 1;
+            if (!resumed)
+            {
+                ok = keyPinned(ssl);
+                if (ok && m_mode == Mode::PinnedResume)
+                {
+                    SSL_SESSION_free(m_session);
+                    m_session = SSL_get1_session(ssl);
+                }
+            }
+        }
+        if (!ok && m_session != nullptr)
+        {
+            SSL_SESSION_free(m_session);
+            m_session = nullptr;
+        }
+
+        if (ok)
+            SSL_shutdown(ssl);
+        SSL_free(ssl);
+        ERR_clear_error();
+        close(fd);
+        return ok;
+    }
+
+private:
+    bool keyPinned(SSL* ssl) const
+    {
+        X509* leaf = SSL_get0_peer_certificate(ssl);
+        uint8_t digest[SpkiPins::DIGEST_LEN];
+        return leaf != nullptr && spkiSha256(leaf, digest) && m_pins.matches(digest);
+    }
+
+    Mode m_mode = Mode::Insecure;
+    SpkiPins m_pins = {};
+    SSL_CTX* m_ctx = nullptr;
+    SSL_SESSION* m_session = nullptr;
+};
+
+
+//===========================================================
+// bench
+//===========================================================
+
+static uint64_t threadCpuNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static double percentile(std::vector<double>& v, double p)
+{
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * (double)v.size()))];
+}
+
+struct Result
+{
+    uint32_t ok = 0;
+    uint32_t resumed = 0;
+    double wall_p50_us = 0, wall_p90_us = 0, cpu_mean_us = 0;
+};
+
+static Result run(Mode mode, const SpkiPins& pins, X509_STORE* store, uint16_t port, uint32_t n)
+{
+    Result r;
+    Client client;
+    if (!client.begin(mode, pins, store))
+        return r;
+
+    bool resumed;
+    for (int i = 0; i < 10; ++i)    // warm-up: code paths, caches, the first session
+        client.handshake(port, resumed);
+
+    std::vector<double> wall;
+    double cpu_total = 0;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        uint64_t c0 = threadCpuNs();
+        uint64_t t0 = TaskTopology::nowUs();
+        bool ok = client.handshake(port, resumed);
+        uint64_t t1 = TaskTopology::nowUs();
+        uint64_t c1 = threadCpuNs();
+        if (!ok)
+            continue;
+        ++r.ok;
+        r.resumed += resumed;
+        wall.push_back((double)(t1 - t0));
+        cpu_total += (double)(c1 - c0) / 1000.0;
+    }
+    client.end();
+
+    if (r.ok != 0)
+    {
+        r.wall_p50_us = percentile(wall, 0.50);
+        r.wall_p90_us = percentile(wall, 0.90);
+        r.cpu_mean_us = cpu_total / r.ok;
+    }
+    return r;
+}
+
+static bool accepted(Mode mode, const SpkiPins& pins, X509_STORE* store, uint16_t port)
+{
+    Client client;
+    bool resumed = false;
+    bool ok = client.begin(mode, pins, store) && client.handshake(port, resumed);
+    client.end();
+    return ok;
+}
+
+static void usage()
+{
+    printf("usage: tls_pin_bench [--handshakes N] [--ec] [--ca-file PEM]\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* a = argv[i];
+        if (!strcmp(a, "--ec"))
+        {
+            opt.ec = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 2;
+        }
+        const char* v = argv[++i];
+        if (!strcmp(a, "--handshakes")) opt.handshakes = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--ca-file")) opt.ca_file = v;
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (opt.handshakes == 0)
+    {
+        usage();
+        return 2;
+    }
+
+    // the stand-in's PKI: root -> intermediate -> api1.pal-es.com, and an impostor
+    EVP_PKEY* root_key = newKey(opt.ec);
+    EVP_PKEY* mid_key = newKey(opt.ec);
+    EVP_PKEY* leaf_key = newKey(opt.ec);
+    EVP_PKEY* fake_key = newKey(opt.ec);
+    X509* root = issue("PalGate bench root", root_key, nullptr, nullptr, true, 1);
+    X509* mid = issue("PalGate bench intermediate", mid_key, root, root_key, true, 2);
+    X509* leaf = issue(HOST, leaf_key, mid, mid_key, false, 3);
+    X509* fake = issue(HOST, fake_key, nullptr, nullptr, false, 4);
+
+    // pins as they would go into config.h: the real key, no backup
+    SpkiPins pins = {};
+    spkiSha256(leaf, pins.sha256[0]);
+    SpkiPins rotated = {};              // the key in use is the backup slot's
+    spkiSha256(fake, rotated.sha256[0]);
+    spkiSha256(leaf, rotated.sha256[1]);
+
+    // trust store: a realistic bundle plus the stand-in's root
+    uint64_t s0 = TaskTopology::nowUs();
+    X509_STORE* store = X509_STORE_new();
+    bool bundle = X509_STORE_load_file(store, opt.ca_file) == 1;
+    ERR_clear_error();
+    X509_STORE_add_cert(store, root);
+    uint64_t s1 = TaskTopology::nowUs();
+    STACK_OF(X509_OBJECT)* objs = X509_STORE_get0_objects(store);
+    int anchors = objs != nullptr ? sk_X509_OBJECT_num(objs) : 0;
+
+    StandIn server, impostor;
+    if (!server.start(leaf_key, leaf, mid) || !impostor.start(fake_key, fake, nullptr))
+    {
+        printf("cannot set up OpenSSL\n");
+        return 1;
+    }
+
+    char pin_hex[2 * SpkiPins::DIGEST_LEN + 1];
+    for (size_t i = 0; i < SpkiPins::DIGEST_LEN; ++i)
+        snprintf(pin_hex + 2 * i, 3, "%02x", pins.sha256[0][i]);
+    printf("%u handshakes per mode, %s keys, TLS 1.2, chain: leaf + intermediate\n", opt.handshakes, opt.ec ? "P-256" : "RSA-2048");
+    printf("  api_pin %s\n", pin_hex);
+    printf("  trust store: %d anchors (%s%s), loaded in %.1f ms\n\n", anchors, bundle ? opt.ca_file : "bundle not found",
+           bundle ? " + bench root" : ", bench root only", (s1 - s0) / 1000.0);
+
+    bool failed = false;
+    printf("  %-14s %8s %8s %12s %12s %14s\n", "mode", "ok", "resumed", "wall p50 us", "wall p90 us", "client CPU us");
+    double insecure_cpu = 0;
+    for (Mode m : { Mode::Insecure, Mode::Pinned, Mode::PinnedResume, Mode::FullChain })
+    {
+        Result r = run(m, pins, store, server.port(), opt.handshakes);
+        if (m == Mode::Insecure)
+            insecure_cpu = r.cpu_mean_us;
+        printf("  %-14s %8u %8u %12.0f %12.0f %14.0f", modeName(m), r.ok, r.resumed, r.wall_p50_us, r.wall_p90_us, r.cpu_mean_us);
+        if (m != Mode::Insecure && insecure_cpu > 0)
+            printf("  (x%.2f)", r.cpu_mean_us / insecure_cpu);
+        printf("\n");
+        failed |= r.ok != opt.handshakes;
+        if (m == Mode::PinnedResume && r.resumed != r.ok)
+        {
+            printf("    not every handshake was resumed\n");
+            failed = true;
+        }
+    }
+
+    // pinning has to refuse another key, and honour the backup slot
+    struct Check { const char* what; Mode mode; const SpkiPins& pins; uint16_t port; bool expect; };
+    const Check checks[] = {
+        { "pinned refuses another key", Mode::Pinned, pins, impostor.port(), false },
+        { "pinned+resume refuses another key", Mode::PinnedResume, pins, impostor.port(), false },
+        { "full-chain refuses a self-signed key", Mode::FullChain, pins, impostor.port(), false },
+        { "backup pin accepted after a key rotation", Mode::Pinned, rotated, server.port(), true },
+    };
+    printf("\n");
+    for (const Check& c : checks)
+    {
+        bool ok = accepted(c.mode, c.pins, store, c.port) == c.expect;
+        printf("  %-42s %s\n", c.what, ok ? "ok" : "FAILED");
+        failed |= !ok;
+    }
+
+    server.stop();
+    impostor.stop();
+    X509_STORE_free(store);
+    for (X509* c : { root, mid, leaf, fake })
+        X509_free(c);
+    for (EVP_PKEY* k : { root_key, mid_key, leaf_key, fake_key })
+        EVP_PKEY_free(k);
+
+    printf("\n%s\n", failed ? "FAILED" : "OK");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,383 @@
+// Host benchmark for the scanner's task topology (src/TaskTopology) under a synthetic
+// advertisement flood.
+//
+// Three pthreads mirror the firmware tasks and talk only through the same SpscQueue /
+// TaskSignal primitives:
+//   ingest   generates advertisements at --rate per second (a --match fraction carry the
+//            target UUID, the rest are other iBeacons or non-iBeacon payloads), filters
+//            them like the firmware's iBeacon match and queues sightings, rate-limited by --repeat-ms
+//   control  drains sightings, debounces (--debounce-ms) and queues trigger requests.
+//            "window" pickup drains at the end of each --window-ms scan window (the firmware
+//            before ingest signalled control); "notify" blocks on a TaskSignal that ingest
+//            raises with every sighting, and drains at once
+//   net      simulates one gate request per trigger: --tls-cpu-ms of CPU work (the
+//            mbedTLS handshake) followed by --http-wait-ms of waiting for the server
+//
+// Each run is repeated with two pinnings: "split" (ingest on core 0, control + net on
+// core 1, as on the ESP32) and "shared" (everything on core 0), for each pickup mode
+// (--pickup window|notify|both, default both). Reports per-thread CPU
+// utilisation (CLOCK_THREAD_CPUTIME_ID and TaskStats busy time), queue high water and
+// drops, how far ingest fell behind the advertisement schedule, and latency percentiles
+// for advert -> control pickup and advert -> net start.
+//
+// Build and run from palgate_esp_scanner/:
+//   g++ -O2 -std=gnu++17 -pthread -Isrc/TaskTopology -I../shared/IBeaconProtocol
+//       -o /tmp/topology_bench tools/topology_bench.cpp src/TaskTopology/TaskTopology.cpp
+//   /tmp/topology_bench [--rate 20000] [--match 0.02] [--seconds 5] [--pickup both] ...
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
+
+#include "IBeaconProtocol.h"
+#include "TaskTopology.h"
+
+struct Options
+{
+    uint32_t rate = 20000;          // advertisements per second
+    double match = 0.02;            // fraction carrying the target UUID
+    uint32_t seconds = 5;
+    uint32_t repeat_ms = 0;         // ingest rate limit per beacon (firmware: SIGHTING_REPEAT_MS); 0 = unthrottled flood
+    uint32_t window_ms = 50;        // control drains at the end of each scan window
+    uint32_t debounce_ms = 100;
+    uint32_t tls_cpu_ms = 30;
+    uint32_t http_wait_ms = 50;
+    bool window_pickup = true;      // run with control draining at the end of each scan window
+    bool notify_pickup = true;      // run with ingest waking control per sighting
+};
+
+struct Sighting
+{
+    uint64_t at_us;
+};
+
+struct Request
+{
+    uint64_t detected_at_us;
+};
+
+struct Run
+{
+    const Options* opt;
+    bool notify = false;            // this run's pickup: ingest signals control
+    std::atomic<bool> stop{false};
+    std::atomic<int> finished{0};
+
+    SpscQueue<Sighting, 16> sightings;
+    SpscQueue<Request, 4> requests;
+    TaskSignal net_signal;
+    TaskSignal control_signal;
+
+    TaskStats ingest_stats, control_stats, net_stats;
+    uint64_t ingest_cpu_us = 0, control_cpu_us = 0, net_cpu_us = 0;
+
+    // written by one thread each, read after all have finished
+    uint64_t adverts = 0, matched = 0, max_lag_us = 0;
+    std::vector<uint32_t> pickup_us;        // advert -> control drains it
+    std::vector<uint32_t> trigger_us;       // advert -> net starts the request
+    uint32_t triggers = 0;
+};
+
+static uint64_t threadCpuUs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void spinUntil(uint64_t t_us)
+{
+    while (TaskTopology::nowUs() < t_us)
+    {
+    }
+}
+
+static void sleepUs(uint64_t us)
+{
+    timespec ts = { (time_t)(us / 1000000ULL), (long)(us % 1000000ULL) * 1000L };
+    nanosleep(&ts, nullptr);
+}
+
+// Same decision as the firmware's iBeacon decoder and MatchSighting(): iBeacon framing, then the 16-byte UUID.
+static bool isTarget(const uint8_t* mfg, size_t len)
+{
+    return IBeacon::isIBeacon(mfg, len) &&
+           std::memcmp(mfg + IBeacon::MFG_UUID_OFFSET, IBeacon::BEACON_UUID.bytes, IBeacon::UUID_LEN) == 0;
+}
+
+static void IngestTask(void* arg)
+{
+    Run& run = *static_cast<Run*>(arg);
+    const Options& opt = *run.opt;
+    std::mt19937 rng(1);
+
+    // a small pool of payloads: target, foreign iBeacons, and other manufacturer data
+    const size_t POOL = 64;
+    uint8_t pool[POOL][IBeacon::MFG_LEN];
+    for (size_t i = 0; i < POOL; ++i)
+    {
+        std::memcpy(pool[i], IBeacon::BEACON_ADV.bytes + IBeacon::ADV_MFG_OFFSET, IBeacon::MFG_LEN);
+        if (i % 2)
+            pool[i][IBeacon::MFG_UUID_OFFSET + i % IBeacon::UUID_LEN] ^= 0x5A;  // another vendor's beacon
+        else if (i > 0)
+            pool[i][0] = 0x06;                                                   // not Apple
+    }
+
+    const uint64_t period_ns = 1000000000ULL / opt.rate;
+    const uint32_t match_cut = (uint32_t)(opt.match * 4294967295.0);
+    const uint64_t start_us = TaskTopology::nowUs();
+    const uint64_t cpu0 = threadCpuUs();
+    uint64_t last_forward_us = 0;
+    bool forwarded = false;
+
+    for (uint64_t n = 0; !run.stop.load(std::memory_order_relaxed); ++n)
+    {
+        // the radio delivers advertisements on its own schedule; lag is how far behind we are
+        uint64_t due_us = start_us + n * period_ns / 1000ULL;
+        uint64_t now_us = TaskTopology::nowUs();
+        if (now_us < due_us)
+        {
+            // ahead of the radio: yield the core like the BT task blocking on its queue
+            sleepUs(due_us - now_us);
+            now_us = TaskTopology::nowUs();
+        }
+        else if (now_us - due_us > run.max_lag_us)
+        {
+            run.max_lag_us = now_us - due_us;
+        }
+
+        BusyScope busy(run.ingest_stats);
+        size_t pick = (rng() <= match_cut) ? 0 : 1 + rng() % (POOL - 1);
+        ++run.adverts;
+
+        if (!isTarget(pool[pick], IBeacon::MFG_LEN))
+            continue;
+        ++run.matched;
+
+        if (forwarded && now_us - last_forward_us < opt.repeat_ms * 1000ULL)
+            continue;
+        if (run.sightings.push(Sighting{now_us}) && run.notify)
+            run.control_signal.notify();
+        forwarded = true;
+        last_forward_us = now_us;
+    }
+
+    run.ingest_cpu_us = threadCpuUs() - cpu0;
+    run.finished.fetch_add(1);
+}
+
+static void ControlTask(void* arg)
+{
+    Run& run = *static_cast<Run*>(arg);
+    const Options& opt = *run.opt;
+    const uint64_t cpu0 = threadCpuUs();
+    uint64_t last_trigger_us = 0;
+    bool triggered = false;
+    uint64_t window_end_us = TaskTopology::nowUs() + opt.window_ms * 1000ULL;
+
+    while (!run.stop.load(std::memory_order_relaxed))
+    {
+        if (run.notify)
+        {
+            // the firmware's WaitForWork(): until a sighting or the window's end
+            uint64_t now_us = TaskTopology::nowUs();
+            if (now_us < window_end_us)
+                run.control_signal.wait((uint32_t)((window_end_us - now_us + 999) / 1000));
+            if (TaskTopology::nowUs() >= window_end_us)
+                window_end_us += opt.window_ms * 1000ULL;
+        }
+        else
+        {
+            sleepUs(opt.window_ms * 1000ULL);   // scan window
+        }
+
+        BusyScope busy(run.control_stats);
+        uint64_t now_us = TaskTopology::nowUs();
+        Sighting s;
+        bool detected = false;
+        uint64_t detected_at_us = 0;
+        while (run.sightings.pop(s))
+        {
+            run.pickup_us.push_back((uint32_t)(now_us - s.at_us));
+            if (!detected)
+            {
+                detected = true;
+                detected_at_us = s.at_us;
+            }
+        }
+
+        if (!detected || (triggered && now_us - last_trigger_us <= opt.debounce_ms * 1000ULL))
+            continue;
+        triggered = true;
+        last_trigger_us = now_us;
+
+        if (run.requests.push(Request{detected_at_us}))
+            run.net_signal.notify();
+    }
+
+    run.control_cpu_us = threadCpuUs() - cpu0;
+    run.finished.fetch_add(1);
+}
+
+static void NetTask(void* arg)
+{
+    Run& run = *static_cast<Run*>(arg);
+    const Options& opt = *run.opt;
+    const uint64_t cpu0 = threadCpuUs();
+
+    while (!run.stop.load(std::memory_order_relaxed))
+    {
+        run.net_signal.wait(100);
+
+        Request req;
+        while (run.requests.pop(req))
+        {
+            BusyScope busy(run.net_stats);
+            uint64_t now_us = TaskTopology::nowUs();
+            run.trigger_us.push_back((uint32_t)(now_us - req.detected_at_us));
+            ++run.triggers;
+
+            spinUntil(now_us + opt.tls_cpu_ms * 1000ULL);   // handshake: CPU bound
+            sleepUs(opt.http_wait_ms * 1000ULL);             // server round trip: idle
+        }
+    }
+
+    run.net_cpu_us = threadCpuUs() - cpu0;
+    run.finished.fetch_add(1);
+}
+
+static uint32_t percentile(std::vector<uint32_t>& v, double p)
+{
+    if (v.empty())
+        return 0;
+    size_t k = std::min(v.size() - 1, (size_t)(p * (double)(v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+static void printLatency(const char* name, std::vector<uint32_t>& v)
+{
+    printf("  %-22s n=%-6zu p50 %8.2f ms  p99 %8.2f ms  max %8.2f ms\n", name, v.size(),
+           percentile(v, 0.50) / 1e3, percentile(v, 0.99) / 1e3, percentile(v, 1.0) / 1e3);
+}
+
+template <typename Q>
+static void printQueue(const char* name, const Q& q)
+{
+    printf("  queue %-16s capacity %2zu  high water %2u  dropped %u\n", name, Q::capacity(), q.highWater(), q.dropped());
+}
+
+static bool runTopology(const char* label, const Options& opt, bool notify, int ingest_core, int app_core)
+{
+    Run run;
+    run.opt = &opt;
+    run.notify = notify;
+    run.pickup_us.reserve((size_t)opt.seconds * 1000000 / std::max<uint32_t>(opt.window_ms, 1) * 16 + 16);
+    run.trigger_us.reserve((size_t)opt.seconds * 1000 + 16);
+
+    const uint64_t wall0 = TaskTopology::nowUs();
+    bool ok = TaskTopology::startPinned("ingest", IngestTask, &run, ingest_core, 0, 256 * 1024) &&
+              TaskTopology::startPinned("control", ControlTask, &run, app_core, 0, 256 * 1024) &&
+              TaskTopology::startPinned("net", NetTask, &run, app_core, 0, 256 * 1024);
+    if (!ok)
+    {
+        fprintf(stderr, "failed to start threads\n");
+        return false;
+    }
+
+    sleepUs((uint64_t)opt.seconds * 1000000ULL);
+    run.stop.store(true);
+    run.net_signal.notify();
+    run.control_signal.notify();
+    while (run.finished.load() != 3)
+        sleepUs(1000);
+    const double wall_us = (double)(TaskTopology::nowUs() - wall0);
+
+    printf("%s, %s pickup (ingest on core %d, control + net on core %d)\n", label, notify ? "notify" : "window",
+           ingest_core, app_core);
+    printf("  %llu adverts (%.0f/s), %llu matched, %u triggers, ingest max lag %.2f ms\n",
+           (unsigned long long)run.adverts, run.adverts / (wall_us / 1e6), (unsigned long long)run.matched,
+           run.triggers, run.max_lag_us / 1e3);
+
+    struct Row { const char* name; uint64_t cpu_us; const TaskStats& stats; };
+    const Row rows[] = { {"ingest", run.ingest_cpu_us, run.ingest_stats},
+                         {"control", run.control_cpu_us, run.control_stats},
+                         {"net", run.net_cpu_us, run.net_stats} };
+    for (const Row& r : rows)
+        printf("  task %-8s cpu %5.1f %%  busy %5.1f %%  runs %u\n", r.name, 100.0 * r.cpu_us / wall_us,
+               100.0 * r.stats.busyMs() * 1e3 / wall_us, r.stats.runs());
+
+    printQueue("sightings", run.sightings);
+    printQueue("requests", run.requests);
+    printLatency("advert -> pickup", run.pickup_us);
+    printLatency("advert -> net start", run.trigger_us);
+    printf("\n");
+    return true;
+}
+
+static void usage()
+{
+    printf("usage: topology_bench [--rate N] [--match F] [--seconds N] [--repeat-ms N] [--window-ms N]\n"
+           "                      [--debounce-ms N] [--tls-cpu-ms N] [--http-wait-ms N] [--pickup window|notify|both]\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!v)
+        {
+            usage();
+            return 2;
+        }
+        if (!strcmp(a, "--rate")) opt.rate = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--match")) opt.match = strtod(v, nullptr);
+        else if (!strcmp(a, "--seconds")) opt.seconds = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--repeat-ms")) opt.repeat_ms = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--window-ms")) opt.window_ms = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--debounce-ms")) opt.debounce_ms = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--tls-cpu-ms")) opt.tls_cpu_ms = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--http-wait-ms")) opt.http_wait_ms = (uint32_t)strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--pickup"))
+        {
+            opt.window_pickup = !strcmp(v, "window") || !strcmp(v, "both");
+            opt.notify_pickup = !strcmp(v, "notify") || !strcmp(v, "both");
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+        ++i;
+    }
+    if (opt.rate == 0 || opt.seconds == 0 || opt.window_ms == 0 || (!opt.window_pickup && !opt.notify_pickup))
+    {
+        usage();
+        return 2;
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%u adverts/s, %.1f %% target, window %u ms, debounce %u ms, TLS %u ms CPU + %u ms wait, %ld cores\n\n",
+           opt.rate, opt.match * 100.0, opt.window_ms, opt.debounce_ms, opt.tls_cpu_ms, opt.http_wait_ms, cores);
+
+    for (bool notify : { false, true })
+    {
+        if (!(notify ? opt.notify_pickup : opt.window_pickup))
+            continue;
+        if (!runTopology("split", opt, notify, TaskTopology::RADIO_CORE, TaskTopology::APP_CORE))
+            return 1;
+        if (!runTopology("shared", opt, notify, TaskTopology::RADIO_CORE, TaskTopology::RADIO_CORE))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""
+Merge scanner span-trace dumps and report the critical path per stage.
+
+Inputs are either the JSON served by GET /trace or serial console logs that
+contain the "---- BEGIN TRACE ----" / "---- END TRACE ----" block printed
+after sending 't'. Each input becomes its own process lane in the merged
+trace, so dumps from several scanners (or several reboots) can be opened
+side by side in chrome://tracing or https://ui.perfetto.dev.
+
+The pipeline is strictly sequential (adv -> loop pickup -> token -> begin ->
+TLS -> request -> response -> LED), so every stage is on the critical path;
+the report shows how much of each event's end-to-end time each stage took.
+
+usage: trace_merge.py dump1.json scanner2.log ... [-o merged.json]
+"""
+
+import argparse
+import json
+import os
+import statistics
+import sys
+
+STAGE_ORDER = [
+    "adv_received", "loop_pickup", "token_generated", "http_begin",
+    "tls_handshake", "request_sent", "first_response_byte", "led_on",
+]
+
+
+def load_dump(path):
+    with open(path, "r", errors="replace") as f:
+        text = f.read()
+
+    begin = text.find("---- BEGIN TRACE ----")
+    if begin >= 0:
+        end = text.find("---- END TRACE ----", begin)
+        text = text[begin + len("---- BEGIN TRACE ----"):end if end >= 0 else None]
+
+    return json.loads(text.strip())
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    k = (len(values) - 1) * p
+    lo = int(k)
+    hi = min(lo + 1, len(values) - 1)
+    return values[lo] + (values[hi] - values[lo]) * (k - lo)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("dumps", nargs="+", help="trace JSON files or serial logs")
+    ap.add_argument("-o", "--output", help="write the merged Chrome trace here")
+    args = ap.parse_args()
+
+    merged = []
+    traces = {}     # (pid, tid) -> [event, ...]
+
+    for pid, path in enumerate(args.dumps, start=1):
+        dump = load_dump(path)
+        device = dump.get("otherData", {}).get("device") or os.path.basename(path)
+        merged.append({"name": "process_name", "ph": "M", "pid": pid, "args": {"name": device}})
+
+        for ev in dump.get("traceEvents", []):
+            ev = dict(ev, pid=pid)
+            merged.append(ev)
+            traces.setdefault((pid, ev["tid"]), []).append(ev)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump({"displayTimeUnit": "ms", "traceEvents": merged}, f)
+
+    stage_us = {name: [] for name in STAGE_ORDER}
+    end_to_end = []
+    dominant = {name: 0 for name in STAGE_ORDER}
+
+    for events in traces.values():
+        events.sort(key=lambda e: e["ts"])
+        if len(events) < 2:
+            continue
+        total = events[-1]["ts"] - events[0]["ts"]
+        end_to_end.append(total)
+
+        worst = None
+        for ev in events:
+            dur = ev.get("dur", 0)
+            if ev["name"] in stage_us and ev.get("ph") == "X":
+                stage_us[ev["name"]].append(dur)
+                if worst is None or dur > worst[1]:
+                    worst = (ev["name"], dur)
+        if worst:
+            dominant[worst[0]] += 1
+
+    if not end_to_end:
+        print("no complete traces found", file=sys.stderr)
+        return 1
+
+    total_sum = float(sum(end_to_end))
+    print("%d traces, end-to-end ms: p50=%.1f p90=%.1f max=%.1f" % (
+        len(end_to_end), percentile(end_to_end, 0.5) / 1000, percentile(end_to_end, 0.9) / 1000,
+        max(end_to_end) / 1000))
+    print()
+    print("%-20s %6s %9s %9s %9s %7s %9s" % ("stage (until next)", "n", "p50 ms", "p90 ms", "max ms", "share", "dominant"))
+
+    for name in STAGE_ORDER:
+        v = stage_us[name]
+        if not v:
+            continue
+        print("%-20s %6d %9.1f %9.1f %9.1f %6.1f%% %9d" % (
+            name, len(v), statistics.median(v) / 1000, percentile(v, 0.9) / 1000, max(v) / 1000,
+            100.0 * sum(v) / total_sum, dominant[name]))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
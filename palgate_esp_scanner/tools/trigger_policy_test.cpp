@@ -0,0 +1,523 @@
+// Host test for the scanner's per-beacon trigger policy (src/TriggerPolicy), driven by
+// replayed multi-car traces.
+//
+// A trace is one sighting per line, "<ms> <major> <minor>", in the order HandleDetection()
+// sees them. The driver feeds each one to TriggerPolicy::admit() and plays every open it
+// allows on two paths: the GATT write reports after --local ms, the HTTPS request after
+// --cloud ms (finished() per path), unless the trace marks the open as not sent.
+//
+//   1. Scripted traces (two cars together, a second car after the first one's window, a
+//      slow open, an open that never went out, ...) must produce exactly the expected
+//      opens and coalesced arrivals.
+//   2. Random fleets: cars arrive at random, are heard every ~500 ms while they wait and
+//      leave. Every verdict is checked against a plain std::map model of the same rules,
+//      and no arrival may be held back by another car. The old global debounce is replayed
+//      on the same traces for comparison.
+//   3. More beacons than entries: the table stays bounded; reports the cost per sighting.
+//
+// A recorded trace in the same format can be replayed with its verdicts printed.
+//
+// Build and run from palgate_esp_scanner/:
+//   g++ -O2 -std=gnu++17 -Isrc/TriggerPolicy -o /tmp/trigger_policy_test
+//       tools/trigger_policy_test.cpp src/TriggerPolicy/TriggerPolicy.cpp
+//   /tmp/trigger_policy_test [--cooldown 10000] [--coalesce 4000] [--local 800] [--cloud 1500] [trace.txt]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TriggerPolicy.h"
+
+using Clock = std::chrono::steady_clock;
+using Verdict = TriggerPolicy::Verdict;
+
+struct Options
+{
+    uint32_t cooldown_ms = 10000;   // debounce_ms
+    uint32_t coalesce_ms = 4000;
+    uint32_t local_ms = 800;        // open -> GATT result
+    uint32_t cloud_ms = 1500;       // open -> HTTPS result
+};
+
+struct Sighting
+{
+    uint32_t ms;
+    uint16_t major;
+    uint16_t minor;
+    bool unsent;        // if this sighting opens, the open does not go out (no time sync, lost arbitration)
+};
+
+static uint64_t g_failures = 0;
+
+#define CHECK(cond, ...)                                    \
+    do {                                                    \
+        if (!(cond)) {                                      \
+            if (g_failures++ < 10) {                        \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+                printf(__VA_ARGS__);                        \
+                printf("\n");                               \
+            }                                               \
+        }                                                   \
+    } while (0)
+
+static uint32_t identityOf(const Sighting& s)
+{
+    return ((uint32_t)s.major << 16) | s.minor;
+}
+
+
+/**
+ * @brief Replays a trace through TriggerPolicy, delivering each open's path results on time.
+ */
+class Replay
+{
+public:
+    explicit Replay(const Options& opt) : m_opt(opt) {}
+
+    Verdict feed(const Sighting& s)
+    {
+        deliver(s.ms);
+        TriggerPolicy::Decision d = m_policy.admit(identityOf(s), s.ms, { m_opt.cooldown_ms, m_opt.coalesce_ms });
+        if (d.verdict == Verdict::Open)
+        {
+            uint32_t trace_id = ++m_next_trace;
+            m_policy.launched(d.slot, trace_id, s.unsent ? 0 : 2);
+            if (!s.unsent)
+            {
+                m_results.push_back({ s.ms + m_opt.local_ms, trace_id });
+                m_results.push_back({ s.ms + m_opt.cloud_ms, trace_id });
+            }
+        }
+        return d.verdict;
+    }
+
+    TriggerPolicy& policy() { return m_policy; }
+
+private:
+    struct Result
+    {
+        uint32_t at_ms;
+        uint32_t trace_id;
+    };
+
+    void deliver(uint32_t now_ms)
+    {
+        for (size_t i = 0; i < m_results.size();)
+        {
+            if ((int32_t)(now_ms - m_results[i].at_ms) >= 0)
+            {
+                m_policy.finished(m_results[i].trace_id);
+                m_results[i] = m_results.back();
+                m_results.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    Options m_opt;
+    TriggerPolicy m_policy;
+    std::vector<Result> m_results;
+    uint32_t m_next_trace = 0;
+};
+
+
+/**
+ * @brief The same rules without a table: one std::map entry per beacon, forever.
+ */
+class Model
+{
+public:
+    explicit Model(const Options& opt) : m_opt(opt) {}
+
+    Verdict feed(const Sighting& s)
+    {
+        for (auto& b : m_beacons)
+        {
+            if (b.second.in_flight && (int32_t)(s.ms - b.second.done_ms) >= 0)
+                b.second.in_flight = false;
+        }
+
+        Beacon& b = m_beacons[identityOf(s)];
+        if (b.in_flight)
+            return Verdict::InFlight;
+        if (b.cooling && s.ms - b.last_ms < m_opt.cooldown_ms)
+            return Verdict::Cooldown;
+
+        b.last_ms = s.ms;
+        b.cooling = true;
+        if (m_open != nullptr && ((m_open->in_flight && m_open->seq == m_seq) || s.ms - m_open_ms < m_opt.coalesce_ms))
+        {
+            b.seq = m_seq;
+            return Verdict::Coalesced;
+        }
+
+        b.seq = ++m_seq;
+        m_open = &b;
+        m_open_ms = s.ms;
+        if (s.unsent)
+        {
+            for (auto& other : m_beacons)
+            {
+                if (&other.second != &b && other.second.seq == b.seq)
+                    other.second.cooling = false;
+            }
+            m_open = nullptr;
+        }
+        else
+        {
+            b.in_flight = true;
+            b.done_ms = s.ms + std::max(m_opt.local_ms, m_opt.cloud_ms);
+        }
+        return Verdict::Open;
+    }
+
+private:
+    struct Beacon
+    {
+        uint32_t last_ms = 0;
+        uint32_t done_ms = 0;
+        uint32_t seq = 0;
+        bool cooling = false;
+        bool in_flight = false;
+    };
+
+    Options m_opt;
+    std::map<uint32_t, Beacon> m_beacons;
+    Beacon* m_open = nullptr;
+    uint32_t m_open_ms = 0;
+    uint32_t m_seq = 0;
+};
+
+
+// ---- trace parsing ----
+
+static bool parseTrace(const char* text, std::vector<Sighting>& out)
+{
+    const char* p = text;
+    while (*p)
+    {
+        const char* eol = strchr(p, '\n');
+        std::string line(p, eol ? (size_t)(eol - p) : strlen(p));
+        p = eol ? eol + 1 : p + line.size();
+
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.resize(hash);
+        unsigned ms, major, minor;
+        char flag[16] = "";
+        int n = sscanf(line.c_str(), "%u %u %u %15s", &ms, &major, &minor, flag);
+        if (n <= 0)
+            continue;
+        if (n < 3 || major > 0xFFFF || minor > 0xFFFF || (n == 4 && strcmp(flag, "unsent") != 0))
+            return false;
+        out.push_back({ ms, (uint16_t)major, (uint16_t)minor, n == 4 });
+    }
+    return true;
+}
+
+// "O1/1@0 C1/2@300 ...": the opens and coalesced arrivals of a replay
+static std::string replayLog(const Options& opt, const std::vector<Sighting>& trace)
+{
+    Replay replay(opt);
+    std::string log;
+    char buf[48];
+    for (const Sighting& s : trace)
+    {
+        Verdict v = replay.feed(s);
+        if (v != Verdict::Open && v != Verdict::Coalesced)
+            continue;
+        snprintf(buf, sizeof(buf), "%s%c%u/%u@%u", log.empty() ? "" : " ", v == Verdict::Open ? 'O' : 'C',
+                 (unsigned)s.major, (unsigned)s.minor, (unsigned)s.ms);
+        log += buf;
+    }
+    return log;
+}
+
+// The code this replaces: one debounce for all beacons. `stranded` counts arrivals it
+// ignored although the gate was not opening for anyone (no open within coalesce_ms).
+static uint32_t globalDebounceOpens(const Options& opt, const std::vector<Sighting>& trace, uint32_t* stranded = nullptr)
+{
+    bool triggered = false;
+    uint32_t last_ms = 0;
+    uint32_t opens = 0;
+    std::map<uint32_t, uint32_t> last_heard;
+    for (const Sighting& s : trace)
+    {
+        auto it = last_heard.find(identityOf(s));
+        bool fresh = it == last_heard.end() || s.ms - it->second > opt.cooldown_ms;
+        last_heard[identityOf(s)] = s.ms;
+
+        if (triggered && s.ms - last_ms <= opt.cooldown_ms)
+        {
+            if (stranded != nullptr && fresh && s.ms - last_ms >= opt.coalesce_ms)
+                ++*stranded;
+            continue;
+        }
+        triggered = true;
+        last_ms = s.ms;
+        ++opens;
+    }
+    return opens;
+}
+
+
+// ---- 1. scripted traces ----
+
+// a car heard every 500 ms from `from` to `to`, as trace lines
+static std::string car(uint32_t from, uint32_t to, unsigned major, unsigned minor)
+{
+    std::string out;
+    char line[48];
+    for (uint32_t t = from; t <= to; t += 500)
+    {
+        snprintf(line, sizeof(line), "%u %u %u\n", (unsigned)t, major, minor);
+        out += line;
+    }
+    return out;
+}
+
+static std::vector<Sighting> merged(const std::string& text)
+{
+    std::vector<Sighting> trace;
+    parseTrace(text.c_str(), trace);
+    std::stable_sort(trace.begin(), trace.end(), [](const Sighting& a, const Sighting& b) { return a.ms < b.ms; });
+    return trace;
+}
+
+static void runScripts(const Options& base)
+{
+    // the expectations assume the defaults
+    Options opt;
+    opt.local_ms = base.local_ms;
+    opt.cloud_ms = std::max<uint32_t>(base.cloud_ms, 1500);
+
+    const std::string two_together = car(0, 8000, 1, 1) + car(300, 9000, 1, 2);
+    const std::string second_later = car(0, 8000, 1, 1) + car(6000, 14000, 1, 2);
+    const std::string three_staggered = car(0, 5000, 1, 1) + car(2000, 7000, 1, 2) + car(3900, 9000, 1, 3);
+    const std::string returns = car(0, 3000, 1, 1) + car(15000, 18000, 1, 1);
+    const std::string within_cooldown = car(0, 3000, 1, 1) + car(6000, 9500, 1, 1);
+    const std::string slow_open = "0 1 1\n5000 1 2\n5500 1 2\n";
+    const std::string unsent = "0 1 1 unsent\n300 1 2\n800 1 2\n";
+
+    struct Case
+    {
+        const char* name;
+        std::string trace;
+        const char* expected;
+        uint32_t cloud_ms;
+    };
+    const Case cases[] = {
+        { "two cars together", two_together, "O1/1@0 C1/2@300", opt.cloud_ms },
+        { "second car after the window", second_later, "O1/1@0 O1/2@6000", opt.cloud_ms },
+        { "three cars, staggered", three_staggered, "O1/1@0 C1/2@2000 C1/3@3900", opt.cloud_ms },
+        { "same car returns", returns, "O1/1@0 O1/1@15000", opt.cloud_ms },
+        { "same car within its cooldown", within_cooldown, "O1/1@0", opt.cloud_ms },
+        { "slow open still in flight", slow_open, "O1/1@0 C1/2@5000", 6000 },
+        { "open that never went out", unsent, "O1/1@0 O1/2@300", opt.cloud_ms },
+    };
+
+    printf("scripted traces (cooldown %u ms, coalesce %u ms):\n", opt.cooldown_ms, opt.coalesce_ms);
+    for (const Case& c : cases)
+    {
+        Options o = opt;
+        o.cloud_ms = c.cloud_ms;
+        std::vector<Sighting> trace = merged(c.trace);
+        std::string log = replayLog(o, trace);
+        CHECK(log == c.expected, "%s: got \"%s\", expected \"%s\"", c.name, log.c_str(), c.expected);
+        printf("  %-30s %-28s (global debounce: %u open%s)\n", c.name, log.c_str(), globalDebounceOpens(o, trace),
+               globalDebounceOpens(o, trace) == 1 ? "" : "s");
+    }
+    printf("\n");
+}
+
+
+// ---- 2. random fleets against the model ----
+
+static std::vector<Sighting> randomFleet(std::mt19937& rng, uint32_t cars, uint32_t duration_ms, uint32_t& arrivals)
+{
+    std::vector<Sighting> trace;
+    std::exponential_distribution<double> gap(1.0 / 9000.0);      // one arrival every ~9 s
+    std::uniform_int_distribution<uint32_t> dwell(2000, 20000);
+    std::uniform_int_distribution<uint32_t> jitter(0, 200);
+    arrivals = 0;
+    for (double t = 0; t < duration_ms; t += gap(rng))
+    {
+        uint16_t minor = (uint16_t)(rng() % cars);
+        uint32_t from = (uint32_t)t;
+        uint32_t to = from + dwell(rng);
+        for (uint32_t ms = from; ms < to; ms += 500 + jitter(rng))
+        {
+            if (rng() % 10 != 0)    // a tenth of the sightings is lost
+                trace.push_back({ ms, 7, minor, rng() % 100 == 0 });
+        }
+        ++arrivals;
+    }
+    std::stable_sort(trace.begin(), trace.end(), [](const Sighting& a, const Sighting& b) { return a.ms < b.ms; });
+    return trace;
+}
+
+static void runFleets(const Options& opt, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    const uint32_t fleets = 200;
+    uint64_t sightings = 0, opens = 0, coalesced = 0, legacy_opens = 0;
+    uint32_t legacy_stranded = 0;
+    uint32_t arrivals_total = 0;
+
+    for (uint32_t f = 0; f < fleets; ++f)
+    {
+        uint32_t arrivals = 0;
+        std::vector<Sighting> trace = randomFleet(rng, 2 + f % 12, 30 * 60 * 1000, arrivals);
+        arrivals_total += arrivals;
+
+        Replay replay(opt);
+        Model model(opt);
+        std::map<uint32_t, uint32_t> last_heard;
+        for (const Sighting& s : trace)
+        {
+            Verdict got = replay.feed(s);
+            Verdict want = model.feed(s);
+            CHECK(got == want, "fleet %u at %u ms, beacon %u: %s, model says %s", f, s.ms, (unsigned)s.minor,
+                  TriggerPolicy::verdictName(got), TriggerPolicy::verdictName(want));
+
+            // a beacon not heard for longer than its cooldown is a new arrival: it opens or joins an open
+            auto it = last_heard.find(identityOf(s));
+            bool fresh = it == last_heard.end() || s.ms - it->second > opt.cooldown_ms;
+            CHECK(!fresh || got == Verdict::Open || got == Verdict::Coalesced, "fleet %u at %u ms: arrival of beacon %u held back (%s)",
+                  f, s.ms, (unsigned)s.minor, TriggerPolicy::verdictName(got));
+            last_heard[identityOf(s)] = s.ms;
+
+            ++sightings;
+            opens += (got == Verdict::Open);
+            coalesced += (got == Verdict::Coalesced);
+            CHECK(replay.policy().live(s.ms) <= TriggerPolicy::SLOTS, "more live entries than slots");
+        }
+        CHECK(replay.policy().recycled() == 0, "fleet %u: entries recycled with only %u beacons", f, 2 + f % 12);
+
+        // the global debounce on the same trace
+        legacy_opens += globalDebounceOpens(opt, trace, &legacy_stranded);
+    }
+
+    printf("random fleets: %u fleets of 2..13 beacons, %u arrivals, %llu sightings\n", fleets, arrivals_total,
+           (unsigned long long)sightings);
+    printf("  per-beacon policy: %llu opens, %llu joins of an open under way, no arrival held back\n", (unsigned long long)opens,
+           (unsigned long long)coalesced);
+    printf("  global debounce:   %llu opens on the same traces, %u arrivals ignored while no gate was opening\n\n",
+           (unsigned long long)legacy_opens, legacy_stranded);
+}
+
+
+// ---- 3. more beacons than entries ----
+
+static void runOverflow(const Options& opt)
+{
+    std::mt19937 rng(7);
+    std::vector<Sighting> trace;
+    const uint32_t beacons = 200;
+    for (uint32_t i = 0; i < 1000000; ++i)
+        trace.push_back({ i * 20, 9, (uint16_t)(rng() % beacons), false });
+
+    Replay replay(opt);
+    uint64_t opens = 0;
+    size_t max_live = 0;
+    auto t0 = Clock::now();
+    for (const Sighting& s : trace)
+    {
+        opens += (replay.feed(s) == Verdict::Open);
+        if ((s.ms & 0xFFF) == 0)
+            max_live = std::max(max_live, replay.policy().live(s.ms));
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (double)trace.size();
+
+    CHECK(max_live <= TriggerPolicy::SLOTS, "%zu live entries", max_live);
+    printf("%u beacons on %zu entries (%zu bytes): %.1f ns per sighting incl. the driver, %u entries recycled, %llu opens\n\n",
+           beacons, TriggerPolicy::SLOTS, sizeof(TriggerPolicy), ns, replay.policy().recycled(),
+           (unsigned long long)opens);
+}
+
+
+static int replayFile(const Options& opt, const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (f == nullptr)
+    {
+        printf("cannot open %s\n", path);
+        return 2;
+    }
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        text.append(buf, n);
+    fclose(f);
+
+    std::vector<Sighting> trace;
+    if (!parseTrace(text.c_str(), trace))
+    {
+        printf("%s: expected lines \"<ms> <major> <minor> [unsent]\"\n", path);
+        return 2;
+    }
+
+    Replay replay(opt);
+    for (const Sighting& s : trace)
+    {
+        Verdict v = replay.feed(s);
+        printf("%8u  %5u/%-5u  %s\n", (unsigned)s.ms, (unsigned)s.major, (unsigned)s.minor, TriggerPolicy::verdictName(v));
+    }
+    printf("\nglobal debounce would have opened %u time(s)\n", globalDebounceOpens(opt, trace));
+    return 0;
+}
+
+static void usage()
+{
+    printf("usage: trigger_policy_test [--cooldown MS] [--coalesce MS] [--local MS] [--cloud MS] [trace.txt]\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    const char* file = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* a = argv[i];
+        if (a[0] != '-')
+        {
+            file = a;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 2;
+        }
+        uint32_t v = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        if (!strcmp(a, "--cooldown")) opt.cooldown_ms = v;
+        else if (!strcmp(a, "--coalesce")) opt.coalesce_ms = v;
+        else if (!strcmp(a, "--local")) opt.local_ms = v;
+        else if (!strcmp(a, "--cloud")) opt.cloud_ms = v;
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+
+    if (file != nullptr)
+        return replayFile(opt, file);
+
+    runScripts(opt);
+    runFleets(opt, 1);
+    runOverflow(opt);
+
+    printf(g_failures ? "FAILED (%llu)\n" : "OK\n", (unsigned long long)g_failures);
+    return g_failures ? 1 : 0;
+}
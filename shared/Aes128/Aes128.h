@@ -0,0 +1,17 @@
+#ifndef AES128_H
+#define AES128_H
+
+#include <stdint.h>
+
+// Compact AES-128 (round keys derived on the fly, 512 B of S-box tables).
+// Shared by the scanner's PalGate token generator and the beacon rolling code.
+namespace Aes128
+{
+    // FIPS-197 forward cipher: out = E_key(in). in and out may alias.
+    void encrypt(const uint8_t key[16], const uint8_t in[16], uint8_t out[16]);
+
+    // FIPS-197 inverse cipher: out = D_key(in). in and out may alias.
+    void decrypt(const uint8_t key[16], const uint8_t in[16], uint8_t out[16]);
+}
+
+#endif // #ifndef AES128_H
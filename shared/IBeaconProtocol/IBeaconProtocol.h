@@ -0,0 +1,154 @@
+#ifndef IBEACON_PROTOCOL_H
+#define IBEACON_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * iBeacon wire format and the PalGate beacon identity, shared by the beacon and the scanner.
+ *
+ * Header-only and constexpr: the beacon's advertisement bytes and the scanner's default
+ * match key are both generated at compile time from PALGATE_BEACON_UUID, so the two
+ * projects cannot disagree on byte order.
+ *
+ * The UUID is transmitted in RFC 4122 string order (big-endian), like every iBeacon.
+ * To use a different identity, define PALGATE_BEACON_UUID / _MAJOR / _MINOR in the
+ * build_flags of both platformio.ini files (or set target_uuid at runtime via /config).
+ */
+
+#ifndef PALGATE_BEACON_UUID
+#define PALGATE_BEACON_UUID "12345678-1234-1234-1234-123456789abc"
+#endif
+#ifndef PALGATE_BEACON_MAJOR
+#define PALGATE_BEACON_MAJOR 1
+#endif
+#ifndef PALGATE_BEACON_MINOR
+#define PALGATE_BEACON_MINOR 1
+#endif
+#ifndef PALGATE_BEACON_TX_POWER
+#define PALGATE_BEACON_TX_POWER -59     // calibrated RSSI at 1 m
+#endif
+
+namespace IBeacon
+{
+    static constexpr size_t UUID_LEN = 16;
+
+    // Manufacturer-specific data, as returned by BLEAdvertisedDevice::getManufacturerData()
+    static constexpr uint8_t COMPANY_LO = 0x4C;     // Apple, 0x004C little-endian
+    static constexpr uint8_t COMPANY_HI = 0x00;
+    static constexpr uint8_t TYPE = 0x02;
+    static constexpr uint8_t LENGTH = 0x15;         // bytes after the length byte
+
+    static constexpr size_t MFG_UUID_OFFSET = 4;
+    static constexpr size_t MFG_MAJOR_OFFSET = MFG_UUID_OFFSET + UUID_LEN;     // big-endian
+    static constexpr size_t MFG_MINOR_OFFSET = MFG_MAJOR_OFFSET + 2;           // big-endian
+    static constexpr size_t MFG_TX_OFFSET = MFG_MINOR_OFFSET + 2;              // signed
+    static constexpr size_t MFG_LEN = MFG_TX_OFFSET + 1;
+
+    // Full legacy advertising payload: Flags AD, then the manufacturer-specific AD
+    static constexpr uint8_t FLAGS_BLE_ONLY = 0x04;  // BR/EDR not supported
+    static constexpr size_t ADV_MFG_OFFSET = 3 + 2;  // flags AD + mfg AD length/type
+    static constexpr size_t ADV_LEN = ADV_MFG_OFFSET + MFG_LEN;
+
+    static_assert(LENGTH == MFG_LEN - 4, "iBeacon length byte covers UUID, major, minor, tx power");
+    static_assert(MFG_LEN == 25, "iBeacon manufacturer data is 25 bytes");
+    static_assert(ADV_LEN <= 31, "legacy advertising payload is at most 31 bytes");
+
+    struct Uuid
+    {
+        uint8_t bytes[UUID_LEN];
+        bool valid;
+    };
+
+    struct Advertisement
+    {
+        uint8_t bytes[ADV_LEN];
+    };
+
+    constexpr int hexValue(char ch)
+    {
+        return (ch >= '0' && ch <= '9') ? ch - '0' :
+               (ch >= 'a' && ch <= 'f') ? ch - 'a' + 10 :
+               (ch >= 'A' && ch <= 'F') ? ch - 'A' + 10 : -1;
+    }
+
+    /**
+     * @brief Parse 32 hex digits ('-' separators ignored) in string order.
+     *        Usable at compile time; `valid` is false on any other input.
+     */
+    constexpr Uuid parseUuid(const char* text)
+    {
+        Uuid u{};
+        size_t n = 0;
+        for (const char* p = text; *p; ++p)
+        {
+            if (*p == '-')
+                continue;
+
+            int v = hexValue(*p);
+            if (v < 0 || n >= 2 * UUID_LEN)
+                return Uuid{};
+
+            u.bytes[n / 2] = (n % 2 == 0) ? uint8_t(v << 4) : uint8_t(u.bytes[n / 2] | v);
+            ++n;
+        }
+        u.valid = (n == 2 * UUID_LEN);
+        return u;
+    }
+
+    /**
+     * @brief The exact advertising payload for an iBeacon, in over-the-air order.
+     */
+    constexpr Advertisement makeAdvertisement(const Uuid& uuid, uint16_t major, uint16_t minor, int8_t tx_power)
+    {
+        Advertisement a{};
+        a.bytes[0] = 2;                             // Flags AD
+        a.bytes[1] = 0x01;
+        a.bytes[2] = FLAGS_BLE_ONLY;
+        a.bytes[3] = uint8_t(1 + MFG_LEN);          // Manufacturer Specific Data AD
+        a.bytes[4] = 0xFF;
+
+        uint8_t* m = a.bytes + ADV_MFG_OFFSET;
+        m[0] = COMPANY_LO;
+        m[1] = COMPANY_HI;
+        m[2] = TYPE;
+        m[3] = LENGTH;
+        for (size_t i = 0; i < UUID_LEN; ++i)
+            m[MFG_UUID_OFFSET + i] = uuid.bytes[i];
+        m[MFG_MAJOR_OFFSET] = uint8_t(major >> 8);
+        m[MFG_MAJOR_OFFSET + 1] = uint8_t(major);
+        m[MFG_MINOR_OFFSET] = uint8_t(minor >> 8);
+        m[MFG_MINOR_OFFSET + 1] = uint8_t(minor);
+        m[MFG_TX_OFFSET] = uint8_t(tx_power);
+        return a;
+    }
+
+    /**
+     * @brief True if `mfg` is iBeacon manufacturer data (Apple company id, type, length).
+     */
+    inline bool isIBeacon(const uint8_t* mfg, size_t len)
+    {
+        return len >= MFG_LEN && mfg[0] == COMPANY_LO && mfg[1] == COMPANY_HI &&
+               mfg[2] == TYPE && mfg[3] == LENGTH;
+    }
+
+    inline uint16_t major(const uint8_t* mfg) { return uint16_t((mfg[MFG_MAJOR_OFFSET] << 8) | mfg[MFG_MAJOR_OFFSET + 1]); }
+    inline uint16_t minor(const uint8_t* mfg) { return uint16_t((mfg[MFG_MINOR_OFFSET] << 8) | mfg[MFG_MINOR_OFFSET + 1]); }
+    inline int8_t txPower(const uint8_t* mfg) { return int8_t(mfg[MFG_TX_OFFSET]); }
+
+
+    // The PalGate beacon: advertised by the beacon, default match key of the scanner
+    static constexpr Uuid BEACON_UUID = parseUuid(PALGATE_BEACON_UUID);
+    static_assert(BEACON_UUID.valid, "PALGATE_BEACON_UUID must be 32 hex digits");
+
+    static constexpr Advertisement BEACON_ADV =
+        makeAdvertisement(BEACON_UUID, PALGATE_BEACON_MAJOR, PALGATE_BEACON_MINOR, PALGATE_BEACON_TX_POWER);
+
+    static_assert(BEACON_ADV.bytes[ADV_MFG_OFFSET] == COMPANY_LO && BEACON_ADV.bytes[ADV_MFG_OFFSET + 3] == LENGTH,
+                  "manufacturer data starts after the flags AD");
+    static_assert(BEACON_ADV.bytes[ADV_MFG_OFFSET + MFG_UUID_OFFSET] == BEACON_UUID.bytes[0] &&
+                  BEACON_ADV.bytes[ADV_LEN - 1] == uint8_t(int8_t(PALGATE_BEACON_TX_POWER)),
+                  "UUID first, tx power last");
+}
+
+#endif // #ifndef IBEACON_PROTOCOL_H
@@ -0,0 +1,226 @@
+#include "PalLog.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+namespace PalLog
+{
+
+// Bounded MPMC ring (Vyukov): each slot's sequence number says whose turn it is,
+// so producers on any task claim with one CAS and never wait on the consumer.
+struct Slot
+{
+    std::atomic<uint32_t> seq;
+    Entry entry;
+};
+
+static Slot s_ring[QUEUE_SIZE];
+static std::atomic<uint32_t> s_head(0);         // next ticket for producers
+static std::atomic<uint32_t> s_tail(0);         // next ticket for the drain task
+static std::atomic<uint32_t> s_written(0);      // tickets before this one are in the sink
+static std::atomic<uint32_t> s_dropped(0);         // not yet reported by the drain task
+static std::atomic<uint32_t> s_dropped_total(0);
+static std::atomic<bool> s_unflushed(false);    // sink got bytes since the last flush()
+static std::atomic<bool> s_ring_ready(false);
+static SinkFn s_sink = nullptr;
+
+static const char LEVEL_CHARS[] = { '?', 'E', 'W', 'I', 'D' };
+
+#ifdef ARDUINO
+static TaskHandle_t s_task = nullptr;
+
+static void defaultSink(const char* data, size_t len)
+{
+    Serial.write(reinterpret_cast<const uint8_t*>(data), len);
+}
+#else
+static void defaultSink(const char* data, size_t len)
+{
+    fwrite(data, 1, len, stdout);
+    fflush(stdout);
+}
+#endif
+
+static void initRing()
+{
+    bool expected = false;
+    if (!s_ring_ready.compare_exchange_strong(expected, true))
+        return;
+    for (uint32_t i = 0; i < QUEUE_SIZE; ++i)
+        s_ring[i].seq.store(i, std::memory_order_relaxed);
+}
+
+uint32_t nowMs()
+{
+#ifdef ARDUINO
+    return millis();
+#else
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+Entry* acquire(uint32_t& ticket)
+{
+    initRing();
+
+    uint32_t pos = s_head.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        Slot& slot = s_ring[pos & (QUEUE_SIZE - 1)];
+        int32_t diff = (int32_t)(slot.seq.load(std::memory_order_acquire) - pos);
+
+        if (diff == 0)
+        {
+            if (s_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                ticket = pos;
+                return &slot.entry;
+            }
+        }
+        else if (diff < 0)
+        {
+            s_dropped.fetch_add(1, std::memory_order_relaxed);
+            s_dropped_total.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        else
+        {
+            pos = s_head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void publish(uint32_t ticket)
+{
+    s_ring[ticket & (QUEUE_SIZE - 1)].seq.store(ticket + 1, std::memory_order_release);
+#ifdef ARDUINO
+    if (s_task != nullptr)
+        xTaskNotifyGive(s_task);
+#endif
+}
+
+// Render and write everything that is ready. Single consumer.
+static size_t drain()
+{
+    size_t n = 0;
+    char line[160];
+
+    for (;;)
+    {
+        uint32_t pos = s_tail.load(std::memory_order_relaxed);
+        Slot& slot = s_ring[pos & (QUEUE_SIZE - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+            break;
+
+        Entry e = slot.entry;   // copy out so the slot can be reused while we format
+        slot.seq.store(pos + QUEUE_SIZE, std::memory_order_release);
+        s_tail.store(pos + 1, std::memory_order_relaxed);
+
+        uint8_t lvl = static_cast<uint8_t>(e.level);
+        int prefix = snprintf(line, sizeof(line), "[%7lu.%03lu] %c ",
+                              (unsigned long)(e.ts_ms / 1000), (unsigned long)(e.ts_ms % 1000),
+                              LEVEL_CHARS[lvl < sizeof(LEVEL_CHARS) ? lvl : 0]);
+        int body = e.render(e, line + prefix, sizeof(line) - prefix - 1);
+        size_t len = prefix + ((body < 0) ? 0 : (size_t)body);
+        if (len > sizeof(line) - 2)
+            len = sizeof(line) - 2;   // truncated line
+        line[len++] = '\n';
+
+        s_sink(line, len);
+        s_unflushed.store(true, std::memory_order_relaxed);
+        s_written.store(pos + 1, std::memory_order_release);   // only now may flush() return
+        ++n;
+    }
+
+    uint32_t lost = s_dropped.exchange(0, std::memory_order_relaxed);
+    if (lost)
+    {
+        int len = snprintf(line, sizeof(line), "[log] %lu message(s) dropped\n", (unsigned long)lost);
+        s_sink(line, (size_t)len);
+    }
+
+    return n;
+}
+
+#ifdef ARDUINO
+static void drainTask(void*)
+{
+    for (;;)
+    {
+        drain();
+        // sleep until a producer publishes (timeout only guards a missed notify)
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    }
+}
+#endif
+
+void begin(SinkFn sink)
+{
+    initRing();
+    s_sink = sink ? sink : defaultSink;
+
+#ifdef ARDUINO
+    if (s_task == nullptr)
+        xTaskCreate(drainTask, "log", 3072, nullptr, tskIDLE_PRIORITY + 1, &s_task);
+#else
+    static std::atomic<bool> s_started(false);
+    if (!s_started.exchange(true))
+    {
+        std::thread([] {
+            for (;;)
+            {
+                if (drain() == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }).detach();
+    }
+#endif
+}
+
+size_t pending()
+{
+    // s_written, not s_tail: the drain task frees the slot before it writes the line
+    return s_head.load(std::memory_order_relaxed) - s_written.load(std::memory_order_acquire);
+}
+
+bool needsFlush()
+{
+    return pending() != 0 || s_unflushed.load(std::memory_order_relaxed);
+}
+
+void flush()
+{
+    if (s_sink == nullptr)
+        return; // begin() not called: nothing drains the ring
+
+    if (!needsFlush())
+        return; // nothing logged since the last flush: no UART wait at all
+
+    while (pending() != 0)
+    {
+#ifdef ARDUINO
+        if (s_task != nullptr)
+            xTaskNotifyGive(s_task);
+        vTaskDelay(1);
+#else
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+    }
+
+#ifdef ARDUINO
+    Serial.flush(); // wait for the UART FIFO to empty
+#endif
+    s_unflushed.store(false, std::memory_order_relaxed);
+}
+
+uint32_t dropped()
+{
+    return s_dropped_total.load(std::memory_order_relaxed);
+}
+
+} // namespace PalLog
@@ -0,0 +1,222 @@
+#ifndef PAL_LOG_H
+#define PAL_LOG_H
+
+// Asynchronous, compile-time-levelled logging shared by the scanner and the beacon.
+//
+//   LOG_E / LOG_W / LOG_I / LOG_D ("printf format", args...)
+//
+// Levels above PAL_LOG_LEVEL expand to nothing: arguments are not evaluated and no
+// code is emitted. Enabled calls do not format anything on the caller's task: they
+// copy the format pointer (the "format id" — literals live in flash) and the raw
+// argument bytes into a lock-free ring. A low-priority task renders and writes them.
+// When the ring is full the message is dropped and counted, never blocking the caller.
+//
+// Strings are copied by value (truncated to the entry's argument space), so passing
+// String::c_str() of a temporary is safe.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <tuple>
+#include <type_traits>
+
+#define PAL_LOG_LEVEL_NONE   0
+#define PAL_LOG_LEVEL_ERROR  1
+#define PAL_LOG_LEVEL_WARN   2
+#define PAL_LOG_LEVEL_INFO   3
+#define PAL_LOG_LEVEL_DEBUG  4
+
+#ifndef PAL_LOG_LEVEL
+#define PAL_LOG_LEVEL PAL_LOG_LEVEL_INFO
+#endif
+
+namespace PalLog
+{
+
+enum class Level : uint8_t { Error = 1, Warn = 2, Info = 3, Debug = 4 };
+
+static const size_t QUEUE_SIZE = 32;        // entries, power of two
+static const size_t ARG_BYTES = 96;         // packed argument space per entry
+
+struct Entry;
+typedef int (*RenderFn)(const Entry& e, char* out, size_t len);
+
+struct Entry
+{
+    RenderFn render;
+    const char* fmt;
+    uint32_t ts_ms;
+    Level level;
+    uint16_t used;                  // bytes packed (may exceed ARG_BYTES when truncated)
+    uint8_t args[ARG_BYTES];
+};
+
+// Where rendered lines go. Defaults to Serial (stdout on the host).
+typedef void (*SinkFn)(const char* data, size_t len);
+
+// Start the drain task. Messages logged before begin() are kept and printed once it runs.
+void begin(SinkFn sink = nullptr);
+
+// Number of messages queued but not yet written.
+size_t pending();
+
+// True when lines are queued or written but not yet confirmed out of the UART.
+bool needsFlush();
+
+// Block until the queue is drained and the sink has finished transmitting.
+// Returns immediately when nothing was logged since the last flush.
+void flush();
+
+// Messages dropped because the ring was full.
+uint32_t dropped();
+
+// Internal: reserve a slot, returns nullptr when full.
+Entry* acquire(uint32_t& ticket);
+void publish(uint32_t ticket);
+uint32_t nowMs();
+
+// Compile-time printf format checking for the macros (never called at runtime).
+inline void checkFormat(const char*, ...) __attribute__((format(printf, 1, 2)));
+inline void checkFormat(const char*, ...) {}
+
+
+//===========================================================
+// argument packing
+//===========================================================
+
+template <typename T, typename Enable = void>
+struct Arg;
+
+// integers, enums, pointers: stored as-is
+template <typename T>
+struct Arg<T, typename std::enable_if<(std::is_integral<T>::value || std::is_enum<T>::value ||
+                                       (std::is_pointer<T>::value &&
+                                        !std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>::value))>::type>
+{
+    typedef T type;
+    static void put(Entry& e, T v)
+    {
+        if (e.used + sizeof(T) <= ARG_BYTES) { memcpy(e.args + e.used, &v, sizeof(T)); }
+        e.used += sizeof(T);
+    }
+    static T get(const Entry& e, size_t& off)
+    {
+        T v{};
+        if (off + sizeof(T) <= ARG_BYTES) memcpy(&v, e.args + off, sizeof(T));
+        off += sizeof(T);
+        return v;
+    }
+};
+
+// floating point: stored as double, which is what printf expects anyway
+template <typename T>
+struct Arg<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    typedef double type;
+    static void put(Entry& e, T v)
+    {
+        double d = v;
+        if (e.used + sizeof(d) <= ARG_BYTES) memcpy(e.args + e.used, &d, sizeof(d));
+        e.used += sizeof(d);
+    }
+    static double get(const Entry& e, size_t& off)
+    {
+        double d = 0;
+        if (off + sizeof(d) <= ARG_BYTES) memcpy(&d, e.args + off, sizeof(d));
+        off += sizeof(d);
+        return d;
+    }
+};
+
+// C strings: copied inline, NUL-terminated, truncated to the space left
+template <typename T>
+struct Arg<T, typename std::enable_if<std::is_pointer<T>::value &&
+                                      std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>::value>::type>
+{
+    typedef const char* type;
+    static void put(Entry& e, const char* s)
+    {
+        if (e.used >= ARG_BYTES)
+            return;
+        size_t room = ARG_BYTES - e.used - 1;
+        size_t n = s ? strnlen(s, room) : 0;
+        if (n) memcpy(e.args + e.used, s, n);
+        e.args[e.used + n] = '\0';
+        e.used += (uint16_t)(n + 1);
+    }
+    static const char* get(const Entry& e, size_t& off)
+    {
+        if (off >= ARG_BYTES)
+            return "";
+        const char* s = reinterpret_cast<const char*>(e.args + off);
+        off += strnlen(s, ARG_BYTES - off) + 1;
+        return s;
+    }
+};
+
+template <typename... A>
+int renderEntry(const Entry& e, char* out, size_t len)
+{
+    size_t off = 0;
+    // braced init: arguments are unpacked strictly left to right
+    std::tuple<typename Arg<typename std::decay<A>::type>::type...> vals{
+        Arg<typename std::decay<A>::type>::get(e, off)...
+    };
+    (void)off;
+    return std::apply([&](auto... v) { return snprintf(out, len, e.fmt, v...); }, vals);
+}
+
+template <typename... A>
+void emit(Level level, const char* fmt, A... args)
+{
+    uint32_t ticket;
+    Entry* e = acquire(ticket);
+    if (e == nullptr)
+        return; // full: dropped and counted
+
+    e->render = &renderEntry<A...>;
+    e->fmt = fmt;
+    e->ts_ms = nowMs();
+    e->level = level;
+    e->used = 0;
+    (Arg<typename std::decay<A>::type>::put(*e, args), ...);
+
+    publish(ticket);
+}
+
+} // namespace PalLog
+
+
+#define PAL_LOG_EMIT(level, fmt, ...)                                   \
+    do {                                                                \
+        if (false) PalLog::checkFormat(fmt, ##__VA_ARGS__);             \
+        PalLog::emit(level, fmt, ##__VA_ARGS__);                        \
+    } while (0)
+
+#if PAL_LOG_LEVEL >= PAL_LOG_LEVEL_ERROR
+#define LOG_E(fmt, ...) PAL_LOG_EMIT(PalLog::Level::Error, fmt, ##__VA_ARGS__)
+#else
+#define LOG_E(fmt, ...) do {} while (0)
+#endif
+
+#if PAL_LOG_LEVEL >= PAL_LOG_LEVEL_WARN
+#define LOG_W(fmt, ...) PAL_LOG_EMIT(PalLog::Level::Warn, fmt, ##__VA_ARGS__)
+#else
+#define LOG_W(fmt, ...) do {} while (0)
+#endif
+
+#if PAL_LOG_LEVEL >= PAL_LOG_LEVEL_INFO
+#define LOG_I(fmt, ...) PAL_LOG_EMIT(PalLog::Level::Info, fmt, ##__VA_ARGS__)
+#else
+#define LOG_I(fmt, ...) do {} while (0)
+#endif
+
+#if PAL_LOG_LEVEL >= PAL_LOG_LEVEL_DEBUG
+#define LOG_D(fmt, ...) PAL_LOG_EMIT(PalLog::Level::Debug, fmt, ##__VA_ARGS__)
+#else
+#define LOG_D(fmt, ...) do {} while (0)
+#endif
+
+#endif // #ifndef PAL_LOG_H
@@ -0,0 +1,184 @@
+#include "PhaseAccounting.h"
+
+#include <cstring>
+#include <cstdio>
+
+#ifdef ARDUINO
+#include "esp_timer.h"
+#else
+#include <chrono>
+#endif
+
+// Rough ESP32-WROOM-32 figures (datasheet, 240 MHz, 3.3 V). Override with
+// setCurrentModel() once measured with a shunt on the real board.
+static const CurrentModel DEFAULT_MODEL =
+{{
+    45000,      // Active: CPU on, WiFi in modem-sleep
+    100000,     // Scan: BLE RX
+    45000,      // SerialFlush: CPU spinning on UART
+    2000,       // LightSleep: RTC + WiFi DTIM wakeups
+    120000,     // WiFiConnect
+    130000,     // Http: WiFi TX/RX + TLS
+    50000,      // BleBringUp: controller + Bluedroid enable
+    50000,      // Advertise: CPU idle, BLE TX every 20-40 ms
+}};
+
+static const char* const PHASE_NAMES[PhaseAccounting::PHASE_COUNT] =
+{
+    "active", "scan", "serial_flush", "light_sleep", "wifi_connect", "http", "ble_bringup", "advertise"
+};
+
+uint64_t PhaseAccounting::defaultClock()
+{
+#ifdef ARDUINO
+    return static_cast<uint64_t>(esp_timer_get_time());
+#else
+    using namespace std::chrono;
+    return static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+const char* PhaseAccounting::phaseName(Phase p)
+{
+    size_t i = static_cast<size_t>(p);
+    return (i < PHASE_COUNT) ? PHASE_NAMES[i] : "?";
+}
+
+PhaseAccounting::PhaseAccounting(PhaseClockFn clock)
+    : m_clock(clock ? clock : defaultClock),
+      m_model(DEFAULT_MODEL),
+      m_phase(Phase::Active),
+      m_since_us(0),
+      m_hour(0)
+{
+    std::memset(m_hours, 0, sizeof(m_hours));
+    std::memset(&m_lifetime, 0, sizeof(m_lifetime));
+    m_since_us = m_clock();
+    m_hour = static_cast<uint32_t>(m_since_us / US_PER_HOUR);
+    bucketFor(m_hour);
+}
+
+void PhaseAccounting::setCurrentModel(const CurrentModel& model)
+{
+    sync(); // charge already elapsed time at the old rates
+    m_model = model;
+}
+
+Phase PhaseAccounting::enter(Phase next)
+{
+    uint64_t now = m_clock();
+    credit(m_since_us, now);
+
+    Phase prev = m_phase;
+    m_phase = next;
+    m_since_us = now;
+    return prev;
+}
+
+void PhaseAccounting::sync()
+{
+    uint64_t now = m_clock();
+    credit(m_since_us, now);
+    m_since_us = now;
+}
+
+const PhaseAccounting::Totals* PhaseAccounting::hour(size_t hours_ago) const
+{
+    if (hours_ago >= HOURS || hours_ago > m_hour)
+        return nullptr;
+
+    uint32_t h = m_hour - static_cast<uint32_t>(hours_ago);
+    const Totals& t = m_hours[h % HOURS];
+    return (t.hour == h) ? &t : nullptr;
+}
+
+PhaseAccounting::Totals& PhaseAccounting::bucketFor(uint32_t hour)
+{
+    Totals& t = m_hours[hour % HOURS];
+    if (t.hour != hour)
+    {
+        // slot held an older hour — recycle it
+        std::memset(&t, 0, sizeof(t));
+        t.hour = hour;
+    }
+    return t;
+}
+
+// Credit [from_us, to_us) to the current phase, splitting at hour boundaries
+// so every bucket only holds time that really happened in that hour.
+void PhaseAccounting::credit(uint64_t from_us, uint64_t to_us)
+{
+    if (to_us <= from_us)
+        return;
+
+    const size_t idx = static_cast<size_t>(m_phase);
+    const uint64_t uA = m_model.uA[idx];
+
+    while (from_us < to_us)
+    {
+        uint32_t h = static_cast<uint32_t>(from_us / US_PER_HOUR);
+        uint64_t hour_end = (uint64_t)(h + 1) * US_PER_HOUR;
+        uint64_t end = (to_us < hour_end) ? to_us : hour_end;
+        uint64_t span = end - from_us;
+
+        Totals& t = bucketFor(h);
+        t.us[idx] += span;
+        t.charge_pC[idx] += span * uA;
+
+        m_lifetime.us[idx] += span;
+        m_lifetime.charge_pC[idx] += span * uA;
+
+        m_hour = h;
+        from_us = end;
+    }
+}
+
+size_t PhaseAccounting::format(const Totals& t, char* buf, size_t len)
+{
+    size_t used = 0;
+    uint64_t total_us = 0;
+    uint64_t total_pC = 0;
+
+    for (size_t i = 0; i < PHASE_COUNT; ++i)
+    {
+        total_us += t.us[i];
+        total_pC += t.charge_pC[i];
+    }
+
+    for (size_t i = 0; i < PHASE_COUNT; ++i)
+    {
+        if (t.us[i] == 0)
+            continue;   // phase not used by this firmware (or not entered this hour)
+
+        double pct = total_us ? (100.0 * (double)t.us[i] / (double)total_us) : 0.0;
+        int n = snprintf(buf + used, (used < len) ? len - used : 0,
+                         "%-12s %10llu ms %6.2f%% %9.4f mAh\n",
+                         PHASE_NAMES[i], (unsigned long long)(t.us[i] / 1000ULL),
+                         pct, toMilliampHours(t.charge_pC[i]));
+        if (n > 0) used += (size_t)n;
+    }
+
+    int n = snprintf(buf + used, (used < len) ? len - used : 0,
+                     "%-12s %10llu ms          %9.4f mAh\n", "total",
+                     (unsigned long long)(total_us / 1000ULL), toMilliampHours(total_pC));
+    if (n > 0) used += (size_t)n;
+
+    return used;
+}
+
+uint32_t PhaseAccounting::averageMicroamps(const Totals& t, uint32_t phase_mask)
+{
+    uint64_t us = 0;
+    uint64_t pC = 0;
+
+    for (size_t i = 0; i < PHASE_COUNT; ++i)
+    {
+        if (phase_mask & (1u << i))
+        {
+            us += t.us[i];
+            pC += t.charge_pC[i];
+        }
+    }
+
+    return us ? static_cast<uint32_t>(pC / us) : 0;
+}
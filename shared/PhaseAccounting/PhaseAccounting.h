@@ -0,0 +1,112 @@
+#ifndef PHASE_ACCOUNTING_H
+#define PHASE_ACCOUNTING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Duty-cycle phases the firmware spends its time in (shared by scanner and beacon;
+// each only enters its own, and format() skips phases with no time).
+// The accounting is single-owner: only the task driving loop() calls enter().
+enum class Phase : uint8_t
+{
+    Active = 0,     // CPU awake, no radio work (loop bookkeeping)
+    Scan,           // scanner: BLE scan window (g_manage_scan->start ... stop)
+    SerialFlush,    // blocked in Serial.flush() draining the UART
+    LightSleep,     // esp_light_sleep_start() until timer / GPIO wakeup
+    WiFiConnect,    // scanner: waiting for association / NTP sync
+    Http,           // scanner: token + TLS + HTTP request inside TriggerGate()
+    BleBringUp,     // beacon: BLE controller/stack enable until advertising started
+    Advertise,      // beacon: advertising, CPU idle between events
+    Count
+};
+
+// Estimated supply current per phase, in microamps.
+struct CurrentModel
+{
+    uint32_t uA[static_cast<size_t>(Phase::Count)];
+};
+
+// Monotonic microsecond clock. On the ESP32 this is esp_timer_get_time(),
+// on Linux a steady_clock; tests may inject a virtual clock.
+typedef uint64_t (*PhaseClockFn)();
+
+class PhaseAccounting
+{
+public:
+    static const size_t PHASE_COUNT = static_cast<size_t>(Phase::Count);
+    static const size_t HOURS = 24;                 // rolling history depth
+    static const uint64_t US_PER_HOUR = 3600ULL * 1000000ULL;
+
+    // Totals for one wall-clock hour of uptime (hour 0 = first hour after boot).
+    struct Totals
+    {
+        uint32_t hour;                      // uptime hour this bucket belongs to
+        uint64_t us[PHASE_COUNT];           // time spent in each phase
+        uint64_t charge_pC[PHASE_COUNT];    // estimated charge (uA * us = pC)
+    };
+
+    explicit PhaseAccounting(PhaseClockFn clock = defaultClock);
+
+    void setCurrentModel(const CurrentModel& model);
+    const CurrentModel& currentModel() const { return m_model; }
+
+    // Close the current phase at "now" and open `next`. Returns the previous phase.
+    Phase enter(Phase next);
+    Phase current() const { return m_phase; }
+
+    // Credit the still-open phase up to now without switching (for reporting).
+    void sync();
+
+    // Uptime hour of the last accounted instant.
+    uint32_t currentHour() const { return m_hour; }
+
+    // Totals for `hours_ago` hours back (0 = current hour). nullptr if not recorded.
+    const Totals* hour(size_t hours_ago) const;
+
+    // Totals since boot.
+    const Totals& lifetime() const { return m_lifetime; }
+
+    // Render one line per phase for the given bucket. Returns bytes written (snprintf semantics).
+    static size_t format(const Totals& t, char* buf, size_t len);
+
+    static uint64_t defaultClock();
+    static const char* phaseName(Phase p);
+    static double toMilliampHours(uint64_t pC) { return (double)pC / 3.6e12; }
+
+    // Average current (uA) over the phases whose bit is set in `phase_mask` (bit i = Phase i).
+    static uint32_t averageMicroamps(const Totals& t, uint32_t phase_mask);
+    static uint32_t phaseBit(Phase p) { return 1u << static_cast<uint32_t>(p); }
+
+private:
+    void credit(uint64_t from_us, uint64_t to_us);
+    Totals& bucketFor(uint32_t hour);
+
+    PhaseClockFn m_clock;
+    CurrentModel m_model;
+    Phase m_phase;
+    uint64_t m_since_us;
+    uint32_t m_hour;
+    Totals m_hours[HOURS];
+    Totals m_lifetime;
+};
+
+
+/**
+ * @brief RAII helper: enters a phase for the lifetime of the scope and
+ *        returns to the previous phase on exit.
+ */
+class PhaseScope
+{
+public:
+    PhaseScope(PhaseAccounting& acc, Phase p) : m_acc(acc), m_prev(acc.enter(p)) {}
+    ~PhaseScope() { m_acc.enter(m_prev); }
+
+private:
+    PhaseScope(const PhaseScope&);
+    PhaseScope& operator=(const PhaseScope&);
+
+    PhaseAccounting& m_acc;
+    Phase m_prev;
+};
+
+#endif // #ifndef PHASE_ACCOUNTING_H
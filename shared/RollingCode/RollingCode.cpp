@@ -0,0 +1,130 @@
+#include "RollingCode.h"
+
+#include <cstring>
+
+#include "Aes128.h"
+
+namespace RollingCode
+{
+
+void tag(const uint8_t key[16], uint32_t counter, uint8_t out[TAG_LEN])
+{
+    uint8_t block[16] = { 'P', 'G', 'R', 'C' };
+    block[4] = (uint8_t)(counter >> 24);
+    block[5] = (uint8_t)(counter >> 16);
+    block[6] = (uint8_t)(counter >> 8);
+    block[7] = (uint8_t)counter;
+
+    Aes128::encrypt(key, block, block);
+    memcpy(out, block, TAG_LEN);
+}
+
+void payload(const uint8_t key[16], const uint8_t prefix[PREFIX_LEN], uint32_t counter, uint8_t out[PAYLOAD_LEN])
+{
+    memcpy(out, prefix, PREFIX_LEN);
+    tag(key, counter, out + PREFIX_LEN);
+}
+
+bool parseHex(const char* text, uint8_t* out, size_t len)
+{
+    size_t n = 0;
+    for (const char* p = text; *p; ++p)
+    {
+        char ch = *p;
+        if (ch == '-')
+            continue;
+
+        uint8_t v;
+        if (ch >= '0' && ch <= '9') v = ch - '0';
+        else if (ch >= 'a' && ch <= 'f') v = ch - 'a' + 10;
+        else if (ch >= 'A' && ch <= 'F') v = ch - 'A' + 10;
+        else return false;
+
+        if (n >= 2 * len)
+            return false;
+        if (n % 2 == 0) out[n / 2] = v << 4;
+        else out[n / 2] |= v;
+        ++n;
+    }
+    return n == 2 * len;
+}
+
+} // namespace RollingCode
+
+
+size_t RollingWindow::slotOf(const uint8_t tag[RollingCode::TAG_LEN])
+{
+    // tag bytes are AES output, already uniformly distributed
+    uint32_t h = (uint32_t)tag[0] | ((uint32_t)tag[1] << 8) | ((uint32_t)tag[2] << 16) | ((uint32_t)tag[3] << 24);
+    return h & (SLOTS - 1);
+}
+
+void RollingWindow::reset(const uint8_t key[16], uint32_t last_accepted, uint16_t window)
+{
+    memcpy(m_key, key, sizeof(m_key));
+    m_window = (window > MAX_WINDOW) ? MAX_WINDOW : window;
+    m_last = last_accepted;
+    RollingCode::tag(m_key, m_last, m_last_tag);
+
+    for (uint16_t i = 1; i <= m_window; ++i)
+    {
+        uint32_t c = m_last + i;
+        Entry& e = m_entries[c % MAX_WINDOW];
+        e.counter = c;
+        RollingCode::tag(m_key, c, e.tag);
+    }
+    rebuildIndex();
+}
+
+void RollingWindow::advance(uint32_t accepted)
+{
+    uint32_t old_end = m_last + m_window;
+    uint32_t new_end = accepted + m_window;
+
+    // the accepted counter's tag, before a full-size window reuses its entry for the tail
+    if (accepted <= old_end)
+        memcpy(m_last_tag, m_entries[accepted % MAX_WINDOW].tag, sizeof(m_last_tag));
+    else
+        RollingCode::tag(m_key, accepted, m_last_tag);
+
+    // counters already in the window keep their tag; only the new tail costs an AES each
+    uint32_t first_new = (old_end > accepted) ? old_end + 1 : accepted + 1;
+    for (uint32_t c = first_new; c <= new_end; ++c)
+    {
+        Entry& e = m_entries[c % MAX_WINDOW];
+        e.counter = c;
+        RollingCode::tag(m_key, c, e.tag);
+    }
+
+    m_last = accepted;
+    rebuildIndex();
+}
+
+void RollingWindow::rebuildIndex()
+{
+    memset(m_index, 0, sizeof(m_index));
+
+    for (uint16_t i = 1; i <= m_window; ++i)
+    {
+        uint32_t c = m_last + i;
+        size_t entry = c % MAX_WINDOW;
+        size_t slot = slotOf(m_entries[entry].tag);
+        while (m_index[slot] != 0)
+            slot = (slot + 1) & (SLOTS - 1);
+        m_index[slot] = (uint8_t)(entry + 1);
+    }
+}
+
+bool RollingWindow::lookup(const uint8_t tag[RollingCode::TAG_LEN], uint32_t& counter) const
+{
+    for (size_t slot = slotOf(tag); m_index[slot] != 0; slot = (slot + 1) & (SLOTS - 1))
+    {
+        const Entry& e = m_entries[m_index[slot] - 1];
+        if (memcmp(e.tag, tag, RollingCode::TAG_LEN) == 0)
+        {
+            counter = e.counter;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,85 @@
+#ifndef ROLLING_CODE_H
+#define ROLLING_CODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Rolling iBeacon payload (optional; enabled by PALGATE_ROLLING_KEY_HEX in both config.h files).
+ *
+ *   UUID[0..9]                 fixed identity prefix (first 10 bytes of the configured UUID)
+ *   UUID[10..15] major minor   10-byte tag = AES-128_K("PGRC" | counter BE32 | 0...)[0..9]
+ *
+ * The beacon has no clock, so its time slot is a press counter (kept across reboots).
+ * The scanner accepts each counter at most once and only ahead of the last accepted one,
+ * so a recorded advertisement cannot be replayed after the real one was used.
+ */
+namespace RollingCode
+{
+    static const size_t PREFIX_LEN = 10;
+    static const size_t TAG_LEN = 10;
+    static const size_t PAYLOAD_LEN = 20;   // UUID + major + minor
+
+    // Truncated AES-128 PRF of the counter (single fixed-length block, so no CMAC chaining needed).
+    void tag(const uint8_t key[16], uint32_t counter, uint8_t out[TAG_LEN]);
+
+    // UUID | major | minor bytes, in over-the-air order, for `counter`.
+    void payload(const uint8_t key[16], const uint8_t prefix[PREFIX_LEN], uint32_t counter, uint8_t out[PAYLOAD_LEN]);
+
+    // Exactly 2*len hex digits ('-' separators ignored, for UUID strings) into `out`.
+    bool parseHex(const char* text, uint8_t* out, size_t len);
+}
+
+
+/**
+ * @brief Expected tags for the counters (last, last + window], indexed by an open-addressed
+ *        hash table. lookup() is one hash plus (usually) one probe and no AES; advance() runs
+ *        AES only for the counters that newly enter the window.
+ *
+ * Not thread-safe: the scanner keeps two instances and publishes one at a time.
+ */
+class RollingWindow
+{
+public:
+    static const uint16_t MAX_WINDOW = 64;
+
+    // Forget everything and compute the tags for (last_accepted, last_accepted + window].
+    void reset(const uint8_t key[16], uint32_t last_accepted, uint16_t window);
+
+    // Counter whose tag is `tag`, if it is inside the window.
+    bool lookup(const uint8_t tag[RollingCode::TAG_LEN], uint32_t& counter) const;
+
+    // True if `tag` is the last accepted counter's: a repeat advert of a press already acted on.
+    bool isLast(const uint8_t tag[RollingCode::TAG_LEN]) const
+    {
+        return memcmp(tag, m_last_tag, RollingCode::TAG_LEN) == 0;
+    }
+
+    // Slide the window to (accepted, accepted + window]. `accepted` must be ahead of last().
+    void advance(uint32_t accepted);
+
+    uint32_t last() const { return m_last; }
+    uint16_t window() const { return m_window; }
+
+private:
+    struct Entry
+    {
+        uint8_t tag[RollingCode::TAG_LEN];
+        uint32_t counter;
+    };
+
+    static const size_t SLOTS = 2 * MAX_WINDOW;   // power of two, load factor <= 0.5
+
+    static size_t slotOf(const uint8_t tag[RollingCode::TAG_LEN]);
+    void rebuildIndex();
+
+    uint8_t m_key[16];
+    uint32_t m_last = 0;
+    uint8_t m_last_tag[RollingCode::TAG_LEN];
+    uint16_t m_window = 0;
+    Entry m_entries[MAX_WINDOW];    // counter c lives at m_entries[c % MAX_WINDOW]
+    uint8_t m_index[SLOTS];         // 0 = empty, else entry index + 1
+};
+
+#endif // #ifndef ROLLING_CODE_H